@@ -0,0 +1,948 @@
+// Timings for the common operations, each next to a std::vector<std::vector<Entity>> doing the same thing, plus an
+// inventory-like trace of adds, removes and moves. Prints ns per operation and how many bytes each one needs.
+//   benchmark [--quick]
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+// 32 bit, so there's room for a few hundred thousand entities.
+#define ENTITYTAINER_Entity
+typedef unsigned int TheEntitytainerEntity;
+#define ENTITYTAINER_Entry
+typedef unsigned int TheEntitytainerEntry;
+#define ENTITYTAINER_IMPLEMENTATION
+#include "../../the_entitytainer.h"
+
+typedef TheEntitytainerEntity          Entity;
+typedef std::vector<std::vector<Entity>> VectorHierarchy;
+
+struct Settings {
+    int num_parents;
+    int num_children; // Per parent
+    int num_repeats;  // The best of these is reported
+    int num_trace_ops;
+};
+
+static unsigned int g_random_state = 1;
+static volatile unsigned long long g_sink; // So the reads aren't optimized away
+
+static unsigned int
+random_next() {
+    // xorshift32, the same sequence on every platform
+    g_random_state ^= g_random_state << 13;
+    g_random_state ^= g_random_state >> 17;
+    g_random_state ^= g_random_state << 5;
+    return g_random_state;
+}
+
+static int
+random_below( int count ) {
+    return (int)( random_next() % (unsigned int)count );
+}
+
+template <typename T>
+static void
+shuffle( std::vector<T>& values ) {
+    for ( int i = (int)values.size() - 1; i > 0; --i ) {
+        std::swap( values[i], values[random_below( i + 1 )] );
+    }
+}
+
+static double
+now_ns() {
+    using namespace std::chrono;
+    return (double)duration_cast<nanoseconds>( steady_clock::now().time_since_epoch() ).count();
+}
+
+static void
+report( const char* name, double ns, int num_ops, long long bytes ) {
+    printf( "%-44s %10.2f ns/op %12lld bytes\n", name, ns / num_ops, bytes );
+}
+
+// Parents are 1 to num_parents, and the children of parent p are the num_children entities after
+// num_parents + ( p - 1 ) * num_children.
+static Entity
+child_of( const Settings& settings, int parent, int i_child ) {
+    return (Entity)( settings.num_parents + ( parent - 1 ) * settings.num_children + i_child + 1 );
+}
+
+static int
+num_entities( const Settings& settings ) {
+    return settings.num_parents * ( settings.num_children + 1 ) + 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------
+// Setup
+
+struct Container {
+    TheEntitytainer* entitytainer;
+    void*            memory;
+    int              memory_size;
+};
+
+static struct TheEntitytainerConfig
+make_config( const Settings& settings, bool holes ) {
+    struct TheEntitytainerConfig config;
+    memset( &config, 0, sizeof( config ) );
+    config.num_entries       = num_entities( settings );
+    config.num_bucket_lists  = 4;
+    config.bucket_sizes[0]   = 4;
+    config.bucket_sizes[1]   = 8;
+    config.bucket_sizes[2]   = 16;
+    config.bucket_sizes[3]   = settings.num_children + 2;
+    config.remove_with_holes = holes;
+    for ( int i = 0; i < config.num_bucket_lists; ++i ) {
+        config.bucket_list_sizes[i] = settings.num_parents + 1;
+    }
+
+    config.memory_size = entitytainer_needed_size( &config );
+    return config;
+}
+
+static Container
+create_container( const Settings& settings, bool holes ) {
+    struct TheEntitytainerConfig config = make_config( settings, holes );
+    config.memory                       = malloc( config.memory_size );
+    Container container;
+    container.memory       = config.memory;
+    container.memory_size  = config.memory_size;
+    container.entitytainer = entitytainer_create( &config );
+    for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+        entitytainer_add_entity( container.entitytainer, (Entity)parent );
+    }
+
+    return container;
+}
+
+static void
+fill_container( const Settings& settings, Container& container ) {
+    for ( int i_child = 0; i_child < settings.num_children; ++i_child ) {
+        for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+            entitytainer_add_child( container.entitytainer, (Entity)parent, child_of( settings, parent, i_child ) );
+        }
+    }
+}
+
+struct Vectors {
+    VectorHierarchy     children;
+    std::vector<Entity> parents;
+};
+
+static Vectors
+create_vectors( const Settings& settings ) {
+    Vectors vectors;
+    vectors.children.resize( settings.num_parents + 1 );
+    vectors.parents.resize( num_entities( settings ), 0 );
+    return vectors;
+}
+
+static void
+fill_vectors( const Settings& settings, Vectors& vectors ) {
+    for ( int i_child = 0; i_child < settings.num_children; ++i_child ) {
+        for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+            Entity child = child_of( settings, parent, i_child );
+            vectors.children[parent].push_back( child );
+            vectors.parents[child] = (Entity)parent;
+        }
+    }
+}
+
+static long long
+vectors_bytes( const Vectors& vectors ) {
+    long long bytes = (long long)( vectors.children.capacity() * sizeof( std::vector<Entity> ) );
+    bytes += (long long)( vectors.parents.capacity() * sizeof( Entity ) );
+    for ( size_t i = 0; i < vectors.children.size(); ++i ) {
+        bytes += (long long)( vectors.children[i].capacity() * sizeof( Entity ) );
+    }
+
+    return bytes;
+}
+
+static std::vector<std::pair<int, Entity> >
+shuffled_children( const Settings& settings ) {
+    std::vector<std::pair<int, Entity> > pairs;
+    for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+        for ( int i_child = 0; i_child < settings.num_children; ++i_child ) {
+            pairs.push_back( std::make_pair( parent, child_of( settings, parent, i_child ) ) );
+        }
+    }
+
+    shuffle( pairs );
+    return pairs;
+}
+
+// -----------------------------------------------------------------------------------------------------------------
+// Benchmarks. Each runs num_repeats times on fresh data and reports the fastest.
+
+static void
+bench_add_child( const Settings& settings ) {
+    // Round robin over the parents, so each one is promoted through all the bucket lists.
+    int       num_ops = settings.num_parents * settings.num_children;
+    double    best    = 1e300;
+    long long bytes   = 0;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        Container container = create_container( settings, false );
+        double    start     = now_ns();
+        fill_container( settings, container );
+        best  = std::min( best, now_ns() - start );
+        bytes = container.memory_size;
+        free( container.memory );
+    }
+
+    report( "add_child (with promotions)", best, num_ops, bytes );
+
+    best = 1e300;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        Vectors vectors = create_vectors( settings );
+        double  start   = now_ns();
+        fill_vectors( settings, vectors );
+        best  = std::min( best, now_ns() - start );
+        bytes = vectors_bytes( vectors );
+    }
+
+    report( "  vector push_back", best, num_ops, bytes );
+}
+
+static void
+bench_remove_child( const Settings& settings ) {
+    std::vector<std::pair<int, Entity> > pairs   = shuffled_children( settings );
+    int                                  num_ops = (int)pairs.size();
+    for ( int holes = 0; holes < 2; ++holes ) {
+        double best = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            Container container = create_container( settings, holes != 0 );
+            fill_container( settings, container );
+            double start = now_ns();
+            for ( size_t i = 0; i < pairs.size(); ++i ) {
+                if ( holes ) {
+                    entitytainer_remove_child_with_holes( container.entitytainer, (Entity)pairs[i].first, pairs[i].second );
+                }
+                else {
+                    entitytainer_remove_child_no_holes( container.entitytainer, (Entity)pairs[i].first, pairs[i].second );
+                }
+            }
+
+            best = std::min( best, now_ns() - start );
+            free( container.memory );
+        }
+
+        report( holes ? "remove_child_with_holes (random order)" : "remove_child_no_holes (random order)",
+                best,
+                num_ops,
+                make_config( settings, holes != 0 ).memory_size );
+
+        best            = 1e300;
+        long long bytes = 0;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            Vectors vectors = create_vectors( settings );
+            fill_vectors( settings, vectors );
+            double start = now_ns();
+            for ( size_t i = 0; i < pairs.size(); ++i ) {
+                std::vector<Entity>&          children = vectors.children[pairs[i].first];
+                std::vector<Entity>::iterator found    = std::find( children.begin(), children.end(), pairs[i].second );
+                if ( holes ) {
+                    *found = 0;
+                }
+                else {
+                    children.erase( found );
+                }
+
+                vectors.parents[pairs[i].second] = 0;
+            }
+
+            best  = std::min( best, now_ns() - start );
+            bytes = vectors_bytes( vectors );
+        }
+
+        report( holes ? "  vector find + clear" : "  vector find + erase", best, num_ops, bytes );
+    }
+}
+
+static void
+bench_get_children( const Settings& settings ) {
+    std::vector<Entity> parents;
+    for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+        parents.push_back( (Entity)parent );
+    }
+
+    Container container = create_container( settings, false );
+    fill_container( settings, container );
+    Vectors vectors = create_vectors( settings );
+    fill_vectors( settings, vectors );
+
+    // Enough passes that the smaller runs aren't just timer noise
+    int num_passes = std::max( 1, 1000000 / ( settings.num_parents * settings.num_children ) );
+    int num_ops    = settings.num_parents * num_passes;
+    for ( int random = 0; random < 2; ++random ) {
+        if ( random ) {
+            shuffle( parents );
+        }
+
+        double best = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            unsigned long long sum   = 0;
+            double             start = now_ns();
+            for ( int i_pass = 0; i_pass < num_passes; ++i_pass ) {
+                for ( size_t i = 0; i < parents.size(); ++i ) {
+                    TheEntitytainerEntity* children;
+                    int                    num_children;
+                    int                    capacity;
+                    entitytainer_get_children( container.entitytainer, parents[i], &children, &num_children, &capacity );
+                    for ( int i_child = 0; i_child < num_children; ++i_child ) {
+                        sum += children[i_child];
+                    }
+                }
+            }
+
+            best = std::min( best, now_ns() - start );
+            g_sink += sum;
+        }
+
+        report( random ? "get_children + sum (random parents)" : "get_children + sum (sequential parents)",
+                best,
+                num_ops,
+                container.memory_size );
+
+        best = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            unsigned long long sum   = 0;
+            double             start = now_ns();
+            for ( int i_pass = 0; i_pass < num_passes; ++i_pass ) {
+                for ( size_t i = 0; i < parents.size(); ++i ) {
+                    const std::vector<Entity>& children = vectors.children[parents[i]];
+                    for ( size_t i_child = 0; i_child < children.size(); ++i_child ) {
+                        sum += children[i_child];
+                    }
+                }
+            }
+
+            best = std::min( best, now_ns() - start );
+            g_sink += sum;
+        }
+
+        report( "  vector", best, num_ops, vectors_bytes( vectors ) );
+    }
+
+    free( container.memory );
+}
+
+static void
+bench_payloads( const Settings& settings ) {
+    // A value per child, like a stack count. Next to the children in a payload column, or in a hash map on the side
+    // that's looked up for each child.
+    std::vector<Entity> parents;
+    for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+        parents.push_back( (Entity)parent );
+    }
+
+    shuffle( parents );
+    struct TheEntitytainerConfig config = make_config( settings, false );
+    config.payload_sizes[0]             = (int)sizeof( int );
+    config.num_payload_columns          = 1;
+    config.memory_size                  = entitytainer_needed_size( &config );
+    config.memory                       = malloc( config.memory_size );
+    TheEntitytainer*                entitytainer = entitytainer_create( &config );
+    std::unordered_map<Entity, int> counts;
+    for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+        entitytainer_add_entity( entitytainer, (Entity)parent );
+    }
+
+    for ( int i_child = 0; i_child < settings.num_children; ++i_child ) {
+        for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+            Entity child = child_of( settings, parent, i_child );
+            entitytainer_add_child( entitytainer, (Entity)parent, child );
+            *(int*)entitytainer_get_payload( entitytainer, child, 0 ) = (int)child & 63;
+            counts[child]                                             = (int)child & 63;
+        }
+    }
+
+    int num_passes = std::max( 1, 1000000 / ( settings.num_parents * settings.num_children ) );
+    int num_ops    = settings.num_parents * num_passes;
+    for ( int hashed = 0; hashed < 2; ++hashed ) {
+        double best = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            unsigned long long sum   = 0;
+            double             start = now_ns();
+            for ( int i_pass = 0; i_pass < num_passes; ++i_pass ) {
+                for ( size_t i = 0; i < parents.size(); ++i ) {
+                    TheEntitytainerChildSpan span;
+                    entitytainer_get_child_span( entitytainer, parents[i], &span );
+                    const int* values = (const int*)span.payloads[0];
+                    for ( int i_child = 0; i_child < span.num_children; ++i_child ) {
+                        sum += hashed ? counts.find( span.children[i_child] )->second : values[i_child];
+                    }
+                }
+            }
+
+            best = std::min( best, now_ns() - start );
+            g_sink += sum;
+        }
+
+        report( hashed ? "  hash map per child" : "children + payload column (random parents)",
+                best,
+                num_ops,
+                config.memory_size );
+    }
+
+    free( config.memory );
+}
+
+static void*
+bench_alloc_page( void*, int size ) {
+    return malloc( size );
+}
+
+static void
+bench_free_page( void*, void* page ) {
+    free( page );
+}
+
+static void
+grow_full_lists( TheEntitytainer*& entitytainer, void*& memory, int& memory_size ) {
+    // Only the lists that are full, the way it'd be done without paging
+    for ( int i = 0; i < entitytainer->num_bucket_lists; ++i ) {
+        TheEntitytainerBucketList* list = entitytainer->bucket_lists + i;
+        if ( list->used_buckets == list->total_buckets ) {
+            memory_size  = entitytainer_realloc_bucket_list_needed_size( entitytainer, i, 2.0f );
+            void* grown  = malloc( memory_size );
+            entitytainer = entitytainer_realloc_bucket_list( entitytainer, grown, memory_size, i, 2.0f );
+            free( memory );
+            memory = grown;
+        }
+    }
+}
+
+static void
+bench_growth( const Settings& settings ) {
+    // Starting small and growing: a realloc of the whole block whenever a bucket list is full, or pages added to
+    // the lists that need them. The worst single add_child is where the realloc stalls (best of the repeats, so it's
+    // not just the OS getting in the way).
+    for ( int paged = 0; paged < 2; ++paged ) {
+        double    best  = 1e300;
+        double    worst = 1e300;
+        long long bytes = 0;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            struct TheEntitytainerConfig config = make_config( settings, false );
+            for ( int i = 0; i < config.num_bucket_lists; ++i ) {
+                config.bucket_list_sizes[i] = 64;
+            }
+
+            if ( paged ) {
+                config.bucket_page_size = 64;
+                config.max_bucket_pages = settings.num_parents / 64 + 2;
+                config.alloc_page       = bench_alloc_page;
+                config.free_page        = bench_free_page;
+            }
+
+            config.memory_size            = entitytainer_needed_size( &config );
+            config.memory                 = malloc( config.memory_size );
+            void*            memory       = config.memory;
+            int              memory_size  = config.memory_size;
+            TheEntitytainer* entitytainer = entitytainer_create( &config );
+            for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+                if ( !paged ) {
+                    grow_full_lists( entitytainer, memory, memory_size );
+                }
+
+                entitytainer_add_entity( entitytainer, (Entity)parent );
+            }
+
+            double start        = now_ns();
+            double repeat_worst = 0;
+            for ( int i_child = 0; i_child < settings.num_children; ++i_child ) {
+                for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+                    double op_start = now_ns();
+                    if ( !paged ) {
+                        grow_full_lists( entitytainer, memory, memory_size );
+                    }
+
+                    entitytainer_add_child( entitytainer, (Entity)parent, child_of( settings, parent, i_child ) );
+                    repeat_worst = std::max( repeat_worst, now_ns() - op_start );
+                }
+            }
+
+            best  = std::min( best, now_ns() - start );
+            worst = std::min( worst, repeat_worst );
+            bytes = memory_size;
+            if ( paged ) {
+                for ( int i = 0; i < entitytainer->num_bucket_lists; ++i ) {
+                    TheEntitytainerBucketList* list      = entitytainer->bucket_lists + i;
+                    int                        num_added = list->num_pages - 64 / config.bucket_page_size;
+                    bytes += (long long)num_added * config.bucket_page_size * list->bucket_size * sizeof( Entity );
+                }
+
+                entitytainer_free_pages( entitytainer );
+            }
+
+            free( memory );
+        }
+
+        int num_ops = settings.num_parents * settings.num_children;
+        report( paged ? "  paged bucket lists" : "add_child from small lists (realloc)", best, num_ops, bytes );
+        report( paged ? "    worst add_child" : "  worst add_child", worst, 1, bytes );
+    }
+}
+
+static void
+bench_remove_holes( const Settings& settings ) {
+    // Every other child removed, then compacted per parent.
+    int    num_ops = settings.num_parents;
+    double best    = 1e300;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        Container container = create_container( settings, true );
+        fill_container( settings, container );
+        for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+            for ( int i_child = 0; i_child < settings.num_children; i_child += 2 ) {
+                entitytainer_remove_child_with_holes(
+                  container.entitytainer, (Entity)parent, child_of( settings, parent, i_child ) );
+            }
+        }
+
+        double start = now_ns();
+        for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+            entitytainer_remove_holes( container.entitytainer, (Entity)parent );
+        }
+
+        best = std::min( best, now_ns() - start );
+        free( container.memory );
+    }
+
+    report( "remove_holes (per parent, half are holes)", best, num_ops, make_config( settings, true ).memory_size );
+
+    best            = 1e300;
+    long long bytes = 0;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        Vectors vectors = create_vectors( settings );
+        fill_vectors( settings, vectors );
+        for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+            for ( int i_child = 0; i_child < settings.num_children; i_child += 2 ) {
+                vectors.children[parent][i_child] = 0;
+            }
+        }
+
+        double start = now_ns();
+        for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+            std::vector<Entity>& children = vectors.children[parent];
+            children.erase( std::remove( children.begin(), children.end(), (Entity)0 ), children.end() );
+        }
+
+        best  = std::min( best, now_ns() - start );
+        bytes = vectors_bytes( vectors );
+    }
+
+    report( "  vector erase(remove)", best, num_ops, bytes );
+}
+
+static void
+bench_hole_churn( const Settings& settings ) {
+    // With holes, a random child goes and comes back into the hole it left, then all children are walked with the
+    // iterator. Without and with track_occupancy. Parents keep their buckets, so it's only the hole handling.
+    std::vector<std::pair<int, Entity> > pairs   = shuffled_children( settings );
+    int                                  num_ops = (int)pairs.size();
+    for ( int occupancy = 0; occupancy < 2; ++occupancy ) {
+        struct TheEntitytainerConfig config = make_config( settings, true );
+        config.keep_capacity_on_remove      = true;
+        config.track_occupancy              = occupancy != 0;
+        config.memory_size                  = entitytainer_needed_size( &config );
+        double best                         = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            config.memory = malloc( config.memory_size );
+            Container container;
+            container.memory       = config.memory;
+            container.memory_size  = config.memory_size;
+            container.entitytainer = entitytainer_create( &config );
+            for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+                entitytainer_add_entity( container.entitytainer, (Entity)parent );
+            }
+
+            fill_container( settings, container );
+            unsigned long long sum   = 0;
+            double             start = now_ns();
+            for ( size_t i = 0; i < pairs.size(); ++i ) {
+                Entity parent = (Entity)pairs[i].first;
+                entitytainer_remove_child_with_holes( container.entitytainer, parent, pairs[i].second );
+                entitytainer_add_child( container.entitytainer, parent, pairs[i].second );
+            }
+
+            for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+                TheEntitytainerChildIter iter;
+                TheEntitytainerEntity    child;
+                int                      index;
+                entitytainer_children_iter( container.entitytainer, (Entity)parent, &iter );
+                while ( entitytainer_children_next( container.entitytainer, &iter, &child, &index ) ) {
+                    sum += child + (unsigned long long)index;
+                }
+            }
+
+            best = std::min( best, now_ns() - start );
+            g_sink += sum;
+            free( container.memory );
+        }
+
+        report( occupancy ? "hole churn + iterate (track_occupancy)" : "hole churn + iterate",
+                best,
+                num_ops,
+                config.memory_size );
+    }
+}
+
+static void
+bench_bucket_layout( const Settings& settings ) {
+    // Bucket sizes that aren't powers of two (5, 10, 20), packed back to back, then with align_buckets padding them
+    // and putting each list on a cache line, then also with track_num_children. The memory is cache line aligned.
+    std::vector<Entity> parents;
+    for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+        parents.push_back( (Entity)parent );
+    }
+
+    shuffle( parents );
+    int num_passes = std::max( 1, 1000000 / ( settings.num_parents * settings.num_children ) );
+    int num_ops    = settings.num_parents * num_passes;
+    for ( int layout = 0; layout < 3; ++layout ) {
+        struct TheEntitytainerConfig config = make_config( settings, false );
+        config.bucket_sizes[0]              = 5;
+        config.bucket_sizes[1]              = 10;
+        config.bucket_sizes[2]              = 20;
+        config.align_buckets                = layout >= 1;
+        config.track_num_children           = layout >= 2;
+        config.memory_size                  = entitytainer_needed_size( &config );
+        unsigned char* memory               = (unsigned char*)malloc( config.memory_size + ENTITYTAINER_CacheLineSize );
+        size_t         misalignment         = (size_t)memory % ENTITYTAINER_CacheLineSize;
+        config.memory = memory + ( ENTITYTAINER_CacheLineSize - misalignment ) % ENTITYTAINER_CacheLineSize;
+
+        double best_add = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            Container container;
+            container.entitytainer = entitytainer_create( &config );
+            for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+                entitytainer_add_entity( container.entitytainer, (Entity)parent );
+            }
+
+            double start = now_ns();
+            fill_container( settings, container );
+            best_add = std::min( best_add, now_ns() - start );
+        }
+
+        // The last repeat's container is still there
+        TheEntitytainer* entitytainer = (TheEntitytainer*)config.memory;
+        double           best_sum     = 1e300;
+        double           best_count   = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            unsigned long long sum   = 0;
+            double             start = now_ns();
+            for ( int i_pass = 0; i_pass < num_passes; ++i_pass ) {
+                for ( size_t i = 0; i < parents.size(); ++i ) {
+                    TheEntitytainerEntity* children;
+                    int                    num_children;
+                    int                    capacity;
+                    entitytainer_get_children( entitytainer, parents[i], &children, &num_children, &capacity );
+                    for ( int i_child = 0; i_child < num_children; ++i_child ) {
+                        sum += children[i_child];
+                    }
+                }
+            }
+
+            best_sum = std::min( best_sum, now_ns() - start );
+            start    = now_ns();
+            for ( int i_pass = 0; i_pass < num_passes; ++i_pass ) {
+                for ( size_t i = 0; i < parents.size(); ++i ) {
+                    sum += entitytainer_num_children( entitytainer, parents[i] );
+                }
+            }
+
+            best_count = std::min( best_count, now_ns() - start );
+            g_sink += sum;
+        }
+
+        const char* names[3] = { "add_child, packed 5/10/20 buckets",
+                                 "add_child, align_buckets",
+                                 "add_child, align_buckets + track_num_children" };
+        report( names[layout], best_add, settings.num_parents * settings.num_children, config.memory_size );
+        report( "  get_children + sum (random parents)", best_sum, num_ops, config.memory_size );
+        report( "  num_children (random parents)", best_count, num_ops, config.memory_size );
+        free( memory );
+    }
+}
+
+static void
+bench_save_load( const Settings& settings ) {
+    // One op is the whole container.
+    Container container = create_container( settings, false );
+    fill_container( settings, container );
+    Container copy = create_container( settings, false );
+
+    int            save_size = entitytainer_save( container.entitytainer, NULL, 0 );
+    unsigned char* buffer    = (unsigned char*)malloc( save_size );
+    double         best_save = 1e300;
+    double         best_load = 1e300;
+    double         best_into = 1e300;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        double start = now_ns();
+        entitytainer_save( container.entitytainer, buffer, save_size );
+        best_save = std::min( best_save, now_ns() - start );
+
+        start                  = now_ns();
+        TheEntitytainer* loaded = entitytainer_load( buffer, save_size );
+        best_load              = std::min( best_load, now_ns() - start );
+        g_sink += (unsigned long long)entitytainer_num_children( loaded, 1 );
+
+        start = now_ns();
+        entitytainer_load_into( copy.entitytainer, container.entitytainer );
+        best_into = std::min( best_into, now_ns() - start );
+    }
+
+    report( "save", best_save, 1, save_size );
+    report( "load (in place)", best_load, 1, save_size );
+    report( "load_into", best_into, 1, copy.memory_size );
+
+    int            compact_size   = entitytainer_save_compact( container.entitytainer, NULL, 0 );
+    unsigned char* compact_buffer = (unsigned char*)malloc( compact_size );
+    double         best_compact   = 1e300;
+    double         best_uncompact = 1e300;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        double start = now_ns();
+        entitytainer_save_compact( container.entitytainer, compact_buffer, compact_size );
+        best_compact = std::min( best_compact, now_ns() - start );
+
+        struct TheEntitytainerConfig config = make_config( settings, false );
+        config.memory                       = copy.memory;
+        config.memory_size                  = copy.memory_size;
+        start                               = now_ns();
+        TheEntitytainer* loaded = entitytainer_load_compact( compact_buffer, compact_size, &config );
+        best_uncompact          = std::min( best_uncompact, now_ns() - start );
+        g_sink += (unsigned long long)entitytainer_num_children( loaded, 1 );
+    }
+
+    report( "save_compact", best_compact, 1, compact_size );
+    report( "load_compact", best_uncompact, 1, compact_size );
+
+    // The vectors have to be flattened to be saved at all: parent count, then a count and the children per parent.
+    Vectors vectors = create_vectors( settings );
+    fill_vectors( settings, vectors );
+    std::vector<Entity> flat;
+    best_save = 1e300;
+    best_load = 1e300;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        flat.clear();
+        double start = now_ns();
+        flat.push_back( (Entity)vectors.children.size() );
+        for ( size_t i = 0; i < vectors.children.size(); ++i ) {
+            flat.push_back( (Entity)vectors.children[i].size() );
+            flat.insert( flat.end(), vectors.children[i].begin(), vectors.children[i].end() );
+        }
+
+        best_save = std::min( best_save, now_ns() - start );
+
+        Vectors loaded;
+        start         = now_ns();
+        size_t cursor = 0;
+        loaded.children.resize( flat[cursor++] );
+        loaded.parents.resize( vectors.parents.size(), 0 );
+        for ( size_t i = 0; i < loaded.children.size(); ++i ) {
+            size_t count = flat[cursor++];
+            loaded.children[i].assign( flat.begin() + cursor, flat.begin() + cursor + count );
+            for ( size_t i_child = 0; i_child < count; ++i_child ) {
+                loaded.parents[flat[cursor + i_child]] = (Entity)i;
+            }
+
+            cursor += count;
+        }
+
+        best_load = std::min( best_load, now_ns() - start );
+        g_sink += loaded.children[1].size();
+    }
+
+    report( "  vector flatten", best_save, 1, (long long)( flat.size() * sizeof( Entity ) ) );
+    report( "  vector unflatten", best_load, 1, vectors_bytes( vectors ) );
+
+    free( compact_buffer );
+    free( buffer );
+    free( copy.memory );
+    free( container.memory );
+}
+
+// -----------------------------------------------------------------------------------------------------------------
+// Inventory churn: num_parents inventories, items picked up (added), dropped (removed) and moved between
+// inventories at random, with most inventories small and a few big ones.
+
+struct TraceOp {
+    int    type; // 0 add, 1 remove, 2 move
+    Entity item;
+    int    from;
+    int    to;
+};
+
+static void
+make_trace( const Settings& settings, std::vector<TraceOp>& ops, int* max_items ) {
+    int capacity = settings.num_children + 2;
+    std::vector<int>    counts( settings.num_parents + 1, 0 );
+    std::vector<int>    owner_of;   // By item
+    std::vector<Entity> live_items; // Items in an inventory
+    std::vector<int>    live_index; // By item, where it is in live_items
+    Entity              next_item = (Entity)settings.num_parents + 1;
+    owner_of.resize( next_item, 0 );
+    live_index.resize( next_item, -1 );
+    for ( int i_op = 0; i_op < settings.num_trace_ops; ++i_op ) {
+        // Some inventories are far more popular than others
+        int     to  = 1 + ( random_below( 8 ) == 0 ? random_below( settings.num_parents )
+                                                   : random_below( std::max( 1, settings.num_parents / 16 ) ) );
+        int     roll = random_below( 100 );
+        TraceOp op;
+        if ( roll < 45 || live_items.empty() ) {
+            if ( counts[to] >= capacity - 1 ) {
+                continue;
+            }
+
+            op.type = 0;
+            op.item = next_item++;
+            op.from = 0;
+            op.to   = to;
+            owner_of.push_back( to );
+            live_index.push_back( (int)live_items.size() );
+            live_items.push_back( op.item );
+            ++counts[to];
+        }
+        else {
+            op.item = live_items[random_below( (int)live_items.size() )];
+            op.from = owner_of[op.item];
+            op.to   = to;
+            op.type = roll < 85 ? 1 : 2;
+            if ( op.type == 2 && ( to == op.from || counts[to] >= capacity - 1 ) ) {
+                continue;
+            }
+
+            --counts[op.from];
+            if ( op.type == 1 ) {
+                int    index        = live_index[op.item];
+                Entity last         = live_items.back();
+                live_items[index]   = last;
+                live_index[last]    = index;
+                live_items.pop_back();
+                live_index[op.item] = -1;
+                owner_of[op.item]   = 0;
+            }
+            else {
+                owner_of[op.item] = to;
+                ++counts[to];
+            }
+        }
+
+        ops.push_back( op );
+    }
+
+    *max_items = (int)next_item;
+}
+
+static void
+bench_inventory_trace( const Settings& settings ) {
+    std::vector<TraceOp> ops;
+    int                  max_items;
+    make_trace( settings, ops, &max_items );
+    int num_ops = (int)ops.size();
+
+    struct TheEntitytainerConfig config = make_config( settings, false );
+    config.num_entries                  = max_items;
+    config.memory_size                  = entitytainer_needed_size( &config );
+    double best                         = 1e300;
+    for ( int reparent = 0; reparent < 2; ++reparent ) {
+        best = 1e300;
+        for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+            config.memory                 = malloc( config.memory_size );
+            TheEntitytainer* entitytainer = entitytainer_create( &config );
+            for ( int parent = 1; parent <= settings.num_parents; ++parent ) {
+                entitytainer_add_entity( entitytainer, (Entity)parent );
+            }
+
+            double start = now_ns();
+            for ( int i = 0; i < num_ops; ++i ) {
+                const TraceOp& op = ops[i];
+                if ( op.type == 2 && reparent ) {
+                    entitytainer_reparent( entitytainer, op.item, (Entity)op.to );
+                    continue;
+                }
+
+                if ( op.type != 0 ) {
+                    entitytainer_remove_child_no_holes( entitytainer, (Entity)op.from, op.item );
+                }
+
+                if ( op.type != 1 ) {
+                    entitytainer_add_child( entitytainer, (Entity)op.to, op.item );
+                }
+            }
+
+            best = std::min( best, now_ns() - start );
+            free( config.memory );
+        }
+
+        report( reparent ? "inventory churn (moves with reparent)" : "inventory churn (add/remove/move)",
+                best,
+                num_ops,
+                config.memory_size );
+    }
+
+    best            = 1e300;
+    long long bytes = 0;
+    for ( int i_repeat = 0; i_repeat < settings.num_repeats; ++i_repeat ) {
+        Vectors vectors;
+        vectors.children.resize( settings.num_parents + 1 );
+        vectors.parents.resize( max_items, 0 );
+        double start = now_ns();
+        for ( int i = 0; i < num_ops; ++i ) {
+            const TraceOp& op = ops[i];
+            if ( op.type != 0 ) {
+                std::vector<Entity>& children = vectors.children[op.from];
+                children.erase( std::find( children.begin(), children.end(), op.item ) );
+                vectors.parents[op.item] = 0;
+            }
+
+            if ( op.type != 1 ) {
+                vectors.children[op.to].push_back( op.item );
+                vectors.parents[op.item] = (Entity)op.to;
+            }
+        }
+
+        best  = std::min( best, now_ns() - start );
+        bytes = vectors_bytes( vectors );
+    }
+
+    report( "  vector", best, num_ops, bytes );
+}
+
+int
+main( int argc, char** argv ) {
+    Settings settings;
+    settings.num_parents   = 4096;
+    settings.num_children  = 30;
+    settings.num_repeats   = 5;
+    settings.num_trace_ops = 1000000;
+    for ( int i = 1; i < argc; ++i ) {
+        if ( strcmp( argv[i], "--quick" ) == 0 ) {
+            // Just checks that everything runs, for ctest.
+            settings.num_parents   = 256;
+            settings.num_repeats   = 1;
+            settings.num_trace_ops = 20000;
+        }
+    }
+
+    printf( "%d parents, %d children each, %d bit entities\n\n",
+            settings.num_parents,
+            settings.num_children,
+            (int)sizeof( Entity ) * 8 );
+
+    bench_add_child( settings );
+    bench_remove_child( settings );
+    bench_get_children( settings );
+    bench_payloads( settings );
+    bench_growth( settings );
+    bench_remove_holes( settings );
+    bench_hole_churn( settings );
+    bench_bucket_layout( settings );
+    bench_save_load( settings );
+    bench_inventory_trace( settings );
+    return 0;
+}
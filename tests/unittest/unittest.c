@@ -27,11 +27,13 @@ main( int argc, char** argv ) {
     memset( &g_testdata, 0, sizeof( g_testdata ) );
     UnitTestData* testdata = &g_testdata;
 
-    // unittest_run_entity32( testdata );
+    unittest_run_entity32( testdata );
     unittest_run_default( testdata );
 
+#if defined( _WIN32 )
     // A bit of a hack.
     system( "pause" );
+#endif
 
-    return 0;
+    return g_testdata.error_index == 0 ? 0 : 1;
 }
@@ -147,7 +147,7 @@ do_multi_parent_tests( TheEntitytainer* entitytainer ) {
 
     for ( TheEntitytainerEntity i_child = 0; i_child < 15; ++i_child ) {
         ASSERT( entitytainer_get_parent( entitytainer, 41 + i_child ) == 40 );
-        ASSERT( entitytainer_get_child_index( entitytainer, 40, 41 + i_child ) == i_child );
+        ASSERT( entitytainer_get_child_index( entitytainer, 40, 41 + i_child ) == (int)i_child );
     }
 
     for ( TheEntitytainerEntity i_child = 0; i_child < 8; ++i_child ) {
@@ -366,6 +366,81 @@ do_multi_entity_tests( TheEntitytainer* entitytainer ) {
     ASSERT( children[6] == 0 );
 }
 
+static void
+do_batch_tests( TheEntitytainer* entitytainer ) {
+    entitytainer_add_entity( entitytainer, 10 );
+
+    TheEntitytainerEntity batch[12];
+    for ( TheEntitytainerEntity i_child = 0; i_child < 12; ++i_child ) {
+        batch[i_child] = 20 + i_child;
+    }
+
+    int                    num_children;
+    int                    capacity;
+    TheEntitytainerEntity* children;
+    entitytainer_add_children( entitytainer, 10, batch, 2 );
+    entitytainer_get_children( entitytainer, 10, &children, &num_children, &capacity );
+    ASSERT( num_children == 2 );
+    ASSERT( capacity == 3 );
+
+    // Should skip the 8 bucket and go straight to the 16 one.
+    entitytainer_add_children( entitytainer, 10, batch + 2, 10 );
+    entitytainer_get_children( entitytainer, 10, &children, &num_children, &capacity );
+    ASSERT( num_children == 12 );
+    ASSERT( capacity == 15 );
+    ASSERT( entitytainer->bucket_lists[1].used_buckets == 0 );
+    ASSERT( entitytainer->bucket_lists[2].used_buckets == 1 );
+    for ( TheEntitytainerEntity i_child = 0; i_child < 12; ++i_child ) {
+        ASSERT( children[i_child] == 20 + i_child );
+        ASSERT( entitytainer_get_parent( entitytainer, 20 + i_child ) == 10 );
+    }
+
+    TheEntitytainerEntity to_remove[] = { 20, 22, 23, 24, 26, 27, 28, 29, 31 };
+    entitytainer_remove_children( entitytainer, 10, to_remove, 9 );
+    entitytainer_get_children( entitytainer, 10, &children, &num_children, &capacity );
+    ASSERT( num_children == 3 );
+    ASSERT( entitytainer_get_parent( entitytainer, 20 ) == 0 );
+    ASSERT( entitytainer_get_parent( entitytainer, 21 ) == 10 );
+
+    if ( entitytainer->remove_with_holes ) {
+        // Holes are kept, so the last child decides the bucket size.
+        ASSERT( capacity == 15 );
+        ASSERT( children[0] == ENTITYTAINER_InvalidEntity );
+        ASSERT( children[1] == 21 );
+        ASSERT( children[10] == 30 );
+
+        entitytainer_add_children( entitytainer, 10, to_remove, 2 );
+        entitytainer_get_children( entitytainer, 10, &children, &num_children, &capacity );
+        ASSERT( num_children == 5 );
+        ASSERT( children[0] == 20 );
+        ASSERT( children[2] == 22 );
+        ASSERT( children[5] == 25 );
+    }
+    else {
+        // Should skip the 8 bucket on the way down too.
+        ASSERT( capacity == 3 );
+        ASSERT( entitytainer->bucket_lists[2].used_buckets == 0 );
+        ASSERT( children[0] == 21 );
+        ASSERT( children[1] == 25 );
+        ASSERT( children[2] == 30 );
+    }
+
+    entitytainer_get_children( entitytainer, 10, &children, &num_children, &capacity );
+    TheEntitytainerEntity remaining[16];
+    int                   num_remaining = 0;
+    for ( int i_child = 0; i_child < capacity; ++i_child ) {
+        if ( children[i_child] != ENTITYTAINER_InvalidEntity ) {
+            remaining[num_remaining++] = children[i_child];
+        }
+    }
+
+    entitytainer_remove_children( entitytainer, 10, remaining, num_remaining );
+    entitytainer_get_children( entitytainer, 10, &children, &num_children, &capacity );
+    ASSERT( num_children == 0 );
+    ASSERT( capacity == 3 );
+    entitytainer_remove_entity( entitytainer, 10 );
+}
+
 static void
 do_save_load_test( TheEntitytainer* entitytainer ) {
     int            buffer_size = entitytainer_save( entitytainer, NULL, 0 );
@@ -472,35 +547,174 @@ do_save_load_upgrade_test( void ) {
 }
 
 static void
-unittest_run_base( UnitTestData* testdata ) {
-    testdata->num_tests = 0;
+do_realloc_tests( void ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 16;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 4;
+    config.bucket_list_sizes[1]         = 2;
+    config.num_bucket_lists             = 2;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+
+    // Make room to grow in place later on.
+    int memory_size    = needed_memory_size * 4;
+    config.memory      = malloc( memory_size );
+    config.memory_size = needed_memory_size;
+
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    entitytainer_add_entity( entitytainer, 1 );
+    entitytainer_add_entity( entitytainer, 2 );
+    entitytainer_add_entity( entitytainer, 3 );
+    for ( TheEntitytainerEntity i_child = 0; i_child < 5; ++i_child ) {
+        entitytainer_add_child( entitytainer, 1, 4 + i_child );
+    }
+    entitytainer_add_child( entitytainer, 2, 10 );
+    ASSERT( entitytainer_needs_realloc( entitytainer, -1, 1 ) );
+
+    // Grow into a new block
+    int   grown_size   = entitytainer_realloc_needed_size( entitytainer, 2.0f );
+    void* grown_memory = malloc( grown_size );
+    ASSERT( grown_size > needed_memory_size );
+    TheEntitytainer* grown = entitytainer_realloc( entitytainer, grown_memory, grown_size, 2.0f );
+    ASSERT( grown->entry_lookup_size == 32 );
+    ASSERT( grown->bucket_lists[0].total_buckets == 8 );
+    ASSERT( grown->bucket_lists[1].total_buckets == 4 );
+    ASSERT( !entitytainer_needs_realloc( grown, -1, 1 ) );
+
+    int                    num_children;
+    int                    capacity;
+    TheEntitytainerEntity* children;
+    entitytainer_get_children( grown, 1, &children, &num_children, &capacity );
+    ASSERT( num_children == 5 );
+    ASSERT( capacity == 7 );
+    ASSERT( children[4] == 8 );
+    ASSERT( entitytainer_get_parent( grown, 10 ) == 2 );
+
+    entitytainer_add_entity( grown, 20 );
+    entitytainer_add_entity( grown, 21 );
+    entitytainer_add_child( grown, 20, 30 );
+    entitytainer_add_child( grown, 3, 31 );
+    ASSERT( entitytainer_get_parent( grown, 30 ) == 20 );
+    ASSERT( entitytainer_num_children( grown, 3 ) == 1 );
+    ASSERT( entitytainer_num_children( grown, 1 ) == 5 );
+
+    // Grow in place, only the second bucket list
+    TheEntitytainer* in_place = entitytainer_realloc_bucket_list( entitytainer, config.memory, memory_size, 1, 2.0f );
+    ASSERT( in_place->entry_lookup_size == 16 );
+    ASSERT( in_place->bucket_lists[0].total_buckets == 4 );
+    ASSERT( in_place->bucket_lists[1].total_buckets == 4 );
+    ASSERT( entitytainer_realloc_bucket_list_needed_size( entitytainer, 1, 2.0f ) <= memory_size );
+
+    entitytainer_get_children( in_place, 1, &children, &num_children, &capacity );
+    ASSERT( num_children == 5 );
+    ASSERT( children[0] == 4 );
+    ASSERT( children[4] == 8 );
+    ASSERT( entitytainer_get_parent( in_place, 10 ) == 2 );
+    ASSERT( entitytainer_num_children( in_place, 3 ) == 0 );
+
+    for ( TheEntitytainerEntity i_child = 0; i_child < 4; ++i_child ) {
+        entitytainer_add_child( in_place, 2, 11 + i_child );
+    }
+    ASSERT( in_place->bucket_lists[1].used_buckets == 2 );
+    ASSERT( entitytainer_num_children( in_place, 2 ) == 5 );
+    ASSERT( !entitytainer_needs_realloc( in_place, -1, 1 ) );
+
+    free( grown_memory );
+    free( config.memory );
+}
 
+static void
+do_hashed_lookup_tests( void ) {
+    // Only room for a few live entities, but they can have any ID.
     struct TheEntitytainerConfig config = { 0 };
-    config.num_entries                  = 64;
+    config.num_entries                  = 16;
     config.bucket_sizes[0]              = 4;
     config.bucket_sizes[1]              = 8;
-    config.bucket_sizes[2]              = 16;
     config.bucket_list_sizes[0]         = 4;
     config.bucket_list_sizes[1]         = 2;
-    config.bucket_list_sizes[2]         = 2;
-    config.num_bucket_lists             = 3;
-    config.remove_with_holes            = false;
+    config.num_bucket_lists             = 2;
+    config.hashed_lookup                = true;
     int needed_memory_size              = entitytainer_needed_size( &config );
     config.memory                       = malloc( needed_memory_size );
     config.memory_size                  = needed_memory_size;
 
     TheEntitytainer* entitytainer = entitytainer_create( &config );
+    ASSERT( entitytainer->entry_lookup_size == 33 );
+    ASSERT( !entitytainer_is_added( entitytainer, 60000 ) );
+    ASSERT( entitytainer_get_parent( entitytainer, 60000 ) == 0 );
 
-    printf( "\n" );
-    printf( "Setup errors found: %u/%u\n", testdata->error_index, testdata->num_tests );
+    entitytainer_add_entity( entitytainer, 60000 );
+    entitytainer_add_entity( entitytainer, 12345 );
+    ASSERT( entitytainer_is_added( entitytainer, 60000 ) );
+    ASSERT( !entitytainer_is_added( entitytainer, 60001 ) );
 
-    if ( testdata->error_index > 0 ) {
-        printf( "Errors found during setup, exiting.\n" );
-        goto LABEL_done;
+    for ( TheEntitytainerEntity i_child = 0; i_child < 6; ++i_child ) {
+        entitytainer_add_child( entitytainer, 60000, 40000 + i_child * 1000 );
     }
+    entitytainer_add_child( entitytainer, 12345, 60001 );
+    entitytainer_add_entity( entitytainer, 60001 );
+    entitytainer_add_child( entitytainer, 60001, 7 );
+    ASSERT( entitytainer->entry_hash_count == 10 );
 
-    testdata->num_tests = 0;
-
+    int                    num_children;
+    int                    capacity;
+    TheEntitytainerEntity* children;
+    entitytainer_get_children( entitytainer, 60000, &children, &num_children, &capacity );
+    ASSERT( num_children == 6 );
+    ASSERT( capacity == 7 );
+    ASSERT( children[5] == 45000 );
+    ASSERT( entitytainer_get_parent( entitytainer, 43000 ) == 60000 );
+    ASSERT( entitytainer_get_parent( entitytainer, 60001 ) == 12345 );
+    ASSERT( entitytainer_get_parent( entitytainer, 7 ) == 60001 );
+
+    // Entities leave the table once they have neither children nor a parent.
+    entitytainer_remove_child_no_holes( entitytainer, 60000, 43000 );
+    ASSERT( entitytainer->entry_hash_count == 9 );
+    ASSERT( entitytainer_get_parent( entitytainer, 43000 ) == 0 );
+    ASSERT( entitytainer_get_parent( entitytainer, 44000 ) == 60000 );
+
+    const TheEntitytainerEntity to_remove[] = { 40000, 41000, 42000, 44000, 45000 };
+    entitytainer_remove_children( entitytainer, 60000, to_remove, 5 );
+    entitytainer_remove_entity( entitytainer, 60000 );
+    ASSERT( entitytainer->entry_hash_count == 3 );
+    ASSERT( !entitytainer_is_added( entitytainer, 60000 ) );
+    ASSERT( entitytainer_get_parent( entitytainer, 7 ) == 60001 );
+
+    // Growing rehashes into the new block
+    int              grown_size   = entitytainer_realloc_needed_size( entitytainer, 2.0f );
+    void*            grown_memory = malloc( grown_size );
+    TheEntitytainer* grown        = entitytainer_realloc( entitytainer, grown_memory, grown_size, 2.0f );
+    ASSERT( grown->entry_lookup_size == 65 );
+    ASSERT( grown->entry_hash_count == 3 );
+    ASSERT( entitytainer_get_parent( grown, 60001 ) == 12345 );
+    ASSERT( entitytainer_get_parent( grown, 7 ) == 60001 );
+    ASSERT( entitytainer_num_children( grown, 12345 ) == 1 );
+    ASSERT( !entitytainer_is_added( grown, 7 ) );
+    for ( TheEntitytainerEntity i_child = 0; i_child < 6; ++i_child ) {
+        entitytainer_add_child( grown, 60001, 1000 + i_child * 2000 );
+        entitytainer_add_child( grown, 12345, 1001 + i_child * 2000 );
+    }
+    ASSERT( grown->entry_hash_count == 15 );
+    ASSERT( entitytainer_num_children( grown, 60001 ) == 7 );
+    ASSERT( entitytainer_get_parent( grown, 11000 ) == 60001 );
+    ASSERT( entitytainer_get_parent( grown, 11001 ) == 12345 );
+    do_save_load_test( grown );
+
+    free( grown_memory );
+    free( config.memory );
+
+    // All the regular tests should behave the same with hashing.
+    config.num_entries     = 64;
+    config.bucket_sizes[2] = 16;
+    config.bucket_list_sizes[0] = 4;
+    config.bucket_list_sizes[1] = 2;
+    config.bucket_list_sizes[2] = 2;
+    config.num_bucket_lists     = 3;
+    needed_memory_size          = entitytainer_needed_size( &config );
+    config.memory               = malloc( needed_memory_size );
+    config.memory_size          = needed_memory_size;
+    entitytainer                = entitytainer_create( &config );
     do_single_parent_tests( entitytainer );
     do_multi_parent_tests( entitytainer );
 
@@ -511,18 +725,3215 @@ unittest_run_base( UnitTestData* testdata ) {
     do_save_load_test( entitytainer );
 
     memset( config.memory, 0, config.memory_size );
-    config.keep_capacity_on_remove = true;
-    entitytainer                   = entitytainer_create( &config );
-    do_reserve_tests( entitytainer );
-    do_save_load_test( entitytainer );
+    entitytainer = entitytainer_create( &config );
+    do_batch_tests( entitytainer );
+    ASSERT( entitytainer->entry_hash_count == 0 );
 
     memset( config.memory, 0, config.memory_size );
-    config.keep_capacity_on_remove = false;
-    entitytainer                   = entitytainer_create( &config );
+    config.remove_with_holes = false;
+    entitytainer             = entitytainer_create( &config );
     do_multi_entity_tests( entitytainer );
     do_save_load_test( entitytainer );
+    free( config.memory );
+}
+
+static TheEntitytainer*
+create_for_hashed_realloc( void* memory, int memory_size, TheEntitytainerEntity* entities, int num_entities ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 32;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 16;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 4;
+    config.num_bucket_lists             = 2;
+    config.hashed_lookup                = true;
+    config.track_child_index            = true;
+    config.track_depth                  = true;
+    config.track_order                  = true;
+    config.memory                       = memory;
+    config.memory_size                  = memory_size;
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+    if ( entities[0] == ENTITYTAINER_InvalidEntity ) {
+        // Some that wrap around the end of the grown table, and some that are pushed up by those, the rest anywhere.
+        TheEntitytainer grown = *entitytainer;
+        --grown.entry_hash_shift;
+        int num_top    = 0;
+        int num_bottom = 0;
+        int num_added  = 0;
+        for ( TheEntitytainerEntity entity = 1000; num_added < num_entities; ++entity ) {
+            int home = entitytainer__hash_slot( &grown, entity );
+            if ( home == grown.entry_lookup_size * 2 - 3 && num_top < 4 ) {
+                ++num_top;
+            }
+            else if ( home == 0 && num_bottom < 2 ) {
+                ++num_bottom;
+            }
+            else if ( entity % 37 != 0 || num_added >= num_entities - 6 + num_top + num_bottom ) {
+                continue;
+            }
+
+            entities[num_added++] = entity;
+        }
+    }
+
+    // A few parents with the rest of them as children, and one removed to get the backward shift in.
+    for ( int i_entity = 0; i_entity < num_entities; ++i_entity ) {
+        if ( i_entity < 4 ) {
+            entitytainer_add_entity( entitytainer, entities[i_entity] );
+        }
+        else {
+            entitytainer_add_child( entitytainer, entities[i_entity % 4], entities[i_entity] );
+        }
+    }
+
+    entitytainer_remove_child_no_holes( entitytainer, entities[5 % 4], entities[5] );
+    return entitytainer;
+}
+
+static void
+do_hashed_realloc_in_place_tests( void ) {
+    // Growing in place rehashes without a copy of the old table. It has to match growing into a new block.
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 32;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 16;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 4;
+    config.num_bucket_lists             = 2;
+    config.hashed_lookup                = true;
+    config.track_child_index            = true;
+    config.track_depth                  = true;
+    config.track_order                  = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+
+    // The same entitytainer twice, one of them with room to grow in place.
+    TheEntitytainerEntity entities[32] = { 0 };
+    int                   memory_size  = needed_memory_size * 4;
+    void*                 memory       = malloc( memory_size );
+    void*                 other_memory = malloc( needed_memory_size );
+
+    TheEntitytainer* in_place = create_for_hashed_realloc( memory, needed_memory_size, entities, 32 );
+    TheEntitytainer* other    = create_for_hashed_realloc( other_memory, needed_memory_size, entities, 32 );
+    ASSERT( in_place->entry_hash_count == 31 );
+
+    int   grown_size   = entitytainer_realloc_needed_size( in_place, 2.0f );
+    void* grown_memory = malloc( grown_size );
+    ASSERT( grown_size <= memory_size );
+    in_place               = entitytainer_realloc( in_place, memory, memory_size, 2.0f );
+    TheEntitytainer* grown = entitytainer_realloc( other, grown_memory, grown_size, 2.0f );
+    ASSERT( (void*)in_place == memory );
+    ASSERT( in_place->entry_lookup_size == grown->entry_lookup_size );
+    ASSERT( in_place->entry_hash_count == 31 );
+
+    // Something wrapped around.
+    ASSERT( entitytainer__hash_slot( in_place, in_place->entry_keys[1] ) == in_place->entry_lookup_size - 2 );
+    for ( int i_entity = 0; i_entity < 32; ++i_entity ) {
+        TheEntitytainerEntity entity = entities[i_entity];
+        ASSERT( ( entitytainer__index( in_place, entity ) != 0 ) == ( i_entity != 5 ) );
+        ASSERT( entitytainer_is_added( in_place, entity ) == entitytainer_is_added( grown, entity ) );
+        ASSERT( entitytainer_get_parent( in_place, entity ) == entitytainer_get_parent( grown, entity ) );
+        ASSERT( entitytainer_get_depth( in_place, entity ) == entitytainer_get_depth( grown, entity ) );
+        if ( entitytainer_is_added( grown, entity ) ) {
+            ASSERT( entitytainer_num_children( in_place, entity ) == entitytainer_num_children( grown, entity ) );
+        }
+
+        TheEntitytainerEntity parent = entitytainer_get_parent( grown, entity );
+        if ( parent != ENTITYTAINER_InvalidEntity ) {
+            ASSERT( entitytainer_get_child_index( in_place, parent, entity ) ==
+                    entitytainer_get_child_index( grown, parent, entity ) );
+        }
+    }
+
+    // Still a working table
+    entitytainer_add_child( in_place, entities[1], entities[5] );
+    entitytainer_remove_entity( in_place, entities[8] );
+    ASSERT( entitytainer_get_parent( in_place, entities[5] ) == entities[1] );
+    ASSERT( entitytainer_get_parent( in_place, entities[8] ) == ENTITYTAINER_InvalidEntity );
+    ASSERT( entitytainer_get_parent( in_place, entities[12] ) == entities[0] );
+
+    free( grown_memory );
+    free( other_memory );
+    free( memory );
+}
+
+static void
+do_entry_layout_tests( void ) {
+    int entry_bits = (int)sizeof( TheEntitytainerEntry ) * 8;
+
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 16;
+    config.bucket_sizes[3]              = 32;
+    config.bucket_sizes[4]              = 64;
+    config.bucket_list_sizes[0]         = 2;
+    config.bucket_list_sizes[1]         = 2;
+    config.bucket_list_sizes[2]         = 2;
+    config.bucket_list_sizes[3]         = 2;
+    config.bucket_list_sizes[4]         = 2;
+    config.num_bucket_lists             = 5;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    // Five bucket lists need three bits
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    ASSERT( entitytainer->entry_list_shift == entry_bits - 3 );
+    ASSERT( entitytainer->entry_bucket_mask == (int)( ( 1u << ( entry_bits - 3 ) ) - 1 ) );
+
+    // Walk a parent through all of them, so the last bucket list index is actually stored in an entry.
+    entitytainer_add_entity( entitytainer, 1 );
+    for ( TheEntitytainerEntity i_child = 2; i_child < 42; ++i_child ) {
+        entitytainer_add_child( entitytainer, 1, i_child );
+    }
+    ASSERT( entitytainer->bucket_lists[4].used_buckets == 1 );
+    ASSERT( entitytainer_get_parent( entitytainer, 41 ) == 1 );
+
+    int                    num_children;
+    int                    capacity;
+    TheEntitytainerEntity* children;
+    entitytainer_get_children( entitytainer, 1, &children, &num_children, &capacity );
+    ASSERT( num_children == 40 );
+    ASSERT( capacity == 63 );
+    ASSERT( children[39] == 41 );
+
+    for ( TheEntitytainerEntity i_child = 2; i_child < 42; ++i_child ) {
+        entitytainer_remove_child_no_holes( entitytainer, 1, i_child );
+    }
+    ASSERT( entitytainer->bucket_lists[4].used_buckets == 0 );
+    ASSERT( entitytainer->bucket_lists[0].used_buckets == 2 );
+    free( config.memory );
+
+    if ( sizeof( TheEntitytainerEntity ) < 4 || sizeof( TheEntitytainerEntry ) < 4 ) {
+        return;
+    }
+
+    // More entities and buckets than fits in 16 bits
+    config.num_entries          = 262144;
+    config.bucket_sizes[0]      = 4;
+    config.bucket_sizes[1]      = 16;
+    config.bucket_list_sizes[0] = 20000;
+    config.bucket_list_sizes[1] = 4;
+    config.num_bucket_lists     = 2;
+    needed_memory_size          = entitytainer_needed_size( &config );
+    config.memory               = malloc( needed_memory_size );
+    config.memory_size          = needed_memory_size;
+    entitytainer                = entitytainer_create( &config );
+    ASSERT( entitytainer->entry_list_shift == entry_bits - 1 );
+
+    for ( int i_parent = 0; i_parent < 19999; ++i_parent ) {
+        TheEntitytainerEntity parent = (TheEntitytainerEntity)( 200000 + i_parent );
+        entitytainer_add_entity( entitytainer, parent );
+        entitytainer_add_child( entitytainer, parent, (TheEntitytainerEntity)( 1 + i_parent ) );
+    }
+
+    ASSERT( entitytainer->bucket_lists[0].used_buckets == 20000 );
+    ASSERT( entitytainer_get_parent( entitytainer, 19999 ) == (TheEntitytainerEntity)219998 );
+    entitytainer_get_children( entitytainer, (TheEntitytainerEntity)219998, &children, &num_children, &capacity );
+    ASSERT( num_children == 1 );
+    ASSERT( children[0] == 19999 );
+
+    // Promote the last one, so both the list bit and a large bucket index are in use.
+    for ( int i_child = 0; i_child < 8; ++i_child ) {
+        entitytainer_add_child( entitytainer, (TheEntitytainerEntity)219998, (TheEntitytainerEntity)( 30000 + i_child ) );
+    }
+    ASSERT( entitytainer_num_children( entitytainer, (TheEntitytainerEntity)219998 ) == 9 );
+    ASSERT( entitytainer_get_parent( entitytainer, 30007 ) == (TheEntitytainerEntity)219998 );
+    entitytainer_add_entity( entitytainer, (TheEntitytainerEntity)250000 );
+    ASSERT( entitytainer->bucket_lists[0].used_buckets == 20000 );
+    entitytainer_add_child( entitytainer, (TheEntitytainerEntity)250000, 25000 );
+    entitytainer_get_children( entitytainer, (TheEntitytainerEntity)219997, &children, &num_children, &capacity );
+    ASSERT( children[0] == 19998 );
+    free( config.memory );
+}
+
+static int
+count_child_spans( TheEntitytainer*       entitytainer,
+                   TheEntitytainerEntity  parent,
+                   TheEntitytainerEntity* children_out,
+                   int*                   num_spans ) {
+    // Flattens the children of parent into children_out, skipping holes.
+    int                      num_children = 0;
+    TheEntitytainerChildSpan span;
+    entitytainer_get_child_span( entitytainer, parent, &span );
+    *num_spans = 0;
+    do {
+        ++*num_spans;
+        ASSERT( span.capacity == 6 || span.capacity == 3 );
+        for ( int i_child = 0; i_child < span.num_children; ++i_child ) {
+            if ( span.children[i_child] != ENTITYTAINER_InvalidEntity ) {
+                children_out[num_children++] = span.children[i_child];
+            }
+        }
+    } while ( entitytainer_next_child_span( entitytainer, &span ) );
+
+    return num_children;
+}
+
+static void
+do_chain_tests( bool remove_with_holes ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 128;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 8;
+    config.bucket_list_sizes[1]         = 16;
+    config.num_bucket_lists             = 2;
+    config.remove_with_holes            = remove_with_holes;
+    config.chain_last_bucket_list       = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer*       entitytainer = entitytainer_create( &config );
+    TheEntitytainerBucketList* pages    = &entitytainer->bucket_lists[1];
+    TheEntitytainerEntity  flat[64];
+    int                    num_spans;
+    int                    num_children;
+    int                    capacity;
+    TheEntitytainerEntity* children;
+
+    // Way more children than a bucket in the last list can hold, so it has to chain. Each page holds 6 children.
+    entitytainer_add_entity( entitytainer, 1 );
+    for ( TheEntitytainerEntity i_child = 0; i_child < 20; ++i_child ) {
+        entitytainer_add_child( entitytainer, 1, 10 + i_child );
+    }
+
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 20 );
+    ASSERT( pages->used_buckets == 4 );
+    entitytainer_get_children( entitytainer, 1, &children, &num_children, &capacity );
+    ASSERT( num_children == 6 );
+    ASSERT( capacity == 6 );
+    ASSERT( count_child_spans( entitytainer, 1, flat, &num_spans ) == 20 );
+    ASSERT( num_spans == 4 );
+    for ( int i_child = 0; i_child < 20; ++i_child ) {
+        ASSERT( flat[i_child] == (TheEntitytainerEntity)( 10 + i_child ) );
+    }
+
+    ASSERT( entitytainer_get_child_index( entitytainer, 1, 25 ) == 15 );
+    ASSERT( entitytainer_get_parent( entitytainer, 29 ) == 1 );
+
+    // Remove from the middle of the first page
+    entitytainer_remove_entity( entitytainer, 12 );
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 19 );
+    ASSERT( entitytainer_get_parent( entitytainer, 12 ) == 0 );
+    ASSERT( count_child_spans( entitytainer, 1, flat, &num_spans ) == 19 );
+    ASSERT( flat[2] == 13 );
+    if ( remove_with_holes ) {
+        // The hole is filled by the next child
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 29 ) == 19 );
+        entitytainer_add_child( entitytainer, 1, 30 );
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 30 ) == 2 );
+        entitytainer_remove_child_with_holes( entitytainer, 1, 30 );
+    }
+    else {
+        ASSERT( flat[5] == 16 );
+        ASSERT( flat[6] == 17 );
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 29 ) == 18 );
+    }
+
+    // Removing the last children frees the pages at the end
+    const TheEntitytainerEntity last_ones[] = { 29, 28, 27, 26, 25, 24 };
+    entitytainer_remove_children( entitytainer, 1, last_ones, 6 );
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 13 );
+    ASSERT( pages->used_buckets == 3 );
+    if ( remove_with_holes ) {
+        entitytainer_remove_holes( entitytainer, 1 );
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 23 ) == 12 );
+    }
+
+    for ( TheEntitytainerEntity i_child = 13; i_child < 24; ++i_child ) {
+        entitytainer_remove_entity( entitytainer, i_child );
+    }
+    ASSERT( pages->used_buckets == 0 );
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 2 );
+    entitytainer_get_children( entitytainer, 1, &children, &num_children, &capacity );
+    ASSERT( capacity == 3 );
+    ASSERT( children[0] == 10 );
+    ASSERT( children[1] == 11 );
+
+    // Batched add puts the parent straight in the last list.
+    TheEntitytainerEntity batch[16];
+    for ( TheEntitytainerEntity i_child = 0; i_child < 16; ++i_child ) {
+        batch[i_child] = 40 + i_child;
+    }
+    entitytainer_add_entity( entitytainer, 2 );
+    entitytainer_add_children( entitytainer, 2, batch, 16 );
+    ASSERT( pages->used_buckets == 3 );
+    ASSERT( count_child_spans( entitytainer, 2, flat, &num_spans ) == 16 );
+    ASSERT( flat[15] == 55 );
+    entitytainer_remove_children( entitytainer, 2, batch + 2, 14 );
+    ASSERT( entitytainer_num_children( entitytainer, 2 ) == 2 );
+    ASSERT( pages->used_buckets == 0 );
+    ASSERT( entitytainer_get_parent( entitytainer, 41 ) == 2 );
+
+    // Reserving allocates the pages up front
+    entitytainer_add_entity( entitytainer, 3 );
+    entitytainer_reserve( entitytainer, 3, 20 );
+    ASSERT( pages->used_buckets == 4 );
+    entitytainer_add_child_at_index( entitytainer, 3, 60, 19 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 3, 60 ) == 19 );
+    ASSERT( pages->used_buckets == 4 );
+    entitytainer_add_child_at_index( entitytainer, 3, 61, 0 );
+    entitytainer_add_child_at_index( entitytainer, 3, 62, 1 );
+    if ( remove_with_holes ) {
+        // Only the first page is needed now, so it can even move to the smaller bucket list.
+        entitytainer_remove_child_with_holes( entitytainer, 3, 60 );
+        ASSERT( pages->used_buckets == 0 );
+        ASSERT( entitytainer_get_child_index( entitytainer, 3, 62 ) == 1 );
+    }
+
+    free( config.memory );
+}
+
+static void
+do_chain_stale_slot_tests( void ) {
+    // A child removed without holes mustn't linger past the count, moving into the chained list copies those slots.
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 8;
+    config.bucket_list_sizes[1]         = 8;
+    config.num_bucket_lists             = 2;
+    config.chain_last_bucket_list       = true;
+    config.track_child_index            = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer*            entitytainer = entitytainer_create( &config );
+    TheEntitytainerEntity       flat[16];
+    int                         num_spans;
+    const TheEntitytainerEntity more[] = { 5, 6 };
+    entitytainer_add_entity( entitytainer, 1 );
+    entitytainer_add_child( entitytainer, 1, 2 );
+    entitytainer_add_child( entitytainer, 1, 3 );
+    entitytainer_add_child( entitytainer, 1, 4 );
+    entitytainer_remove_child_no_holes( entitytainer, 1, 4 );
+    entitytainer_add_entity( entitytainer, 10 );
+    entitytainer_add_child( entitytainer, 10, 4 );
+    entitytainer_add_children( entitytainer, 1, more, 2 );
+    ASSERT( count_child_spans( entitytainer, 1, flat, &num_spans ) == 4 );
+    ASSERT( flat[0] == 2 && flat[1] == 3 && flat[2] == 5 && flat[3] == 6 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 10, 4 ) == 0 );
+
+    // Filtering the chain mustn't pick up the old child and rewrite its index either.
+    entitytainer_remove_child_no_holes( entitytainer, 1, 5 );
+    ASSERT( count_child_spans( entitytainer, 1, flat, &num_spans ) == 3 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 10, 4 ) == 0 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 1, 6 ) == 2 );
+
+    // Reserving and add_child_at_index move the same way.
+    entitytainer_add_entity( entitytainer, 20 );
+    entitytainer_add_child( entitytainer, 20, 21 );
+    entitytainer_add_child( entitytainer, 20, 22 );
+    entitytainer_remove_child_no_holes( entitytainer, 20, 22 );
+    entitytainer_reserve( entitytainer, 20, 12 );
+    ASSERT( count_child_spans( entitytainer, 20, flat, &num_spans ) == 1 );
+    entitytainer_add_child_at_index( entitytainer, 20, 23, 1 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 20, 23 ) == 1 );
+
+    free( config.memory );
+}
+
+static void
+check_child_indices( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int num_children_expected ) {
+    // Every child's tracked index should match where it actually is, across all spans.
+    int                      num_children = 0;
+    int                      position     = 0;
+    TheEntitytainerChildSpan span;
+    entitytainer_get_child_span( entitytainer, parent, &span );
+    do {
+        for ( int i_child = 0; i_child < span.num_children; ++i_child ) {
+            TheEntitytainerEntity child = span.children[i_child];
+            if ( child != ENTITYTAINER_InvalidEntity ) {
+                ASSERT( entitytainer_get_child_index( entitytainer, parent, child ) == position + i_child );
+                ++num_children;
+            }
+        }
+
+        position += span.capacity;
+    } while ( entitytainer_next_child_span( entitytainer, &span ) );
+
+    ASSERT( num_children == num_children_expected );
+    ASSERT( entitytainer_num_children( entitytainer, parent ) == num_children_expected );
+}
+
+static void
+do_child_index_tests( bool remove_with_holes, bool remove_unordered, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 10;
+    config.bucket_list_sizes[0]         = 8;
+    config.bucket_list_sizes[1]         = 8;
+    config.bucket_list_sizes[2]         = 16;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.remove_unordered             = remove_unordered;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    config.track_child_index            = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    ASSERT( entitytainer->entry_child_index != NULL );
+
+    // 20 children, so the last list has to chain. Each page holds 8.
+    entitytainer_add_entity( entitytainer, 1 );
+    for ( TheEntitytainerEntity i_child = 0; i_child < 20; ++i_child ) {
+        entitytainer_add_child( entitytainer, 1, 10 + i_child );
+    }
+
+    check_child_indices( entitytainer, 1, 20 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 1, 27 ) == 17 );
+
+    entitytainer_remove_entity( entitytainer, 15 );
+    check_child_indices( entitytainer, 1, 19 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 1, 15 ) == -1 );
+    if ( remove_with_holes ) {
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 16 ) == 6 );
+    }
+    else if ( remove_unordered ) {
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 29 ) == 5 );
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 16 ) == 6 );
+    }
+    else {
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, 16 ) == 5 );
+    }
+
+    // Removing the last child works the same in all modes
+    entitytainer_remove_entity( entitytainer, remove_unordered && !remove_with_holes ? 28 : 29 );
+    check_child_indices( entitytainer, 1, 18 );
+
+    const TheEntitytainerEntity some[] = { 10, 20, 24 };
+    entitytainer_remove_children( entitytainer, 1, some, 3 );
+    check_child_indices( entitytainer, 1, 15 );
+
+    const TheEntitytainerEntity more[] = { 40, 41, 42 };
+    entitytainer_add_children( entitytainer, 1, more, 3 );
+    check_child_indices( entitytainer, 1, 18 );
+
+    if ( remove_with_holes ) {
+        entitytainer_remove_holes( entitytainer, 1 );
+        check_child_indices( entitytainer, 1, 18 );
+    }
+
+    const TheEntitytainerEntity lots[] = { 11, 12, 13, 14, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 40 };
+    for ( int i_child = 0; i_child < 15; ++i_child ) {
+        entitytainer_remove_entity( entitytainer, lots[i_child] );
+        check_child_indices( entitytainer, 1, 17 - i_child );
+    }
+
+    if ( !remove_with_holes ) {
+        // Shrink all the way back to the first bucket list
+        int bucket_list_index = entitytainer->entry_lookup[entitytainer__index( entitytainer, 1 )] >>
+                                entitytainer->entry_list_shift;
+        ASSERT( bucket_list_index == 0 );
+    }
+
+    // A child of another parent isn't found
+    entitytainer_add_entity( entitytainer, 2 );
+    entitytainer_add_child( entitytainer, 2, 50 );
+    entitytainer_add_child( entitytainer, 2, 51 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 1, 50 ) == -1 );
+    ASSERT( entitytainer_get_child_index( entitytainer, 2, 51 ) == 1 );
+    entitytainer_remove_entity( entitytainer, 50 );
+    check_child_indices( entitytainer, 2, 1 );
+    do_save_load_test( entitytainer );
+
+    free( config.memory );
+}
+
+static void
+do_find_tests( void ) {
+    // The search kernels, at every position relative to the SIMD block boundaries (if any).
+    TheEntitytainerEntity entities[80];
+    for ( int count = 0; count <= 80; ++count ) {
+        for ( int i = 0; i < 80; ++i ) {
+            entities[i] = (TheEntitytainerEntity)( 100 + i );
+        }
+
+        ASSERT( entitytainer__find_entity( entities, count, 7 ) == -1 );
+        ASSERT( entitytainer__find_entity( entities, count, ENTITYTAINER_InvalidEntity ) == -1 );
+        ASSERT( entitytainer__find_last_used( entities, count ) == count - 1 );
+        for ( int i = 0; i < count; ++i ) {
+            ASSERT( entitytainer__find_entity( entities, count, (TheEntitytainerEntity)( 100 + i ) ) == i );
+        }
+
+        // Holes, the first one is found first and the last used one is before the trailing ones.
+        for ( int i = count - 1; i >= 0; i -= 3 ) {
+            entities[i] = ENTITYTAINER_InvalidEntity;
+            ASSERT( entitytainer__find_entity( entities, count, ENTITYTAINER_InvalidEntity ) == i );
+        }
+
+        for ( int i = 0; i < count; ++i ) {
+            entities[i] = (TheEntitytainerEntity)( 100 + i );
+        }
+
+        for ( int i = count - 1; i >= 0; --i ) {
+            entities[i] = ENTITYTAINER_InvalidEntity;
+            ASSERT( entitytainer__find_last_used( entities, count ) == i - 1 );
+        }
+
+        ASSERT( entitytainer__find_entity( entities, count, 0 ) == ( count > 0 ? 0 : -1 ) );
+        if ( count < 80 ) {
+            // Untouched past count
+            ASSERT( entitytainer__find_entity( entities, 80, (TheEntitytainerEntity)( 100 + count ) ) == count );
+            ASSERT( entitytainer__find_last_used( entities, 80 ) == 79 );
+        }
+    }
+}
+
+static void
+do_subtree_tests( bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 16;
+    config.num_bucket_lists             = 2;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer*      entitytainer = entitytainer_create( &config );
+    TheEntitytainerEntity entities[64];
+    int                   reserved     = entitytainer->bucket_lists[0].used_buckets;
+
+    // 1
+    //   2
+    //     5
+    //       8
+    //     6
+    //   3
+    //     7
+    //   4
+    const TheEntitytainerEntity parents[] = { 1, 1, 1, 2, 2, 3, 5 };
+    const TheEntitytainerEntity children[] = { 2, 3, 4, 5, 6, 7, 8 };
+    for ( int i = 0; i < 7; ++i ) {
+        if ( !entitytainer_is_added( entitytainer, parents[i] ) ) {
+            entitytainer_add_entity( entitytainer, parents[i] );
+        }
+
+        entitytainer_add_child( entitytainer, parents[i], children[i] );
+    }
+
+    // A hole in 1's bucket (with remove_with_holes) shouldn't show up
+    entitytainer_add_child( entitytainer, 1, 9 );
+    entitytainer_remove_entity( entitytainer, 9 );
+
+    const TheEntitytainerEntity breadth_first[] = { 2, 3, 4, 5, 6, 7, 8 };
+    ASSERT( entitytainer_get_subtree( entitytainer, 1, entities, 64, false ) == 7 );
+    ASSERT( memcmp( entities, breadth_first, sizeof( breadth_first ) ) == 0 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 1, entities, 7, false ) == 7 );
+    ASSERT( memcmp( entities, breadth_first, sizeof( breadth_first ) ) == 0 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 1, entities, 6, false ) == -1 );
+
+    const TheEntitytainerEntity depth_first[] = { 2, 5, 8, 6, 3, 7, 4 };
+    ASSERT( entitytainer_get_subtree( entitytainer, 1, entities, 64, true ) == 7 );
+    ASSERT( memcmp( entities, depth_first, sizeof( depth_first ) ) == 0 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 1, entities, 7, true ) == 7 );
+    ASSERT( memcmp( entities, depth_first, sizeof( depth_first ) ) == 0 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 1, entities, 6, true ) == -1 );
+
+    ASSERT( entitytainer_get_subtree( entitytainer, 2, entities, 64, true ) == 3 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 8, entities, 64, true ) == 0 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 8, entities, 0, false ) == 0 );
+
+    // Too small buffer, nothing happens
+    int used_buckets = entitytainer->bucket_lists[0].used_buckets;
+    ASSERT( entitytainer_remove_subtree( entitytainer, 2, entities, 3 ) == -1 );
+    ASSERT( entitytainer_get_parent( entitytainer, 8 ) == 5 );
+    ASSERT( entitytainer->bucket_lists[0].used_buckets == used_buckets );
+
+    ASSERT( entitytainer_remove_subtree( entitytainer, 2, entities, 64 ) == 4 );
+    const TheEntitytainerEntity removed[] = { 2, 5, 6, 8 };
+    ASSERT( memcmp( entities, removed, sizeof( removed ) ) == 0 );
+    ASSERT( entitytainer->bucket_lists[0].used_buckets == used_buckets - 2 );
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 2 );
+    for ( int i = 0; i < 4; ++i ) {
+        ASSERT( !entitytainer_is_added( entitytainer, removed[i] ) );
+        ASSERT( entitytainer_get_parent( entitytainer, removed[i] ) == 0 );
+    }
+
+    ASSERT( entitytainer_get_subtree( entitytainer, 1, entities, 64, false ) == 3 );
+    ASSERT( entitytainer_get_parent( entitytainer, 7 ) == 3 );
+
+    // The freed buckets can be used again
+    entitytainer_add_entity( entitytainer, 5 );
+    entitytainer_add_child( entitytainer, 5, 6 );
+    entitytainer_add_child( entitytainer, 1, 5 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 5, entities, 64, false ) == 1 );
+    ASSERT( entities[0] == 6 );
+
+    // Chained, with grandchildren on every page
+    int used_pages = entitytainer->bucket_lists[1].used_buckets;
+    entitytainer_add_entity( entitytainer, 20 );
+    for ( TheEntitytainerEntity i_child = 0; i_child < 20; ++i_child ) {
+        entitytainer_add_child( entitytainer, 20, 30 + i_child );
+    }
+
+    entitytainer_add_entity( entitytainer, 30 );
+    entitytainer_add_child( entitytainer, 30, 50 );
+    entitytainer_add_entity( entitytainer, 49 );
+    entitytainer_add_child( entitytainer, 49, 51 );
+    ASSERT( entitytainer->bucket_lists[1].used_buckets == used_pages + 4 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 20, entities, 64, true ) == 22 );
+    ASSERT( entities[0] == 30 && entities[1] == 50 && entities[2] == 31 && entities[21] == 51 );
+    ASSERT( entitytainer_get_subtree( entitytainer, 20, entities, 64, false ) == 22 );
+    ASSERT( entities[19] == 49 && entities[20] == 50 && entities[21] == 51 );
+
+    entitytainer_add_child( entitytainer, 1, 20 );
+    ASSERT( entitytainer_remove_subtree( entitytainer, 1, entities, 64 ) == 29 );
+    ASSERT( entitytainer->bucket_lists[0].used_buckets == reserved );
+    ASSERT( entitytainer->bucket_lists[1].used_buckets == 0 );
+    ASSERT( !entitytainer_is_added( entitytainer, 1 ) );
+    ASSERT( entitytainer_get_parent( entitytainer, 51 ) == 0 );
+    if ( hashed_lookup ) {
+        ASSERT( entitytainer->entry_hash_count == 0 );
+    }
+
+    free( config.memory );
+}
+
+static void
+check_depths( TheEntitytainer* entitytainer, const TheEntitytainerEntity* entities, int num_entities ) {
+    // Compares the tracked depth/root against walking up the parents.
+    for ( int i = 0; i < num_entities; ++i ) {
+        TheEntitytainerEntity entity = entities[i];
+        int                   depth  = 0;
+        TheEntitytainerEntity root   = entity;
+        for ( TheEntitytainerEntity parent = entitytainer_get_parent( entitytainer, entity ); parent != 0;
+              parent                       = entitytainer_get_parent( entitytainer, parent ) ) {
+            ++depth;
+            root = parent;
+        }
+
+        ASSERT( entitytainer_get_depth( entitytainer, entity ) == depth );
+        ASSERT( entitytainer_get_root( entitytainer, entity ) == root );
+        ASSERT( entitytainer_is_ancestor( entitytainer, root, entity ) == ( depth > 0 ) );
+        ASSERT( !entitytainer_is_ancestor( entitytainer, entity, entity ) );
+    }
+}
+
+static void
+do_depth_tests( bool track_depth, bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 16;
+    config.num_bucket_lists             = 2;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    config.track_depth                  = track_depth;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer*            entitytainer = entitytainer_create( &config );
+    const TheEntitytainerEntity all[]        = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    ASSERT( ( entitytainer->entry_depth != NULL ) == track_depth );
+
+    // 1 - 2 - 3 - 4, and 10 - 11
+    entitytainer_add_entity( entitytainer, 1 );
+    entitytainer_add_entity( entitytainer, 2 );
+    entitytainer_add_entity( entitytainer, 3 );
+    entitytainer_add_entity( entitytainer, 4 );
+    entitytainer_add_entity( entitytainer, 10 );
+    entitytainer_add_entity( entitytainer, 11 );
+    entitytainer_add_child( entitytainer, 1, 2 );
+    entitytainer_add_child( entitytainer, 2, 3 );
+    entitytainer_add_child( entitytainer, 3, 4 );
+    entitytainer_add_child( entitytainer, 10, 11 );
+    check_depths( entitytainer, all, 12 );
+    ASSERT( entitytainer_get_depth( entitytainer, 4 ) == 3 );
+    ASSERT( entitytainer_get_root( entitytainer, 4 ) == 1 );
+    ASSERT( entitytainer_get_root( entitytainer, 12 ) == 12 );
+    ASSERT( entitytainer_is_ancestor( entitytainer, 2, 4 ) );
+    ASSERT( !entitytainer_is_ancestor( entitytainer, 4, 2 ) );
+    ASSERT( !entitytainer_is_ancestor( entitytainer, 10, 4 ) );
+    ASSERT( !entitytainer_is_ancestor( entitytainer, 11, 4 ) );
+
+    // Building a subtree on its own and attaching it updates all of it
+    entitytainer_add_entity( entitytainer, 5 );
+    entitytainer_add_entity( entitytainer, 6 );
+    entitytainer_add_entity( entitytainer, 9 );
+    entitytainer_add_child( entitytainer, 5, 6 );
+    entitytainer_add_child( entitytainer, 6, 7 );
+    entitytainer_add_child( entitytainer, 6, 8 );
+    entitytainer_add_child( entitytainer, 5, 9 );
+    entitytainer_add_child( entitytainer, 4, 5 );
+    check_depths( entitytainer, all, 12 );
+    ASSERT( entitytainer_get_depth( entitytainer, 8 ) == 6 );
+    ASSERT( entitytainer_get_root( entitytainer, 8 ) == 1 );
+    ASSERT( entitytainer_is_ancestor( entitytainer, 3, 8 ) );
+    ASSERT( !entitytainer_is_ancestor( entitytainer, 9, 8 ) );
+
+    // Detaching, the subtree gets a new root
+    if ( remove_with_holes ) {
+        entitytainer_remove_child_with_holes( entitytainer, 3, 4 );
+    }
+    else {
+        entitytainer_remove_child_no_holes( entitytainer, 3, 4 );
+    }
+
+    check_depths( entitytainer, all, 12 );
+    ASSERT( entitytainer_get_root( entitytainer, 8 ) == 4 );
+    ASSERT( entitytainer_get_depth( entitytainer, 8 ) == 3 );
+
+    // Batched
+    const TheEntitytainerEntity subtrees[] = { 4, 12 };
+    entitytainer_add_children( entitytainer, 11, subtrees, 2 );
+    check_depths( entitytainer, all, 12 );
+    ASSERT( entitytainer_get_root( entitytainer, 7 ) == 10 );
+    entitytainer_remove_children( entitytainer, 11, subtrees, 2 );
+    check_depths( entitytainer, all, 12 );
+
+    // Lots of siblings, in chained pages
+    for ( TheEntitytainerEntity i_child = 0; i_child < 20; ++i_child ) {
+        entitytainer_add_child( entitytainer, 9, 30 + i_child );
+    }
+
+    entitytainer_add_entity( entitytainer, 49 );
+    entitytainer_add_child( entitytainer, 49, 50 );
+    entitytainer_add_child( entitytainer, 3, 4 );
+    ASSERT( entitytainer_get_depth( entitytainer, 50 ) == 7 );
+    ASSERT( entitytainer_get_root( entitytainer, 50 ) == 1 );
+    ASSERT( entitytainer_is_ancestor( entitytainer, 1, 50 ) );
+    ASSERT( entitytainer_is_ancestor( entitytainer, 9, 50 ) );
+    ASSERT( !entitytainer_is_ancestor( entitytainer, 6, 50 ) );
+
+    // Removed entities start over at the top
+    TheEntitytainerEntity removed[64];
+    ASSERT( entitytainer_remove_subtree( entitytainer, 5, removed, 64 ) == 26 );
+    check_depths( entitytainer, all, 12 );
+    ASSERT( entitytainer_get_depth( entitytainer, 50 ) == 0 );
+    ASSERT( entitytainer_get_root( entitytainer, 50 ) == 50 );
+    entitytainer_add_entity( entitytainer, 6 );
+    entitytainer_add_child( entitytainer, 6, 7 );
+    check_depths( entitytainer, all, 12 );
+    ASSERT( entitytainer_get_depth( entitytainer, 7 ) == 1 );
+
+    // The depths move along when growing
+    int   grown_size   = entitytainer_realloc_needed_size( entitytainer, 2.0f );
+    void* grown_memory = malloc( grown_size );
+    entitytainer       = entitytainer_realloc( entitytainer, grown_memory, grown_size, 2.0f );
+    check_depths( entitytainer, all, 12 );
+    ASSERT( entitytainer_get_depth( entitytainer, 4 ) == 3 );
+
+    free( grown_memory );
+    free( config.memory );
+}
+
+static void
+check_order( TheEntitytainer* entitytainer, int num_entities_expected, int first_dirty_expected ) {
+    // Parents before children, every entity once.
+    int                    num_entities;
+    int                    first_dirty;
+    TheEntitytainerEntity* order = entitytainer_get_topological_order( entitytainer, &num_entities, &first_dirty );
+    ASSERT( num_entities == num_entities_expected );
+    ASSERT( first_dirty == first_dirty_expected || first_dirty_expected == -1 );
+    for ( int i = 0; i < num_entities; ++i ) {
+        TheEntitytainerEntity parent = entitytainer_get_parent( entitytainer, order[i] );
+        ASSERT( order[i] != ENTITYTAINER_InvalidEntity );
+        for ( int i_after = i; i_after < num_entities; ++i_after ) {
+            ASSERT( order[i_after] != parent );
+            ASSERT( order[i_after] != order[i] || i_after == i );
+        }
+    }
+
+    entitytainer_get_topological_order( entitytainer, &num_entities, &first_dirty );
+    ASSERT( first_dirty == num_entities );
+}
+
+static void
+do_order_tests( bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 16;
+    config.num_bucket_lists             = 2;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    config.track_order                  = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer*       entitytainer = entitytainer_create( &config );
+    int                    num_entities;
+    int                    first_dirty;
+    TheEntitytainerEntity* order = entitytainer_get_topological_order( entitytainer, &num_entities, &first_dirty );
+    ASSERT( num_entities == 0 );
+
+    // A subtree that's built before its parent exists
+    entitytainer_add_entity( entitytainer, 5 );
+    entitytainer_add_entity( entitytainer, 6 );
+    entitytainer_add_child( entitytainer, 5, 6 );
+    entitytainer_add_child( entitytainer, 6, 7 );
+    entitytainer_add_child( entitytainer, 5, 8 );
+    entitytainer_add_entity( entitytainer, 1 );
+    entitytainer_add_child( entitytainer, 1, 2 );
+    check_order( entitytainer, 6, 0 );
+
+    // Attaching it moves it after the parent, only from the first moved one is dirty
+    entitytainer_add_child( entitytainer, 1, 5 );
+    check_order( entitytainer, 6, 0 );
+    order = entitytainer_get_topological_order( entitytainer, &num_entities, &first_dirty );
+    ASSERT( order[0] == 1 && order[1] == 2 && order[2] == 5 && order[3] == 6 && order[4] == 7 && order[5] == 8 );
+
+    // Appending children doesn't move anything
+    entitytainer_add_entity( entitytainer, 2 );
+    entitytainer_add_child( entitytainer, 2, 3 );
+    check_order( entitytainer, 7, 6 );
+    entitytainer_add_entity( entitytainer, 3 );
+    check_order( entitytainer, 7, 7 );
+
+    // A child after its parent stays put
+    if ( remove_with_holes ) {
+        entitytainer_remove_child_with_holes( entitytainer, 6, 7 );
+    }
+    else {
+        entitytainer_remove_child_no_holes( entitytainer, 6, 7 );
+    }
+
+    check_order( entitytainer, 6, 4 );
+    entitytainer_add_entity( entitytainer, 9 );
+    entitytainer_add_child( entitytainer, 9, 7 );
+    check_order( entitytainer, 8, 6 );
+    entitytainer_add_child( entitytainer, 3, 9 );
+    check_order( entitytainer, 8, 8 );
+
+    const TheEntitytainerEntity batch[] = { 20, 21, 22 };
+    entitytainer_add_entity( entitytainer, 8 );
+    entitytainer_add_children( entitytainer, 8, batch, 3 );
+    check_order( entitytainer, 11, 8 );
+    entitytainer_remove_children( entitytainer, 8, batch, 3 );
+    check_order( entitytainer, 8, 8 );
+
+    TheEntitytainerEntity removed[64];
+    ASSERT( entitytainer_remove_subtree( entitytainer, 2, removed, 64 ) == 4 );
+    check_order( entitytainer, 4, 1 );
+    entitytainer_remove_entity( entitytainer, 8 );
+    check_order( entitytainer, 3, -1 );
+
+    // Lots of churn, so the holes have to be compacted while adding
+    for ( int i = 0; i < 500; ++i ) {
+        entitytainer_add_child( entitytainer, 1, (TheEntitytainerEntity)( 10 + i % 40 ) );
+        if ( i % 40 == 39 ) {
+            for ( TheEntitytainerEntity i_child = 10; i_child < 50; ++i_child ) {
+                entitytainer_remove_entity( entitytainer, i_child );
+            }
+        }
+    }
+
+    check_order( entitytainer, 23, -1 );
+
+    int   grown_size   = entitytainer_realloc_needed_size( entitytainer, 2.0f );
+    void* grown_memory = malloc( grown_size );
+    entitytainer       = entitytainer_realloc( entitytainer, grown_memory, grown_size, 2.0f );
+    check_order( entitytainer, 23, -1 );
+    entitytainer_add_child( entitytainer, 6, 60 );
+    check_order( entitytainer, 24, 23 );
+
+    free( grown_memory );
+    free( config.memory );
+}
+
+static void
+do_concurrency_tests( void ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 8;
+    config.bucket_list_sizes[1]         = 8;
+    config.num_bucket_lists             = 2;
+    config.defer_bucket_frees           = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer*           entitytainer = entitytainer_create( &config );
+    TheEntitytainerBucketList* small_list   = &entitytainer->bucket_lists[0];
+
+    int sequence = entitytainer_read_begin( entitytainer );
+    ASSERT( !entitytainer_read_retry( entitytainer, sequence ) );
+
+    entitytainer_write_begin( entitytainer );
+    ASSERT( entitytainer->sequence == sequence + 1 );
+    entitytainer_add_entity( entitytainer, 1 );
+    entitytainer_add_child( entitytainer, 1, 2 );
+    entitytainer_add_child( entitytainer, 1, 3 );
+    entitytainer_write_end( entitytainer );
+    ASSERT( entitytainer_read_retry( entitytainer, sequence ) );
+
+    sequence = entitytainer_read_begin( entitytainer );
+    ASSERT( ( sequence & 1 ) == 0 );
+    TheEntitytainerEntity* old_children;
+    int                    num_children;
+    int                    capacity;
+    entitytainer_get_children( entitytainer, 1, &old_children, &num_children, &capacity );
+    ASSERT( !entitytainer_read_retry( entitytainer, sequence ) );
+    ASSERT( num_children == 2 );
+    int used_buckets = small_list->used_buckets;
+
+    // Growing moves the children to a bigger bucket, but the old one is only retired
+    entitytainer_write_begin( entitytainer );
+    entitytainer_add_child( entitytainer, 1, 4 );
+    entitytainer_add_child( entitytainer, 1, 5 );
+    entitytainer_write_end( entitytainer );
+    ASSERT( entitytainer_read_retry( entitytainer, sequence ) );
+    ASSERT( small_list->used_buckets == used_buckets );
+    ASSERT( small_list->first_free_bucket == (int)ENTITYTAINER_NoFreeBucket );
+    ASSERT( old_children[0] == 2 && old_children[1] == 3 );
+
+    // ...so it isn't handed out again
+    entitytainer_add_entity( entitytainer, 10 );
+    entitytainer_add_child( entitytainer, 10, 11 );
+    ASSERT( small_list->used_buckets == used_buckets + 1 );
+    ASSERT( old_children[0] == 2 && old_children[1] == 3 );
+
+    entitytainer_remove_entity( entitytainer, 11 );
+    entitytainer_remove_entity( entitytainer, 10 );
+    ASSERT( small_list->used_buckets == used_buckets + 1 );
+
+    entitytainer_reclaim_buckets( entitytainer );
+    ASSERT( small_list->used_buckets == used_buckets - 1 );
+    ASSERT( small_list->first_retired_bucket == (int)ENTITYTAINER_NoFreeBucket );
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 4 );
+
+    // Reclaimed buckets are handed out again
+    int reused_bucket = small_list->first_free_bucket;
+    entitytainer_add_entity( entitytainer, 10 );
+    entitytainer_add_child( entitytainer, 10, 11 );
+    ASSERT( small_list->used_buckets == used_buckets );
+    ASSERT( small_list->first_free_bucket != reused_bucket );
+
+    free( config.memory );
+}
+
+static void
+do_command_tests( bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 16;
+    config.bucket_list_sizes[0]         = 32;
+    config.bucket_list_sizes[1]         = 8;
+    config.bucket_list_sizes[2]         = 8;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.track_depth                  = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer*             entitytainer = entitytainer_create( &config );
+    TheEntitytainerCommand       commands[2][16];
+    TheEntitytainerCommandBuffer buffers[2];
+    entitytainer_command_buffer_init( &buffers[0], commands[0], 16 );
+    entitytainer_command_buffer_init( &buffers[1], commands[1], 16 );
+
+    // Nothing happens until the commands are applied
+    ASSERT( entitytainer_record_add_entity( &buffers[0], 1 ) );
+    ASSERT( entitytainer_record_add_entity( &buffers[1], 2 ) );
+    for ( TheEntitytainerEntity child = 10; child < 16; ++child ) {
+        ASSERT( entitytainer_record_add_child( &buffers[child % 2], 1, child ) );
+    }
+
+    ASSERT( entitytainer_record_add_child( &buffers[0], 2, 20 ) );
+    ASSERT( entitytainer_record_add_child( &buffers[1], 2, 10 ) ); // 1 got it first
+    ASSERT( entitytainer_record_add_child( &buffers[1], 3, 21 ) ); // 3 isn't added
+    ASSERT( entitytainer_record_add_entity( &buffers[1], 1 ) );    // Already added
+    ASSERT( !entitytainer_is_added( entitytainer, 1 ) );
+
+    TheEntitytainerCommand conflicts[8];
+    int                    scratch_size = entitytainer_apply_commands_needed_size( buffers, 2 );
+    void*                  scratch      = malloc( scratch_size );
+    ASSERT( entitytainer_apply_commands( entitytainer, buffers, 2, scratch, scratch_size, conflicts, 8 ) == 3 );
+    ASSERT( buffers[0].num_commands == 0 && buffers[1].num_commands == 0 );
+    ASSERT( conflicts[0].type == ENTITYTAINER_CommandAddEntity && conflicts[0].entity == 1 );
+    ASSERT( conflicts[1].type == ENTITYTAINER_CommandAddChild && conflicts[1].parent == 2 && conflicts[1].entity == 10 );
+    ASSERT( conflicts[2].type == ENTITYTAINER_CommandAddChild && conflicts[2].parent == 3 );
+
+    // All six children went straight into the 8 bucket list, in the order they were recorded
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, 1 )];
+    ASSERT( ( lookup >> entitytainer->entry_list_shift ) == 1 );
+    ASSERT( entitytainer->bucket_lists[1].used_buckets == 1 );
+    ASSERT( entitytainer->bucket_lists[0].used_buckets == 2 );
+    for ( TheEntitytainerEntity child = 10; child < 16; ++child ) {
+        ASSERT( entitytainer_get_child_index( entitytainer, 1, child ) == (int)( ( child % 2 ) * 3 + ( child - 10 ) / 2 ) );
+        ASSERT( entitytainer_get_depth( entitytainer, child ) == 1 );
+    }
+
+    ASSERT( entitytainer_get_parent( entitytainer, 20 ) == 2 );
+    ASSERT( entitytainer_get_parent( entitytainer, 21 ) == ENTITYTAINER_InvalidEntity );
+
+    // Reparenting in one go: removes are applied before adds
+    entitytainer_record_remove_child( &buffers[0], 1, 10 );
+    entitytainer_record_remove_child( &buffers[1], 1, 10 ); // Twice
+    entitytainer_record_remove_child( &buffers[1], 2, 11 ); // Not its parent
+    entitytainer_record_add_child( &buffers[1], 2, 10 );
+    entitytainer_record_add_entity( &buffers[0], 20 );
+    entitytainer_record_add_child( &buffers[0], 20, 2 ); // Would make a cycle
+    entitytainer_record_add_child( &buffers[0], 20, 20 );
+    entitytainer_record_remove_entity( &buffers[1], 1 ); // Still has children
+    entitytainer_record_remove_child( &buffers[0], 1, 15 );
+    entitytainer_record_remove_entity( &buffers[0], 15 );
+    scratch_size = entitytainer_apply_commands_needed_size( buffers, 2 );
+    scratch      = realloc( scratch, scratch_size );
+    ASSERT( entitytainer_apply_commands( entitytainer, buffers, 2, scratch, scratch_size, conflicts, 2 ) == 5 );
+    ASSERT( conflicts[0].type == ENTITYTAINER_CommandRemoveChild && conflicts[0].entity == 11 ); // 2 is in list 0
+    ASSERT( conflicts[1].type == ENTITYTAINER_CommandRemoveChild && conflicts[1].entity == 10 );
+    ASSERT( entitytainer_get_parent( entitytainer, 10 ) == 2 );
+    ASSERT( entitytainer_get_parent( entitytainer, 15 ) == ENTITYTAINER_InvalidEntity );
+    ASSERT( entitytainer_get_parent( entitytainer, 2 ) == ENTITYTAINER_InvalidEntity );
+    ASSERT( entitytainer_get_depth( entitytainer, 10 ) == 1 );
+    ASSERT( entitytainer_is_added( entitytainer, 1 ) );
+    ASSERT( entitytainer_is_added( entitytainer, 20 ) );
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 4 );
+    ASSERT( entitytainer_num_children( entitytainer, 2 ) == 2 );
+
+    // Full buffers say so
+    for ( int i = 0; i < 16; ++i ) {
+        ASSERT( entitytainer_record_add_entity( &buffers[0], (TheEntitytainerEntity)( 30 + i ) ) );
+    }
+
+    ASSERT( !entitytainer_record_add_entity( &buffers[0], 50 ) );
+    scratch_size = entitytainer_apply_commands_needed_size( buffers, 2 );
+    scratch      = realloc( scratch, scratch_size );
+    ASSERT( entitytainer_apply_commands( entitytainer, buffers, 2, scratch, scratch_size, NULL, 0 ) == 0 );
+    ASSERT( entitytainer_is_added( entitytainer, 45 ) );
+    ASSERT( !entitytainer_is_added( entitytainer, 50 ) );
+
+    free( scratch );
+    free( config.memory );
+}
+
+static void
+do_batch_query_tests( bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 64;
+    config.bucket_list_sizes[1]         = 256;
+    config.num_bucket_lists             = 2;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    // 40 parents with 0-19 children each, so some are chained
+    TheEntitytainer*      entitytainer = entitytainer_create( &config );
+    TheEntitytainerEntity child        = 100;
+    for ( TheEntitytainerEntity parent = 1; parent <= 40; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+        for ( int i = 0; i < (int)( parent * 7 ) % 20; ++i ) {
+            entitytainer_add_child( entitytainer, parent, child++ );
+        }
+    }
+
+    if ( remove_with_holes ) {
+        TheEntitytainerEntity* children;
+        int                    num_children;
+        int                    capacity;
+        entitytainer_get_children( entitytainer, 5, &children, &num_children, &capacity );
+        entitytainer_remove_child_with_holes( entitytainer, 5, children[1] );
+    }
+
+    // More than one batch, out of order and with repeats
+    TheEntitytainerEntity    parents[90];
+    TheEntitytainerChildSpan spans[90];
+    int                      counts[90];
+    for ( int i = 0; i < 90; ++i ) {
+        parents[i] = (TheEntitytainerEntity)( 1 + ( i * 17 ) % 40 );
+    }
+
+    entitytainer_get_children_batch( entitytainer, parents, 90, spans );
+    entitytainer_num_children_batch( entitytainer, parents, 90, counts );
+    for ( int i = 0; i < 90; ++i ) {
+        TheEntitytainerChildSpan span;
+        entitytainer_get_child_span( entitytainer, parents[i], &span );
+        ASSERT( spans[i].children == span.children );
+        ASSERT( spans[i].num_children == span.num_children );
+        ASSERT( spans[i].capacity == span.capacity );
+        ASSERT( spans[i].num_children_left == span.num_children_left );
+        ASSERT( spans[i].next_page == span.next_page );
+        ASSERT( counts[i] == entitytainer_num_children( entitytainer, parents[i] ) );
+
+        int num_children = 0;
+        do {
+            for ( int i_child = 0; i_child < spans[i].num_children; ++i_child ) {
+                num_children += spans[i].children[i_child] != ENTITYTAINER_InvalidEntity;
+            }
+        } while ( entitytainer_next_child_span( entitytainer, spans + i ) );
+
+        ASSERT( num_children == counts[i] );
+    }
+
+    entitytainer_get_children_batch( entitytainer, parents, 0, spans );
+    free( config.memory );
+}
+
+static void
+check_defragmented( TheEntitytainer* entitytainer, const int* num_children, int num_parents ) {
+    // Buckets in parent order, pages right after their head, no gaps and nothing in the free lists.
+    int targets[ENTITYTAINER_MAX_BUCKET_LISTS] = { 1 };
+    for ( TheEntitytainerEntity parent = 1; parent <= (TheEntitytainerEntity)num_parents; ++parent ) {
+        check_child_indices( entitytainer, parent, num_children[parent] );
+        TheEntitytainerEntry lookup            = entitytainer->entry_lookup[parent];
+        int                  bucket_list_index = lookup >> entitytainer->entry_list_shift;
+        ASSERT( (int)( lookup & entitytainer->entry_bucket_mask ) == targets[bucket_list_index]++ );
+
+        TheEntitytainerBucketList* bucket_list = &entitytainer->bucket_lists[bucket_list_index];
+        TheEntitytainerChildSpan   span;
+        entitytainer_get_child_span( entitytainer, parent, &span );
+        while ( span.next_page != NULL ) {
+            ASSERT( span.next_page == bucket_list->bucket_data + targets[bucket_list_index]++ * bucket_list->bucket_size );
+            entitytainer_next_child_span( entitytainer, &span );
+        }
+    }
+
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        ASSERT( entitytainer->bucket_lists[i_bl].used_buckets == targets[i_bl] );
+        ASSERT( entitytainer->bucket_lists[i_bl].first_free_bucket == (int)ENTITYTAINER_NoFreeBucket );
+    }
+}
+
+static void
+do_defragment_tests( bool remove_with_holes ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 12;
+    config.bucket_list_sizes[0]         = 32;
+    config.bucket_list_sizes[1]         = 32;
+    config.bucket_list_sizes[2]         = 64;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.chain_last_bucket_list       = true;
+    config.track_child_index            = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    // Grow and shrink the parents in a scrambled order, so their buckets end up all over the place
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    int              num_children[21] = { 0 };
+    for ( TheEntitytainerEntity parent = 1; parent <= 20; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+    }
+
+    TheEntitytainerEntity next_child = 100;
+    for ( int i = 0; i < 300; ++i ) {
+        TheEntitytainerEntity parent = (TheEntitytainerEntity)( 1 + ( i * 7 + i / 20 ) % 20 );
+        if ( i % 3 == 2 && num_children[parent] > 0 ) {
+            TheEntitytainerChildSpan span;
+            entitytainer_get_child_span( entitytainer, parent, &span );
+            int i_child = 0;
+            while ( span.children[i_child] == ENTITYTAINER_InvalidEntity ) {
+                ++i_child;
+            }
+
+            entitytainer_remove_entity( entitytainer, span.children[i_child] );
+            --num_children[parent];
+        }
+        else if ( num_children[parent] < (int)( 3 + parent % 5 * 6 ) ) {
+            entitytainer_add_child( entitytainer, parent, next_child++ );
+            ++num_children[parent];
+        }
+    }
+
+    int   scratch_size = entitytainer_defragment_needed_size( entitytainer );
+    void* scratch      = malloc( scratch_size );
+    int   num_calls    = 1;
+    while ( !entitytainer_defragment( entitytainer, 3, scratch, scratch_size ) ) {
+        ++num_calls;
+        for ( TheEntitytainerEntity parent = 1; parent <= 20; ++parent ) {
+            check_child_indices( entitytainer, parent, num_children[parent] );
+        }
+    }
+
+    ASSERT( num_calls > 2 );
+    check_defragmented( entitytainer, num_children, 20 );
+    ASSERT( entitytainer_defragment( entitytainer, 0, scratch, scratch_size ) );
+
+    // Changes in between calls are fine
+    entitytainer_remove_entity( entitytainer, entitytainer_get_parent( entitytainer, 100 ) == 0 ? 101 : 100 );
+    for ( TheEntitytainerEntity parent = 1; parent <= 20; ++parent ) {
+        num_children[parent] = entitytainer_num_children( entitytainer, parent );
+        if ( remove_with_holes ) {
+            num_children[parent] = 0;
+            TheEntitytainerChildSpan span;
+            entitytainer_get_child_span( entitytainer, parent, &span );
+            do {
+                for ( int i_child = 0; i_child < span.num_children; ++i_child ) {
+                    num_children[parent] += span.children[i_child] != ENTITYTAINER_InvalidEntity;
+                }
+            } while ( entitytainer_next_child_span( entitytainer, &span ) );
+        }
+    }
+
+    for ( int i = 0; i < 6; ++i ) {
+        entitytainer_add_child( entitytainer, 4, next_child++ );
+        ++num_children[4];
+        entitytainer_defragment( entitytainer, 1, scratch, scratch_size );
+    }
+
+    while ( !entitytainer_defragment( entitytainer, 2, scratch, scratch_size ) ) {
+    }
+
+    check_defragmented( entitytainer, num_children, 20 );
+
+    // And the free lists work afterwards
+    entitytainer_add_entity( entitytainer, 30 );
+    entitytainer_add_child( entitytainer, 30, next_child++ );
+    ASSERT( entitytainer_get_parent( entitytainer, (TheEntitytainerEntity)( next_child - 1 ) ) == 30 );
+
+    free( scratch );
+    free( config.memory );
+}
+
+static void
+check_same_hierarchy( TheEntitytainer* entitytainer_a, TheEntitytainer* entitytainer_b, int max_entity ) {
+    for ( TheEntitytainerEntity entity = 1; entity <= (TheEntitytainerEntity)max_entity; ++entity ) {
+        ASSERT( entitytainer_is_added( entitytainer_a, entity ) == entitytainer_is_added( entitytainer_b, entity ) );
+        ASSERT( entitytainer_get_parent( entitytainer_a, entity ) == entitytainer_get_parent( entitytainer_b, entity ) );
+        ASSERT( entitytainer_get_depth( entitytainer_a, entity ) == entitytainer_get_depth( entitytainer_b, entity ) );
+        if ( !entitytainer_is_added( entitytainer_a, entity ) ) {
+            continue;
+        }
+
+        // Same children in the same order
+        TheEntitytainerEntity    children[2][64];
+        int                      num_children[2] = { 0, 0 };
+        TheEntitytainer*         entitytainers[2] = { entitytainer_a, entitytainer_b };
+        TheEntitytainerChildSpan span;
+        for ( int i = 0; i < 2; ++i ) {
+            entitytainer_get_child_span( entitytainers[i], entity, &span );
+            do {
+                for ( int i_child = 0; i_child < span.num_children; ++i_child ) {
+                    if ( span.children[i_child] != ENTITYTAINER_InvalidEntity ) {
+                        children[i][num_children[i]++] = span.children[i_child];
+                    }
+                }
+            } while ( entitytainer_next_child_span( entitytainers[i], &span ) );
+        }
+
+        ASSERT( num_children[0] == num_children[1] );
+        ASSERT( memcmp( children[0], children[1], num_children[0] * sizeof( TheEntitytainerEntity ) ) == 0 );
+    }
+
+    int                    num_a;
+    int                    num_b;
+    int                    first_dirty;
+    TheEntitytainerEntity* order_a = entitytainer_get_topological_order( entitytainer_a, &num_a, &first_dirty );
+    TheEntitytainerEntity* order_b = entitytainer_get_topological_order( entitytainer_b, &num_b, &first_dirty );
+    ASSERT( num_a == num_b );
+    ASSERT( memcmp( order_a, order_b, num_a * sizeof( TheEntitytainerEntity ) ) == 0 );
+}
+
+static void
+do_compact_save_tests( bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 12;
+    config.bucket_list_sizes[0]         = 256;
+    config.bucket_list_sizes[1]         = 64;
+    config.bucket_list_sizes[2]         = 64;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    config.track_depth                  = true;
+    config.track_order                  = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    for ( TheEntitytainerEntity parent = 1; parent <= 10; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+        for ( TheEntitytainerEntity i_child = 0; i_child < parent * 2; ++i_child ) {
+            entitytainer_add_child( entitytainer, parent, (TheEntitytainerEntity)( parent * 20 + i_child ) );
+        }
+    }
+
+    entitytainer_add_entity( entitytainer, 300 );
+    entitytainer_add_child( entitytainer, 300, 1 );
+    entitytainer_remove_entity( entitytainer, 42 );
+    entitytainer_remove_entity( entitytainer, 161 );
+    entitytainer_remove_entity( entitytainer, 3 * 20 + 2 );
+
+    int full_size    = entitytainer_save( entitytainer, NULL, 0 );
+    int compact_size = entitytainer_save_compact( entitytainer, NULL, 0 );
+    ASSERT( compact_size * 4 < full_size );
+    unsigned char* buffer = malloc( compact_size );
+    ASSERT( entitytainer_save_compact( entitytainer, buffer, compact_size ) == compact_size );
+
+    // Not a compact save, or cut short
+    struct TheEntitytainerConfig loaded_config;
+    ASSERT( !entitytainer_load_compact_config( (unsigned char*)config.memory, compact_size, &loaded_config ) );
+    ASSERT( !entitytainer_load_compact_config( buffer, compact_size - 1, &loaded_config ) );
+    ASSERT( entitytainer_load_compact_config( buffer, compact_size, &loaded_config ) );
+    ASSERT( loaded_config.num_entries == 512 && loaded_config.bucket_list_sizes[1] == 64 );
+    ASSERT( loaded_config.remove_with_holes == remove_with_holes && loaded_config.track_order );
+
+    // Same size
+    loaded_config.memory_size = entitytainer_needed_size( &loaded_config );
+    loaded_config.memory      = malloc( loaded_config.memory_size );
+    TheEntitytainer* loaded   = entitytainer_load_compact( buffer, compact_size, &loaded_config );
+    check_same_hierarchy( entitytainer, loaded, 310 );
+
+    // Bigger
+    struct TheEntitytainerConfig grown_config;
+    entitytainer_load_compact_config( buffer, compact_size, &grown_config );
+    grown_config.num_entries          = 1024;
+    grown_config.bucket_sizes[0]      = 6;
+    grown_config.bucket_list_sizes[0] = 512;
+    grown_config.bucket_list_sizes[2] = 128;
+    grown_config.memory_size          = entitytainer_needed_size( &grown_config );
+    grown_config.memory               = malloc( grown_config.memory_size );
+    TheEntitytainer* grown            = entitytainer_load_compact( buffer, compact_size, &grown_config );
+    check_same_hierarchy( entitytainer, grown, 310 );
+
+    // Both keep working
+    entitytainer_add_child( entitytainer, 5, 400 );
+    entitytainer_add_child( grown, 5, 400 );
+    entitytainer_add_entity( entitytainer, 401 );
+    entitytainer_add_entity( grown, 401 );
+    entitytainer_remove_entity( entitytainer, 101 );
+    entitytainer_remove_entity( grown, 101 );
+    check_same_hierarchy( entitytainer, grown, 410 );
+
+    free( grown_config.memory );
+    free( loaded_config.memory );
+    free( buffer );
+    free( config.memory );
+}
+
+static void
+do_view_tests( bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 12;
+    config.bucket_list_sizes[0]         = 256;
+    config.bucket_list_sizes[1]         = 64;
+    config.bucket_list_sizes[2]         = 64;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    config.track_depth                  = true;
+    config.track_order                  = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    for ( TheEntitytainerEntity parent = 1; parent <= 10; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+        for ( TheEntitytainerEntity i_child = 0; i_child < parent * 2; ++i_child ) {
+            entitytainer_add_child( entitytainer, parent, (TheEntitytainerEntity)( parent * 20 + i_child ) );
+        }
+    }
+
+    entitytainer_add_child( entitytainer, 1, 300 );
+    entitytainer_remove_entity( entitytainer, 42 );
+    entitytainer_remove_entity( entitytainer, 161 );
+
+    // Getting the order compacts its holes, which would write to the buffer, so do that before saving.
+    int                    num_entities;
+    int                    first_dirty;
+    TheEntitytainerEntity* order = entitytainer_get_topological_order( entitytainer, &num_entities, &first_dirty );
+    (void)order;
+
+    int            save_size = entitytainer_save( entitytainer, NULL, 0 );
+    unsigned char* buffer    = malloc( save_size );
+    unsigned char* pristine  = malloc( save_size );
+    entitytainer_save( entitytainer, buffer, save_size );
+    memcpy( pristine, buffer, save_size );
+
+    TheEntitytainerView view;
+    TheEntitytainer*    viewed = entitytainer_view( buffer, save_size, &view );
+    ASSERT( (unsigned char*)viewed != buffer );
+    check_same_hierarchy( entitytainer, viewed, 310 );
+
+    TheEntitytainerEntity subtree[2][512];
+    int                   num_subtree = entitytainer_get_subtree( entitytainer, 1, subtree[0], 512, true );
+    ASSERT( num_subtree == entitytainer_get_subtree( viewed, 1, subtree[1], 512, true ) );
+    ASSERT( memcmp( subtree[0], subtree[1], num_subtree * sizeof( TheEntitytainerEntity ) ) == 0 );
+    ASSERT( entitytainer_is_ancestor( viewed, 1, 300 ) );
+
+    // None of it touched the buffer
+    ASSERT( memcmp( buffer, pristine, save_size ) == 0 );
+
+    // Copying it out gives a normal, writable entitytainer
+    struct TheEntitytainerConfig copy_config = config;
+    copy_config.memory                       = malloc( needed_memory_size );
+    TheEntitytainer* copied                  = entitytainer_create( &copy_config );
+    entitytainer_load_into( copied, viewed );
+    entitytainer_add_child( copied, 2, 400 );
+    ASSERT( entitytainer_get_parent( copied, 400 ) == 2 );
+    ASSERT( entitytainer_get_parent( viewed, 400 ) == ENTITYTAINER_InvalidEntity );
+    ASSERT( memcmp( buffer, pristine, save_size ) == 0 );
+
+    free( copy_config.memory );
+    free( pristine );
+    free( buffer );
+    free( config.memory );
+}
+
+static void
+check_same_memory( TheEntitytainer* entitytainer_a, TheEntitytainer* entitytainer_b ) {
+    int lookup_size  = entitytainer_a->entry_lookup_size;
+    int lookups_size = lookup_size * sizeof( TheEntitytainerEntry );
+    int column_size  = lookup_size * sizeof( TheEntitytainerEntity );
+    ASSERT( memcmp( entitytainer_a->entry_lookup, entitytainer_b->entry_lookup, lookups_size ) == 0 );
+    TheEntitytainerEntity* columns[2][ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( entitytainer_a, columns[0] );
+    entitytainer__entry_columns( entitytainer_b, columns[1] );
+    for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+        ASSERT( memcmp( columns[0][i_column], columns[1][i_column], column_size ) == 0 );
+    }
+
+    if ( entitytainer_a->hashed_lookup ) {
+        ASSERT( memcmp( entitytainer_a->entry_keys, entitytainer_b->entry_keys, column_size ) == 0 );
+        ASSERT( entitytainer_a->entry_hash_count == entitytainer_b->entry_hash_count );
+    }
+
+    ASSERT( entitytainer_a->order_count == entitytainer_b->order_count );
+    ASSERT( entitytainer_a->order_holes == entitytainer_b->order_holes );
+    ASSERT( memcmp( entitytainer_a->order,
+                    entitytainer_b->order,
+                    entitytainer_a->order_count * sizeof( TheEntitytainerEntity ) ) == 0 );
+    for ( int i_bl = 0; i_bl < entitytainer_a->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* list_a = entitytainer_a->bucket_lists + i_bl;
+        TheEntitytainerBucketList* list_b = entitytainer_b->bucket_lists + i_bl;
+        ASSERT( list_a->first_free_bucket == list_b->first_free_bucket );
+        ASSERT( list_a->used_buckets == list_b->used_buckets );
+        ASSERT( memcmp( list_a->bucket_data,
+                        list_b->bucket_data,
+                        list_a->total_buckets * list_a->bucket_size * sizeof( TheEntitytainerEntity ) ) == 0 );
+    }
+}
+
+static void
+do_delta_tests( bool remove_with_holes, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 12;
+    config.bucket_list_sizes[0]         = 512;
+    config.bucket_list_sizes[1]         = 128;
+    config.bucket_list_sizes[2]         = 256;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = true;
+    config.track_child_index            = true;
+    config.track_depth                  = true;
+    config.track_order                  = true;
+    config.track_dirty                  = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    // The replica doesn't have to track anything itself.
+    struct TheEntitytainerConfig replica_config = config;
+    replica_config.track_dirty                  = false;
+    replica_config.memory_size                  = entitytainer_needed_size( &replica_config );
+    replica_config.memory                       = malloc( replica_config.memory_size );
+
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    TheEntitytainer* replica      = entitytainer_create( &replica_config );
+    ASSERT( entitytainer_get_generation( entitytainer ) == 0 );
+
+    int            full_size   = entitytainer_save( entitytainer, NULL, 0 );
+    int            buffer_size = full_size * 2;
+    unsigned char* buffer      = malloc( buffer_size );
+    unsigned int   random      = 1234;
+    for ( int i_round = 0; i_round < 40; ++i_round ) {
+        int num_ops = i_round < 10 ? 400 : 20;
+        for ( int i_op = 0; i_op < num_ops; ++i_op ) {
+            random                       = random * 1103515245u + 12345u;
+            TheEntitytainerEntity entity = (TheEntitytainerEntity)( 1 + ( random >> 8 ) % 300 );
+            random                       = random * 1103515245u + 12345u;
+            TheEntitytainerEntity other  = (TheEntitytainerEntity)( 1 + ( random >> 8 ) % 300 );
+            bool                  added  = entitytainer_is_added( entitytainer, entity );
+            TheEntitytainerEntity parent = entitytainer_get_parent( entitytainer, entity );
+            switch ( ( random >> 4 ) % 6 ) {
+            case 0:
+                if ( !added ) {
+                    entitytainer_add_entity( entitytainer, entity );
+                }
+                break;
+            case 1:
+                if ( entitytainer_is_added( entitytainer, other ) && parent == ENTITYTAINER_InvalidEntity &&
+                     other != entity && !entitytainer_is_ancestor( entitytainer, entity, other ) ) {
+                    entitytainer_add_child( entitytainer, other, entity );
+                }
+                break;
+            case 2:
+                if ( parent != ENTITYTAINER_InvalidEntity ) {
+                    if ( remove_with_holes ) {
+                        entitytainer_remove_child_with_holes( entitytainer, parent, entity );
+                    }
+                    else {
+                        entitytainer_remove_child_no_holes( entitytainer, parent, entity );
+                    }
+                }
+                break;
+            case 3:
+                if ( !added || entitytainer_num_children( entitytainer, entity ) == 0 ) {
+                    entitytainer_remove_entity( entitytainer, entity );
+                }
+                break;
+            case 4:
+                if ( added && remove_with_holes ) {
+                    entitytainer_remove_holes( entitytainer, entity );
+                }
+                break;
+            case 5:
+                if ( added && ( random >> 12 ) % 8 == 0 ) {
+                    TheEntitytainerEntity removed[512];
+                    entitytainer_remove_subtree( entitytainer, entity, removed, 512 );
+                }
+                break;
+            }
+        }
+
+        if ( i_round % 7 == 6 ) {
+            int                    num_entities;
+            int                    first_dirty;
+            TheEntitytainerEntity* order;
+            order = entitytainer_get_topological_order( entitytainer, &num_entities, &first_dirty );
+            (void)order;
+        }
+
+        if ( i_round % 11 == 10 ) {
+            int   scratch_size = entitytainer_defragment_needed_size( entitytainer );
+            void* scratch      = malloc( scratch_size );
+            entitytainer_defragment( entitytainer, 8, scratch, scratch_size );
+            free( scratch );
+        }
+
+        int delta_size = entitytainer_save_delta( entitytainer, NULL, 0 );
+        ASSERT( delta_size <= buffer_size );
+        ASSERT( entitytainer_save_delta( entitytainer, buffer, buffer_size ) == delta_size );
+        if ( i_round >= 10 && i_round % 7 != 6 ) {
+            // Small changes, small deltas. Compacting the order renumbers everything after the first hole though.
+            ASSERT( delta_size * 10 < full_size );
+        }
+
+        ASSERT( entitytainer_apply_delta( replica, buffer, delta_size ) );
+        entitytainer_clear_dirty( entitytainer );
+        ASSERT( entitytainer_get_generation( replica ) == i_round + 1 );
+        ASSERT( entitytainer_get_generation( entitytainer ) == i_round + 1 );
+        check_same_memory( entitytainer, replica );
+
+        // Not again, and not cut short
+        ASSERT( !entitytainer_apply_delta( replica, buffer, delta_size ) );
+        ASSERT( !entitytainer_apply_delta( replica, buffer, delta_size - 1 ) );
+    }
+
+    // Nothing changed, so only the header
+    ASSERT( entitytainer_save_delta( entitytainer, NULL, 0 ) == (int)sizeof( TheEntitytainerDeltaHeader ) );
+    check_same_hierarchy( entitytainer, replica, 300 );
+
+    free( buffer );
+    free( replica_config.memory );
+    free( config.memory );
+}
+
+static TheEntitytainer*
+create_for_rehash( int num_entries, bool track_dirty ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = num_entries;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 16;
+    config.bucket_sizes[2]              = 64;
+    config.bucket_list_sizes[0]         = 8;
+    config.bucket_list_sizes[1]         = 4;
+    config.bucket_list_sizes[2]         = 2;
+    config.num_bucket_lists             = 3;
+    config.hashed_lookup                = true;
+    config.remove_with_holes            = true;
+    config.track_occupancy              = true;
+    config.track_dirty                  = track_dirty;
+    config.memory_size                  = entitytainer_needed_size( &config );
+    config.memory                       = malloc( config.memory_size );
+    return entitytainer_create( &config );
+}
+
+static void
+check_rehashed_children( TheEntitytainer* entitytainer ) {
+    ASSERT( entitytainer_num_children( entitytainer, 1000 ) == 3 );
+    int                    seen = 0;
+    TheEntitytainerEntity* children;
+    int                    num_children;
+    int                    capacity;
+    entitytainer_get_children( entitytainer, 1000, &children, &num_children, &capacity );
+    for ( int i_child = 0; i_child < num_children; ++i_child ) {
+        ASSERT( children[i_child] >= 2000 && children[i_child] <= 2002 );
+        seen |= 1 << ( children[i_child] - 2000 );
+    }
+
+    ASSERT( seen == 7 );
+    for ( TheEntitytainerEntity child = 2000; child <= 2002; ++child ) {
+        ASSERT( entitytainer_get_parent( entitytainer, child ) == 1000 );
+    }
+}
+
+static void
+do_load_into_rehash_tests( void ) {
+    // load_into between hashed tables of different sizes rehashes, and the occupancy bits still need rebuilding.
+    TheEntitytainer* small = create_for_rehash( 16, false );
+    entitytainer_add_entity( small, 1000 );
+    entitytainer_add_child( small, 1000, 2000 );
+    entitytainer_add_child( small, 1000, 2001 );
+
+    TheEntitytainer* big = create_for_rehash( 64, false );
+    ASSERT( big->entry_lookup_size != small->entry_lookup_size );
+    entitytainer_load_into( big, small );
+    entitytainer_add_child( big, 1000, 2002 );
+    check_rehashed_children( big );
+
+    // Everything that was loaded is dirty too, so a delta brings an empty replica up to date. Clear goes through all
+    // of it as well.
+    TheEntitytainer* tracked = create_for_rehash( 64, true );
+    TheEntitytainer* replica = create_for_rehash( 64, false );
+    entitytainer_load_into( tracked, small );
+    entitytainer_add_child( tracked, 1000, 2002 );
+    int            delta_size = entitytainer_save_delta( tracked, NULL, 0 );
+    unsigned char* delta      = malloc( delta_size );
+    entitytainer_save_delta( tracked, delta, delta_size );
+    ASSERT( entitytainer_apply_delta( replica, delta, delta_size ) );
+    check_rehashed_children( replica );
+
+    entitytainer_clear( tracked );
+    ASSERT( !entitytainer_is_added( tracked, 1000 ) );
+    ASSERT( entitytainer_get_parent( tracked, 2000 ) == ENTITYTAINER_InvalidEntity );
+
+    free( delta );
+    free( replica->config.memory );
+    free( tracked->config.memory );
+    free( big->config.memory );
+    free( small->config.memory );
+}
+
+static void
+do_stats_tests( void ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 16;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 8;
+    config.bucket_list_sizes[2]         = 4;
+    config.num_bucket_lists             = 3;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    entitytainer_add_entity( entitytainer, 1 );
+    entitytainer_add_entity( entitytainer, 2 );
+    entitytainer_add_entity( entitytainer, 3 );
+    for ( TheEntitytainerEntity child = 10; child < 14; ++child ) {
+        entitytainer_add_child( entitytainer, 1, child );
+    }
+
+    entitytainer_remove_child_no_holes( entitytainer, 1, 13 );
+    entitytainer_remove_entity( entitytainer, 3 );
+
+    TheEntitytainerStats stats;
+    entitytainer_get_stats( entitytainer, &stats );
+    ASSERT( stats.num_bucket_lists == 3 );
+    ASSERT( stats.bucket_lists[0].bucket_size == 4 && stats.bucket_lists[0].total_buckets == 16 );
+
+    // 1 went up to the second list and back, and 3's bucket was freed. Bucket 0 of the first list counts as used.
+    ASSERT( stats.bucket_lists[0].used_buckets == 3 );
+    ASSERT( stats.bucket_lists[0].free_buckets == 1 );
+    ASSERT( stats.bucket_lists[0].high_water_buckets == 4 );
+    ASSERT( stats.bucket_lists[1].used_buckets == 0 );
+    ASSERT( stats.bucket_lists[1].free_buckets == 1 );
+    ASSERT( stats.bucket_lists[1].high_water_buckets == 1 );
+    ASSERT( stats.bucket_lists[2].high_water_buckets == 0 );
+#if defined( ENTITYTAINER_STATS )
+    ASSERT( stats.bucket_lists[1].promotions == 1 && stats.bucket_lists[1].demotions == 0 );
+    ASSERT( stats.bucket_lists[1].promotion_bytes == 4 * (long long)sizeof( TheEntitytainerEntity ) );
+    ASSERT( stats.bucket_lists[0].promotions == 0 && stats.bucket_lists[0].demotions == 1 );
+#else
+    ASSERT( stats.bucket_lists[1].promotions == 0 );
+#endif
+
+    ASSERT( stats.num_parents == 2 );
+    ASSERT( stats.max_children == 3 );
+    ASSERT( stats.child_count_histogram[0] == 1 );
+    ASSERT( stats.child_count_histogram[3] == 1 );
+
+    // Retired buckets are still used
+    entitytainer->defer_bucket_frees = true;
+    entitytainer_remove_entity( entitytainer, 2 );
+    entitytainer_get_stats( entitytainer, &stats );
+    ASSERT( stats.bucket_lists[0].used_buckets == 3 );
+    ASSERT( stats.bucket_lists[0].retired_buckets == 1 );
+    ASSERT( stats.num_parents == 1 );
+    entitytainer_reclaim_buckets( entitytainer );
+    entitytainer_get_stats( entitytainer, &stats );
+    ASSERT( stats.bucket_lists[0].used_buckets == 2 && stats.bucket_lists[0].free_buckets == 2 );
+    ASSERT( stats.bucket_lists[0].retired_buckets == 0 );
+
+    free( config.memory );
+}
+
+static void
+do_suggest_config_tests( void ) {
+    int histogram[ENTITYTAINER_StatsHistogramSize] = { 0 };
+    int num_bins                                    = 64;
+
+    // Everyone has three children, so one bucket list that fits them beats starting smaller and promoting.
+    histogram[3]                         = 100;
+    struct TheEntitytainerConfig config  = { 0 };
+    config.num_entries                   = 4096;
+    ASSERT( entitytainer_suggest_config( histogram, num_bins, 1 << 20, &config ) );
+    ASSERT( config.num_bucket_lists == 1 );
+    ASSERT( config.bucket_sizes[0] == 4 );
+    ASSERT( !config.chain_last_bucket_list );
+    ASSERT( config.bucket_list_sizes[0] > 101 );
+    ASSERT( entitytainer_needed_size( &config ) <= 1 << 20 );
+
+    // Not enough memory for the parents themselves
+    ASSERT( !entitytainer_suggest_config( histogram, num_bins, 1024, &config ) );
+    ASSERT( config.bucket_list_sizes[0] == 101 );
+
+    // Lots of small parents and some big ones in the last bin, which need chaining.
+    histogram[3]            = 0;
+    histogram[2]            = 1000;
+    histogram[20]           = 20;
+    histogram[num_bins - 1] = 4;
+    ASSERT( entitytainer_suggest_config( histogram, num_bins, 1 << 20, &config ) );
+    ASSERT( config.num_bucket_lists >= 2 );
+    ASSERT( config.bucket_sizes[0] == 3 );
+    ASSERT( config.chain_last_bucket_list );
+    for ( int i = 1; i < config.num_bucket_lists; ++i ) {
+        ASSERT( config.bucket_sizes[i] > config.bucket_sizes[i - 1] );
+    }
+
+    int needed_memory_size = entitytainer_needed_size( &config );
+    ASSERT( needed_memory_size <= 1 << 20 );
+    config.memory                 = malloc( needed_memory_size );
+    config.memory_size            = needed_memory_size;
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+
+    // It takes them all, with children past the last bin too.
+    TheEntitytainerEntity entity = 1;
+    for ( int i_bin = 0; i_bin < num_bins; ++i_bin ) {
+        for ( int i_parent = 0; i_parent < histogram[i_bin]; ++i_parent ) {
+            TheEntitytainerEntity parent = entity++;
+            entitytainer_add_entity( entitytainer, parent );
+            int num_children = i_bin == num_bins - 1 ? i_bin * 2 : i_bin;
+            for ( int i_child = 0; i_child < num_children; ++i_child ) {
+                entitytainer_add_child( entitytainer, parent, entity++ );
+            }
+        }
+    }
+
+    TheEntitytainerStats stats;
+    entitytainer_get_stats( entitytainer, &stats );
+    ASSERT( stats.num_parents == 1024 );
+    ASSERT( stats.child_count_histogram[2] == 1000 );
+    ASSERT( stats.max_children == ( num_bins - 1 ) * 2 );
+    for ( int i = 0; i < stats.num_bucket_lists; ++i ) {
+        ASSERT( stats.bucket_lists[i].used_buckets <= stats.bucket_lists[i].total_buckets );
+    }
+
+    free( config.memory );
+}
+
+static int
+demotion_capacity( TheEntitytainer* entitytainer, TheEntitytainerEntity parent ) {
+    int                    num_children;
+    int                    capacity;
+    TheEntitytainerEntity* children;
+    entitytainer_get_children( entitytainer, parent, &children, &num_children, &capacity );
+    return capacity;
+}
+
+static void
+do_demotion_tests( bool remove_with_holes, bool hashed_lookup, bool lazy_demotion ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 256;
+    config.bucket_sizes[0]              = 8;
+    config.bucket_sizes[1]              = 16;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 8;
+    config.demote_margins[0]            = 2;
+    config.num_bucket_lists             = 2;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.lazy_demotion                = lazy_demotion;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+
+    // Into the smaller list only if that leaves two free slots, and one more (the shrink margin) with holes.
+    int threshold = remove_with_holes ? 4 : 5;
+    for ( TheEntitytainerEntity parent = 1; parent <= 3; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+        for ( int i_child = 0; i_child < 8; ++i_child ) {
+            entitytainer_add_child( entitytainer, parent, (TheEntitytainerEntity)( parent * 16 + i_child ) );
+        }
+
+        ASSERT( demotion_capacity( entitytainer, parent ) == 15 );
+        for ( int i_child = 7; i_child >= threshold; --i_child ) {
+            TheEntitytainerEntity child = (TheEntitytainerEntity)( parent * 16 + i_child );
+            if ( remove_with_holes ) {
+                entitytainer_remove_child_with_holes( entitytainer, parent, child );
+            }
+            else {
+                entitytainer_remove_child_no_holes( entitytainer, parent, child );
+            }
+
+            bool demoted = i_child == threshold && !lazy_demotion;
+            ASSERT( demotion_capacity( entitytainer, parent ) == ( demoted ? 7 : 15 ) );
+        }
+    }
+
+    // It goes back up at 8, so this parent is not hovering at the boundary anymore.
+    if ( !lazy_demotion ) {
+        entitytainer_add_child( entitytainer, 1, 16 + 6 );
+        entitytainer_add_child( entitytainer, 1, 16 + 7 );
+        ASSERT( demotion_capacity( entitytainer, 1 ) == 7 );
+        free( config.memory );
+        return;
+    }
+
+    // Parent 3 grows again before maintain gets to it, so it stays.
+    for ( int i_child = threshold; i_child < 8; ++i_child ) {
+        entitytainer_add_child( entitytainer, 3, (TheEntitytainerEntity)( 3 * 16 + i_child ) );
+    }
+
+    // One at a time, in entry order (which isn't the entity order with hashed lookup)
+    ASSERT( !entitytainer_maintain( entitytainer, 0 ) );
+    ASSERT( !entitytainer_maintain( entitytainer, 1 ) );
+    ASSERT( demotion_capacity( entitytainer, 1 ) + demotion_capacity( entitytainer, 2 ) == 7 + 15 );
+    entitytainer_maintain( entitytainer, 1 ); // Depends on whether 3 comes before or after
+    ASSERT( demotion_capacity( entitytainer, 1 ) == 7 );
+    ASSERT( demotion_capacity( entitytainer, 2 ) == 7 );
+    ASSERT( entitytainer_maintain( entitytainer, 1 ) );
+    ASSERT( demotion_capacity( entitytainer, 3 ) == 15 );
+    for ( TheEntitytainerEntity parent = 1; parent <= 2; ++parent ) {
+        ASSERT( entitytainer_num_children( entitytainer, parent ) == threshold );
+        for ( int i_child = 0; i_child < threshold; ++i_child ) {
+            TheEntitytainerEntity child = (TheEntitytainerEntity)( parent * 16 + i_child );
+            ASSERT( entitytainer_get_parent( entitytainer, child ) == parent );
+            ASSERT( entitytainer_get_child_index( entitytainer, parent, child ) == i_child );
+        }
+    }
+
+    // Removed parents are skipped.
+    TheEntitytainerEntity children[8];
+    for ( int i_child = 0; i_child < 8; ++i_child ) {
+        children[i_child] = (TheEntitytainerEntity)( 3 * 16 + i_child );
+    }
+
+    entitytainer_remove_children( entitytainer, 3, children, 8 );
+    ASSERT( demotion_capacity( entitytainer, 3 ) == 15 );
+    entitytainer_remove_entity( entitytainer, 3 );
+    ASSERT( entitytainer_maintain( entitytainer, 8 ) );
+    ASSERT( !entitytainer_is_added( entitytainer, 3 ) );
+
+    // A full smaller list is the same as with eager demotion, the parent stays where it is.
+    entitytainer_add_entity( entitytainer, 5 );
+    for ( int i_child = 0; i_child < 8; ++i_child ) {
+        children[i_child] = (TheEntitytainerEntity)( 5 * 16 + i_child );
+    }
+
+    entitytainer_add_children( entitytainer, 5, children, 8 );
+    entitytainer_remove_children( entitytainer, 5, children + threshold, 8 - threshold );
+    for ( TheEntitytainerEntity entity = 100;
+          entitytainer->bucket_lists[0].used_buckets < entitytainer->bucket_lists[0].total_buckets;
+          ++entity ) {
+        entitytainer_add_entity( entitytainer, entity );
+    }
+
+    ASSERT( entitytainer_maintain( entitytainer, 8 ) );
+    ASSERT( demotion_capacity( entitytainer, 5 ) == 15 );
+    free( config.memory );
+}
+
+static void
+check_occupancy( TheEntitytainer* entitytainer, int max_entity ) {
+    // The iterator gives the same children as the spans, and the bits match the buckets.
+    for ( TheEntitytainerEntity parent = 1; parent <= (TheEntitytainerEntity)max_entity; ++parent ) {
+        if ( !entitytainer_is_added( entitytainer, parent ) ) {
+            continue;
+        }
+
+        TheEntitytainerChildIter iter;
+        TheEntitytainerChildSpan span;
+        TheEntitytainerEntity    child;
+        int                      index;
+        int                      first_index  = 0;
+        int                      num_children = 0;
+        entitytainer_children_iter( entitytainer, parent, &iter );
+        entitytainer_get_child_span( entitytainer, parent, &span );
+        do {
+            for ( int i = 0; i < span.num_children; ++i ) {
+                if ( span.children[i] != ENTITYTAINER_InvalidEntity ) {
+                    ASSERT( entitytainer_children_next( entitytainer, &iter, &child, &index ) );
+                    ASSERT( child == span.children[i] && index == first_index + i );
+                    ++num_children;
+                }
+            }
+
+            first_index += span.capacity;
+        } while ( entitytainer_next_child_span( entitytainer, &span ) );
+
+        ASSERT( !entitytainer_children_next( entitytainer, &iter, &child, NULL ) );
+        ASSERT( num_children == entitytainer_num_children( entitytainer, parent ) );
+
+        int                        lookup_index      = entitytainer__index( entitytainer, parent );
+        TheEntitytainerEntry       lookup            = entitytainer->entry_lookup[lookup_index];
+        int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+        int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+        TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+        const unsigned int*        bits = entitytainer__occupancy_bits( entitytainer, bucket_list_index, bucket_index );
+        ASSERT( ( bits == iter.occupancy ) );
+        if ( bits == NULL ) {
+            ASSERT( !entitytainer->track_occupancy || entitytainer__is_chained( entitytainer, bucket_list_index ) );
+            continue;
+        }
+
+        TheEntitytainerEntity* children = bucket_list->bucket_data + bucket_index * bucket_list->bucket_size + 1;
+        for ( int i = 0; i < bucket_list->bucket_size - 1; ++i ) {
+            bool occupied = ( ( bits[i >> 5] >> ( i & 31 ) ) & 1 ) != 0;
+            ASSERT( occupied == ( children[i] != ENTITYTAINER_InvalidEntity ) );
+        }
+    }
+}
+
+static void
+do_occupancy_tests( bool track_occupancy, bool chain_last_bucket_list ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 16;
+    config.bucket_sizes[2]              = 72; // More than two words of bits
+    config.bucket_list_sizes[0]         = 64;
+    config.bucket_list_sizes[1]         = 16;
+    config.bucket_list_sizes[2]         = 16;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = true;
+    config.chain_last_bucket_list       = chain_last_bucket_list;
+    config.track_child_index            = true;
+    config.track_occupancy              = track_occupancy;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+    ASSERT( ( entitytainer->occupancy[0] != NULL ) == track_occupancy );
+    ASSERT( ( entitytainer->occupancy[2] != NULL ) == ( track_occupancy && !chain_last_bucket_list ) );
+
+    // Grow and shrink a few parents with every kind of change, so they move between the lists with holes in them.
+    unsigned int random = 4321;
+    for ( TheEntitytainerEntity parent = 1; parent <= 8; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+    }
+
+    for ( int i = 0; i < 2000; ++i ) {
+        random                       = random * 1103515245u + 12345u;
+        TheEntitytainerEntity parent = (TheEntitytainerEntity)( 1 + ( random >> 8 ) % 8 );
+        TheEntitytainerEntity child  = (TheEntitytainerEntity)( 16 + ( random >> 12 ) % 400 );
+        TheEntitytainerEntity children[4];
+        int                   num_children = entitytainer_num_children( entitytainer, parent );
+        switch ( ( random >> 4 ) % 8 ) {
+        case 0:
+        case 1:
+        case 2:
+            if ( entitytainer_get_parent( entitytainer, child ) == 0 && num_children < 60 ) {
+                entitytainer_add_child( entitytainer, parent, child );
+            }
+            break;
+        case 3:
+        case 4:
+            if ( entitytainer_get_parent( entitytainer, child ) != 0 ) {
+                entitytainer_remove_entity( entitytainer, child );
+            }
+            break;
+        case 5: {
+            int num_free = 0;
+            for ( TheEntitytainerEntity other = child; other < child + 8 && num_free < 4; ++other ) {
+                if ( entitytainer_get_parent( entitytainer, other ) == 0 ) {
+                    children[num_free++] = other;
+                }
+            }
+
+            if ( num_children + num_free < 60 ) {
+                entitytainer_add_children( entitytainer, parent, children, num_free );
+            }
+            break;
+        }
+        case 6: {
+            TheEntitytainerChildIter iter;
+            int                      num_removed = 0;
+            entitytainer_children_iter( entitytainer, parent, &iter );
+            while ( num_removed < 4 && entitytainer_children_next( entitytainer, &iter, &child, NULL ) ) {
+                if ( ( random >> ( 16 + num_removed ) ) & 1 ) {
+                    children[num_removed++] = child;
+                }
+            }
+
+            entitytainer_remove_children( entitytainer, parent, children, num_removed );
+            break;
+        }
+        default:
+            if ( ( random >> 12 ) % 4 == 0 ) {
+                entitytainer_remove_holes( entitytainer, parent );
+            }
+            else if ( entitytainer_get_parent( entitytainer, child ) == 0 ) {
+                // Somewhere after the last child
+                TheEntitytainerChildIter iter;
+                TheEntitytainerEntity    other;
+                int                      index = -1;
+                entitytainer_children_iter( entitytainer, parent, &iter );
+                while ( entitytainer_children_next( entitytainer, &iter, &other, &index ) ) {
+                }
+
+                index += 1 + ( random >> 20 ) % 4;
+                if ( index < 60 ) {
+                    entitytainer_add_child_at_index( entitytainer, parent, child, index );
+                }
+            }
+            break;
+        }
+
+        check_occupancy( entitytainer, 8 );
+    }
+
+    // The bits are rebuilt when everything's replaced
+    int            compact_size = entitytainer_save_compact( entitytainer, NULL, 0 );
+    unsigned char* buffer       = malloc( compact_size );
+    entitytainer_save_compact( entitytainer, buffer, compact_size );
+    struct TheEntitytainerConfig loaded_config;
+    ASSERT( entitytainer_load_compact_config( buffer, compact_size, &loaded_config ) );
+    ASSERT( loaded_config.track_occupancy == track_occupancy );
+    loaded_config.memory_size = entitytainer_needed_size( &loaded_config );
+    loaded_config.memory      = malloc( loaded_config.memory_size );
+    TheEntitytainer* loaded   = entitytainer_load_compact( buffer, compact_size, &loaded_config );
+    check_occupancy( loaded, 8 );
+    entitytainer_add_child( loaded, 1, 500 );
+    check_occupancy( loaded, 8 );
+
+    // ...and follow the buckets around when defragmenting
+    int   scratch_size = entitytainer_defragment_needed_size( entitytainer );
+    void* scratch      = malloc( scratch_size );
+    while ( !entitytainer_defragment( entitytainer, 2, scratch, scratch_size ) ) {
+        check_occupancy( entitytainer, 8 );
+    }
+
+    check_occupancy( entitytainer, 8 );
+    free( scratch );
+    free( loaded_config.memory );
+    free( buffer );
+    free( config.memory );
+}
+
+static void
+check_bags( TheEntitytainer* entitytainer, const int* num_items, int num_entities ) {
+    // Bags are 1 to 4, everything else is an item or inside one.
+    TheEntitytainerEntity entities[128];
+    int                   num_checked = 0;
+    for ( TheEntitytainerEntity bag = 1; bag <= 4; ++bag ) {
+        check_child_indices( entitytainer, bag, num_items[bag] );
+        entities[num_checked++] = bag;
+
+        TheEntitytainerChildIter iter;
+        TheEntitytainerEntity    item;
+        entitytainer_children_iter( entitytainer, bag, &iter );
+        while ( entitytainer_children_next( entitytainer, &iter, &item, NULL ) ) {
+            ASSERT( entitytainer_get_parent( entitytainer, item ) == bag );
+            entities[num_checked++] = item;
+        }
+    }
+
+    check_depths( entitytainer, entities, num_checked );
+    check_order( entitytainer, num_entities, -1 );
+}
+
+static void
+do_reparent_tests( bool remove_with_holes, bool hashed_lookup, bool chain_last_bucket_list ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 128;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = chain_last_bucket_list ? 16 : 32;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 8;
+    config.bucket_list_sizes[2]         = 8;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = chain_last_bucket_list;
+    config.track_child_index            = true;
+    config.track_depth                  = true;
+    config.track_order                  = true;
+    config.track_occupancy              = remove_with_holes;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+
+    // Bag 1 has 12 items, one of which is a bag with an item in it. Bag 2 has 3 items. With holes, one of bag 1's
+    // items is gone again.
+    int num_items[5] = { 0, 12, 3, 0, 0 };
+    for ( TheEntitytainerEntity bag = 1; bag <= 4; ++bag ) {
+        entitytainer_add_entity( entitytainer, bag );
+    }
+
+    for ( TheEntitytainerEntity item = 10; item < 22; ++item ) {
+        entitytainer_add_child( entitytainer, 1, item );
+    }
+
+    for ( TheEntitytainerEntity item = 30; item < 33; ++item ) {
+        entitytainer_add_child( entitytainer, 2, item );
+    }
+
+    entitytainer_add_entity( entitytainer, 10 );
+    entitytainer_add_child( entitytainer, 10, 60 );
+    int num_entities = 4 + 12 + 3 + 1;
+    if ( remove_with_holes ) {
+        entitytainer_remove_entity( entitytainer, 13 );
+        --num_items[1];
+        --num_entities;
+    }
+
+    check_bags( entitytainer, num_items, num_entities );
+
+    // One at a time, the one with its own item too
+    entitytainer_reparent( entitytainer, 11, 2 );
+    entitytainer_reparent( entitytainer, 10, 2 );
+    num_items[1] -= 2;
+    num_items[2] += 2;
+    ASSERT( entitytainer_get_child_index( entitytainer, 2, 10 ) == 4 );
+    ASSERT( entitytainer_get_depth( entitytainer, 60 ) == 2 && entitytainer_get_root( entitytainer, 60 ) == 2 );
+    check_bags( entitytainer, num_items, num_entities );
+
+    // Into an empty bag, from nowhere, and to where it already is
+    entitytainer_reparent( entitytainer, 70, 3 );
+    entitytainer_reparent( entitytainer, 70, 3 );
+    ++num_items[3];
+    ++num_entities;
+    check_bags( entitytainer, num_items, num_entities );
+
+    // Everything in bag 1 on top of bag 3's item, then all of that into the empty bag 4, which trades buckets.
+    TheEntitytainerEntity* children;
+    int                    num_children;
+    int                    capacity;
+    entitytainer_move_children( entitytainer, 1, 3 );
+    num_items[3] += num_items[1];
+    num_items[1] = 0;
+    check_bags( entitytainer, num_items, num_entities );
+    entitytainer_get_children( entitytainer, 3, &children, &num_children, &capacity );
+    ASSERT( children[0] == 70 && children[1] == 12 );
+
+    int index_before = entitytainer_get_child_index( entitytainer, 3, 21 );
+    entitytainer_move_children( entitytainer, 3, 4 );
+    num_items[4] = num_items[3];
+    num_items[3] = 0;
+    ASSERT( entitytainer_get_child_index( entitytainer, 4, 21 ) == index_before );
+    ASSERT( demotion_capacity( entitytainer, 3 ) == 3 );
+    check_bags( entitytainer, num_items, num_entities );
+
+    // Bag 2 (and bag 10 in it) into bag 4 too, over the last bucket list's size when chained.
+    entitytainer_move_children( entitytainer, 2, 4 );
+    num_items[4] += num_items[2];
+    num_items[2] = 0;
+    ASSERT( entitytainer_get_parent( entitytainer, 60 ) == 10 && entitytainer_get_depth( entitytainer, 60 ) == 2 );
+    check_bags( entitytainer, num_items, num_entities );
+
+    // ...and back out of it, to a bag that has something
+    entitytainer_reparent( entitytainer, 30, 1 );
+    entitytainer_move_children( entitytainer, 4, 1 );
+    num_items[1] = num_items[4];
+    num_items[4] = 0;
+    check_bags( entitytainer, num_items, num_entities );
+    entitytainer_move_children( entitytainer, 4, 1 );
+    check_bags( entitytainer, num_items, num_entities );
+    if ( remove_with_holes ) {
+        check_occupancy( entitytainer, 70 );
+    }
+
+    free( config.memory );
+}
+
+static int
+payload_value( TheEntitytainerEntity child ) {
+    return child * 7 + 1;
+}
+
+static void
+set_payloads( TheEntitytainer* entitytainer, TheEntitytainerEntity child ) {
+    unsigned char* tag   = (unsigned char*)entitytainer_get_payload( entitytainer, child, 0 );
+    int*           value = (int*)entitytainer_get_payload( entitytainer, child, 1 );
+    ASSERT( *tag == 0 && *value == 0 ); // New children start out cleared, even in a slot that was used before
+    *tag   = (unsigned char)child;
+    *value = payload_value( child );
+}
+
+static void
+check_payloads( TheEntitytainer* entitytainer, int num_parents ) {
+    // Every child still has what set_payloads gave it, through the spans and through the iterator.
+    for ( TheEntitytainerEntity parent = 1; parent <= (TheEntitytainerEntity)num_parents; ++parent ) {
+        TheEntitytainerChildSpan span;
+        entitytainer_get_child_span( entitytainer, parent, &span );
+        do {
+            unsigned char* tags   = (unsigned char*)span.payloads[0];
+            int*           values = (int*)span.payloads[1];
+            for ( int i_child = 0; i_child < span.num_children; ++i_child ) {
+                TheEntitytainerEntity child = span.children[i_child];
+                if ( child != ENTITYTAINER_InvalidEntity ) {
+                    ASSERT( tags[i_child] == (unsigned char)child && values[i_child] == payload_value( child ) );
+                }
+            }
+        } while ( entitytainer_next_child_span( entitytainer, &span ) );
+
+        TheEntitytainerChildIter iter;
+        TheEntitytainerEntity    child;
+        entitytainer_children_iter( entitytainer, parent, &iter );
+        while ( entitytainer_children_next( entitytainer, &iter, &child, NULL ) ) {
+            int* value = (int*)entitytainer_children_payload( entitytainer, &iter, 1 );
+            ASSERT( *value == payload_value( child ) );
+            ASSERT( value == entitytainer_get_payload( entitytainer, child, 1 ) );
+        }
+    }
+}
+
+static void
+do_payload_tests( bool remove_with_holes, bool chain_last_bucket_list, bool remove_unordered ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = chain_last_bucket_list ? 16 : 32;
+    config.bucket_list_sizes[0]         = 64;
+    config.bucket_list_sizes[1]         = 32;
+    config.bucket_list_sizes[2]         = 32;
+    config.num_bucket_lists             = 3;
+    config.payload_sizes[0]             = 1; // A tag, so the int column after it has to be aligned
+    config.payload_sizes[1]             = (int)sizeof( int );
+    config.num_payload_columns          = 2;
+    config.remove_with_holes            = remove_with_holes;
+    config.chain_last_bucket_list       = chain_last_bucket_list;
+    config.track_child_index            = !remove_with_holes;
+    config.remove_unordered             = remove_unordered;
+    config.track_dirty                  = true;
+    config.track_occupancy              = remove_with_holes;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    struct TheEntitytainerConfig replica_config = config;
+    replica_config.track_dirty                  = false;
+    replica_config.memory_size                  = entitytainer_needed_size( &replica_config );
+    replica_config.memory                       = malloc( replica_config.memory_size );
+    TheEntitytainer* replica                    = entitytainer_create( &replica_config );
+
+    // Parents growing and shrinking through all the bucket lists
+    TheEntitytainer* entitytainer    = entitytainer_create( &config );
+    int              num_children[8] = { 0 };
+    for ( TheEntitytainerEntity parent = 1; parent <= 7; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+    }
+
+    TheEntitytainerEntity next_child = 100;
+    for ( int i = 0; i < 400; ++i ) {
+        TheEntitytainerEntity parent = (TheEntitytainerEntity)( 1 + ( i * 5 + i / 6 ) % 6 );
+        if ( i % 4 == 3 && num_children[parent] > 0 ) {
+            TheEntitytainerChildIter iter;
+            TheEntitytainerEntity    child;
+            entitytainer_children_iter( entitytainer, parent, &iter );
+            for ( int i_skip = i % num_children[parent]; i_skip >= 0; --i_skip ) {
+                entitytainer_children_next( entitytainer, &iter, &child, NULL );
+            }
+
+            entitytainer_remove_entity( entitytainer, child );
+            --num_children[parent];
+        }
+        else if ( num_children[parent] < (int)( 3 + parent * 4 ) ) {
+            entitytainer_add_child( entitytainer, parent, next_child );
+            set_payloads( entitytainer, next_child++ );
+            ++num_children[parent];
+        }
+    }
+
+    check_payloads( entitytainer, 7 );
+    if ( remove_with_holes ) {
+        for ( TheEntitytainerEntity parent = 1; parent <= 6; ++parent ) {
+            entitytainer_remove_holes( entitytainer, parent );
+        }
+
+        check_payloads( entitytainer, 7 );
+    }
+
+    // The payloads go with the children when they're moved, one by one, by swapping buckets or by copying.
+    TheEntitytainerChildIter iter;
+    TheEntitytainerEntity    child;
+    for ( int i = 0; i < 4; ++i ) {
+        entitytainer_children_iter( entitytainer, 6, &iter );
+        entitytainer_children_next( entitytainer, &iter, &child, NULL );
+        entitytainer_reparent( entitytainer, child, 1 );
+    }
+
+    entitytainer_move_children( entitytainer, 3, 7 );
+    entitytainer_move_children( entitytainer, 4, 2 );
+    check_payloads( entitytainer, 7 );
+
+    int   scratch_size = entitytainer_defragment_needed_size( entitytainer );
+    void* scratch      = malloc( scratch_size );
+    while ( !entitytainer_defragment( entitytainer, 5, scratch, scratch_size ) ) {
+    }
+
+    check_payloads( entitytainer, 7 );
+
+    // Everything since it was created is in the first delta
+    int            delta_size = entitytainer_save_delta( entitytainer, NULL, 0 );
+    unsigned char* delta      = malloc( delta_size );
+    ASSERT( entitytainer_save_delta( entitytainer, delta, delta_size ) == delta_size );
+    ASSERT( entitytainer_apply_delta( replica, delta, delta_size ) );
+    check_payloads( replica, 7 );
+
+    // Compact, into bigger buckets
+    int            compact_size = entitytainer_save_compact( entitytainer, NULL, 0 );
+    unsigned char* compact      = malloc( compact_size );
+    entitytainer_save_compact( entitytainer, compact, compact_size );
+    struct TheEntitytainerConfig grown_config;
+    ASSERT( entitytainer_load_compact_config( compact, compact_size, &grown_config ) );
+    ASSERT( grown_config.num_payload_columns == 2 && grown_config.payload_sizes[1] == (int)sizeof( int ) );
+    grown_config.bucket_sizes[0] = 6;
+    grown_config.memory_size     = entitytainer_needed_size( &grown_config );
+    grown_config.memory          = malloc( grown_config.memory_size );
+    TheEntitytainer* grown       = entitytainer_load_compact( compact, compact_size, &grown_config );
+    check_payloads( grown, 7 );
+
+    // Reallocated and saved as it is
+    int              realloc_size   = entitytainer_realloc_needed_size( entitytainer, 2.0f );
+    void*            realloc_memory = malloc( realloc_size );
+    TheEntitytainer* reallocated    = entitytainer_realloc( entitytainer, realloc_memory, realloc_size, 2.0f );
+    check_payloads( reallocated, 7 );
+    entitytainer_add_child( reallocated, 5, next_child );
+    set_payloads( reallocated, next_child++ );
+
+    int            save_size = entitytainer_save( reallocated, NULL, 0 );
+    unsigned char* saved     = malloc( save_size );
+    entitytainer_save( reallocated, saved, save_size );
+    check_payloads( entitytainer_load( saved, save_size ), 7 );
+
+    free( saved );
+    free( realloc_memory );
+    free( grown_config.memory );
+    free( compact );
+    free( delta );
+    free( scratch );
+    free( replica_config.memory );
+    free( config.memory );
+}
+
+static void
+check_channels( TheEntitytainer* entitytainer, int num_removed ) {
+    // Entity 10 + i is a child of 1 in channel 0 and of 2 or 3 (odd ones) in channel 1, and the ones divisible by
+    // three are children of 11 in channel 2. The first num_removed ones were taken out of channel 0.
+    TheEntitytainerChildSpan spans[3];
+    TheEntitytainerEntity    parents[3];
+    entitytainer_get_relations( entitytainer, 1, spans, parents );
+    ASSERT( spans[0].num_children == 12 - num_removed && spans[1].num_children == 0 && spans[2].num_children == 0 );
+    ASSERT( parents[0] == 0 && parents[1] == 0 && parents[2] == 0 );
+    for ( int i = 0; i < spans[0].num_children; ++i ) {
+        TheEntitytainerEntity child = spans[0].children[i];
+        ASSERT( entitytainer_get_channel( entitytainer, child ) == 0 );
+        ASSERT( entitytainer_from_channel( entitytainer, child ) >= (TheEntitytainerEntity)( 10 + num_removed ) );
+    }
+
+    entitytainer_get_relations( entitytainer, 2, spans, NULL );
+    ASSERT( spans[0].num_children == 0 && spans[1].num_children == 6 && spans[2].num_children == 0 );
+    for ( TheEntitytainerEntity entity = 10; entity < 22; ++entity ) {
+        bool removed = entity < (TheEntitytainerEntity)( 10 + num_removed );
+        entitytainer_get_relations( entitytainer, entity, spans, parents );
+        ASSERT( parents[0] == ( removed ? 0 : 1 ) );
+        ASSERT( parents[1] == ( entity % 2 == 0 ? 2 : 3 ) );
+        ASSERT( parents[2] == ( entity % 3 == 0 ? 11 : 0 ) );
+        ASSERT( spans[0].num_children == 0 && spans[1].num_children == 0 );
+        ASSERT( spans[2].num_children == ( entity == 11 ? 4 : 0 ) );
+
+        TheEntitytainerEntity in_squad = entitytainer_to_channel( entitytainer, entity, 2 );
+        TheEntitytainerEntity root     = entity % 3 == 0 ? entitytainer_to_channel( entitytainer, 11, 2 ) : in_squad;
+        ASSERT( entitytainer_get_depth( entitytainer, in_squad ) == ( entity % 3 == 0 ? 1 : 0 ) );
+        ASSERT( entitytainer_get_root( entitytainer, in_squad ) == root );
+    }
+}
+
+static void
+do_channel_tests( bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 32;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 16;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 8;
+    config.num_bucket_lists             = 2;
+    config.num_channels                 = 3;
+    config.hashed_lookup                = hashed_lookup;
+    config.track_child_index            = true;
+    config.track_depth                  = true;
+    config.track_dirty                  = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    struct TheEntitytainerConfig replica_config = config;
+    replica_config.memory                       = malloc( replica_config.memory_size );
+    TheEntitytainer* replica                    = entitytainer_create( &replica_config );
+
+    // The same entities, in three hierarchies
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    entitytainer_add_entity( entitytainer, entitytainer_to_channel( entitytainer, 1, 0 ) );
+    entitytainer_add_entity( entitytainer, entitytainer_to_channel( entitytainer, 2, 1 ) );
+    entitytainer_add_entity( entitytainer, entitytainer_to_channel( entitytainer, 3, 1 ) );
+    entitytainer_add_entity( entitytainer, entitytainer_to_channel( entitytainer, 11, 2 ) );
+    for ( TheEntitytainerEntity entity = 10; entity < 22; ++entity ) {
+        TheEntitytainerEntity in_inventory = entitytainer_to_channel( entitytainer, entity, 1 );
+        entitytainer_add_child( entitytainer, entitytainer_to_channel( entitytainer, 1, 0 ), in_inventory - 1 );
+        entitytainer_add_child(
+          entitytainer, entitytainer_to_channel( entitytainer, entity % 2 == 0 ? 2 : 3, 1 ), in_inventory );
+        if ( entity % 3 == 0 ) {
+            entitytainer_add_child( entitytainer,
+                                    entitytainer_to_channel( entitytainer, 11, 2 ),
+                                    entitytainer_to_channel( entitytainer, entity, 2 ) );
+        }
+    }
+
+    ASSERT( entitytainer_from_channel( entitytainer, entitytainer_to_channel( entitytainer, 21, 2 ) ) == 21 );
+    ASSERT( entitytainer_get_channel( entitytainer, entitytainer_to_channel( entitytainer, 21, 2 ) ) == 2 );
+    check_channels( entitytainer, 0 );
+
+    // Removing from one channel leaves the others alone
+    for ( TheEntitytainerEntity entity = 10; entity < 13; ++entity ) {
+        entitytainer_remove_entity( entitytainer, entitytainer_to_channel( entitytainer, entity, 0 ) );
+    }
+
+    check_channels( entitytainer, 3 );
+
+    int            delta_size = entitytainer_save_delta( entitytainer, NULL, 0 );
+    unsigned char* delta      = malloc( delta_size );
+    entitytainer_save_delta( entitytainer, delta, delta_size );
+    ASSERT( entitytainer_apply_delta( replica, delta, delta_size ) );
+    check_channels( replica, 3 );
+
+    // All channels in one blob
+    int            compact_size = entitytainer_save_compact( entitytainer, NULL, 0 );
+    unsigned char* compact      = malloc( compact_size );
+    entitytainer_save_compact( entitytainer, compact, compact_size );
+    struct TheEntitytainerConfig loaded_config;
+    ASSERT( entitytainer_load_compact_config( compact, compact_size, &loaded_config ) );
+    ASSERT( loaded_config.num_channels == 3 );
+    loaded_config.memory_size = entitytainer_needed_size( &loaded_config );
+    loaded_config.memory      = malloc( loaded_config.memory_size );
+    check_channels( entitytainer_load_compact( compact, compact_size, &loaded_config ), 3 );
+
+    int              realloc_size   = entitytainer_realloc_needed_size( entitytainer, 2.0f );
+    void*            realloc_memory = malloc( realloc_size );
+    TheEntitytainer* reallocated    = entitytainer_realloc( entitytainer, realloc_memory, realloc_size, 2.0f );
+    check_channels( reallocated, 3 );
+    entitytainer_add_entity( reallocated, entitytainer_to_channel( reallocated, 63, 2 ) );
+    ASSERT( entitytainer_num_children( reallocated, entitytainer_to_channel( reallocated, 63, 2 ) ) == 0 );
+
+    // Without channels, entities are their own channel entities
+    config.num_channels = 0;
+    config.memory_size  = entitytainer_needed_size( &config );
+    TheEntitytainer* plain = entitytainer_create( &config );
+    ASSERT( entitytainer_to_channel( plain, 5, 0 ) == 5 && entitytainer_from_channel( plain, 5 ) == 5 );
+    ASSERT( entitytainer_get_channel( plain, 5 ) == 0 );
+
+    free( realloc_memory );
+    free( loaded_config.memory );
+    free( compact );
+    free( delta );
+    free( replica_config.memory );
+    free( config.memory );
+}
+
+static int g_num_test_pages;
+
+static void*
+test_alloc_page( void* page_user_data, int size ) {
+    ASSERT( page_user_data == &g_num_test_pages );
+    ++g_num_test_pages;
+    return malloc( size );
+}
+
+static void
+test_free_page( void* page_user_data, void* page ) {
+    ASSERT( page_user_data == &g_num_test_pages );
+    --g_num_test_pages;
+    free( page );
+}
+
+static TheEntitytainerEntity
+paged_child( TheEntitytainerEntity parent, int i_child ) {
+    return (TheEntitytainerEntity)( 100 + parent * 16 + i_child );
+}
+
+static void
+check_paged( TheEntitytainer* entitytainer, bool removed_odd ) {
+    // Parent p had ( p % 6 ) * 3 children, and the odd ones may have been removed.
+    for ( TheEntitytainerEntity parent = 1; parent <= 40; ++parent ) {
+        int num_added    = (int)( parent % 6 ) * 3;
+        int num_expected = removed_odd ? ( num_added + 1 ) / 2 : num_added;
+        ASSERT( entitytainer_num_children( entitytainer, parent ) == num_expected );
+
+        int                      num_found = 0;
+        TheEntitytainerChildSpan span;
+        entitytainer_get_child_span( entitytainer, parent, &span );
+        do {
+            for ( int i = 0; i < span.num_children; ++i ) {
+                num_found += entitytainer_get_parent( entitytainer, span.children[i] ) == parent ? 1 : 0;
+            }
+        } while ( entitytainer_next_child_span( entitytainer, &span ) );
+
+        ASSERT( num_found == num_expected );
+        for ( int i_child = 0; i_child < num_added; ++i_child ) {
+            bool                  removed = removed_odd && i_child % 2 == 1;
+            TheEntitytainerEntity child   = paged_child( parent, i_child );
+            ASSERT( entitytainer_get_parent( entitytainer, child ) == ( removed ? 0 : parent ) );
+        }
+    }
+}
+
+static void
+do_paged_tests( bool chain_last_bucket_list, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 1024;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = chain_last_bucket_list ? 12 : 16;
+    config.bucket_list_sizes[0]         = 8;
+    config.bucket_list_sizes[1]         = 4;
+    config.bucket_list_sizes[2]         = 0;
+    config.num_bucket_lists             = 3;
+    config.bucket_page_size             = 4;
+    config.max_bucket_pages             = 32;
+    config.alloc_page                   = test_alloc_page;
+    config.free_page                    = test_free_page;
+    config.page_user_data               = &g_num_test_pages;
+    config.chain_last_bucket_list       = chain_last_bucket_list;
+    config.hashed_lookup                = hashed_lookup;
+    config.track_child_index            = true;
+    config.memory_size                  = entitytainer_needed_size( &config );
+    config.memory                       = malloc( config.memory_size );
+    void*            memory             = config.memory;
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+    ASSERT( !entitytainer_needs_realloc( entitytainer, 0.5f, 0 ) );
+
+    // A parent in the second bucket list, whose bucket shouldn't move while the lists grow around it
+    TheEntitytainerEntity* children;
+    int                    num_children;
+    int                    capacity;
+    entitytainer_add_entity( entitytainer, 1 );
+    entitytainer_add_entity( entitytainer, 2 );
+    for ( int i_child = 0; i_child < 6; ++i_child ) {
+        entitytainer_add_child( entitytainer, 2, paged_child( 2, i_child ) );
+    }
+
+    entitytainer_get_children( entitytainer, 2, &children, &num_children, &capacity );
+    for ( TheEntitytainerEntity parent = 3; parent <= 40; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+        for ( int i_child = 0; i_child < (int)( parent % 6 ) * 3; ++i_child ) {
+            entitytainer_add_child( entitytainer, parent, paged_child( parent, i_child ) );
+        }
+    }
+
+    for ( int i_child = 0; i_child < 3; ++i_child ) {
+        entitytainer_add_child( entitytainer, 1, paged_child( 1, i_child ) );
+    }
+
+    TheEntitytainerEntity* children_after;
+    entitytainer_get_children( entitytainer, 2, &children_after, &num_children, &capacity );
+    ASSERT( children_after == children && num_children == 6 && children[5] == paged_child( 2, 5 ) );
+    ASSERT( g_num_test_pages > 0 );
+    TheEntitytainerStats stats;
+    entitytainer_get_stats( entitytainer, &stats );
+    ASSERT( stats.bucket_lists[0].total_buckets > config.bucket_list_sizes[0] );
+    ASSERT( stats.bucket_lists[0].total_buckets % config.bucket_page_size == 0 );
+    check_paged( entitytainer, false );
+
+    // Parents move down to buckets on other pages, and defragment moves buckets between pages
+    for ( TheEntitytainerEntity parent = 1; parent <= 40; ++parent ) {
+        for ( int i_child = 1; i_child < (int)( parent % 6 ) * 3; i_child += 2 ) {
+            entitytainer_remove_child_no_holes( entitytainer, parent, paged_child( parent, i_child ) );
+        }
+    }
+
+    check_paged( entitytainer, true );
+    int   scratch_size = entitytainer_defragment_needed_size( entitytainer );
+    void* scratch      = malloc( scratch_size );
+    while ( !entitytainer_defragment( entitytainer, 7, scratch, scratch_size ) ) {
+    }
+
+    check_paged( entitytainer, true );
+
+    // Compact save works, into flat or paged bucket lists
+    int            compact_size = entitytainer_save_compact( entitytainer, NULL, 0 );
+    unsigned char* compact      = malloc( compact_size );
+    entitytainer_save_compact( entitytainer, compact, compact_size );
+    struct TheEntitytainerConfig flat_config;
+    ASSERT( entitytainer_load_compact_config( compact, compact_size, &flat_config ) );
+    flat_config.memory_size = entitytainer_needed_size( &flat_config );
+    flat_config.memory      = malloc( flat_config.memory_size );
+    check_paged( entitytainer_load_compact( compact, compact_size, &flat_config ), true );
+
+    int num_pages_before    = g_num_test_pages;
+    config.memory           = malloc( config.memory_size );
+    TheEntitytainer* loaded = entitytainer_load_compact( compact, compact_size, &config );
+    ASSERT( g_num_test_pages > num_pages_before );
+    check_paged( loaded, true );
+    entitytainer_free_pages( loaded );
+    ASSERT( g_num_test_pages == num_pages_before );
+
+    entitytainer_free_pages( entitytainer );
+    ASSERT( g_num_test_pages == 0 );
+    free( config.memory );
+    free( flat_config.memory );
+    free( compact );
+    free( scratch );
+    free( memory );
+}
+
+static void
+fill_for_clear( TheEntitytainer* entitytainer, int seed ) {
+    // Parents with a few children each, then some of them removed so there are free buckets in every list.
+    for ( TheEntitytainerEntity parent = 1; parent <= 30; ++parent ) {
+        entitytainer_add_entity( entitytainer, parent );
+        for ( int i_child = 0; i_child < (int)( parent + seed ) % 11; ++i_child ) {
+            entitytainer_add_child( entitytainer, parent, (TheEntitytainerEntity)( 100 + parent * 16 + i_child ) );
+        }
+    }
+
+    for ( TheEntitytainerEntity parent = 1; parent <= 30; parent += 3 ) {
+        for ( int i_child = (int)( parent + seed ) % 11 - 1; i_child >= 1; i_child -= 2 ) {
+            TheEntitytainerEntity child = (TheEntitytainerEntity)( 100 + parent * 16 + i_child );
+            entitytainer_remove_child_no_holes( entitytainer, parent, child );
+        }
+    }
+}
+
+static unsigned char*
+save_for_clear( TheEntitytainer* entitytainer, int* size ) {
+    *size                 = entitytainer_save_compact( entitytainer, NULL, 0 );
+    unsigned char* buffer = malloc( *size );
+    entitytainer_save_compact( entitytainer, buffer, *size );
+    return buffer;
+}
+
+static void
+do_clear_tests( bool lazy_zeroing, bool hashed_lookup ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 1024;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 12;
+    config.bucket_list_sizes[0]         = 64;
+    config.bucket_list_sizes[1]         = 32;
+    config.bucket_list_sizes[2]         = 32;
+    config.num_bucket_lists             = 3;
+    config.hashed_lookup                = hashed_lookup;
+    config.track_child_index            = true;
+    config.track_depth                  = true;
+    config.track_order                  = true;
+    config.track_dirty                  = true;
+    config.memory_size                  = entitytainer_needed_size( &config );
+
+    // What it should look like, built in zeroed memory.
+    struct TheEntitytainerConfig reference_config = config;
+    reference_config.memory                       = calloc( 1, config.memory_size );
+    TheEntitytainer* reference                    = entitytainer_create( &reference_config );
+    fill_for_clear( reference, 2 );
+    int            reference_size;
+    unsigned char* reference_save = save_for_clear( reference, &reference_size );
+
+    // With lazy zeroing the buckets are left as they were, so start out with junk.
+    config.lazy_zeroing = lazy_zeroing;
+    config.memory       = malloc( config.memory_size );
+    memset( config.memory, lazy_zeroing ? 0xab : 0, config.memory_size );
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+    fill_for_clear( entitytainer, 5 );
+    ASSERT( entitytainer->entry_high_water > 30 && entitytainer->entry_high_water < entitytainer->entry_lookup_size );
+
+    // A replica that's kept up to date through the clear with a delta
+    entitytainer_clear_dirty( entitytainer );
+    int            full_size      = entitytainer_save( entitytainer, NULL, 0 );
+    unsigned char* replica_memory = malloc( full_size );
+    entitytainer_save( entitytainer, replica_memory, full_size );
+    TheEntitytainer* replica = entitytainer_load( replica_memory, full_size );
+
+    entitytainer_clear( entitytainer );
+    ASSERT( entitytainer->entry_high_water == 0 );
+    ASSERT( !entitytainer_is_added( entitytainer, 1 ) );
+    ASSERT( entitytainer_get_parent( entitytainer, 100 + 16 ) == ENTITYTAINER_InvalidEntity );
+    int num_ordered;
+    int first_dirty;
+    entitytainer_get_topological_order( entitytainer, &num_ordered, &first_dirty );
+    ASSERT( num_ordered == 0 );
+    TheEntitytainerStats stats;
+    entitytainer_get_stats( entitytainer, &stats );
+    ASSERT( stats.num_parents == 0 );
+    for ( int i_bl = 0; i_bl < config.num_bucket_lists; ++i_bl ) {
+        ASSERT( stats.bucket_lists[i_bl].high_water_buckets == ( i_bl == 0 ? 1 : 0 ) );
+    }
+
+    // Then it's the same as a new one, down to the bytes of a compact save.
+    fill_for_clear( entitytainer, 2 );
+    int            cleared_size;
+    unsigned char* cleared_save = save_for_clear( entitytainer, &cleared_size );
+    ASSERT( cleared_size == reference_size && memcmp( cleared_save, reference_save, reference_size ) == 0 );
+
+    int            delta_size = entitytainer_save_delta( entitytainer, NULL, 0 );
+    unsigned char* delta      = malloc( delta_size );
+    entitytainer_save_delta( entitytainer, delta, delta_size );
+    ASSERT( entitytainer_apply_delta( replica, delta, delta_size ) );
+    int            replica_size;
+    unsigned char* replica_save = save_for_clear( replica, &replica_size );
+    ASSERT( replica_size == reference_size && memcmp( replica_save, reference_save, reference_size ) == 0 );
+
+    // And a second clear goes the same way
+    entitytainer_clear( entitytainer );
+    fill_for_clear( entitytainer, 2 );
+    free( cleared_save );
+    cleared_save = save_for_clear( entitytainer, &cleared_size );
+    ASSERT( cleared_size == reference_size && memcmp( cleared_save, reference_save, reference_size ) == 0 );
+
+    free( replica_save );
+    free( delta );
+    free( cleared_save );
+    free( replica_memory );
+    free( config.memory );
+    free( reference_save );
+    free( reference_config.memory );
+}
+
+static void
+do_clear_twice_tests( bool hashed_lookup ) {
+    // Two clears between deltas. The second one has a lower high water, but what the first one zeroed above it still
+    // has to be sent.
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 8;
+    config.num_bucket_lists             = 2;
+    config.hashed_lookup                = hashed_lookup;
+    config.track_dirty                  = true;
+    config.memory_size                  = entitytainer_needed_size( &config );
+    config.memory                       = malloc( config.memory_size );
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+
+    int            full_size      = entitytainer_save( entitytainer, NULL, 0 );
+    unsigned char* replica_memory = malloc( full_size );
+    entitytainer_save( entitytainer, replica_memory, full_size );
+    TheEntitytainer* replica = entitytainer_load( replica_memory, full_size );
+
+    unsigned char delta[4096];
+    entitytainer_add_entity( entitytainer, 20 );
+    entitytainer_add_child( entitytainer, 20, 21 );
+    int delta_size = entitytainer_save_delta( entitytainer, delta, sizeof( delta ) );
+    ASSERT( entitytainer_apply_delta( replica, delta, delta_size ) );
+    entitytainer_clear_dirty( entitytainer );
+    ASSERT( entitytainer_get_parent( replica, 21 ) == 20 );
+
+    entitytainer_clear( entitytainer );
+    entitytainer_add_entity( entitytainer, 3 );
+    entitytainer_clear( entitytainer );
+    delta_size = entitytainer_save_delta( entitytainer, delta, sizeof( delta ) );
+    ASSERT( entitytainer_apply_delta( replica, delta, delta_size ) );
+    ASSERT( !entitytainer_is_added( replica, 20 ) );
+    ASSERT( !entitytainer_is_added( replica, 3 ) );
+    ASSERT( entitytainer_get_parent( replica, 21 ) == ENTITYTAINER_InvalidEntity );
+
+    free( replica_memory );
+    free( config.memory );
+}
+
+static void
+check_num_children( TheEntitytainer* entitytainer, int max_entity ) {
+    // The kept counts against the children actually in the buckets.
+    TheEntitytainerEntity parents[512]  = { 0 };
+    int                   expected[512] = { 0 };
+    int                   num_parents   = 0;
+    for ( TheEntitytainerEntity parent = 1; (int)parent <= max_entity; ++parent ) {
+        if ( !entitytainer_is_added( entitytainer, parent ) ) {
+            continue;
+        }
+
+        int                      count = 0;
+        TheEntitytainerChildIter iter;
+        TheEntitytainerEntity    child;
+        entitytainer_children_iter( entitytainer, parent, &iter );
+        while ( entitytainer_children_next( entitytainer, &iter, &child, NULL ) ) {
+            ASSERT( entitytainer_get_parent( entitytainer, child ) == parent );
+            ++count;
+        }
+
+        ASSERT( entitytainer_num_children( entitytainer, parent ) == count );
+        parents[num_parents]    = parent;
+        expected[num_parents++] = count;
+    }
+
+    int num_children[512] = { 0 };
+    entitytainer_num_children_batch( entitytainer, parents, num_parents, num_children );
+    for ( int i = 0; i < num_parents; ++i ) {
+        ASSERT( num_children[i] == expected[i] );
+    }
+}
+
+static void
+do_aligned_layout_tests( bool remove_with_holes, bool hashed_lookup, bool chain_last_bucket_list ) {
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 512;
+    config.bucket_sizes[0]              = 3;
+    config.bucket_sizes[1]              = 6;
+    config.bucket_sizes[2]              = 20;
+    config.bucket_list_sizes[0]         = 512;
+    config.bucket_list_sizes[1]         = 128;
+    config.bucket_list_sizes[2]         = 64;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = remove_with_holes;
+    config.hashed_lookup                = hashed_lookup;
+    config.chain_last_bucket_list       = chain_last_bucket_list;
+    config.track_child_index            = true;
+    config.track_dirty                  = true;
+    config.align_buckets                = true;
+    config.track_num_children           = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+
+    // Powers of two up to a cache line, whole cache lines above that. Same with 16 and 32 bit entities.
+    ASSERT( entitytainer->config.bucket_sizes[0] == 4 && entitytainer->bucket_lists[0].bucket_size == 4 );
+    ASSERT( entitytainer->config.bucket_sizes[1] == 8 && entitytainer->bucket_lists[1].bucket_size == 8 );
+    ASSERT( entitytainer->config.bucket_sizes[2] == 32 && entitytainer->bucket_lists[2].bucket_size == 32 );
+    for ( int i_bl = 0; i_bl < config.num_bucket_lists; ++i_bl ) {
+        unsigned char* bucket_data = (unsigned char*)entitytainer->bucket_lists[i_bl].bucket_data;
+        ASSERT( ( bucket_data - (unsigned char*)entitytainer ) % ENTITYTAINER_CacheLineSize == 0 );
+    }
+
+    struct TheEntitytainerConfig replica_config = config;
+    replica_config.track_dirty                  = false;
+    replica_config.memory_size                  = entitytainer_needed_size( &replica_config );
+    replica_config.memory                       = malloc( replica_config.memory_size );
+    TheEntitytainer* replica                    = entitytainer_create( &replica_config );
+
+    int            buffer_size = entitytainer_save( entitytainer, NULL, 0 ) * 2;
+    unsigned char* buffer      = malloc( buffer_size );
+    unsigned int   random      = 2345;
+    for ( int i_round = 0; i_round < 20; ++i_round ) {
+        for ( int i_op = 0; i_op < 200; ++i_op ) {
+            random                       = random * 1103515245u + 12345u;
+            TheEntitytainerEntity entity = (TheEntitytainerEntity)( 1 + ( random >> 8 ) % 300 );
+            random                       = random * 1103515245u + 12345u;
+            TheEntitytainerEntity other  = (TheEntitytainerEntity)( 1 + ( random >> 8 ) % 300 );
+            bool                  added  = entitytainer_is_added( entitytainer, entity );
+            bool                  other_added = entitytainer_is_added( entitytainer, other );
+            TheEntitytainerEntity parent      = entitytainer_get_parent( entitytainer, entity );
+            switch ( ( random >> 4 ) % 7 ) {
+            case 0:
+                if ( !added ) {
+                    entitytainer_add_entity( entitytainer, entity );
+                }
+                break;
+            case 1:
+            case 2:
+                if ( other_added && other != entity && !entitytainer_is_ancestor( entitytainer, entity, other ) ) {
+                    // Adds it if it doesn't have a parent
+                    entitytainer_reparent( entitytainer, entity, other );
+                }
+                break;
+            case 3:
+                if ( parent != ENTITYTAINER_InvalidEntity ) {
+                    if ( remove_with_holes ) {
+                        entitytainer_remove_child_with_holes( entitytainer, parent, entity );
+                    }
+                    else {
+                        entitytainer_remove_child_no_holes( entitytainer, parent, entity );
+                    }
+                }
+                break;
+            case 4:
+                if ( !added || entitytainer_num_children( entitytainer, entity ) == 0 ) {
+                    entitytainer_remove_entity( entitytainer, entity );
+                }
+                break;
+            case 5:
+                if ( added && other_added && other != entity && !entitytainer_is_ancestor( entitytainer, entity, other ) ) {
+                    entitytainer_move_children( entitytainer, entity, other );
+                }
+                break;
+            case 6:
+                if ( added && ( random >> 12 ) % 8 == 0 ) {
+                    TheEntitytainerEntity removed[512];
+                    entitytainer_remove_subtree( entitytainer, entity, removed, 512 );
+                }
+                break;
+            }
+        }
+
+        if ( i_round % 5 == 4 ) {
+            int   scratch_size = entitytainer_defragment_needed_size( entitytainer );
+            void* scratch      = malloc( scratch_size );
+            entitytainer_defragment( entitytainer, 8, scratch, scratch_size );
+            free( scratch );
+        }
+
+        check_num_children( entitytainer, 300 );
+        int delta_size = entitytainer_save_delta( entitytainer, buffer, buffer_size );
+        ASSERT( entitytainer_apply_delta( replica, buffer, delta_size ) );
+        entitytainer_clear_dirty( entitytainer );
+        check_num_children( replica, 300 );
+    }
+
+    // The padding and alignment come back with the raw and the compact save.
+    int full_size = entitytainer_save( entitytainer, buffer, buffer_size );
+    ASSERT( full_size <= buffer_size );
+    TheEntitytainer* loaded = entitytainer_load( buffer, full_size );
+    ASSERT( ( (unsigned char*)loaded->bucket_lists[2].bucket_data - buffer ) % ENTITYTAINER_CacheLineSize == 0 );
+    check_num_children( loaded, 300 );
+
+    int compact_size = entitytainer_save_compact( entitytainer, buffer, buffer_size );
+    struct TheEntitytainerConfig compact_config;
+    ASSERT( entitytainer_load_compact_config( buffer, compact_size, &compact_config ) );
+    ASSERT( compact_config.align_buckets && compact_config.track_num_children );
+    compact_config.memory_size = entitytainer_needed_size( &compact_config );
+    compact_config.memory      = malloc( compact_config.memory_size );
+    TheEntitytainer* compact   = entitytainer_load_compact( buffer, compact_size, &compact_config );
+    ASSERT( compact != NULL && compact->bucket_lists[2].bucket_size == 32 );
+    check_num_children( compact, 300 );
+
+    entitytainer_clear( entitytainer );
+    check_num_children( entitytainer, 300 );
+
+    free( compact_config.memory );
+    free( buffer );
+    free( replica_config.memory );
+    free( config.memory );
+}
+
+static void
+do_aligned_chain_sizes_tests( void ) {
+    // 5 and 8 both pad to 8, which would leave the chained list no bigger than the one before it.
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 5;
+    config.bucket_sizes[2]              = 8;
+    config.bucket_list_sizes[0]         = 16;
+    config.bucket_list_sizes[1]         = 8;
+    config.bucket_list_sizes[2]         = 32;
+    config.num_bucket_lists             = 3;
+    config.chain_last_bucket_list       = true;
+    config.align_buckets                = true;
+    config.track_num_children           = true;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+    TheEntitytainer* entitytainer       = entitytainer_create( &config );
+    ASSERT( entitytainer->bucket_lists[0].bucket_size == 4 );
+    ASSERT( entitytainer->bucket_lists[1].bucket_size == 8 );
+    ASSERT( entitytainer->bucket_lists[2].bucket_size == 16 );
+
+    // Padding the padded sizes again changes nothing, which is what the compact load does.
+    struct TheEntitytainerConfig padded_config = entitytainer->config;
+    ASSERT( entitytainer_needed_size( &padded_config ) == needed_memory_size );
+
+    entitytainer_add_entity( entitytainer, 1 );
+    for ( TheEntitytainerEntity child = 2; child < 40; ++child ) {
+        entitytainer_add_child( entitytainer, 1, child );
+    }
+
+    check_num_children( entitytainer, 40 );
+    ASSERT( entitytainer_num_children( entitytainer, 1 ) == 38 );
+    free( config.memory );
+}
+
+static void
+unittest_run_base( UnitTestData* testdata ) {
+    testdata->num_tests = 0;
+
+    struct TheEntitytainerConfig config = { 0 };
+    config.num_entries                  = 64;
+    config.bucket_sizes[0]              = 4;
+    config.bucket_sizes[1]              = 8;
+    config.bucket_sizes[2]              = 16;
+    config.bucket_list_sizes[0]         = 4;
+    config.bucket_list_sizes[1]         = 2;
+    config.bucket_list_sizes[2]         = 2;
+    config.num_bucket_lists             = 3;
+    config.remove_with_holes            = false;
+    int needed_memory_size              = entitytainer_needed_size( &config );
+    config.memory                       = malloc( needed_memory_size );
+    config.memory_size                  = needed_memory_size;
+
+    TheEntitytainer* entitytainer = entitytainer_create( &config );
+
+    printf( "\n" );
+    printf( "Setup errors found: %u/%u\n", testdata->error_index, testdata->num_tests );
+
+    if ( testdata->error_index > 0 ) {
+        printf( "Errors found during setup, exiting.\n" );
+        goto LABEL_done;
+    }
+
+    testdata->num_tests = 0;
+
+    do_single_parent_tests( entitytainer );
+    do_multi_parent_tests( entitytainer );
+
+    memset( config.memory, 0, config.memory_size );
+    config.remove_with_holes = true;
+    entitytainer             = entitytainer_create( &config );
+    do_single_parent_hole_tests( entitytainer );
+    do_save_load_test( entitytainer );
+
+    memset( config.memory, 0, config.memory_size );
+    config.keep_capacity_on_remove = true;
+    entitytainer                   = entitytainer_create( &config );
+    do_reserve_tests( entitytainer );
+    do_save_load_test( entitytainer );
+
+    memset( config.memory, 0, config.memory_size );
+    config.keep_capacity_on_remove = false;
+    entitytainer                   = entitytainer_create( &config );
+    do_multi_entity_tests( entitytainer );
+    do_save_load_test( entitytainer );
+
+    memset( config.memory, 0, config.memory_size );
+    config.remove_with_holes = false;
+    entitytainer             = entitytainer_create( &config );
+    do_batch_tests( entitytainer );
+
+    memset( config.memory, 0, config.memory_size );
+    config.remove_with_holes = true;
+    entitytainer             = entitytainer_create( &config );
+    do_batch_tests( entitytainer );
 
     do_save_load_upgrade_test();
+    do_realloc_tests();
+    do_hashed_lookup_tests();
+    do_hashed_realloc_in_place_tests();
+    do_entry_layout_tests();
+    do_chain_tests( false );
+    do_chain_tests( true );
+    do_chain_stale_slot_tests();
+    do_child_index_tests( false, false, false );
+    do_child_index_tests( false, true, false );
+    do_child_index_tests( true, false, false );
+    do_child_index_tests( false, true, true );
+    do_child_index_tests( true, false, true );
+    do_find_tests();
+    do_subtree_tests( false, false );
+    do_subtree_tests( true, false );
+    do_subtree_tests( false, true );
+    do_depth_tests( false, false, false );
+    do_depth_tests( true, false, false );
+    do_depth_tests( true, true, false );
+    do_depth_tests( true, false, true );
+    do_order_tests( false, false );
+    do_order_tests( true, false );
+    do_order_tests( false, true );
+    do_concurrency_tests();
+    do_command_tests( false, false );
+    do_command_tests( true, false );
+    do_command_tests( false, true );
+    do_batch_query_tests( false, false );
+    do_batch_query_tests( true, false );
+    do_batch_query_tests( false, true );
+    do_defragment_tests( false );
+    do_defragment_tests( true );
+    do_compact_save_tests( false, false );
+    do_compact_save_tests( true, false );
+    do_compact_save_tests( false, true );
+    do_view_tests( false, false );
+    do_view_tests( true, false );
+    do_view_tests( false, true );
+    do_delta_tests( false, false );
+    do_delta_tests( true, false );
+    do_delta_tests( false, true );
+    do_load_into_rehash_tests();
+    do_stats_tests();
+    do_suggest_config_tests();
+    do_demotion_tests( false, false, false );
+    do_demotion_tests( true, false, false );
+    do_demotion_tests( false, false, true );
+    do_demotion_tests( true, false, true );
+    do_demotion_tests( false, true, true );
+    do_occupancy_tests( false, false );
+    do_occupancy_tests( true, false );
+    do_occupancy_tests( true, true );
+    do_reparent_tests( false, false, false );
+    do_reparent_tests( true, false, false );
+    do_reparent_tests( false, true, false );
+    do_reparent_tests( false, false, true );
+    do_reparent_tests( true, true, true );
+    do_payload_tests( false, false, false );
+    do_payload_tests( false, false, true );
+    do_payload_tests( true, false, false );
+    do_payload_tests( false, true, true );
+    do_payload_tests( true, true, false );
+    do_channel_tests( false );
+    do_channel_tests( true );
+    do_paged_tests( false, false );
+    do_paged_tests( true, false );
+    do_paged_tests( false, true );
+    do_clear_tests( false, false );
+    do_clear_tests( true, false );
+    do_clear_tests( true, true );
+    do_clear_twice_tests( false );
+    do_clear_twice_tests( true );
+    do_aligned_layout_tests( false, false, false );
+    do_aligned_layout_tests( true, false, true );
+    do_aligned_layout_tests( false, true, true );
+    do_aligned_chain_sizes_tests();
 
     printf( "Run errors found:   %u/%u\n", testdata->error_index, testdata->num_tests );
 
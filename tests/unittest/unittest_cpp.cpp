@@ -0,0 +1,117 @@
+// Tests for the C++ front-end in the_entitytainer.hpp, against the C functions on the same entitytainer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static unsigned g_num_tests;
+static unsigned g_num_errors;
+
+static void
+unittest_entitytainer_assert( bool test ) {
+    ++g_num_tests;
+    if ( !test ) {
+        ++g_num_errors;
+    }
+}
+
+#define ENTITYTAINER_assert unittest_entitytainer_assert
+#define ASSERT unittest_entitytainer_assert
+#define ENTITYTAINER_IMPLEMENTATION
+#include "../../the_entitytainer.h"
+#include "../../the_entitytainer.hpp"
+
+typedef entitytainer::Container<TheEntitytainerEntity, TheEntitytainerEntry, 4, 8, 12> Tainer;
+
+// Usable for static buffers
+static_assert( Tainer::needed_size( 64, { { 4, 2, 4 } } ) > 0, "needed_size is constexpr" );
+
+static void
+do_layout_tests() {
+    struct TheEntitytainerConfig config = Tainer::make_config( 64, { { 4, 2, 4 } } );
+    ASSERT( Tainer::needed_size( 64, { { 4, 2, 4 } } ) == entitytainer_needed_size( &config ) );
+    ASSERT( Tainer::needed_size( config ) == entitytainer_needed_size( &config ) );
+
+    config.track_depth = true;
+    ASSERT( Tainer::needed_size( config ) == entitytainer_needed_size( &config ) );
+}
+
+static void
+do_children_tests( bool holes, bool chained ) {
+    TheEntitytainerConfig options  = TheEntitytainerConfig();
+    options.remove_with_holes      = holes;
+    options.chain_last_bucket_list = chained;
+    options.track_num_children     = chained;
+    TheEntitytainerConfig config   = Tainer::make_config( 64, { { 4, 2, 4 } }, options );
+    int                   size     = Tainer::needed_size( config );
+    void*                 memory   = malloc( size );
+    Tainer                tainer   = Tainer::create( config, memory, size );
+    ASSERT( tainer.valid() );
+
+    tainer.add_entity( 1 );
+    ASSERT( tainer.num_children( 1 ) == 0 );
+    ASSERT( tainer.children_span( 1 ).empty() );
+    int num_children = chained ? 20 : 11;
+    for ( TheEntitytainerEntity child = 2; child < 2 + num_children; ++child ) {
+        tainer.add_child( 1, child );
+
+        // Through every bucket list
+        int                    c_count;
+        int                    c_capacity;
+        TheEntitytainerEntity* c_children;
+        entitytainer_get_children( tainer.handle(), 1, &c_children, &c_count, &c_capacity );
+        auto span = tainer.children_span( 1 );
+        ASSERT( tainer.num_children( 1 ) == entitytainer_num_children( tainer.handle(), 1 ) );
+        ASSERT( (int)span.size() == c_count && span.data() == c_children );
+        ASSERT( chained || tainer.num_children( 1 ) == c_count );
+    }
+
+    ASSERT( tainer.get_parent( 5 ) == 1 );
+    tainer.remove_child( 1, 4 );
+    ASSERT( tainer.get_parent( 4 ) == 0 );
+
+    std::vector<TheEntitytainerEntity> seen;
+    for ( TheEntitytainerEntity child : tainer.children( 1 ) ) {
+        seen.push_back( child );
+    }
+
+    ASSERT( (int)seen.size() == num_children - 1 );
+    bool in_order = true;
+    for ( int i = 0; i < (int)seen.size(); ++i ) {
+        TheEntitytainerEntity expected = (TheEntitytainerEntity)( i < 2 ? i + 2 : i + 3 );
+        in_order                       = in_order && seen[i] == expected;
+    }
+
+    ASSERT( in_order );
+
+    // The blob is a plain C save
+    int            blob_size = tainer.save( nullptr, 0 );
+    unsigned char* blob      = (unsigned char*)malloc( blob_size );
+    tainer.save( blob, blob_size );
+    TheEntitytainer* loaded = entitytainer_load( blob, blob_size );
+    ASSERT( entitytainer_num_children( loaded, 1 ) == tainer.num_children( 1 ) );
+    Tainer reloaded = Tainer::load( blob, blob_size );
+    ASSERT( reloaded.valid() && reloaded.num_children( 1 ) == tainer.num_children( 1 ) );
+
+    typedef entitytainer::Container<TheEntitytainerEntity, TheEntitytainerEntry, 4, 8> Other;
+    ASSERT( !Other::attach( loaded ).valid() );
+
+    free( blob );
+    free( memory );
+}
+
+int
+main( int argc, char** argv ) {
+    (void)( argc );
+    (void)( argv );
+
+    do_layout_tests();
+    do_children_tests( false, false );
+    do_children_tests( true, false );
+    do_children_tests( false, true );
+    do_children_tests( true, true );
+
+    printf( "C++ errors found: %u/%u\n", g_num_errors, g_num_tests );
+    return g_num_errors == 0 ? 0 : 1;
+}
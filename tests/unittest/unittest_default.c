@@ -1,5 +1,6 @@
 
 #define ENTITYTAINER_STATIC
+#define ENTITYTAINER_SIMD
 #include "unittest_base.c"
 
 void
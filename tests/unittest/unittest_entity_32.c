@@ -1,13 +1,14 @@
 
-// #define ENTITYTAINER_STATIC
-// #define ENTITYTAINER_Entity
-// typedef int TheEntitytainerEntity;
-// #include "unittest_base.c"
-
-// void
-// unittest_run_entity32( UnitTestData* testdata ) {
-//     unittest_run_base( testdata );
-
-
-// }
-
+#define ENTITYTAINER_STATIC
+#define ENTITYTAINER_SIMD
+#define ENTITYTAINER_STATS
+#define ENTITYTAINER_Entity
+typedef unsigned int TheEntitytainerEntity;
+#define ENTITYTAINER_Entry
+typedef unsigned int TheEntitytainerEntry;
+#include "unittest_base.c"
+
+void
+unittest_run_entity32( UnitTestData* testdata ) {
+    unittest_run_base( testdata );
+}
@@ -73,6 +73,11 @@ See end of file for license information.
 #ifndef INCLUDE_THE_ENTITYTAINER_H
 #define INCLUDE_THE_ENTITYTAINER_H
 
+#include <stddef.h> // offsetof
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -96,7 +101,7 @@ extern "C" {
 
 #ifndef ENTITYTAINER_assert
 #include <assert.h>
-#define ENTITYTAINER_assert assert;
+#define ENTITYTAINER_assert assert
 #endif
 
 #ifndef ENTITYTAINER_memcpy
@@ -104,11 +109,20 @@ extern "C" {
 #define ENTITYTAINER_memcpy memcpy
 #endif
 
+#ifndef ENTITYTAINER_memmove
+#include <string.h>
+#define ENTITYTAINER_memmove memmove
+#endif
+
 #ifndef ENTITYTAINER_memset
 #include <string.h>
 #define ENTITYTAINER_memset memset
 #endif
 
+#if !defined( ENTITYTAINER_alignof ) && defined( __cplusplus )
+#define ENTITYTAINER_alignof( type ) alignof( type ) // C++ doesn't allow defining the struct inside offsetof
+#endif
+
 #ifndef ENTITYTAINER_alignof
 #define ENTITYTAINER_alignof( type ) \
     offsetof(                        \
@@ -119,16 +133,36 @@ extern "C" {
       d )
 #endif
 
+// Define ENTITYTAINER_Entity and/or ENTITYTAINER_Entry and typedef your own (unsigned) types to use other widths,
+// for example 32 bit entities to go above 65k entities, or 32 bit entries to go above 16k buckets per bucket list.
 #ifndef ENTITYTAINER_Entity
 typedef unsigned short TheEntitytainerEntity;
+#endif
+
+#ifndef ENTITYTAINER_InvalidEntity
 #define ENTITYTAINER_InvalidEntity ( (TheEntitytainerEntity)0u )
 #endif
 
 #ifndef ENTITYTAINER_Entry
 typedef unsigned short TheEntitytainerEntry;
-#define ENTITYTAINER_BucketMask 0x3fff
-#define ENTITYTAINER_BucketListBitCount 2
-#define ENTITYTAINER_BucketListOffset ( sizeof( TheEntitytainerEntry ) * 8 - ENTITYTAINER_BucketListBitCount )
+#endif
+
+// The top bits of an entry is the bucket list index, the rest is the bucket index. By default as few bits as needed
+// for num_bucket_lists are used for the bucket list. Define this to use a fixed number of bits instead.
+// #define ENTITYTAINER_BucketListBitCount 2
+
+// Define ENTITYTAINER_STATS to count the bucket moves, see entitytainer_get_stats. It adds a few counters to each
+// bucket list, so define it the same everywhere.
+// #define ENTITYTAINER_STATS
+
+// Parents by number of children in entitytainer_get_stats, the last one counts all the bigger ones.
+#ifndef ENTITYTAINER_StatsHistogramSize
+#define ENTITYTAINER_StatsHistogramSize 256
+#endif
+
+// What align_buckets pads and aligns the buckets to, in bytes.
+#ifndef ENTITYTAINER_CacheLineSize
+#define ENTITYTAINER_CacheLineSize 64
 #endif
 
 #define ENTITYTAINER_NoFreeBucket ( (TheEntitytainerEntity)-1 )
@@ -141,6 +175,8 @@ typedef unsigned short TheEntitytainerEntry;
 #endif
 
 #define ENTITYTAINER_MAX_BUCKET_LISTS 8
+#define ENTITYTAINER_MAX_ENTRY_COLUMNS 8
+#define ENTITYTAINER_MAX_PAYLOAD_COLUMNS 4
 
 struct TheEntitytainerConfig {
     void* memory;
@@ -148,40 +184,247 @@ struct TheEntitytainerConfig {
     int   num_entries;
     int   bucket_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
     int   bucket_list_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int   demote_margins[ENTITYTAINER_MAX_BUCKET_LISTS]; // Free slots a parent has to leave to move down into a list
     int   num_bucket_lists;
+    int   payload_sizes[ENTITYTAINER_MAX_PAYLOAD_COLUMNS]; // Bytes per child, see entitytainer_get_payload
+    int   num_payload_columns;
+    int   num_channels; // Separate hierarchies sharing the bucket lists, see entitytainer_to_channel. 0 means 1.
+    int   bucket_page_size; // Buckets per page (a power of two), see entitytainer_free_pages. 0 for flat bucket lists.
+    int   max_bucket_pages; // Page table size of each bucket list, including the pages in memory
+    void* ( *alloc_page )( void* page_user_data, int size );
+    void  ( *free_page )( void* page_user_data, void* page );
+    void* page_user_data;
     bool  remove_with_holes;
     bool  keep_capacity_on_remove;
+    bool  hashed_lookup; // num_entries is then the max number of live entities, rather than the max entity ID.
+    bool  chain_last_bucket_list; // Parents in the last bucket list can grow past its bucket size.
+    bool  track_child_index;      // Keeps each child's index in its parent, for O(1) removal and get_child_index.
+    bool  remove_unordered;       // remove_child_no_holes moves the last child into the removed slot.
+    bool  track_depth;            // Keeps each entity's depth and root, for O(1) get_depth/get_root.
+    bool  track_order;            // Keeps all entities in a flat array, parents before children.
+    bool  defer_bucket_frees;     // Freed buckets aren't reused until entitytainer_reclaim_buckets, see read_begin.
+    bool  track_dirty;            // Marks the entries and buckets that change, see entitytainer_save_delta.
+    bool  lazy_demotion;          // Removals only mark the parents that can move down, see entitytainer_maintain.
+    bool  track_occupancy;        // With remove_with_holes, a bit per child slot so holes aren't searched for.
+    bool  lazy_zeroing;           // create and clear leave the buckets as they are, see entitytainer_clear.
+    bool  align_buckets;          // Cache line aligned bucket data and padded bucket sizes, see entitytainer_create.
+    bool  track_num_children;     // Keeps each parent's child count next to the lookup, for num_children.
 };
 
 typedef struct {
-    TheEntitytainerEntity* bucket_data;
-    int                    bucket_size;
-    int                    total_buckets;
-    int                    first_free_bucket;
-    int                    used_buckets;
+    TheEntitytainerEntity*  bucket_data;
+    int                     bucket_size;
+    int                     total_buckets;
+    int                     first_free_bucket;
+    int                     first_retired_bucket; // Freed but not reusable yet, with defer_bucket_frees
+    int                     used_buckets;         // Including the retired ones
+    unsigned char*          payloads[ENTITYTAINER_MAX_PAYLOAD_COLUMNS]; // A value per slot, after all the bucket data
+    TheEntitytainerEntity** pages; // With bucket_page_size, the start of each page of buckets. NULL otherwise.
+    int                     page_shift;
+    int                     num_pages;
+    int                     max_pages;
+#if defined( ENTITYTAINER_STATS )
+    int                     promotions; // Parents moved here from a smaller bucket list
+    int                     demotions;  // ...and from a bigger one
+    long long               promotion_bytes;
+#endif
 } TheEntitytainerBucketList;
 
 typedef struct {
     struct TheEntitytainerConfig config;
     TheEntitytainerEntry*        entry_lookup;
     TheEntitytainerEntity*       entry_parent_lookup;
+    TheEntitytainerEntity*       entry_num_children; // Only used with track_num_children, the same as bucket[0]
+    TheEntitytainerEntity*       entry_child_index; // Only used with track_child_index
+    TheEntitytainerEntity*       entry_depth;       // Only used with track_depth
+    TheEntitytainerEntity*       entry_root;        // Only used with track_depth, 0 for entities without a parent
+    TheEntitytainerEntity*       entry_order;       // Only used with track_order, position in order plus one
+    TheEntitytainerEntity*       order;             // Only used with track_order, see get_topological_order
+    TheEntitytainerEntity*       entry_keys;        // Only used for hashed lookup
+    unsigned int*                dirty_entries;     // Only used with track_dirty, a bit per entry
+    unsigned int*                dirty_buckets[ENTITYTAINER_MAX_BUCKET_LISTS]; // ...and per bucket
+    unsigned int*                demote_candidates; // Only used with lazy_demotion, a bit per entry
+    unsigned int*                occupancy[ENTITYTAINER_MAX_BUCKET_LISTS]; // Only used with track_occupancy
     TheEntitytainerBucketList*   bucket_lists;
     int                          num_bucket_lists;
+    int                          num_channels; // At least 1
     int                          entry_lookup_size;
+    int                          entry_list_shift;
+    int                          entry_bucket_mask;
+    int                          entry_hash_shift;
+    int                          entry_hash_count;
+    int                          order_count; // Including holes
+    int                          order_holes;
+    int                          order_dirty; // First position that changed since the last get_topological_order
+    int                          sequence;    // Odd while writing, see entitytainer_write_begin
+    int                          dirty_order; // First position that changed since the last clear_dirty
+    int                          generation;  // Number of clear_dirty calls
+    int                          entry_high_water; // Entries from here on haven't been written since the last clear
     bool                         remove_with_holes;
     bool                         keep_capacity_on_remove;
+    bool                         hashed_lookup;
+    bool                         chain_last_bucket_list;
+    bool                         track_child_index;
+    bool                         remove_unordered;
+    bool                         track_depth;
+    bool                         track_order;
+    bool                         defer_bucket_frees;
+    bool                         track_dirty;
+    bool                         lazy_demotion;
+    bool                         track_occupancy;
+    bool                         track_num_children;
 } TheEntitytainer;
 
+// A run of children. A parent in a chained bucket has several, see entitytainer_get_child_span. With holes,
+// num_children is the whole span, and some of the children can be ENTITYTAINER_InvalidEntity.
+typedef struct {
+    TheEntitytainerEntity* children;
+    int                    num_children;
+    int                    capacity;
+    int                    num_children_left; // In the spans after this one, when not using holes
+    TheEntitytainerEntity* next_page;
+    void*                  payloads[ENTITYTAINER_MAX_PAYLOAD_COLUMNS]; // Parallel to children, one per payload column
+} TheEntitytainerChildSpan;
+
+// Walks a parent's children without the holes, see entitytainer_children_iter.
+typedef struct {
+    TheEntitytainerChildSpan span;
+    const unsigned int*      occupancy;   // With track_occupancy, the bits of the span's bucket
+    int                      slot;        // Next one in the span to look at
+    int                      first_index; // Child index of the span's first slot
+    int                      num_left;    // Children that haven't been returned yet
+} TheEntitytainerChildIter;
+
+typedef struct {
+    int       bucket_size;
+    int       total_buckets;
+    int       used_buckets;       // Including the retired ones
+    int       high_water_buckets; // The most that have been used at once, since create or the last defragment
+    int       free_buckets;       // In the free list, the rest above high_water_buckets have never been used
+    int       retired_buckets;
+    int       promotions; // These three are only counted with ENTITYTAINER_STATS
+    int       demotions;
+    long long promotion_bytes;
+} TheEntitytainerBucketListStats;
+
+typedef struct {
+    TheEntitytainerBucketListStats bucket_lists[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int                            num_bucket_lists;
+    int                            num_parents; // Entities with a bucket, that is
+    int                            max_children;
+    int                            child_count_histogram[ENTITYTAINER_StatsHistogramSize];
+} TheEntitytainerStats;
+
+// Recorded by entitytainer_record_*, see entitytainer_apply_commands.
+#define ENTITYTAINER_CommandAddEntity 0
+#define ENTITYTAINER_CommandRemoveChild 1
+#define ENTITYTAINER_CommandAddChild 2
+#define ENTITYTAINER_CommandRemoveEntity 3
+#define ENTITYTAINER_NumCommandTypes 4
+
+typedef struct {
+    int                   type;
+    TheEntitytainerEntity parent; // Not used by add/remove entity
+    TheEntitytainerEntity entity; // The child, for add/remove child
+} TheEntitytainerCommand;
+
+// One per thread. Recording doesn't touch the entitytainer, so buffers can be filled while it's being read.
+typedef struct {
+    TheEntitytainerCommand* commands;
+    int                     num_commands;
+    int                     capacity;
+} TheEntitytainerCommandBuffer;
+
+// With align_buckets, bucket sizes up to a cache line of entities are padded to a power of two and bigger ones to
+// whole cache lines (further up if that would make it the same as the previous list's), and each bucket list's data
+// starts on a cache line, so a bucket never straddles more lines than it has to. The alignment is relative to the
+// entitytainer, so that raw saves load the same way, so cache line align the memory too. entitytainer->config has the
+// padded sizes.
 ENTITYTAINER_API int entitytainer_needed_size( struct TheEntitytainerConfig* config );
 ENTITYTAINER_API TheEntitytainer* entitytainer_create( struct TheEntitytainerConfig* config );
 
+// Removes everything, like a new entitytainer_create with the same config, but only zeroes the entries that have been
+// written to and each bucket list's buckets up to the highest one that's been handed out, instead of all of memory.
+// With lazy_zeroing, create and clear don't zero the buckets at all (or allocated pages), only the entries and the
+// other per entry data. A bucket is always zeroed when it's handed out, so this is for memory that's already zeroed
+// (fresh pages from the OS) or where the old contents don't matter, to not touch the bucket memory up front. Raw saves
+// then contain whatever was in the unused buckets. Allocated pages and the generation are kept, with track_dirty the
+// next delta clears a replica too.
+ENTITYTAINER_API void entitytainer_clear( TheEntitytainer* entitytainer );
+
+// Grows the entitytainer into a new memory block (or the same one, if it was able to grow in place). Growth is
+// applied to the number of entries and to each bucket list, or only to one bucket list for the _bucket_list version.
+ENTITYTAINER_API int entitytainer_realloc_needed_size( TheEntitytainer* entitytainer, float growth );
+ENTITYTAINER_API int
+entitytainer_realloc_bucket_list_needed_size( TheEntitytainer* entitytainer, int bucket_list_index, float growth );
 ENTITYTAINER_API TheEntitytainer*
                  entitytainer_realloc( TheEntitytainer* entitytainer_old, void* memory, int memory_size, float growth );
+ENTITYTAINER_API TheEntitytainer* entitytainer_realloc_bucket_list( TheEntitytainer* entitytainer_old,
+                                                                    void*            memory,
+                                                                    int              memory_size,
+                                                                    int              bucket_list_index,
+                                                                    float            growth );
 ENTITYTAINER_API bool
 entitytainer_needs_realloc( TheEntitytainer* entitytainer, float percent_free, int num_free_buckets );
 
+// Paged bucket lists grow without a realloc. With bucket_page_size, each bucket list is a table of pages of that many
+// buckets. The first bucket_list_sizes[i] buckets are in memory like before (bucket_list_sizes has to be a multiple of
+// the page size), and when a list runs out, a page is added with alloc_page( page_user_data, size ), up to
+// max_bucket_pages. Nothing moves when that happens, so children pointers stay valid (until the children change, as
+// usual) and readers don't have to stop. Finding a bucket goes through the page table, which costs a shift and a load.
+// The pages aren't in the memory block, so paged bucket lists can't be saved with entitytainer_save (use
+// save_compact) or reallocated, and they don't support track_dirty, track_occupancy or payload columns.
+// free_pages gives the allocated pages back with free_page( page_user_data, page ), once the entitytainer isn't used
+// anymore.
+ENTITYTAINER_API void entitytainer_free_pages( TheEntitytainer* entitytainer );
+
+// Occupancy of each bucket list, and how many children the parents have. Goes through all the entries and free lists,
+// so it's for tuning and debugging rather than every frame.
+ENTITYTAINER_API void entitytainer_get_stats( TheEntitytainer* entitytainer, TheEntitytainerStats* stats );
+
+// Picks the bucket lists for a child count histogram, like child_count_histogram from entitytainer_get_stats or one
+// recorded elsewhere. histogram[i] is the number of parents with i children, and the last bin counts all the bigger
+// ones, which get a chained last bucket list. The sizes minimize the bucket memory plus the bytes copied when parents
+// are promoted from one bucket list to the next, on their way up to their child count.
+// Fill in the rest of config first (num_entries, hashed_lookup and so on). This sets bucket_sizes, num_bucket_lists
+// and chain_last_bucket_list, and spreads what's left of max_memory over bucket_list_sizes, so that
+// entitytainer_needed_size fits. Returns false if the histogram doesn't fit in max_memory or in the bits of an
+// entry, in which case config is left with room for exactly the histogram (clamped to what the entry can address).
+ENTITYTAINER_API bool entitytainer_suggest_config( const int*                    histogram,
+                                                   int                           num_bins,
+                                                   int                           max_memory,
+                                                   struct TheEntitytainerConfig* config );
+
+// Moves the buckets of each bucket list so they're in the same order as the entries (i.e. by parent, unless using
+// hashed lookup), with a chained parent's pages right after it, and without gaps. Moves at most max_moves buckets per
+// call and returns true once there's nothing left to move, so it can be spread out over several frames. Things can
+// change in between calls, it just starts over from the first parent that's out of place. Each call also goes
+// through all entries and buckets once. Bucket lists with retired buckets are skipped until they're reclaimed.
+// Children pointers from before the call aren't valid afterwards. scratch must be at least
+// entitytainer_defragment_needed_size bytes.
+ENTITYTAINER_API int  entitytainer_defragment_needed_size( TheEntitytainer* entitytainer );
+ENTITYTAINER_API bool entitytainer_defragment( TheEntitytainer* entitytainer,
+                                               int              max_moves,
+                                               void*            scratch,
+                                               int              scratch_size );
+
+// With lazy_demotion, removing children doesn't move the parent down to a smaller bucket list right away, it's only
+// marked. maintain moves at most max_demotions of the marked parents (each straight to the smallest bucket list that
+// fits, with demote_margins) and returns true once none are left. Parents that can't move because the smaller bucket
+// lists are full are unmarked, like they'd be skipped by an eager removal. Children pointers from before the call
+// aren't valid afterwards.
+ENTITYTAINER_API bool entitytainer_maintain( TheEntitytainer* entitytainer, int max_demotions );
+
 ENTITYTAINER_API void entitytainer_add_entity( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
 ENTITYTAINER_API void entitytainer_remove_entity( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+
+// Removes entity and everything below it. The removed entities are written to removed, entity first and parents
+// before their children (useful for cleaning up other components). Returns the number of removed entities, or -1
+// (and removes nothing) if they don't all fit in max_removed.
+ENTITYTAINER_API int entitytainer_remove_subtree( TheEntitytainer*       entitytainer,
+                                                  TheEntitytainerEntity  entity,
+                                                  TheEntitytainerEntity* removed,
+                                                  int                    max_removed );
 ENTITYTAINER_API void entitytainer_reserve( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int capacity );
 
 ENTITYTAINER_API void
@@ -197,45 +440,601 @@ ENTITYTAINER_API void entitytainer_remove_child_with_holes( TheEntitytainer*
                                                             TheEntitytainerEntity parent,
                                                             TheEntitytainerEntity child );
 
+// Batched versions of add_child/remove_child. The bucket is moved at most once, directly to the bucket list that fits
+// the final number of children.
+ENTITYTAINER_API void entitytainer_add_children( TheEntitytainer*             entitytainer,
+                                                 TheEntitytainerEntity        parent,
+                                                 const TheEntitytainerEntity* children,
+                                                 int                          num_children );
+ENTITYTAINER_API void entitytainer_remove_children( TheEntitytainer*             entitytainer,
+                                                    TheEntitytainerEntity        parent,
+                                                    const TheEntitytainerEntity* children,
+                                                    int                          num_children );
+
+// Moves child (and everything below it) from its parent, if it has one, to new_parent. The same as removing and
+// adding it, except that the child's entry stays put, its payloads come along and its depth and order are only updated
+// once. new_parent can't be child or below it.
+ENTITYTAINER_API void entitytainer_reparent( TheEntitytainer*      entitytainer,
+                                             TheEntitytainerEntity child,
+                                             TheEntitytainerEntity new_parent );
+// Moves all of from's children to to, after to's own children. If to doesn't have any, they swap buckets and the
+// children keep their child indices, otherwise they're copied over in one go like add_children (with holes, from's
+// holes are removed first). Either way it's then one pass over the moved children for their entries. to can't be
+// from or below it.
+ENTITYTAINER_API void
+entitytainer_move_children( TheEntitytainer* entitytainer, TheEntitytainerEntity from, TheEntitytainerEntity to );
+
 ENTITYTAINER_API void entitytainer_get_children( TheEntitytainer*        entitytainer,
                                                  TheEntitytainerEntity   parent,
                                                  TheEntitytainerEntity** children,
                                                  int*                    num_children,
                                                  int*                    capacity );
 ENTITYTAINER_API int  entitytainer_num_children( TheEntitytainer* entitytainer, TheEntitytainerEntity parent );
+
+// With chain_last_bucket_list, get_children only returns the first page of a chained parent's children. These walk
+// all of them:
+//     TheEntitytainerChildSpan span;
+//     entitytainer_get_child_span( entitytainer, parent, &span );
+//     do { ... } while ( entitytainer_next_child_span( entitytainer, &span ) );
+ENTITYTAINER_API void entitytainer_get_child_span( TheEntitytainer*          entitytainer,
+                                                   TheEntitytainerEntity     parent,
+                                                   TheEntitytainerChildSpan* span );
+ENTITYTAINER_API bool entitytainer_next_child_span( TheEntitytainer* entitytainer, TheEntitytainerChildSpan* span );
+// Returns the children one at a time, skipping the holes, along with their child index (index can be NULL). Stops
+// once it's seen all of them, so the empty end of a big bucket isn't read. With track_occupancy it jumps between the
+// set bits and never reads a hole, except in a chained bucket. Same validity rules as a span.
+//     TheEntitytainerChildIter iter;
+//     entitytainer_children_iter( entitytainer, parent, &iter );
+//     while ( entitytainer_children_next( entitytainer, &iter, &child, &index ) ) { ... }
+ENTITYTAINER_API void entitytainer_children_iter( TheEntitytainer*          entitytainer,
+                                                  TheEntitytainerEntity     parent,
+                                                  TheEntitytainerChildIter* iter );
+ENTITYTAINER_API bool entitytainer_children_next( TheEntitytainer*          entitytainer,
+                                                  TheEntitytainerChildIter* iter,
+                                                  TheEntitytainerEntity*    child,
+                                                  int*                      index );
+// Payload columns (see payload_sizes in the config) are per child data that lives next to the children, a value per
+// bucket slot, and is moved along with them: promotion, demotion, remove_holes, reparent, defragment, save and load.
+// It's zeroed when a child is added. In a span, the payload of children[i] is at payloads[column] + i * its size.
+// get_payload has to find the child's slot first. With track_dirty it marks the child's bucket as the caller is
+// probably going to write to it, writes through a span or children_payload aren't tracked.
+ENTITYTAINER_API void*
+entitytainer_get_payload( TheEntitytainer* entitytainer, TheEntitytainerEntity child, int column );
+// The payload of the child that children_next last returned.
+ENTITYTAINER_API void* entitytainer_children_payload( TheEntitytainer*                entitytainer,
+                                                      const TheEntitytainerChildIter* iter,
+                                                      int                             column );
+// Same as calling get_child_span/num_children for each parent, but in stages (find the entries, then the buckets,
+// then read them) with prefetching, so the cache misses of many parents overlap instead of coming one after another.
+ENTITYTAINER_API void entitytainer_get_children_batch( TheEntitytainer*             entitytainer,
+                                                       const TheEntitytainerEntity* parents,
+                                                       int                          num_parents,
+                                                       TheEntitytainerChildSpan*    spans );
+ENTITYTAINER_API void entitytainer_num_children_batch( TheEntitytainer*             entitytainer,
+                                                       const TheEntitytainerEntity* parents,
+                                                       int                          num_parents,
+                                                       int*                         num_children );
 ENTITYTAINER_API int  entitytainer_get_child_index( TheEntitytainer*      entitytainer,
                                                     TheEntitytainerEntity parent,
                                                     TheEntitytainerEntity child );
 ENTITYTAINER_API TheEntitytainerEntity entitytainer_get_parent( TheEntitytainer*      entitytainer,
                                                                 TheEntitytainerEntity child );
 
+// With num_channels, each entity has its own parent and children in every channel (say attachments, inventory and
+// squads), and all channels share the bucket lists, save/load and so on. num_entries is per channel. The rest of the
+// API takes channel entities: to_channel is the entity as seen by one channel. Children and parents come back as
+// channel entities too, and from_channel turns them back into entities. Add the channel entity before giving it
+// children, and children can only be added in their parent's channel. Without channels, both return entity as is.
+ENTITYTAINER_API TheEntitytainerEntity entitytainer_to_channel( TheEntitytainer*      entitytainer,
+                                                                TheEntitytainerEntity entity,
+                                                                int                   channel );
+ENTITYTAINER_API TheEntitytainerEntity entitytainer_from_channel( TheEntitytainer*      entitytainer,
+                                                                  TheEntitytainerEntity channel_entity );
+ENTITYTAINER_API int entitytainer_get_channel( TheEntitytainer* entitytainer, TheEntitytainerEntity channel_entity );
+// Everything entity is related to, in one go. An entity's entries for all channels are next to each other (unless
+// using hashed lookup), so this reads one row. spans[channel] is like get_child_span, and empty if the channel entity
+// isn't added. parents[channel] is the parent as an entity, or 0. Either can be NULL.
+ENTITYTAINER_API void entitytainer_get_relations( TheEntitytainer*          entitytainer,
+                                                  TheEntitytainerEntity     entity,
+                                                  TheEntitytainerChildSpan* spans,
+                                                  TheEntitytainerEntity*    parents );
+
+// Number of ancestors, the topmost ancestor (the entity itself if it has no parent), and whether ancestor is above
+// entity. O(1) with track_depth (is_ancestor only walks up if the depths and roots match), otherwise they walk up.
+ENTITYTAINER_API int  entitytainer_get_depth( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+ENTITYTAINER_API TheEntitytainerEntity entitytainer_get_root( TheEntitytainer*      entitytainer,
+                                                              TheEntitytainerEntity entity );
+ENTITYTAINER_API bool                  entitytainer_is_ancestor( TheEntitytainer*      entitytainer,
+                                                                 TheEntitytainerEntity ancestor,
+                                                                 TheEntitytainerEntity entity );
+
 ENTITYTAINER_API bool entitytainer_is_added( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+
+// With track_order, returns all added entities and children, parents before children, without holes. Kept up to
+// date as children are added and removed. first_dirty is set to the first position that has changed since the last
+// call (num_entities if nothing has), so things like transforms only need to be updated from there.
+ENTITYTAINER_API TheEntitytainerEntity*
+entitytainer_get_topological_order( TheEntitytainer* entitytainer, int* num_entities, int* first_dirty );
+
+// Writes all descendants of root (not root itself) to entities, either breadth first or depth first (pre-order).
+// Either way parents come before their children. No recursion, and no memory other than entities is needed.
+// Returns the number of descendants, or -1 if they don't all fit in max_entities.
+ENTITYTAINER_API int entitytainer_get_subtree( TheEntitytainer*       entitytainer,
+                                               TheEntitytainerEntity  root,
+                                               TheEntitytainerEntity* entities,
+                                               int                    max_entities,
+                                               bool                   depth_first );
 ENTITYTAINER_API void entitytainer_remove_holes( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
 
+// Lock free reading while one other thread writes. The writer wraps its changes in write_begin/write_end (one pair
+// around a whole batch of changes is fine), and readers retry if anything was written while they were reading:
+//     int sequence;
+//     do {
+//         sequence = entitytainer_read_begin( entitytainer );
+//         entitytainer_get_children( entitytainer, parent, &children, &num_children, &capacity );
+//         ... copy what you need ...
+//     } while ( entitytainer_read_retry( entitytainer, sequence ) );
+// Whatever was read before read_retry returns false can be garbage, so don't act on it until then. Not supported with
+// hashed_lookup (entries move around), or while reallocating.
+// With defer_bucket_frees, freed buckets aren't reused until reclaim_buckets is called, so a children pointer stays
+// readable, though maybe out of date, after the writer has moved on. Call it when no reader can have an old pointer,
+// e.g. once all jobs of a frame are done. Retired buckets still count as used until then.
+ENTITYTAINER_API void entitytainer_write_begin( TheEntitytainer* entitytainer );
+ENTITYTAINER_API void entitytainer_write_end( TheEntitytainer* entitytainer );
+ENTITYTAINER_API int  entitytainer_read_begin( TheEntitytainer* entitytainer );
+ENTITYTAINER_API bool entitytainer_read_retry( TheEntitytainer* entitytainer, int sequence );
+ENTITYTAINER_API void entitytainer_reclaim_buckets( TheEntitytainer* entitytainer );
+
+// Deferred changes. Each thread records into its own buffer, then one thread applies all of them in one go:
+//  1. Add entities.
+//  2. Remove children, grouped by parent, so each parent's bucket shrinks at most once.
+//  3. Add children, grouped by parent, so each parent's bucket grows at most once. A parent's children are added
+//     in the order they were recorded.
+//  4. Remove entities.
+// Within a step, parents are visited in bucket list order. Commands that can't be applied are skipped and copied to
+// conflicts (up to max_conflicts), and the total number of skipped commands is returned:
+//  * Adding an entity that's already added, or removing an entity that still has children.
+//  * Adding a child that already has a parent, or one that's also added elsewhere in the same apply. The first
+//    recorded one wins, with buffers in the order they're passed in.
+//  * Adding a child to a parent that isn't added, or to itself or one of its descendants.
+//  * Removing a child from something that isn't its parent.
+// Which commands win only depends on the buffers' contents, not on when they were recorded. The buffers are empty
+// afterwards. scratch must be at least entitytainer_apply_commands_needed_size bytes.
+ENTITYTAINER_API void entitytainer_command_buffer_init( TheEntitytainerCommandBuffer* buffer,
+                                                        TheEntitytainerCommand*       commands,
+                                                        int                           capacity );
+ENTITYTAINER_API bool entitytainer_record_add_entity( TheEntitytainerCommandBuffer* buffer,
+                                                      TheEntitytainerEntity         entity );
+ENTITYTAINER_API bool entitytainer_record_remove_entity( TheEntitytainerCommandBuffer* buffer,
+                                                         TheEntitytainerEntity         entity );
+ENTITYTAINER_API bool entitytainer_record_add_child( TheEntitytainerCommandBuffer* buffer,
+                                                     TheEntitytainerEntity         parent,
+                                                     TheEntitytainerEntity         child );
+ENTITYTAINER_API bool entitytainer_record_remove_child( TheEntitytainerCommandBuffer* buffer,
+                                                        TheEntitytainerEntity         parent,
+                                                        TheEntitytainerEntity         child );
+ENTITYTAINER_API int  entitytainer_apply_commands_needed_size( TheEntitytainerCommandBuffer* buffers, int num_buffers );
+ENTITYTAINER_API int  entitytainer_apply_commands( TheEntitytainer*              entitytainer,
+                                                   TheEntitytainerCommandBuffer* buffers,
+                                                   int                           num_buffers,
+                                                   void*                         scratch,
+                                                   int                           scratch_size,
+                                                   TheEntitytainerCommand*       conflicts,
+                                                   int                           max_conflicts );
+
 ENTITYTAINER_API int entitytainer_save( TheEntitytainer* entitytainer, unsigned char* buffer, int buffer_size );
 ENTITYTAINER_API TheEntitytainer* entitytainer_load( unsigned char* buffer, int buffer_size );
-ENTITYTAINER_API void entitytainer_load_into( TheEntitytainer* entitytainer_src, TheEntitytainer* entitytainer_dst );
+
+// Like load, but doesn't change (or copy) the buffer: the pointers are set up in view instead, which only has to live
+// as long as the returned entitytainer. Made for memory mapped files; the buffer can be read only, as long as only
+// the functions that read are used. Mutating is fine if the mapping is private/copy on write (the OS then only
+// copies the touched pages), or load_into a writable entitytainer first.
+typedef struct {
+    TheEntitytainer           entitytainer;
+    TheEntitytainerBucketList bucket_lists[ENTITYTAINER_MAX_BUCKET_LISTS];
+} TheEntitytainerView;
+
+ENTITYTAINER_API TheEntitytainer*
+entitytainer_view( const unsigned char* buffer, int buffer_size, TheEntitytainerView* view );
+
+// A smaller save, for files and the network. Only live entries are written, and for each bucket list only the buckets
+// up to the last one in use, so save after entitytainer_defragment to skip the free ones too. Returns the size, and
+// only writes if it fits in buffer_size.
+// To load, get the saved config with load_compact_config, change the sizes if you want (they have to fit what was
+// saved), set the memory and call load_compact. Returns false/NULL if the buffer isn't a compact save, or if it was
+// saved with other entity/entry types or on a machine with different endianness.
+ENTITYTAINER_API int
+entitytainer_save_compact( TheEntitytainer* entitytainer, unsigned char* buffer, int buffer_size );
+ENTITYTAINER_API bool entitytainer_load_compact_config( const unsigned char*          buffer,
+                                                        int                           buffer_size,
+                                                        struct TheEntitytainerConfig* config );
+ENTITYTAINER_API TheEntitytainer* entitytainer_load_compact( const unsigned char*          buffer,
+                                                             int                           buffer_size,
+                                                             struct TheEntitytainerConfig* config );
+ENTITYTAINER_API void
+entitytainer_load_into( TheEntitytainer* entitytainer_dst, const TheEntitytainer* entitytainer_src );
+
+// With track_dirty, save_delta only writes the entries, buckets and part of the order that changed since the last
+// clear_dirty, tagged with the current generation. Returns the size, and only writes if it fits in buffer_size.
+// Call clear_dirty once the delta has been sent (or written), that starts the next generation.
+// apply_delta applies a delta to an entitytainer with the same config that's at the delta's generation, and moves it
+// to the next one. Returns false (and doesn't change anything) if the delta doesn't fit, so the replica needs a full
+// save; a full save keeps the generation, so the deltas can continue from it.
+ENTITYTAINER_API int entitytainer_save_delta( TheEntitytainer* entitytainer, unsigned char* buffer, int buffer_size );
+ENTITYTAINER_API void entitytainer_clear_dirty( TheEntitytainer* entitytainer );
+ENTITYTAINER_API int  entitytainer_get_generation( TheEntitytainer* entitytainer );
+ENTITYTAINER_API bool
+entitytainer_apply_delta( TheEntitytainer* entitytainer, const unsigned char* buffer, int buffer_size );
 
 #ifdef ENTITYTAINER_IMPLEMENTATION
 
+// Define ENTITYTAINER_SIMD to search buckets with SSE2, AVX2 or NEON, whichever the compiler targets. Other
+// platforms (and entity types that aren't 16 or 32 bit) use plain loops.
+#if defined( ENTITYTAINER_SIMD )
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#define ENTITYTAINER_SIMD_AVX2
+#define ENTITYTAINER_SIMD_BYTES 32
+#define ENTITYTAINER_SIMD_MASK_BITS 1
+#define ENTITYTAINER_SIMD_FULL_MASK 0xffffffffull
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define ENTITYTAINER_SIMD_SSE2
+#define ENTITYTAINER_SIMD_BYTES 16
+#define ENTITYTAINER_SIMD_MASK_BITS 1
+#define ENTITYTAINER_SIMD_FULL_MASK 0xffffull
+#elif defined( __ARM_NEON ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define ENTITYTAINER_SIMD_NEON
+#define ENTITYTAINER_SIMD_BYTES 16
+#define ENTITYTAINER_SIMD_MASK_BITS 4
+#define ENTITYTAINER_SIMD_FULL_MASK 0xffffffffffffffffull
+#endif
+#endif
+
+#if defined( _MSC_VER )
+#include <intrin.h> // Bit scans, barriers and prefetch
+#endif
+
+// Used by the batch queries. Define as nothing to turn it off.
+#ifndef ENTITYTAINER_prefetch
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define ENTITYTAINER_prefetch( ptr ) __builtin_prefetch( ptr )
+#elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#define ENTITYTAINER_prefetch( ptr ) _mm_prefetch( (const char*)( ptr ), _MM_HINT_T0 )
+#elif defined( _MSC_VER ) && defined( _M_ARM64 )
+#define ENTITYTAINER_prefetch( ptr ) __prefetch( ptr )
+#else
+#define ENTITYTAINER_prefetch( ptr )
+#endif
+#endif
+
+// How many parents the batch queries have in flight. More hides more latency, until the prefetches start pushing
+// each other out of the cache.
+#ifndef ENTITYTAINER_BatchSize
+#define ENTITYTAINER_BatchSize 32
+#endif
+
 static void* entitytainer__ptr_to_aligned_ptr( void* ptr, int align );
+static TheEntitytainer*
+            entitytainer__layout( struct TheEntitytainerConfig* config, TheEntitytainer* header, TheEntitytainerBucketList* lists );
+static void entitytainer__grow_config( TheEntitytainer*              entitytainer,
+                                       int                           bucket_list_index,
+                                       float                         growth,
+                                       struct TheEntitytainerConfig* config );
+static TheEntitytainer* entitytainer__realloc( TheEntitytainer* entitytainer_old, struct TheEntitytainerConfig* config );
+static int   entitytainer__lookup_size( struct TheEntitytainerConfig* config );
+static void  entitytainer__align_config( struct TheEntitytainerConfig* config );
+static long long
+entitytainer__suggest_buckets( const int* histogram, int first, int last, int bucket_size, bool chained );
+static int   entitytainer__suggest_max_buckets( int num_bucket_lists );
+static unsigned char* entitytainer__place_lookups( TheEntitytainer* header, unsigned char* buffer );
+static int   entitytainer__entry_columns( TheEntitytainer* entitytainer, TheEntitytainerEntity** columns );
+static void  entitytainer__copy_entry( TheEntitytainer* entitytainer_dst,
+                                       int              index_dst,
+                                       TheEntitytainer* entitytainer_src,
+                                       int              index_src );
+static int   entitytainer__child_position( TheEntitytainer* entitytainer, TheEntitytainerEntity child );
+static void  entitytainer__set_child_index( TheEntitytainer*      entitytainer,
+                                            TheEntitytainerEntity child,
+                                            int                   child_index );
+static void  entitytainer__set_num_children( TheEntitytainer*      entitytainer,
+                                             TheEntitytainerEntity parent,
+                                             int                   num_children );
+static int   entitytainer__hash_slot( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+static unsigned char* entitytainer__place_bucket_data( const struct TheEntitytainerConfig* config,
+                                                      TheEntitytainerBucketList*          lists,
+                                                      const unsigned char*                base,
+                                                      unsigned char*                      buffer );
+static int   entitytainer__index( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+static int   entitytainer__insert_index( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+static void  entitytainer__release_index( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+static void  entitytainer__rehash( TheEntitytainer* entitytainer, int old_entries );
+static void  entitytainer__move_row( TheEntitytainer* entitytainer, int index_dst, int index_src );
+static void  entitytainer__swap_rows( TheEntitytainer* entitytainer, int index_a, int index_b );
+static void  entitytainer__sift_rows( TheEntitytainer* entitytainer, int first, int root, int count );
+static int   entitytainer__max_buckets( TheEntitytainer* entitytainer );
+static TheEntitytainerEntity entitytainer__child_after( TheEntitytainer*      entitytainer,
+                                                        TheEntitytainerEntity parent,
+                                                        int                   position );
+static TheEntitytainerEntity entitytainer__next_in_subtree( TheEntitytainer*      entitytainer,
+                                                            TheEntitytainerEntity top,
+                                                            TheEntitytainerEntity entity );
+static void  entitytainer__update_depth( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+static void  entitytainer__order_append( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+static void  entitytainer__order_remove( TheEntitytainer* entitytainer, TheEntitytainerEntity entity );
+static void  entitytainer__order_attach( TheEntitytainer* entitytainer, TheEntitytainerEntity child );
+static void  entitytainer__order_compact( TheEntitytainer* entitytainer );
+static int   entitytainer__gather_children( TheEntitytainer*       entitytainer,
+                                            TheEntitytainerEntity  parent,
+                                            TheEntitytainerEntity* children,
+                                            int                    max_children );
+static int   entitytainer__find_entity( const TheEntitytainerEntity* entities, int count, TheEntitytainerEntity entity );
+static int   entitytainer__find_last_used( const TheEntitytainerEntity* entities, int count );
+static bool  entitytainer__is_chained( TheEntitytainer* entitytainer, int bucket_list_index );
+static TheEntitytainerEntity* entitytainer__next_page( TheEntitytainer*       entitytainer,
+                                                       TheEntitytainerEntity* page,
+                                                       bool                   allocate );
+static TheEntitytainerEntity*
+             entitytainer__chain_slot( TheEntitytainer* entitytainer, TheEntitytainerEntity* head, int position );
+static void  entitytainer__chain_trim( TheEntitytainer* entitytainer, TheEntitytainerEntity* head, int num_positions );
+static int   entitytainer__chain_add_child( TheEntitytainer*       entitytainer,
+                                            TheEntitytainerEntity* head,
+                                            TheEntitytainerEntity  child );
+static int   entitytainer__chain_find_child( TheEntitytainer*       entitytainer,
+                                             TheEntitytainerEntity* head,
+                                             TheEntitytainerEntity  child );
+static int   entitytainer__chain_remove_child( TheEntitytainer*       entitytainer,
+                                               TheEntitytainerEntity* head,
+                                               TheEntitytainerEntity  child );
+static int   entitytainer__chain_filter( TheEntitytainer*       entitytainer,
+                                         TheEntitytainerEntity* head,
+                                         TheEntitytainerEntity  parent,
+                                         bool                   compact );
+static int   entitytainer__link_child( TheEntitytainer*      entitytainer,
+                                       TheEntitytainerEntity parent,
+                                       TheEntitytainerEntity child );
+static void  entitytainer__unlink_no_holes( TheEntitytainer*      entitytainer,
+                                            TheEntitytainerEntity parent,
+                                            TheEntitytainerEntity child );
+static void  entitytainer__unlink_with_holes( TheEntitytainer*      entitytainer,
+                                              TheEntitytainerEntity parent,
+                                              TheEntitytainerEntity child );
+static void  entitytainer__link_children( TheEntitytainer*             entitytainer,
+                                          TheEntitytainerEntity        parent,
+                                          const TheEntitytainerEntity* children,
+                                          int                          num_children,
+                                          bool                         move_payloads );
+static void
+entitytainer__unlink_children( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int num_removed );
+static int   entitytainer__alloc_bucket( TheEntitytainer* entitytainer, TheEntitytainerBucketList* bucket_list );
+static void  entitytainer__add_page( TheEntitytainer* entitytainer, TheEntitytainerBucketList* bucket_list );
+static TheEntitytainerEntity* entitytainer__bucket( const TheEntitytainerBucketList* bucket_list, int bucket_index );
+static int                    entitytainer__bucket_index( const TheEntitytainerBucketList* bucket_list,
+                                                          const TheEntitytainerEntity*     bucket );
+static void  entitytainer__free_bucket( TheEntitytainer*           entitytainer,
+                                       TheEntitytainerBucketList* bucket_list,
+                                       int                        bucket_index );
+static int   entitytainer__load_acquire( int* value );
+static void  entitytainer__store_release( int* value, int new_value );
+static void  entitytainer__fence_acquire( void );
+static void  entitytainer__fence_release( void );
+static bool  entitytainer__has_free_bucket( TheEntitytainerBucketList* bucket_list );
+static int   entitytainer__count_free( const TheEntitytainerBucketList* bucket_list );
+static int   entitytainer__find_bucket_list( TheEntitytainer* entitytainer, int first_bucket_list, int capacity );
+static TheEntitytainerEntity*
+entitytainer__move_bucket( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int bucket_list_index_new );
+static int   entitytainer__demote_target( TheEntitytainer* entitytainer,
+                                          int              bucket_list_index,
+                                          int              num_positions,
+                                          bool             need_free );
+static void  entitytainer__demote( TheEntitytainer*      entitytainer,
+                                   TheEntitytainerEntity parent,
+                                   int                   bucket_list_index,
+                                   int                   num_positions );
+static int
+entitytainer__num_positions( TheEntitytainer* entitytainer, int bucket_list_index, TheEntitytainerEntity* bucket );
+static void entitytainer__defrag_swap( TheEntitytainer* entitytainer,
+                                       int              bucket_list_index,
+                                       int*             owners,
+                                       int              bucket_index,
+                                       int              bucket_index_new );
+static void entitytainer__fill_span( TheEntitytainer*          entitytainer,
+                                     TheEntitytainerEntry      lookup,
+                                     TheEntitytainerChildSpan* span );
+static void entitytainer__prefetch_entries( TheEntitytainer*             entitytainer,
+                                            const TheEntitytainerEntity* parents,
+                                            int                          num_parents );
+static void entitytainer__prefetch_buckets( TheEntitytainer*             entitytainer,
+                                            const TheEntitytainerEntity* parents,
+                                            int                          num_parents,
+                                            TheEntitytainerEntry*        lookups );
+
+// Compact save format
+#define ENTITYTAINER_CompactMagic 0x43455445 // "ETEC"
+#define ENTITYTAINER_CompactVersion 3
+#define ENTITYTAINER_CompactEndianness 0x01020304
+
+typedef struct {
+    int magic;
+    int version;
+    int endianness;
+    int entity_size;
+    int entry_size;
+    int flags; // The config's bools, see entitytainer__config_flags
+    int num_entries;
+    int num_bucket_lists;
+    int bucket_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int bucket_list_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int num_saved_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int first_free_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int first_retired_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int used_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int num_saved_entries;
+    int num_columns;
+    int order_count;
+    int order_holes;
+    int num_payload_columns;
+    int payload_sizes[ENTITYTAINER_MAX_PAYLOAD_COLUMNS];
+    int num_channels;
+} TheEntitytainerCompactHeader;
+
+// Then for each saved entry: its entity, its bucket (bucket list << 24 | bucket index, or 0) and its columns. Then the
+// order, and then each bucket list's saved buckets, followed by their payloads one column after the other.
+#define ENTITYTAINER_CompactListShift 24
+
+static int entitytainer__config_flags( const struct TheEntitytainerConfig* config );
+static int entitytainer__compact_size( const TheEntitytainerCompactHeader* header );
+
+// Delta save format
+#define ENTITYTAINER_DeltaMagic 0x44455445 // "ETED"
+#define ENTITYTAINER_DirtyWords( count ) ( ( ( count ) + 31 ) / 32 )
+
+typedef struct {
+    int magic;
+    int entity_size;
+    int entry_size;
+    int flags; // Without track_dirty, lazy_demotion and track_occupancy, the replica doesn't need them
+    int generation;
+    int entry_lookup_size;
+    int num_bucket_lists;
+    int bucket_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int bucket_list_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int num_dirty_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int first_free_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int first_retired_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int used_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int num_dirty_entries;
+    int num_columns;
+    int entry_hash_count;
+    int order_count;
+    int order_holes;
+    int order_start;
+    int num_payload_columns;
+    int payload_sizes[ENTITYTAINER_MAX_PAYLOAD_COLUMNS];
+    int num_channels;
+} TheEntitytainerDeltaHeader;
+
+// Then for each dirty entry: its index, its key (with hashed lookup), its lookup and its columns. Then the order from
+// order_start, and then each bucket list's dirty buckets, as the index followed by the bucket and its payloads.
+
+static void entitytainer__mark_entry( TheEntitytainer* entitytainer, int index );
+static void entitytainer__mark_bucket( TheEntitytainer* entitytainer, int bucket_list_index, int bucket_index );
+static void entitytainer__mark_page( TheEntitytainer* entitytainer, TheEntitytainerEntity* page );
+static void entitytainer__mark_order( TheEntitytainer* entitytainer, int position );
+static void entitytainer__mark_all( TheEntitytainer* entitytainer );
+static void entitytainer__set_bits( unsigned int* bits, int count );
+static void entitytainer__add_bits( unsigned int* bits, int count );
+static int  entitytainer__count_bits( const unsigned int* bits, int count );
+static int  entitytainer__first_clear_bit( const unsigned int* bits, int count );
+static int  entitytainer__next_set_bit( const unsigned int* bits, int first, int count );
+static int  entitytainer__last_set_bit( const unsigned int* bits, int count );
+static int  entitytainer__delta_size( const TheEntitytainerDeltaHeader* header, bool hashed_lookup );
+
+// With track_occupancy, every bucket outside the chained bucket list has a bit per child slot, set where there's a
+// child. Bit i is child index i, i.e. bucket[i + 1].
+#define ENTITYTAINER_OccupancyWords( bucket_size ) ENTITYTAINER_DirtyWords( ( bucket_size ) - 1 )
+
+static unsigned int*
+entitytainer__occupancy_bits( TheEntitytainer* entitytainer, int bucket_list_index, int bucket_index );
+static void  entitytainer__sync_occupancy( TheEntitytainer* entitytainer, int bucket_list_index, int bucket_index );
+static bool  entitytainer__has_occupancy( const struct TheEntitytainerConfig* config, int bucket_list_index );
+
+// Each bucket list has an array per payload column after all the bucket data, with a value per slot (the count and
+// page link slots have one too, it's just never used). They're aligned like the header, so a saved buffer loads with
+// the same padding.
+#define ENTITYTAINER_PayloadAlign ( (int)ENTITYTAINER_alignof( TheEntitytainer ) )
+
+static int   entitytainer__payload_size( const struct TheEntitytainerConfig* config );
+static unsigned char*
+entitytainer__payload( TheEntitytainer* entitytainer, const TheEntitytainerEntity* slot, int column );
+static void entitytainer__move_payloads( TheEntitytainer*             entitytainer,
+                                         TheEntitytainerEntity*       slot_dst,
+                                         const TheEntitytainerEntity* slot_src,
+                                         int                          count );
+static void entitytainer__clear_payloads( TheEntitytainer* entitytainer, TheEntitytainerEntity* slot, int count );
+static void entitytainer__swap_payloads( TheEntitytainer*       entitytainer,
+                                         TheEntitytainerEntity* slot_a,
+                                         TheEntitytainerEntity* slot_b,
+                                         int                    count );
+static void entitytainer__span_payloads( TheEntitytainer* entitytainer, TheEntitytainerChildSpan* span );
+static TheEntitytainerEntity*
+entitytainer__child_slot( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int position );
+
+#define ENTITYTAINER_DefragFree -1
+#define ENTITYTAINER_DefragFixed -2
+
+// A command waiting to be applied, with what it's sorted by.
+typedef struct {
+    TheEntitytainerCommand command;
+    int                    bucket_list_index; // The parent's
+    int                    order;             // Where it was recorded, over all buffers
+} TheEntitytainerQueuedCommand;
+
+#define ENTITYTAINER_SortByChild 0  // Child, order
+#define ENTITYTAINER_SortByParent 1 // Bucket list, parent, order
+
+static bool entitytainer__command_less( const TheEntitytainerQueuedCommand* a,
+                                        const TheEntitytainerQueuedCommand* b,
+                                        int                                 sort_by );
+static void entitytainer__sift_down( TheEntitytainerQueuedCommand* commands, int i_root, int i_end, int sort_by );
+static void entitytainer__sort_commands( TheEntitytainerQueuedCommand* commands, int num_commands, int sort_by );
+static bool entitytainer__record( TheEntitytainerCommandBuffer* buffer,
+                                  int                           type,
+                                  TheEntitytainerEntity         parent,
+                                  TheEntitytainerEntity         entity );
+static int  entitytainer__conflict( TheEntitytainerCommand*             conflicts,
+                                    int                                 max_conflicts,
+                                    int                                 num_conflicts,
+                                    const TheEntitytainerQueuedCommand* queued );
 
 ENTITYTAINER_API int
 entitytainer_needed_size( struct TheEntitytainerConfig* config ) {
+    struct TheEntitytainerConfig aligned = *config;
+    entitytainer__align_config( &aligned );
+    config = &aligned;
+
+    int lookup_size = entitytainer__lookup_size( config );
     int size_needed = sizeof( TheEntitytainer );
-    size_needed += config->num_entries * sizeof( TheEntitytainerEntry );           // Lookup
-    size_needed += config->num_entries * sizeof( TheEntitytainerEntity );          // Reverse lookup
+    size_needed += lookup_size * sizeof( TheEntitytainerEntry );                   // Lookup
+    size_needed += lookup_size * sizeof( TheEntitytainerEntity );                  // Reverse lookup
+    size_needed += config->track_num_children ? lookup_size * sizeof( TheEntitytainerEntity ) : 0; // Child counts
+    size_needed += config->track_child_index ? lookup_size * sizeof( TheEntitytainerEntity ) : 0; // Child index
+    size_needed += config->track_depth ? 2 * lookup_size * sizeof( TheEntitytainerEntity ) : 0;   // Depth and root
+    size_needed += config->track_order ? 2 * lookup_size * sizeof( TheEntitytainerEntity ) : 0;   // Order
+    size_needed += config->hashed_lookup ? lookup_size * sizeof( TheEntitytainerEntity ) : 0;     // Hash keys
     size_needed += config->num_bucket_lists * sizeof( TheEntitytainerBucketList ); // List structs
+    if ( config->bucket_page_size > 0 ) {
+        size_needed += config->num_bucket_lists * config->max_bucket_pages * sizeof( TheEntitytainerEntity* );
+    }
+    if ( config->track_dirty ) {
+        size_needed += ENTITYTAINER_DirtyWords( lookup_size ) * sizeof( unsigned int );
+    }
+
+    if ( config->lazy_demotion ) {
+        size_needed += ENTITYTAINER_DirtyWords( lookup_size ) * sizeof( unsigned int );
+    }
 
     // Bucket lists
     for ( int i = 0; i < config->num_bucket_lists; ++i ) {
         size_needed += config->bucket_list_sizes[i] * config->bucket_sizes[i] * sizeof( TheEntitytainerEntity );
+        if ( config->track_dirty ) {
+            size_needed += ENTITYTAINER_DirtyWords( config->bucket_list_sizes[i] ) * sizeof( unsigned int );
+        }
+
+        if ( entitytainer__has_occupancy( config, i ) ) {
+            int words    = ENTITYTAINER_OccupancyWords( config->bucket_sizes[i] );
+            size_needed += config->bucket_list_sizes[i] * words * sizeof( unsigned int );
+        }
+
+        size_needed += config->bucket_list_sizes[i] * config->bucket_sizes[i] * entitytainer__payload_size( config );
     }
 
     // Account for struct alignment, with good margins :D
-    int things_to_align = 1 + config->num_bucket_lists;
+    int things_to_align = 3 + config->num_bucket_lists * ( 1 + config->num_payload_columns );
     int safe_alignment  = sizeof( void* ) * 16;
     size_needed += things_to_align * safe_alignment;
+    size_needed += config->align_buckets ? config->num_bucket_lists * ENTITYTAINER_CacheLineSize : 0;
 
     return size_needed;
 }
@@ -243,106 +1042,143 @@ entitytainer_needed_size( struct TheEntitytainerConfig* config ) {
 ENTITYTAINER_API TheEntitytainer*
                  entitytainer_create( struct TheEntitytainerConfig* config ) {
 
-    unsigned char* buffer_start = (unsigned char*)config->memory;
-    ENTITYTAINER_memset( buffer_start, 0, config->memory_size );
-    unsigned char* buffer = buffer_start;
-    buffer = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer, (int)ENTITYTAINER_alignof( TheEntitytainer ) );
+    TheEntitytainer           layout;
+    TheEntitytainerBucketList layout_lists[ENTITYTAINER_MAX_BUCKET_LISTS];
+    TheEntitytainer*          entitytainer = entitytainer__layout( config, &layout, layout_lists );
+    if ( config->lazy_zeroing ) {
+        // Everything before the bucket data, and the bucket that a 0 entry points to.
+        unsigned char* bucket_data = (unsigned char*)layout_lists[0].bucket_data;
+        ENTITYTAINER_memset( config->memory, 0, bucket_data - (unsigned char*)config->memory );
+        ENTITYTAINER_memset( bucket_data, 0, layout_lists[0].bucket_size * sizeof( TheEntitytainerEntity ) );
+    }
+    else {
+        ENTITYTAINER_memset( config->memory, 0, config->memory_size );
+    }
 
-    TheEntitytainer* entitytainer         = (TheEntitytainer*)buffer;
-    entitytainer->num_bucket_lists        = config->num_bucket_lists;
-    entitytainer->remove_with_holes       = config->remove_with_holes;
-    entitytainer->keep_capacity_on_remove = config->keep_capacity_on_remove;
-    entitytainer->entry_lookup_size       = config->num_entries;
+    *entitytainer                          = layout;
+    for ( int i = 0; i < config->num_bucket_lists; ++i ) {
+        entitytainer->bucket_lists[i] = layout_lists[i];
+        for ( int i_page = 0; i_page < layout_lists[i].num_pages; ++i_page ) {
+            int offset                         = ( i_page << layout_lists[i].page_shift ) * layout_lists[i].bucket_size;
+            entitytainer->bucket_lists[i].pages[i_page] = layout_lists[i].bucket_data + offset;
+        }
+    }
 
-    ENTITYTAINER_memcpy( &entitytainer->config, config, sizeof( *config ) );
+    ENTITYTAINER_assert( *entitytainer->bucket_lists[0].bucket_data == 0 );
+    return entitytainer;
+}
 
-    buffer += sizeof( TheEntitytainer );
-    entitytainer->entry_lookup = (TheEntitytainerEntry*)buffer;
-    buffer += sizeof( TheEntitytainerEntry ) * config->num_entries;
-    entitytainer->entry_parent_lookup = (TheEntitytainerEntity*)buffer;
-    buffer += sizeof( TheEntitytainerEntity ) * config->num_entries;
+ENTITYTAINER_API void
+entitytainer_clear( TheEntitytainer* entitytainer ) {
+    int num_entries = entitytainer->entry_high_water;
+    ENTITYTAINER_memset( entitytainer->entry_lookup, 0, num_entries * sizeof( TheEntitytainerEntry ) );
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( entitytainer, columns );
+    for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+        ENTITYTAINER_memset( columns[i_column], 0, num_entries * sizeof( TheEntitytainerEntity ) );
+    }
 
-    buffer                     = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer,
-                                                               (int)ENTITYTAINER_alignof( TheEntitytainerBucketList ) );
-    entitytainer->bucket_lists = (TheEntitytainerBucketList*)buffer;
+    if ( entitytainer->entry_keys != NULL ) {
+        ENTITYTAINER_memset( entitytainer->entry_keys, 0, num_entries * sizeof( TheEntitytainerEntity ) );
+    }
 
-    unsigned char*         bucket_list_end   = buffer + sizeof( TheEntitytainerBucketList ) * config->num_bucket_lists;
-    TheEntitytainerEntity* bucket_data_start = (TheEntitytainerEntity*)bucket_list_end;
-    TheEntitytainerEntity* bucket_data       = bucket_data_start;
-    for ( int i = 0; i < config->num_bucket_lists; ++i ) {
-        // Just making sure that we don't go into the bucket data area
-        ENTITYTAINER_assert( buffer + sizeof( TheEntitytainerBucketList ) <= bucket_list_end );
+    if ( entitytainer->order != NULL ) {
+        ENTITYTAINER_memset( entitytainer->order, 0, entitytainer->order_count * sizeof( TheEntitytainerEntity ) );
+    }
 
-        // We need to do this because first_free_bucket is stored as an int.
-        ENTITYTAINER_assert( config->bucket_sizes[i] * sizeof( TheEntitytainerEntity ) >= sizeof( int ) );
+    if ( entitytainer->demote_candidates != NULL ) {
+        ENTITYTAINER_memset(
+          entitytainer->demote_candidates, 0, ENTITYTAINER_DirtyWords( num_entries ) * sizeof( unsigned int ) );
+    }
 
-        TheEntitytainerBucketList* list = (TheEntitytainerBucketList*)buffer;
-        list->bucket_data               = bucket_data;
-        list->bucket_size               = config->bucket_sizes[i];
-        list->total_buckets             = config->bucket_list_sizes[i];
-        list->first_free_bucket         = ENTITYTAINER_NoFreeBucket;
-        list->used_buckets              = 0;
+    // The zeroed entries go in the next delta (except entry 0, which is never written). The buckets don't need to,
+    // nothing points to them anymore. Bits above the high water can still be waiting from an earlier clear.
+    if ( entitytainer->track_dirty && num_entries > 0 ) {
+        entitytainer__add_bits( entitytainer->dirty_entries, num_entries );
+        entitytainer->dirty_entries[0] &= ~1u;
+        entitytainer->dirty_order = 0;
+    }
 
-        if ( i == 0 ) {
-            // We need this in order to ensure that we can use 0 as the default "invalid" entry.
-            list->used_buckets = 1;
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        // Buckets are handed out from the bottom, and only when there are no free ones, so the ones that have been
+        // used are the used and free ones.
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        int num_buckets = bucket_list->used_buckets + entitytainer__count_free( bucket_list );
+        if ( !entitytainer->config.lazy_zeroing ) {
+            int run = bucket_list->pages != NULL ? 1 << bucket_list->page_shift : num_buckets;
+            for ( int i_bucket = 0; i_bucket < num_buckets; i_bucket += run ) {
+                int count = run < num_buckets - i_bucket ? run : num_buckets - i_bucket;
+                ENTITYTAINER_memset( entitytainer__bucket( bucket_list, i_bucket ),
+                                     0,
+                                     count * bucket_list->bucket_size * sizeof( TheEntitytainerEntity ) );
+            }
+
+            for ( int i_column = 0; i_column < entitytainer->config.num_payload_columns; ++i_column ) {
+                int slots = num_buckets * bucket_list->bucket_size;
+                ENTITYTAINER_memset(
+                  bucket_list->payloads[i_column], 0, slots * entitytainer->config.payload_sizes[i_column] );
+            }
+
+            if ( entitytainer->occupancy[i_bl] != NULL ) {
+                int words = num_buckets * ENTITYTAINER_OccupancyWords( bucket_list->bucket_size );
+                ENTITYTAINER_memset( entitytainer->occupancy[i_bl], 0, words * sizeof( unsigned int ) );
+            }
         }
 
-        buffer += sizeof( TheEntitytainerBucketList );
-        bucket_data += list->bucket_size * list->total_buckets;
+        bucket_list->first_free_bucket    = ENTITYTAINER_NoFreeBucket;
+        bucket_list->first_retired_bucket = ENTITYTAINER_NoFreeBucket;
+        bucket_list->used_buckets         = i_bl == 0 ? 1 : 0;
+#if defined( ENTITYTAINER_STATS )
+        bucket_list->promotions      = 0;
+        bucket_list->demotions       = 0;
+        bucket_list->promotion_bytes = 0;
+#endif
     }
 
-    ENTITYTAINER_assert( *bucket_data_start == 0 );
-    ENTITYTAINER_assert( (unsigned char*)bucket_data <= buffer_start + config->memory_size );
-    return entitytainer;
+    ENTITYTAINER_memset( entitytainer->bucket_lists[0].bucket_data,
+                         0,
+                         entitytainer->bucket_lists[0].bucket_size * sizeof( TheEntitytainerEntity ) );
+    entitytainer->entry_hash_count = 0;
+    entitytainer->order_count      = 0;
+    entitytainer->order_holes      = 0;
+    entitytainer->order_dirty      = 0;
+    entitytainer->entry_high_water = 0;
 }
 
-ENTITYTAINER_API TheEntitytainer*
-                 entitytainer_realloc( TheEntitytainer* entitytainer_old, void* memory, int memory_size, float growth ) {
-    ENTITYTAINER_assert( false ); // Not yet implemented
-    (void)memory_size;
-
-    int num_entries = entitytainer_old->entry_lookup_size; // * growth;
-    int size_needed = sizeof( TheEntitytainer );
-    size_needed += (int)( num_entries * sizeof( TheEntitytainerEntry ) );
-    size_needed += (int)( num_entries * sizeof( TheEntitytainerEntity ) );
-    size_needed += entitytainer_old->num_bucket_lists * sizeof( TheEntitytainerBucketList );
-
-    for ( int i = 0; i < entitytainer_old->num_bucket_lists; ++i ) {
-        TheEntitytainerBucketList* bucket_list = &entitytainer_old->bucket_lists[i];
-        int old_bucket_size = bucket_list->total_buckets * bucket_list->bucket_size * sizeof( TheEntitytainerEntity );
-        size_needed += (int)( old_bucket_size * growth );
-    }
+ENTITYTAINER_API int
+entitytainer_realloc_needed_size( TheEntitytainer* entitytainer, float growth ) {
+    struct TheEntitytainerConfig config;
+    entitytainer__grow_config( entitytainer, -1, growth, &config );
+    return entitytainer_needed_size( &config );
+}
 
-    char* buffer = (char*)memory;
+ENTITYTAINER_API int
+entitytainer_realloc_bucket_list_needed_size( TheEntitytainer* entitytainer, int bucket_list_index, float growth ) {
+    struct TheEntitytainerConfig config;
+    entitytainer__grow_config( entitytainer, bucket_list_index, growth, &config );
+    return entitytainer_needed_size( &config );
+}
 
-    TheEntitytainer* entitytainer   = (TheEntitytainer*)buffer;
-    *entitytainer                   = *entitytainer_old;
-    entitytainer->entry_lookup_size = num_entries;
-    buffer += sizeof( TheEntitytainer );
-    entitytainer->entry_lookup = (TheEntitytainerEntry*)buffer;
-    buffer += sizeof( TheEntitytainerEntry ) * num_entries;
-    entitytainer->entry_parent_lookup = (TheEntitytainerEntity*)buffer;
-    buffer += sizeof( TheEntitytainerEntity ) * num_entries;
-
-    // char* bucket_data = buffer + sizeof( TheEntitytainerBucketList ) * entitytainer_old->num_bucket_lists;
-    // for ( int i = 0; i < entitytainer_old->num_bucket_lists; ++i ) {
-    //     // ENTITYTAINER_assert( bucket_data - buffer > bucket_sizes[i] * bucket_list_sizes[i] ); // >= ?
-    //     TheEntitytainerBucketList* list = (TheEntitytainerBucketList*)buffer;
-    //     list->bucket_data                   = bucket_data;
-    //     list->bucket_size               = entitytainer_old->bucket_lists[i].bucket_size;
-    //     list->total_buckets             = entitytainer_old->bucket_lists[i].total_buckets;
-    //     list->first_free_bucket         = entitytainer_old->bucket_lists[i].first_free_bucket;
-    //     list->used_buckets              = entitytainer_old->bucket_lists[i].used_buckets;
-
-    //     int old_buffer_size = entitytainer_old->bucket_lists[i].total_buckets * sizeof( TheEntitytainerEntry );
-    //     ENTITYTAINER_memcpy( list->bucket_data, entitytainer_old->bucket_lists[i].bucket_data, old_buffer_size );
-    //     buffer += sizeof( TheEntitytainerBucketList );
-    //     bucket_data += list->bucket_size * list->total_buckets;
-    // }
+ENTITYTAINER_API TheEntitytainer*
+                 entitytainer_realloc( TheEntitytainer* entitytainer_old, void* memory, int memory_size, float growth ) {
+    struct TheEntitytainerConfig config;
+    entitytainer__grow_config( entitytainer_old, -1, growth, &config );
+    config.memory      = memory;
+    config.memory_size = memory_size;
+    return entitytainer__realloc( entitytainer_old, &config );
+}
 
-    // ENTITYTAINER_assert( bucket_data == buffer + buffer_size );
-    return entitytainer;
+ENTITYTAINER_API TheEntitytainer*
+                 entitytainer_realloc_bucket_list( TheEntitytainer* entitytainer_old,
+                                                   void*            memory,
+                                                   int              memory_size,
+                                                   int              bucket_list_index,
+                                                   float            growth ) {
+    struct TheEntitytainerConfig config;
+    entitytainer__grow_config( entitytainer_old, bucket_list_index, growth, &config );
+    config.memory      = memory;
+    config.memory_size = memory_size;
+    return entitytainer__realloc( entitytainer_old, &config );
 }
 
 ENTITYTAINER_API bool
@@ -350,6 +1186,10 @@ entitytainer_needs_realloc( TheEntitytainer* entitytainer, float percent_free, i
     for ( int i = 0; i < entitytainer->num_bucket_lists; ++i ) {
         // ENTITYTAINER_assert( bucket_data - buffer > bucket_sizes[i] * bucket_list_sizes[i] ); // >= ?
         TheEntitytainerBucketList* list = &entitytainer->bucket_lists[i];
+        if ( list->pages != NULL ) {
+            continue; // Grows by itself
+        }
+
         if ( percent_free >= 0 ) {
             num_free_buckets = (int)( list->total_buckets * percent_free );
         }
@@ -363,564 +1203,4553 @@ entitytainer_needs_realloc( TheEntitytainer* entitytainer, float percent_free, i
 }
 
 ENTITYTAINER_API void
-entitytainer_add_entity( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
-    ENTITYTAINER_assert( entitytainer->entry_lookup[entity] == 0 );
-
-    TheEntitytainerBucketList* bucket_list  = &entitytainer->bucket_lists[0];
-    int                        bucket_index = bucket_list->used_buckets;
-    if ( bucket_list->first_free_bucket != ENTITYTAINER_NoFreeBucket ) {
-        // There's a freed bucket available
-        bucket_index                   = bucket_list->first_free_bucket;
-        int bucket_offset              = bucket_index * bucket_list->bucket_size;
-        bucket_list->first_free_bucket = bucket_list->bucket_data[bucket_offset];
-    }
-
-    // TODO: Move to larger bucket list if this one is full
-    ASSERT( bucket_list->used_buckets < bucket_list->total_buckets );
-    ++bucket_list->used_buckets;
+entitytainer_free_pages( TheEntitytainer* entitytainer ) {
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        if ( bucket_list->pages == NULL ) {
+            continue;
+        }
 
-    TheEntitytainerEntry* lookup = &entitytainer->entry_lookup[entity];
-    ENTITYTAINER_assert( *lookup == 0 );
-    *lookup = (TheEntitytainerEntry)bucket_index; // bucket list index is 0
+        // The first ones are in memory
+        int first_page = entitytainer->config.bucket_list_sizes[i_bl] >> bucket_list->page_shift;
+        for ( int i_page = first_page; i_page < bucket_list->num_pages; ++i_page ) {
+            entitytainer->config.free_page( entitytainer->config.page_user_data, bucket_list->pages[i_page] );
+            bucket_list->pages[i_page] = NULL;
+        }
 
-    int                    bucket_offset = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity* bucket        = bucket_list->bucket_data + bucket_offset;
-    ENTITYTAINER_memset( bucket, 0, bucket_list->bucket_size * sizeof( TheEntitytainerEntity ) );
+        bucket_list->num_pages     = first_page;
+        bucket_list->total_buckets = entitytainer->config.bucket_list_sizes[i_bl];
+    }
 }
 
 ENTITYTAINER_API void
-entitytainer_remove_entity( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entity];
-
-    if ( entitytainer->entry_parent_lookup[entity] != 0 ) {
-        if ( entitytainer->remove_with_holes ) {
-            entitytainer_remove_child_with_holes( entitytainer, entitytainer->entry_parent_lookup[entity], entity );
-        }
-        else {
-            entitytainer_remove_child_no_holes( entitytainer, entitytainer->entry_parent_lookup[entity], entity );
+entitytainer_get_stats( TheEntitytainer* entitytainer, TheEntitytainerStats* stats ) {
+    ENTITYTAINER_memset( stats, 0, sizeof( *stats ) );
+    stats->num_bucket_lists = entitytainer->num_bucket_lists;
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList*      bucket_list = entitytainer->bucket_lists + i_bl;
+        TheEntitytainerBucketListStats* list_stats  = stats->bucket_lists + i_bl;
+        list_stats->bucket_size                     = bucket_list->bucket_size;
+        list_stats->total_buckets                   = bucket_list->total_buckets;
+        list_stats->used_buckets                    = bucket_list->used_buckets;
+        for ( int i_retired = bucket_list->first_retired_bucket; i_retired != (int)ENTITYTAINER_NoFreeBucket;
+              i_retired     = *entitytainer__bucket( bucket_list, i_retired ) ) {
+            ++list_stats->retired_buckets;
         }
 
-        lookup = entitytainer->entry_lookup[entity];
-    }
-
-    if ( lookup == 0 ) {
-        // lookup is 0 for entities that don't have children (or haven't been added by _add_entity)
-        return;
+        // New buckets are only handed out when the free list is empty, so everything below is used or free.
+        list_stats->free_buckets       = entitytainer__count_free( bucket_list );
+        list_stats->high_water_buckets = bucket_list->used_buckets + list_stats->free_buckets;
+#if defined( ENTITYTAINER_STATS )
+        list_stats->promotions      = bucket_list->promotions;
+        list_stats->demotions       = bucket_list->demotions;
+        list_stats->promotion_bytes = bucket_list->promotion_bytes;
+#endif
     }
 
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = bucket_list->bucket_data + bucket_offset;
-    ASSERT( bucket[0] == 0 ); // Entity had children, remove them first.
-    *bucket                        = (TheEntitytainerEntity)bucket_list->first_free_bucket;
-    bucket_list->first_free_bucket = bucket_index;
-
-    entitytainer->entry_lookup[entity] = 0;
-    --bucket_list->used_buckets;
-}
+    for ( int i_entry = 1; i_entry < entitytainer->entry_lookup_size; ++i_entry ) {
+        TheEntitytainerEntry lookup = entitytainer->entry_lookup[i_entry];
+        if ( lookup == 0 ) {
+            continue;
+        }
 
-ENTITYTAINER_API void
-entitytainer_reserve( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int capacity ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = bucket_list->bucket_data + bucket_offset;
-    if ( bucket_list->bucket_size > capacity ) {
-        return;
+        int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+        TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+        int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+        int num_children = (int)*entitytainer__bucket( bucket_list, bucket_index );
+        ++stats->num_parents;
+        ++stats->child_count_histogram[num_children < ENTITYTAINER_StatsHistogramSize
+                                         ? num_children
+                                         : ENTITYTAINER_StatsHistogramSize - 1];
+        if ( num_children > stats->max_children ) {
+            stats->max_children = num_children;
+        }
     }
+}
 
-    TheEntitytainerBucketList* bucket_list_new       = NULL;
-    int                        bucket_list_index_new = -1;
-    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
-        bucket_list_new = &entitytainer->bucket_lists[i_bl];
-        if ( bucket_list_new->bucket_size > capacity + 1 ) {
-            bucket_list_index_new = i_bl;
-            break;
+ENTITYTAINER_API bool
+entitytainer_suggest_config( const int*                    histogram,
+                             int                           num_bins,
+                             int                           max_memory,
+                             struct TheEntitytainerConfig* config ) {
+    ENTITYTAINER_assert( num_bins >= 2 && num_bins <= ENTITYTAINER_StatsHistogramSize );
+
+    // A bucket list of size s fits s - 1 children, so the sizes go up to one past the last bin, and one more for the
+    // link when chaining. Costs are in bytes, -1 for not possible.
+    long long entity_size = (long long)sizeof( TheEntitytainerEntity );
+    int       min_size    = (int)( ( sizeof( int ) + entity_size - 1 ) / entity_size ); // See entitytainer__layout
+    int       max_size    = num_bins + 1;
+    long long parents_from[ENTITYTAINER_StatsHistogramSize + 1]; // With at least this many children
+    long long costs[ENTITYTAINER_MAX_BUCKET_LISTS][ENTITYTAINER_StatsHistogramSize + 2];
+    int       prev_sizes[ENTITYTAINER_MAX_BUCKET_LISTS][ENTITYTAINER_StatsHistogramSize + 2];
+    int       max_children = 0;
+    parents_from[num_bins] = 0;
+    for ( int i = num_bins - 1; i >= 0; --i ) {
+        parents_from[i] = parents_from[i + 1] + histogram[i];
+        if ( histogram[i] > 0 && max_children == 0 ) {
+            max_children = i;
         }
     }
 
-    ASSERT( bucket_list_index_new != -1 );
+    // costs[k][s] is for the children counts below s, in k + 1 bucket lists where the last one has size s. Every
+    // parent that gets to s children is copied out of it, with a promotion.
+    bool chained = histogram[num_bins - 1] > 0;
+    for ( int k = 0; k < ENTITYTAINER_MAX_BUCKET_LISTS; ++k ) {
+        for ( int size = 0; size <= max_size; ++size ) {
+            costs[k][size]      = -1;
+            prev_sizes[k][size] = 0;
+            if ( size < min_size || size >= num_bins ) {
+                continue;
+            }
 
-    int bucket_index_new = bucket_list_new->used_buckets;
-    if ( bucket_list_new->first_free_bucket != ENTITYTAINER_NoFreeBucket ) {
-        // There's a freed bucket available
-        bucket_index_new                   = bucket_list_new->first_free_bucket;
-        int bucket_offset_new              = bucket_index_new * bucket_list_new->bucket_size;
-        bucket_list_new->first_free_bucket = bucket_list_new->bucket_data[bucket_offset_new];
-    }
+            if ( k == 0 ) {
+                costs[k][size] = ( parents_from[0] - parents_from[size] ) * size * entity_size;
+                continue;
+            }
 
-    int                    bucket_offset_new = bucket_index_new * bucket_list_new->bucket_size;
-    TheEntitytainerEntity* bucket_new        = bucket_list_new->bucket_data + bucket_offset_new;
-    ENTITYTAINER_memset( bucket_new, 0, bucket_list_new->bucket_size * sizeof( TheEntitytainerEntity ) );
-    ENTITYTAINER_memcpy( bucket_new, bucket, bucket_list->bucket_size * sizeof( TheEntitytainerEntity ) );
+            for ( int prev = min_size; prev < size; ++prev ) {
+                if ( costs[k - 1][prev] < 0 ) {
+                    continue;
+                }
 
-    *bucket                        = (TheEntitytainerEntity)bucket_list->first_free_bucket;
-    bucket_list->first_free_bucket = bucket_index;
-    bucket                         = bucket_new;
+                long long cost = costs[k - 1][prev] + ( parents_from[prev] - parents_from[size] ) * size * entity_size +
+                                 parents_from[prev] * prev * entity_size;
+                if ( costs[k][size] < 0 || cost < costs[k][size] ) {
+                    costs[k][size]      = cost;
+                    prev_sizes[k][size] = prev;
+                }
+            }
+        }
+    }
 
-    bucket_list_new->used_buckets++;
-    bucket_list->used_buckets--;
+    // Then the last bucket list takes the rest. Without chaining it only has to fit the biggest parent.
+    long long best_costs[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int       best_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int       best_prev_sizes[ENTITYTAINER_MAX_BUCKET_LISTS];
+    for ( int k = 0; k < ENTITYTAINER_MAX_BUCKET_LISTS; ++k ) {
+        best_costs[k] = -1;
+        for ( int prev = k == 0 ? 0 : min_size; prev < ( k == 0 ? 1 : max_size ); ++prev ) {
+            long long prev_cost = 0;
+            if ( k > 0 ) {
+                if ( costs[k - 1][prev] < 0 ) {
+                    continue;
+                }
 
-    // Update lookup
-    TheEntitytainerEntry lookup_new =
-      ( TheEntitytainerEntry )( bucket_list_index_new << ENTITYTAINER_BucketListOffset );
-    lookup_new                         = lookup_new | (TheEntitytainerEntry)bucket_index_new;
-    entitytainer->entry_lookup[parent] = lookup_new;
-}
+                prev_cost = costs[k - 1][prev] + parents_from[prev] * prev * entity_size;
+            }
 
-ENTITYTAINER_API void
-entitytainer_add_child( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, TheEntitytainerEntity child ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = bucket_list->bucket_data + bucket_offset;
-    if ( bucket[0] + 1 == bucket_list->bucket_size ) {
-        ASSERT( bucket_list_index != 3 );
-        TheEntitytainerBucketList* bucket_list_new  = bucket_list + 1;
-        int                        bucket_index_new = bucket_list_new->used_buckets;
-        if ( bucket_list_new->first_free_bucket != ENTITYTAINER_NoFreeBucket ) {
-            // There's a freed bucket available
-            bucket_index_new                   = bucket_list_new->first_free_bucket;
-            int bucket_offset_new              = bucket_index_new * bucket_list_new->bucket_size;
-            bucket_list_new->first_free_bucket = bucket_list_new->bucket_data[bucket_offset_new];
-        }
-
-        int                    bucket_offset_new = bucket_index_new * bucket_list_new->bucket_size;
-        TheEntitytainerEntity* bucket_new        = bucket_list_new->bucket_data + bucket_offset_new;
-        ENTITYTAINER_memset( bucket_new, 0, bucket_list_new->bucket_size * sizeof( TheEntitytainerEntity ) );
-        ENTITYTAINER_memcpy( bucket_new, bucket, bucket_list->bucket_size * sizeof( TheEntitytainerEntity ) );
-
-        *bucket                        = (TheEntitytainerEntity)bucket_list->first_free_bucket;
-        bucket_list->first_free_bucket = bucket_index;
-        bucket                         = bucket_new;
-
-        bucket_list_new->used_buckets++;
-        bucket_list->used_buckets--;
-
-        // Update lookup
-        int                  bucket_list_index_new = ( bucket_list_index + 1 ) << ENTITYTAINER_BucketListOffset;
-        TheEntitytainerEntry lookup_new            = (TheEntitytainerEntry)bucket_list_index_new;
-        lookup_new                                 = lookup_new | (TheEntitytainerEntry)bucket_index_new;
-        entitytainer->entry_lookup[parent]         = lookup_new;
-    }
+            int size_begin = prev + 1 > min_size ? prev + 1 : min_size;
+            int size_end   = size_begin;
+            if ( chained ) {
+                size_begin = size_begin > 3 ? size_begin : 3;
+                size_end   = max_size;
+            }
+            else if ( size_begin < max_children + 1 ) {
+                size_begin = max_children + 1;
+                size_end   = size_begin;
+            }
 
-    // Update count and insert child into bucket
-    TheEntitytainerEntity count = bucket[0] + (TheEntitytainerEntity)1;
-    bucket[0]                   = count;
-    if ( entitytainer->remove_with_holes ) {
-        int i = 1;
-        for ( ; i < count; ++i ) {
-            if ( bucket[i] == ENTITYTAINER_InvalidEntity ) {
-                bucket[i] = child;
-                break;
+            for ( int size = size_begin; size <= size_end; ++size ) {
+                long long buckets = entitytainer__suggest_buckets( histogram, prev, num_bins - 1, size, chained );
+                long long cost    = prev_cost + buckets * size * entity_size;
+                if ( best_costs[k] < 0 || cost < best_costs[k] ) {
+                    best_costs[k]      = cost;
+                    best_sizes[k]      = size;
+                    best_prev_sizes[k] = prev;
+                }
             }
         }
-        if ( i == count ) {
-            // Didn't find a "holed" slot, add child to the end.
-            bucket[i] = child;
-        }
-    }
-    else {
-        bucket[count] = child;
     }
 
-    ASSERT( entitytainer->entry_parent_lookup[child] == ENTITYTAINER_InvalidEntity );
-    entitytainer->entry_parent_lookup[child] = parent;
-}
-
-ENTITYTAINER_API void
-entitytainer_add_child_at_index( TheEntitytainer*      entitytainer,
-                                 TheEntitytainerEntity parent,
-                                 TheEntitytainerEntity child,
-                                 int                   index ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = bucket_list->bucket_data + bucket_offset;
-    while ( index + 1 >= bucket_list->bucket_size ) {
-        ASSERT( bucket_list_index != 3 ); // No bucket lists with buckets of this size
-        TheEntitytainerBucketList* bucket_list_new  = bucket_list + 1;
-        int                        bucket_index_new = bucket_list_new->used_buckets;
-        if ( index + 1 >= bucket_list_new->bucket_size ) {
-            bucket_list_index += 1;
-            bucket_list = bucket_list_new;
+    // More bucket lists leave fewer bits in the entry for the bucket index, so take the cheapest one that fits.
+    int  bucket_sizes[ENTITYTAINER_MAX_BUCKET_LISTS][ENTITYTAINER_MAX_BUCKET_LISTS];
+    int  best_k = -1;
+    bool fits   = false;
+    for ( int k = 0; k < ENTITYTAINER_MAX_BUCKET_LISTS; ++k ) {
+        if ( best_costs[k] < 0 ) {
             continue;
         }
 
-        if ( bucket_list_new->first_free_bucket != ENTITYTAINER_NoFreeBucket ) {
-            // There's a freed bucket available
-            bucket_index_new                   = bucket_list_new->first_free_bucket;
-            int bucket_offset_new              = bucket_index_new * bucket_list_new->bucket_size;
-            bucket_list_new->first_free_bucket = bucket_list_new->bucket_data[bucket_offset_new];
+        bucket_sizes[k][k] = best_sizes[k];
+        for ( int i = k, size = best_prev_sizes[k]; i > 0; size = prev_sizes[i - 1][size], --i ) {
+            bucket_sizes[k][i - 1] = size;
         }
 
-        ASSERT( bucket_index_new < bucket_list_new->total_buckets ); // No free buckets at all
-        int                    bucket_offset_new = bucket_index_new * bucket_list_new->bucket_size;
-        TheEntitytainerEntity* bucket_new        = bucket_list_new->bucket_data + bucket_offset_new;
-        ENTITYTAINER_memset( bucket_new, 0, bucket_list_new->bucket_size * sizeof( TheEntitytainerEntity ) );
-        ENTITYTAINER_memcpy( bucket_new, bucket, bucket_list->bucket_size * sizeof( TheEntitytainerEntity ) );
+        bool k_fits      = true;
+        int  max_buckets = entitytainer__suggest_max_buckets( k + 1 );
+        for ( int i = 0; i <= k; ++i ) {
+            int       first   = i == 0 ? 0 : bucket_sizes[k][i - 1];
+            int       last    = i == k ? num_bins - 1 : bucket_sizes[k][i] - 1;
+            long long buckets =
+              entitytainer__suggest_buckets( histogram, first, last, bucket_sizes[k][i], i == k && chained );
+            k_fits            = k_fits && max_buckets > 0 && buckets + ( i == 0 ) <= max_buckets;
+        }
 
-        *bucket                        = (TheEntitytainerEntity)bucket_list->first_free_bucket;
-        bucket_list->first_free_bucket = bucket_index;
+        if ( best_k < 0 || ( k_fits && !fits ) || ( k_fits == fits && best_costs[k] < best_costs[best_k] ) ) {
+            best_k = k;
+            fits   = k_fits;
+        }
+    }
 
-        bucket_list_new->used_buckets++;
-        bucket_list->used_buckets--;
+    ENTITYTAINER_assert( best_k >= 0 );
+    long long exact_buckets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    long long bucket_bytes = 0;
+    int       max_buckets  = entitytainer__suggest_max_buckets( best_k + 1 );
+    config->num_bucket_lists       = best_k + 1;
+    config->chain_last_bucket_list = chained;
+    for ( int i = 0; i <= best_k; ++i ) {
+        int first               = i == 0 ? 0 : bucket_sizes[best_k][i - 1];
+        int last                = i == best_k ? num_bins - 1 : bucket_sizes[best_k][i] - 1;
+        config->bucket_sizes[i] = bucket_sizes[best_k][i];
+        exact_buckets[i] =
+          entitytainer__suggest_buckets( histogram, first, last, config->bucket_sizes[i], i == best_k && chained );
+        exact_buckets[i] += i == 0; // Bucket 0 of the first list is reserved
+        exact_buckets[i] = exact_buckets[i] < max_buckets ? exact_buckets[i] : max_buckets;
+        config->bucket_list_sizes[i] = (int)exact_buckets[i];
+        bucket_bytes += exact_buckets[i] * config->bucket_sizes[i] * entity_size;
+    }
 
-        bucket       = bucket_new;
-        bucket_list  = bucket_list_new;
-        bucket_index = bucket_index_new;
-        bucket_list_index += 1;
+    if ( !fits || entitytainer_needed_size( config ) > max_memory ) {
+        return false;
+    }
 
-        // Update lookup
-        int                  bucket_list_index_new = ( bucket_list_index ) << ENTITYTAINER_BucketListOffset;
-        TheEntitytainerEntry lookup_new            = (TheEntitytainerEntry)bucket_list_index_new;
-        lookup_new                                 = lookup_new | (TheEntitytainerEntry)bucket_index_new;
-        entitytainer->entry_lookup[parent]         = lookup_new;
+    // Spread the rest out in proportion, then back off until the alignment margins and dirty bits fit too.
+    long long spare = max_memory - entitytainer_needed_size( config );
+    for ( int i = 0; i <= best_k; ++i ) {
+        long long buckets            = exact_buckets[i] + exact_buckets[i] * spare / bucket_bytes;
+        config->bucket_list_sizes[i] = (int)( buckets < max_buckets ? buckets : max_buckets );
     }
 
-    // Update count and insert child into bucket
-    ASSERT( bucket[index + 1] == ENTITYTAINER_InvalidEntity );
-    TheEntitytainerEntity count = bucket[0] + (TheEntitytainerEntity)1;
-    bucket[0]                   = count;
-    bucket[index + 1]           = child;
+    while ( entitytainer_needed_size( config ) > max_memory ) {
+        for ( int i = 0; i <= best_k; ++i ) {
+            int extra = config->bucket_list_sizes[i] - (int)exact_buckets[i];
+            config->bucket_list_sizes[i] -= extra > 16 ? extra / 16 : extra > 0 ? 1 : 0;
+        }
+    }
 
-    ASSERT( entitytainer->entry_parent_lookup[child] == ENTITYTAINER_InvalidEntity );
-    entitytainer->entry_parent_lookup[child] = parent;
+    return true;
 }
 
-ENTITYTAINER_API void
-entitytainer_remove_child_no_holes( TheEntitytainer*      entitytainer,
-                                    TheEntitytainerEntity parent,
-                                    TheEntitytainerEntity child ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = (TheEntitytainerEntity*)( bucket_list->bucket_data + bucket_offset );
+static long long
+entitytainer__suggest_buckets( const int* histogram, int first, int last, int bucket_size, bool chained ) {
+    // Buckets needed by the parents with first to last children. A chained page holds bucket_size - 2 children.
+    long long buckets = 0;
+    for ( int i = first; i <= last; ++i ) {
+        int pages = 1;
+        if ( chained && i > bucket_size - 2 ) {
+            pages = ( i + bucket_size - 3 ) / ( bucket_size - 2 );
+        }
 
-    // Remove child from bucket, move children after forward one step.
-    int                    num_children  = bucket[0];
-    TheEntitytainerEntity* child_to_move = &bucket[1];
-    int                    count         = 0;
-    while ( *child_to_move != child && count < num_children ) {
-        ++count;
-        ++child_to_move;
+        buckets += (long long)histogram[i] * pages;
     }
 
-    ASSERT( count < num_children );
+    return buckets;
+}
 
-    for ( ; count < num_children - 1; ++count ) {
-        *child_to_move = *( child_to_move + 1 );
-        ++child_to_move;
+static int
+entitytainer__suggest_max_buckets( int num_bucket_lists ) {
+    // Same as in entitytainer__layout.
+#ifdef ENTITYTAINER_BucketListBitCount
+    int list_bit_count = ENTITYTAINER_BucketListBitCount;
+    if ( num_bucket_lists > ( 1 << list_bit_count ) ) {
+        return 0;
+    }
+#else
+    int list_bit_count = 1;
+    while ( ( 1 << list_bit_count ) < num_bucket_lists ) {
+        ++list_bit_count;
     }
+#endif
 
-    // Lower child count, clear entry
-    bucket[0]--;
-    entitytainer->entry_parent_lookup[child] = 0;
+    TheEntitytainer limits;
+    limits.entry_bucket_mask = (int)( ( 1u << ( (int)sizeof( TheEntitytainerEntry ) * 8 - list_bit_count ) ) - 1 );
+    return entitytainer__max_buckets( &limits );
+}
 
-    if ( entitytainer->keep_capacity_on_remove ) {
-        return;
+ENTITYTAINER_API int
+entitytainer_defragment_needed_size( TheEntitytainer* entitytainer ) {
+    int num_buckets = 0;
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        num_buckets += entitytainer->bucket_lists[i_bl].total_buckets;
     }
 
-    TheEntitytainerBucketList* bucket_list_prev =
-      bucket_list_index > 0 ? ( entitytainer->bucket_lists + bucket_list_index - 1 ) : NULL;
-    if ( bucket_list_prev != NULL && bucket[0] + 1 == bucket_list_prev->bucket_size ) {
-        TheEntitytainerBucketList* bucket_list_new  = bucket_list_prev;
-        int                        bucket_index_new = bucket_list_new->used_buckets;
-        if ( bucket_list_new->first_free_bucket != ENTITYTAINER_NoFreeBucket ) {
-            // There's a freed bucket available
-            bucket_index_new                   = bucket_list_new->first_free_bucket;
-            int bucket_offset_new              = bucket_index_new * bucket_list_new->bucket_size;
-            bucket_list_new->first_free_bucket = bucket_list_new->bucket_data[bucket_offset_new];
-        }
-
-        int                    bucket_offset_new = bucket_index_new * bucket_list_new->bucket_size;
-        TheEntitytainerEntity* bucket_new        = bucket_list_new->bucket_data + bucket_offset_new;
-        ENTITYTAINER_memcpy( bucket_new, bucket, bucket_list_new->bucket_size * sizeof( TheEntitytainerEntity ) );
+    return num_buckets * (int)sizeof( int );
+}
 
-        bucket_list_new->used_buckets++;
-        bucket_list->used_buckets--;
+ENTITYTAINER_API bool
+entitytainer_defragment( TheEntitytainer* entitytainer, int max_moves, void* scratch, int scratch_size ) {
+    ENTITYTAINER_assert( scratch_size >= entitytainer_defragment_needed_size( entitytainer ) );
+    (void)scratch_size;
+
+    // What's in each bucket: an entry index, a page (as -3 - the bucket that links to it), free, or not to be moved.
+    int* owners[ENTITYTAINER_MAX_BUCKET_LISTS];
+    int  targets[ENTITYTAINER_MAX_BUCKET_LISTS];
+    bool done = true;
+    for ( int i_bl = 0, offset = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        owners[i_bl]                           = (int*)scratch + offset;
+        offset += bucket_list->total_buckets;
+        for ( int i_bucket = 0; i_bucket < bucket_list->total_buckets; ++i_bucket ) {
+            owners[i_bl][i_bucket] = ENTITYTAINER_DefragFree;
+        }
 
-        // Update lookup
-        int                  bucket_list_index_new = ( bucket_list_index - 1 ) << ENTITYTAINER_BucketListOffset;
-        TheEntitytainerEntry lookup_new            = (TheEntitytainerEntry)bucket_list_index_new;
-        lookup_new                                 = lookup_new | (TheEntitytainerEntry)bucket_index_new;
-        entitytainer->entry_lookup[parent]         = lookup_new;
+        targets[i_bl] = i_bl == 0 ? 1 : 0; // Bucket 0 of the first list is never used, lookup 0 means no bucket.
+        if ( bucket_list->first_retired_bucket != (int)ENTITYTAINER_NoFreeBucket ) {
+            targets[i_bl] = -1;
+            done          = false;
+        }
     }
-}
 
-ENTITYTAINER_API void
-entitytainer_remove_child_with_holes( TheEntitytainer*      entitytainer,
-                                      TheEntitytainerEntity parent,
-                                      TheEntitytainerEntity child ) {
-    ENTITYTAINER_assert( entitytainer->remove_with_holes );
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = (TheEntitytainerEntity*)( bucket_list->bucket_data + bucket_offset );
+    owners[0][0] = ENTITYTAINER_DefragFixed;
+    for ( int i_entry = 1; i_entry < entitytainer->entry_lookup_size; ++i_entry ) {
+        TheEntitytainerEntry lookup = entitytainer->entry_lookup[i_entry];
+        if ( lookup == 0 ) {
+            continue;
+        }
 
-    // Remove child from bucket, move children after forward one step.
-    int capacity            = bucket_list->bucket_size;
-    int last_child_index    = 0;
-    int child_to_move_index = 0;
-    for ( int i = 1; i < capacity; i++ ) {
-        if ( bucket[i] == child ) {
-            child_to_move_index = i;
+        int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+        TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+        int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+        owners[bucket_list_index][bucket_index]      = i_entry;
+        if ( !entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+            continue;
         }
-        else if ( bucket[i] != ENTITYTAINER_InvalidEntity ) {
-            last_child_index = i;
+
+        int link = entitytainer__bucket( bucket_list, bucket_index )[bucket_list->bucket_size - 1];
+        for ( ; link != 0; link = entitytainer__bucket( bucket_list, link - 1 )[bucket_list->bucket_size - 1] ) {
+            owners[bucket_list_index][link - 1] = -3 - bucket_index;
+            bucket_index                        = link - 1;
         }
     }
 
-    ASSERT( child_to_move_index != 0 );
-    bucket[child_to_move_index] = ENTITYTAINER_InvalidEntity;
+    int num_moves = 0;
+    for ( int i_entry = 1; i_entry < entitytainer->entry_lookup_size && num_moves <= max_moves; ++i_entry ) {
+        TheEntitytainerEntry lookup            = entitytainer->entry_lookup[i_entry];
+        int                  bucket_list_index = lookup >> entitytainer->entry_list_shift;
+        if ( lookup == 0 || targets[bucket_list_index] == -1 ) {
+            continue;
+        }
 
-    // Lower child count, clear entry
-    bucket[0]--;
-    entitytainer->entry_parent_lookup[child] = 0;
+        TheEntitytainerBucketList* bucket_list  = entitytainer->bucket_lists + bucket_list_index;
+        int                        bucket_index = lookup & entitytainer->entry_bucket_mask;
+        while ( true ) {
+            int target = targets[bucket_list_index]++;
+            if ( bucket_index != target ) {
+                if ( num_moves == max_moves ) {
+                    ++num_moves; // Makes the outer loop stop too
+                    done = false;
+                    break;
+                }
 
-    if ( entitytainer->keep_capacity_on_remove ) {
-        return;
+                entitytainer__defrag_swap(
+                  entitytainer, bucket_list_index, owners[bucket_list_index], bucket_index, target );
+                ++num_moves;
+            }
+
+            // Then the pages, if any
+            if ( !entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+                break;
+            }
+
+            int link = entitytainer__bucket( bucket_list, target )[bucket_list->bucket_size - 1];
+            if ( link == 0 ) {
+                break;
+            }
+
+            bucket_index = link - 1;
+        }
     }
 
-    TheEntitytainerBucketList* bucket_list_prev =
-      bucket_list_index > 0 ? ( entitytainer->bucket_lists + bucket_list_index - 1 ) : NULL;
-    if ( bucket_list_prev != NULL && last_child_index + ENTITYTAINER_ShrinkMargin < bucket_list_prev->bucket_size ) {
-        // We've shrunk enough to fit in the previous bucket, move.
-        TheEntitytainerBucketList* bucket_list_new   = bucket_list_prev;
-        int                        bucket_index_new  = bucket_list_new->used_buckets;
-        int                        bucket_offset_new = bucket_index_new * bucket_list_new->bucket_size;
-        if ( bucket_list_new->first_free_bucket != ENTITYTAINER_NoFreeBucket ) {
-            // There's a freed bucket available
-            bucket_index_new                   = bucket_list_new->first_free_bucket;
-            bucket_offset_new                  = bucket_index_new * bucket_list_new->bucket_size;
-            bucket_list_new->first_free_bucket = bucket_list_new->bucket_data[bucket_offset_new];
+    // All the free buckets below the highest used one go back into the free list, lowest first. The ones above it
+    // are handed out in order anyway.
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        if ( targets[i_bl] == -1 ) {
+            continue;
+        }
+
+        int end = bucket_list->total_buckets;
+        while ( end > 0 && owners[i_bl][end - 1] == ENTITYTAINER_DefragFree ) {
+            --end;
+        }
+
+        bucket_list->first_free_bucket = ENTITYTAINER_NoFreeBucket;
+        for ( int i_bucket = end - 1; i_bucket >= 0; --i_bucket ) {
+            if ( owners[i_bl][i_bucket] == ENTITYTAINER_DefragFree ) {
+                *entitytainer__bucket( bucket_list, i_bucket ) =
+                  (TheEntitytainerEntity)bucket_list->first_free_bucket;
+                bucket_list->first_free_bucket = i_bucket;
+                entitytainer__mark_bucket( entitytainer, i_bl, i_bucket );
+            }
         }
+    }
+
+    return done;
+}
+
+ENTITYTAINER_API bool
+entitytainer_maintain( TheEntitytainer* entitytainer, int max_demotions ) {
+    ENTITYTAINER_assert( entitytainer->lazy_demotion );
+    for ( int i_word = 0; i_word < ENTITYTAINER_DirtyWords( entitytainer->entry_lookup_size ); ++i_word ) {
+        for ( int i_entry = i_word * 32; entitytainer->demote_candidates[i_word] != 0; ++i_entry ) {
+            unsigned int bit = 1u << ( i_entry & 31 );
+            if ( ( entitytainer->demote_candidates[i_word] & bit ) == 0 ) {
+                continue;
+            }
 
-        TheEntitytainerEntity* bucket_new = bucket_list_new->bucket_data + bucket_offset_new;
-        ENTITYTAINER_memcpy( bucket_new, bucket, bucket_list_new->bucket_size * sizeof( TheEntitytainerEntity ) );
+            if ( max_demotions <= 0 ) {
+                return false;
+            }
 
-        bucket_list_new->used_buckets++;
-        bucket_list->used_buckets--;
+            // The marks are only hints, the parent can have been removed or gotten more children since, or with
+            // hashed lookup another entity can have moved into the slot.
+            entitytainer->demote_candidates[i_word] &= ~bit;
+            TheEntitytainerEntry  lookup = entitytainer->entry_lookup[i_entry];
+            TheEntitytainerEntity parent =
+              entitytainer->hashed_lookup ? entitytainer->entry_keys[i_entry] : (TheEntitytainerEntity)i_entry;
+            if ( lookup == 0 || parent == ENTITYTAINER_InvalidEntity ) {
+                continue;
+            }
 
-        // Update lookup
-        int                  bucket_list_index_new = ( bucket_list_index - 1 ) << ENTITYTAINER_BucketListOffset;
-        TheEntitytainerEntry lookup_new            = (TheEntitytainerEntry)bucket_list_index_new;
-        lookup_new                                 = lookup_new | (TheEntitytainerEntry)bucket_index_new;
-        entitytainer->entry_lookup[parent]         = lookup_new;
+            int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+            TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+            int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+            TheEntitytainerEntity*     bucket = entitytainer__bucket( bucket_list, bucket_index );
+            int num_positions         = entitytainer__num_positions( entitytainer, bucket_list_index, bucket );
+            int bucket_list_index_new =
+              entitytainer__demote_target( entitytainer, bucket_list_index, num_positions, true );
+            if ( bucket_list_index_new < bucket_list_index ) {
+                entitytainer__move_bucket( entitytainer, parent, bucket_list_index_new );
+                --max_demotions;
+            }
+        }
     }
+
+    return true;
 }
 
 ENTITYTAINER_API void
-entitytainer_get_children( TheEntitytainer*        entitytainer,
-                           TheEntitytainerEntity   parent,
-                           TheEntitytainerEntity** children,
-                           int*                    num_children,
-                           int*                    capacity ) {
+entitytainer_add_entity( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    ENTITYTAINER_assert( entitytainer->entry_lookup[entitytainer__index( entitytainer, entity )] == 0 );
 
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = (TheEntitytainerEntity*)( bucket_list->bucket_data + bucket_offset );
-    *num_children                                = (int)bucket[0];
-    *children                                    = bucket + 1;
-    *capacity                                    = bucket_list->bucket_size - 1;
+    // TODO: Move to larger bucket list if this one is full
+    TheEntitytainerBucketList* bucket_list  = &entitytainer->bucket_lists[0];
+    int                        bucket_index = entitytainer__alloc_bucket( entitytainer, bucket_list );
+
+    TheEntitytainerEntry* lookup = &entitytainer->entry_lookup[entitytainer__insert_index( entitytainer, entity )];
+    ENTITYTAINER_assert( *lookup == 0 );
+    *lookup = (TheEntitytainerEntry)bucket_index; // bucket list index is 0
+
+    // It's already in the order if it's someone's child.
+    if ( entitytainer->order != NULL &&
+         entitytainer->entry_order[entitytainer__index( entitytainer, entity )] == ENTITYTAINER_InvalidEntity ) {
+        entitytainer__order_append( entitytainer, entity );
+    }
+
+    TheEntitytainerEntity* bucket        = entitytainer__bucket( bucket_list, bucket_index );
+    ENTITYTAINER_memset( bucket, 0, bucket_list->bucket_size * sizeof( TheEntitytainerEntity ) );
 }
 
-ENTITYTAINER_API int
-entitytainer_num_children( TheEntitytainer* entitytainer, TheEntitytainerEntity parent ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
+ENTITYTAINER_API void
+entitytainer_remove_entity( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    TheEntitytainerEntry  lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, entity )];
+    TheEntitytainerEntity parent = entitytainer->entry_parent_lookup[entitytainer__index( entitytainer, entity )];
+
+    if ( parent != 0 ) {
+        if ( entitytainer->remove_with_holes ) {
+            entitytainer_remove_child_with_holes( entitytainer, parent, entity );
+        }
+        else {
+            entitytainer_remove_child_no_holes( entitytainer, parent, entity );
+        }
+
+        lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, entity )];
+    }
+
+    if ( lookup == 0 ) {
+        // lookup is 0 for entities that don't have children (or haven't been added by _add_entity)
+        return;
+    }
+
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
     TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = (TheEntitytainerEntity*)( bucket_list->bucket_data + bucket_offset );
-    return (int)bucket[0];
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    ENTITYTAINER_assert( bucket[0] == 0 ); // Entity had children, remove them first.
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        // There can be pages left if keep_capacity_on_remove is set.
+        entitytainer__chain_trim( entitytainer, bucket, 0 );
+    }
+
+    entitytainer__free_bucket( entitytainer, bucket_list, bucket_index );
+    entitytainer->entry_lookup[entitytainer__index( entitytainer, entity )] = 0;
+    entitytainer__release_index( entitytainer, entity );
 }
 
 ENTITYTAINER_API int
-entitytainer_get_child_index( TheEntitytainer*      entitytainer,
-                              TheEntitytainerEntity parent,
-                              TheEntitytainerEntity child ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[parent];
-    ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
-    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = (TheEntitytainerEntity*)( bucket_list->bucket_data + bucket_offset );
-    int                        num_children      = (int)bucket[0];
-    for ( int i = 0; i < num_children; ++i ) {
-        if ( bucket[1 + i] == child ) {
-            return i;
+entitytainer_remove_subtree( TheEntitytainer*       entitytainer,
+                             TheEntitytainerEntity  entity,
+                             TheEntitytainerEntity* removed,
+                             int                    max_removed ) {
+    if ( max_removed < 1 ) {
+        return -1;
+    }
+
+    int num_descendants = entitytainer_get_subtree( entitytainer, entity, removed + 1, max_removed - 1, false );
+    if ( num_descendants == -1 ) {
+        return -1;
+    }
+
+    // Only the top one needs to be removed from its parent's bucket, the rest of the buckets are freed as they are.
+    removed[0]                   = entity;
+    TheEntitytainerEntity parent = entitytainer_get_parent( entitytainer, entity );
+    if ( parent != 0 ) {
+        if ( entitytainer->remove_with_holes ) {
+            entitytainer_remove_child_with_holes( entitytainer, parent, entity );
+        }
+        else {
+            entitytainer_remove_child_no_holes( entitytainer, parent, entity );
         }
     }
 
-    return -1;
-}
+    for ( int i_removed = 0; i_removed <= num_descendants; ++i_removed ) {
+        TheEntitytainerEntity descendant   = removed[i_removed];
+        int                   lookup_index = entitytainer__index( entitytainer, descendant );
+        TheEntitytainerEntry  lookup       = entitytainer->entry_lookup[lookup_index];
+        if ( entitytainer->order != NULL ) {
+            entitytainer__order_remove( entitytainer, descendant );
+        }
 
-ENTITYTAINER_API TheEntitytainerEntity
-entitytainer_get_parent( TheEntitytainer* entitytainer, TheEntitytainerEntity child ) {
-    TheEntitytainerEntity parent = entitytainer->entry_parent_lookup[child];
-    return parent;
+        TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+        int                    num_columns = entitytainer__entry_columns( entitytainer, columns );
+        for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+            columns[i_column][lookup_index] = 0;
+        }
+
+        if ( lookup != 0 ) {
+            int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+            TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+            int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+            TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+            if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+                entitytainer__chain_trim( entitytainer, bucket, 0 );
+            }
+
+            entitytainer__free_bucket( entitytainer, bucket_list, bucket_index );
+            entitytainer->entry_lookup[lookup_index] = 0;
+        }
+
+        entitytainer__release_index( entitytainer, descendant );
+    }
+
+    return num_descendants + 1;
 }
 
-ENTITYTAINER_API bool
-entitytainer_is_added( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entity];
-    return lookup != 0;
+ENTITYTAINER_API void
+entitytainer_reserve( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int capacity ) {
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    if ( !entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        if ( bucket_list->bucket_size > capacity ) {
+            return;
+        }
+
+        bucket_list_index = entitytainer__find_bucket_list( entitytainer, bucket_list_index + 1, capacity + 1 );
+        ENTITYTAINER_assert( bucket_list_index != -1 );
+        bucket = entitytainer__move_bucket( entitytainer, parent, bucket_list_index );
+    }
+
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) && capacity > 0 ) {
+        // Allocate the pages up front.
+        entitytainer__chain_slot( entitytainer, bucket, capacity - 1 );
+    }
 }
 
 ENTITYTAINER_API void
-entitytainer_remove_holes( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
-    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entity];
+entitytainer_add_child( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, TheEntitytainerEntity child ) {
+    int position    = entitytainer__link_child( entitytainer, parent, child );
+    int child_index = entitytainer__insert_index( entitytainer, child );
+    ENTITYTAINER_assert( entitytainer->entry_parent_lookup[child_index] == ENTITYTAINER_InvalidEntity );
+    entitytainer->entry_parent_lookup[child_index] = parent;
+    entitytainer__set_child_index( entitytainer, child, position );
+    entitytainer__update_depth( entitytainer, child );
+    entitytainer__order_attach( entitytainer, child );
+}
+
+static int
+entitytainer__link_child( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, TheEntitytainerEntity child ) {
+    // The bucket half of add_child, returns the child's position.
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
     ENTITYTAINER_assert( lookup != 0 );
-    int                        bucket_list_index = lookup >> ENTITYTAINER_BucketListOffset;
+    ENTITYTAINER_assert( parent % entitytainer->num_channels == child % entitytainer->num_channels );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
     TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
-    int                        bucket_index      = lookup & ENTITYTAINER_BucketMask;
-    int                        bucket_offset     = bucket_index * bucket_list->bucket_size;
-    TheEntitytainerEntity*     bucket            = (TheEntitytainerEntity*)( bucket_list->bucket_data + bucket_offset );
-    int                        first_free_index  = 1;
-    for ( int i = 1; i < bucket_list->bucket_size; ++i ) {
-        TheEntitytainerEntity child = bucket[i];
-        if ( child != ENTITYTAINER_InvalidEntity ) {
-            for ( int i_free = first_free_index; i_free < i; ++i_free ) {
-                if ( bucket[i_free] == ENTITYTAINER_InvalidEntity ) {
-                    first_free_index = i_free + 1;
-                    bucket[i_free]   = child;
-                    bucket[i]        = ENTITYTAINER_InvalidEntity;
-                    break;
-                }
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+    int                        position          = 0;
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        position = entitytainer__chain_add_child( entitytainer, bucket, child );
+    }
+    else {
+        if ( (int)bucket[0] + 1 == bucket_list->bucket_size ) {
+            // Already in the largest bucket list
+            ENTITYTAINER_assert( bucket_list_index + 1 < entitytainer->num_bucket_lists );
+            bucket       = entitytainer__move_bucket( entitytainer, parent, ++bucket_list_index );
+            bucket_list  = entitytainer->bucket_lists + bucket_list_index;
+            bucket_index = entitytainer__bucket_index( bucket_list, bucket );
+        }
+
+        // Update count and insert child into bucket
+        TheEntitytainerEntity count     = bucket[0] + (TheEntitytainerEntity)1;
+        unsigned int*         occupancy = entitytainer__occupancy_bits( entitytainer, bucket_list_index, bucket_index );
+        bucket[0]                       = count;
+        if ( occupancy != NULL ) {
+            // Same as below, the first hole is before the end if there is one.
+            position = entitytainer__first_clear_bit( occupancy, count - 1 );
+            occupancy[position >> 5] |= 1u << ( position & 31 );
+            bucket[position + 1] = child;
+        }
+        else if ( entitytainer->remove_with_holes ) {
+            position = entitytainer__find_entity( bucket + 1, count - 1, ENTITYTAINER_InvalidEntity );
+            if ( position == -1 ) {
+                // Didn't find a "holed" slot, add child to the end.
+                position = count - 1;
             }
+
+            bucket[position + 1] = child;
         }
+        else {
+            bucket[count] = child;
+            position      = count - 1;
+        }
+
+        entitytainer__clear_payloads( entitytainer, &bucket[position + 1], 1 );
     }
+
+    entitytainer__set_num_children( entitytainer, parent, (int)bucket[0] );
+    return position;
 }
 
-ENTITYTAINER_API int
-entitytainer_save( TheEntitytainer* entitytainer, unsigned char* buffer, int buffer_size ) {
+ENTITYTAINER_API void
+entitytainer_add_child_at_index( TheEntitytainer*      entitytainer,
+                                 TheEntitytainerEntity parent,
+                                 TheEntitytainerEntity child,
+                                 int                   index ) {
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+    if ( !entitytainer__is_chained( entitytainer, bucket_list_index ) && index + 1 >= bucket_list->bucket_size ) {
+        bucket_list_index = entitytainer__find_bucket_list( entitytainer, bucket_list_index + 1, index + 1 );
+        ENTITYTAINER_assert( bucket_list_index != -1 ); // No bucket lists with buckets of this size
+        bucket       = entitytainer__move_bucket( entitytainer, parent, bucket_list_index );
+        bucket_list  = entitytainer->bucket_lists + bucket_list_index;
+        bucket_index = entitytainer__bucket_index( bucket_list, bucket );
+    }
 
-    TheEntitytainerBucketList* last       = &entitytainer->bucket_lists[entitytainer->num_bucket_lists - 1];
-    TheEntitytainerEntity*     entity_end = last->bucket_data + last->bucket_size * last->total_buckets;
-    unsigned char*             begin      = (unsigned char*)entitytainer;
-    unsigned char*             end        = (unsigned char*)entity_end;
-    int                        size       = (int)( end - begin );
-    if ( size > buffer_size ) {
-        return size;
+    // Update count and insert child into bucket
+    TheEntitytainerEntity* slot = entitytainer__is_chained( entitytainer, bucket_list_index )
+                                    ? entitytainer__chain_slot( entitytainer, bucket, index )
+                                    : &bucket[index + 1];
+    ENTITYTAINER_assert( *slot == ENTITYTAINER_InvalidEntity );
+    TheEntitytainerEntity count = bucket[0] + (TheEntitytainerEntity)1;
+    bucket[0]                   = count;
+    *slot                       = child;
+    entitytainer__set_num_children( entitytainer, parent, (int)count );
+    entitytainer__clear_payloads( entitytainer, slot, 1 );
+    unsigned int* occupancy = entitytainer__occupancy_bits( entitytainer, bucket_list_index, bucket_index );
+    if ( occupancy != NULL ) {
+        occupancy[index >> 5] |= 1u << ( index & 31 );
     }
 
-    ENTITYTAINER_memcpy( buffer, entitytainer, size );
-    return size;
+    int child_index = entitytainer__insert_index( entitytainer, child );
+    ENTITYTAINER_assert( entitytainer->entry_parent_lookup[child_index] == ENTITYTAINER_InvalidEntity );
+    entitytainer->entry_parent_lookup[child_index] = parent;
+    entitytainer__set_child_index( entitytainer, child, index );
+    entitytainer__update_depth( entitytainer, child );
+    entitytainer__order_attach( entitytainer, child );
 }
 
-ENTITYTAINER_API TheEntitytainer*
-                 entitytainer_load( unsigned char* buffer, int buffer_size ) {
-    ENTITYTAINER_assert( entitytainer__ptr_to_aligned_ptr( buffer, (int)ENTITYTAINER_alignof( TheEntitytainer ) ) ==
-                         buffer );
+ENTITYTAINER_API void
+entitytainer_remove_child_no_holes( TheEntitytainer*      entitytainer,
+                                    TheEntitytainerEntity parent,
+                                    TheEntitytainerEntity child ) {
+    entitytainer__unlink_no_holes( entitytainer, parent, child );
+    entitytainer->entry_parent_lookup[entitytainer__index( entitytainer, child )] = 0;
+    entitytainer__update_depth( entitytainer, child );
+    entitytainer__release_index( entitytainer, child );
+}
 
-    // Fix pointers
-    TheEntitytainer* entitytainer = (TheEntitytainer*)buffer;
-    buffer += sizeof( TheEntitytainer );
-    entitytainer->entry_lookup = (TheEntitytainerEntry*)buffer;
-    buffer += sizeof( TheEntitytainerEntry ) * entitytainer->entry_lookup_size;
-    entitytainer->entry_parent_lookup = (TheEntitytainerEntity*)buffer;
-    buffer += sizeof( TheEntitytainerEntity ) * entitytainer->entry_lookup_size;
+static void
+entitytainer__unlink_no_holes( TheEntitytainer*      entitytainer,
+                               TheEntitytainerEntity parent,
+                               TheEntitytainerEntity child ) {
+    // The bucket half of remove_child_no_holes, including moving the parent down.
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
 
-    buffer                     = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer,
-                                                               (int)ENTITYTAINER_alignof( TheEntitytainerBucketList ) );
-    entitytainer->bucket_lists = (TheEntitytainerBucketList*)buffer;
+    // Remove child from bucket, move children after forward one step.
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        entitytainer__chain_remove_child( entitytainer, bucket, child );
+    }
+    else {
+        int                    num_children  = bucket[0];
+        int                    count         = entitytainer__child_position( entitytainer, child );
+        if ( count == -1 ) {
+            count = entitytainer__find_entity( bucket + 1, num_children, child );
+        }
 
-    unsigned char* bucket_list_end = buffer + sizeof( TheEntitytainerBucketList ) * entitytainer->num_bucket_lists;
-    TheEntitytainerEntity* bucket_data_start = (TheEntitytainerEntity*)bucket_list_end;
-    TheEntitytainerEntity* bucket_data       = bucket_data_start;
-    for ( int i = 0; i < entitytainer->num_bucket_lists; ++i ) {
-        TheEntitytainerBucketList* list = (TheEntitytainerBucketList*)buffer;
-        list->bucket_data               = bucket_data;
-        buffer += sizeof( TheEntitytainerBucketList );
-        bucket_data += list->bucket_size * list->total_buckets;
+        ENTITYTAINER_assert( count != -1 && count < num_children );
+        TheEntitytainerEntity* child_to_move = &bucket[1 + count];
+        ENTITYTAINER_assert( *child_to_move == child );
+
+        if ( entitytainer->remove_unordered ) {
+            // Fill the gap with the last child instead of moving all of them.
+            TheEntitytainerEntity last_child = bucket[num_children];
+            bucket[num_children]             = ENTITYTAINER_InvalidEntity;
+            if ( last_child != child ) {
+                *child_to_move = last_child;
+                entitytainer__move_payloads( entitytainer, child_to_move, &bucket[num_children], 1 );
+                entitytainer__set_child_index( entitytainer, last_child, count );
+            }
+        }
+        else {
+            entitytainer__move_payloads( entitytainer, child_to_move, child_to_move + 1, num_children - 1 - count );
+            for ( ; count < num_children - 1; ++count ) {
+                *child_to_move = *( child_to_move + 1 );
+                entitytainer__set_child_index( entitytainer, *child_to_move, count );
+                ++child_to_move;
+            }
+
+            // The slots past the count stay empty, move_bucket copies them into a chain.
+            *child_to_move = ENTITYTAINER_InvalidEntity;
+        }
+
+        entitytainer__sync_occupancy( entitytainer, bucket_list_index, bucket_index );
     }
 
-    (void)buffer_size;
-    ENTITYTAINER_assert( (unsigned char*)bucket_data <= buffer + buffer_size );
-    return entitytainer;
+    // Lower child count
+    bucket[0]--;
+    entitytainer__set_num_children( entitytainer, parent, (int)bucket[0] );
+    entitytainer__demote( entitytainer, parent, bucket_list_index, (int)bucket[0] );
 }
 
 ENTITYTAINER_API void
-entitytainer_load_into( TheEntitytainer* entitytainer_dst, const TheEntitytainer* entitytainer_src ) {
-    // if ( ENTITYTAINER_memcmp( &entitytainer_dst->config, &entitytainer_src->config, sizeof( TheEntitytainerConfig ) )
-    // ==
-    //      0 ) {
-    //     ENTITYTAINER_memcpy( entitytainer_dst, entitytainer_src, sizeof( TheEntitytainerConfig ) );
-    //     return;
-    // }
+entitytainer_remove_child_with_holes( TheEntitytainer*      entitytainer,
+                                      TheEntitytainerEntity parent,
+                                      TheEntitytainerEntity child ) {
+    ENTITYTAINER_assert( entitytainer->remove_with_holes );
+    entitytainer__unlink_with_holes( entitytainer, parent, child );
+    entitytainer->entry_parent_lookup[entitytainer__index( entitytainer, child )] = 0;
+    entitytainer__update_depth( entitytainer, child );
+    entitytainer__release_index( entitytainer, child );
+}
 
-    // Only allow grow for now
-    ASSERT( entitytainer_src->config.num_bucket_lists == entitytainer_dst->config.num_bucket_lists );
-    for ( int i_bl = 0; i_bl < entitytainer_src->config.num_bucket_lists; ++i_bl ) {
-        ASSERT( entitytainer_src->config.bucket_sizes[i_bl] <= entitytainer_dst->config.bucket_sizes[i_bl] );
-        ASSERT( entitytainer_src->config.bucket_list_sizes[i_bl] <= entitytainer_dst->config.bucket_list_sizes[i_bl] );
+static void
+entitytainer__unlink_with_holes( TheEntitytainer*      entitytainer,
+                                 TheEntitytainerEntity parent,
+                                 TheEntitytainerEntity child ) {
+    // Same for remove_child_with_holes
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
 
-        if ( entitytainer_src->config.bucket_sizes[i_bl] == entitytainer_dst->config.bucket_sizes[i_bl] ) {
-            int bucket_list_size = sizeof( TheEntitytainerEntity ) * entitytainer_src->config.bucket_list_sizes[i_bl] *
-                                   entitytainer_src->config.bucket_sizes[i_bl];
-            ENTITYTAINER_memcpy( entitytainer_dst->bucket_lists[i_bl].bucket_data,
-                                 entitytainer_src->bucket_lists[i_bl].bucket_data,
-                                 bucket_list_size );
+    // Remove child from bucket, move children after forward one step.
+    int last_child_index = 0;
+    int position         = entitytainer__child_position( entitytainer, child );
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        last_child_index = entitytainer__chain_remove_child( entitytainer, bucket, child );
+    }
+    else {
+        int           capacity  = bucket_list->bucket_size - 1;
+        unsigned int* occupancy = entitytainer__occupancy_bits( entitytainer, bucket_list_index, bucket_index );
+        if ( position == -1 ) {
+            position = entitytainer__find_entity( bucket + 1, capacity, child );
+        }
+
+        ENTITYTAINER_assert( position != -1 && bucket[position + 1] == child );
+        bucket[position + 1] = ENTITYTAINER_InvalidEntity;
+        if ( occupancy != NULL ) {
+            occupancy[position >> 5] &= ~( 1u << ( position & 31 ) );
+        }
+
+        // Only need to know where the last child is if we might be able to shrink.
+        int fewest_slots  = (int)bucket[0] - 1 + ENTITYTAINER_ShrinkMargin;
+        int smaller_index = entitytainer__demote_target( entitytainer, bucket_list_index, fewest_slots, false );
+        if ( entitytainer->keep_capacity_on_remove || smaller_index == bucket_list_index ) {
+            last_child_index = bucket_list->bucket_size;
+        }
+        else if ( occupancy != NULL ) {
+            last_child_index = 1 + entitytainer__last_set_bit( occupancy, capacity );
         }
         else {
-            TheEntitytainerBucketList* bucket_list_src = &entitytainer_src->bucket_lists[i_bl];
-            int                        bucket_size_src = entitytainer_src->config.bucket_sizes[i_bl];
-            TheEntitytainerBucketList* bucket_list_dst = &entitytainer_dst->bucket_lists[i_bl];
-            int                        bucket_size_dst = entitytainer_dst->config.bucket_sizes[i_bl];
-            for ( int i_bucket = 0; i_bucket < entitytainer_src->config.bucket_list_sizes[i_bl]; ++i_bucket ) {
-                int                    bucket_offset_src = i_bucket * bucket_size_src;
-                TheEntitytainerEntity* bucket_src        = bucket_list_src->bucket_data + bucket_offset_src;
-                int                    bucket_offset_dst = i_bucket * bucket_size_dst;
-                TheEntitytainerEntity* bucket_dst        = bucket_list_dst->bucket_data + bucket_offset_dst;
-                ENTITYTAINER_memcpy( bucket_dst, bucket_src, bucket_size_src * sizeof( TheEntitytainerEntity ) );
-            }
+            last_child_index = 1 + entitytainer__find_last_used( bucket + 1, capacity );
         }
-        entitytainer_dst->bucket_lists[i_bl].first_free_bucket = entitytainer_src->bucket_lists[i_bl].first_free_bucket;
-        entitytainer_dst->bucket_lists[i_bl].used_buckets      = entitytainer_src->bucket_lists[i_bl].used_buckets;
     }
 
-    ENTITYTAINER_memcpy( entitytainer_dst->entry_lookup,
-                         entitytainer_src->entry_lookup,
-                         sizeof( TheEntitytainerEntry ) * entitytainer_src->entry_lookup_size );
-    ENTITYTAINER_memcpy( entitytainer_dst->entry_parent_lookup,
-                         entitytainer_src->entry_parent_lookup,
-                         sizeof( TheEntitytainerEntity ) * entitytainer_src->entry_lookup_size );
+    // Lower child count, and move down if we've shrunk enough to fit in a smaller bucket.
+    bucket[0]--;
+    entitytainer__set_num_children( entitytainer, parent, (int)bucket[0] );
+    entitytainer__demote( entitytainer, parent, bucket_list_index, last_child_index + ENTITYTAINER_ShrinkMargin );
 }
 
-static void*
-entitytainer__ptr_to_aligned_ptr( void* ptr, int align ) {
-    if ( align == 0 ) {
-        return ptr;
+ENTITYTAINER_API void
+entitytainer_add_children( TheEntitytainer*             entitytainer,
+                           TheEntitytainerEntity        parent,
+                           const TheEntitytainerEntity* children,
+                           int                          num_children ) {
+    // Set up the children's entries first, so their child index can be written as they're placed.
+    for ( int i_child = 0; i_child < num_children; ++i_child ) {
+        int child_index = entitytainer__insert_index( entitytainer, children[i_child] );
+        ENTITYTAINER_assert( entitytainer->entry_parent_lookup[child_index] == ENTITYTAINER_InvalidEntity );
+        entitytainer->entry_parent_lookup[child_index] = parent;
     }
 
-    long long int ptr_address = (long long int)ptr;
-    int           offset      = ( ~(int)ptr_address + 1 ) & ( align - 1 );
-    void*         aligned_ptr = (char*)ptr + offset;
-    return aligned_ptr;
+    entitytainer__link_children( entitytainer, parent, children, num_children, false );
+    if ( entitytainer->track_depth || entitytainer->track_order ) {
+        for ( int i_child = 0; i_child < num_children; ++i_child ) {
+            entitytainer__update_depth( entitytainer, children[i_child] );
+            entitytainer__order_attach( entitytainer, children[i_child] );
+        }
+    }
+}
+
+static void
+entitytainer__link_children( TheEntitytainer*             entitytainer,
+                             TheEntitytainerEntity        parent,
+                             const TheEntitytainerEntity* children,
+                             int                          num_children,
+                             bool                         move_payloads ) {
+    // The bucket half of add_children. With move_payloads, children is another parent's bucket and their payloads
+    // come along, otherwise they're cleared.
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+
+    // Go straight to the bucket list that fits all the children, instead of promoting one list at a time.
+    int count = bucket[0];
+    if ( !entitytainer__is_chained( entitytainer, bucket_list_index ) &&
+         count + num_children >= bucket_list->bucket_size ) {
+        bucket_list_index = entitytainer__find_bucket_list( entitytainer, bucket_list_index + 1, count + num_children );
+        ENTITYTAINER_assert( bucket_list_index != -1 ); // No bucket lists with buckets of this size
+        bucket       = entitytainer__move_bucket( entitytainer, parent, bucket_list_index );
+        bucket_list  = entitytainer->bucket_lists + bucket_list_index;
+        bucket_index = entitytainer__bucket_index( bucket_list, bucket );
+    }
+
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        for ( int i_child = 0; i_child < num_children; ++i_child ) {
+            int position = entitytainer__chain_add_child( entitytainer, bucket, children[i_child] );
+            entitytainer__set_child_index( entitytainer, children[i_child], position );
+            if ( move_payloads && entitytainer->config.num_payload_columns > 0 ) {
+                TheEntitytainerEntity* slot = entitytainer__chain_slot( entitytainer, bucket, position );
+                entitytainer__move_payloads( entitytainer, slot, &children[i_child], 1 );
+            }
+        }
+    }
+    else if ( entitytainer->remove_with_holes ) {
+        // Same as adding them one by one; each child goes into the first free slot.
+        int capacity = entitytainer->bucket_lists[bucket_list_index].bucket_size - 1;
+        int i_slot   = 0;
+        for ( int i_child = 0; i_child < num_children; ++i_child ) {
+            int hole = entitytainer__find_entity( bucket + 1 + i_slot, capacity - i_slot, ENTITYTAINER_InvalidEntity );
+            ENTITYTAINER_assert( hole != -1 );
+            i_slot += hole;
+            entitytainer__set_child_index( entitytainer, children[i_child], i_slot );
+            if ( move_payloads ) {
+                entitytainer__move_payloads( entitytainer, &bucket[1 + i_slot], &children[i_child], 1 );
+            }
+            else {
+                entitytainer__clear_payloads( entitytainer, &bucket[1 + i_slot], 1 );
+            }
+
+            bucket[1 + i_slot++] = children[i_child];
+        }
+
+        entitytainer__sync_occupancy( entitytainer, bucket_list_index, bucket_index );
+    }
+    else {
+        ENTITYTAINER_memcpy( bucket + 1 + count, children, num_children * sizeof( TheEntitytainerEntity ) );
+        if ( move_payloads ) {
+            entitytainer__move_payloads( entitytainer, bucket + 1 + count, children, num_children );
+        }
+        else {
+            entitytainer__clear_payloads( entitytainer, bucket + 1 + count, num_children );
+        }
+
+        if ( entitytainer->track_child_index ) {
+            for ( int i_child = 0; i_child < num_children; ++i_child ) {
+                entitytainer__set_child_index( entitytainer, children[i_child], count + i_child );
+            }
+        }
+    }
+
+    bucket[0] = (TheEntitytainerEntity)( count + num_children );
+    entitytainer__set_num_children( entitytainer, parent, count + num_children );
+}
+
+ENTITYTAINER_API void
+entitytainer_remove_children( TheEntitytainer*             entitytainer,
+                              TheEntitytainerEntity        parent,
+                              const TheEntitytainerEntity* children,
+                              int                          num_children ) {
+    // Clear the reverse lookup first, that way we know which children to keep without searching the list.
+    for ( int i_child = 0; i_child < num_children; ++i_child ) {
+        int child_index = entitytainer__index( entitytainer, children[i_child] );
+        ENTITYTAINER_assert( entitytainer->entry_parent_lookup[child_index] == parent );
+        entitytainer->entry_parent_lookup[child_index] = ENTITYTAINER_InvalidEntity;
+        entitytainer__update_depth( entitytainer, children[i_child] );
+        entitytainer__release_index( entitytainer, children[i_child] );
+    }
+
+    entitytainer__unlink_children( entitytainer, parent, num_children );
+}
+
+static void
+entitytainer__unlink_children( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int num_removed ) {
+    // The bucket half of remove_children. The children that aren't parent's anymore are taken out.
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+
+    int count            = bucket[0];
+    int last_child_index = 0;
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        last_child_index = entitytainer__chain_filter( entitytainer, bucket, parent, !entitytainer->remove_with_holes );
+    }
+    else if ( entitytainer->remove_with_holes ) {
+        for ( int i = 1; i < bucket_list->bucket_size; ++i ) {
+            TheEntitytainerEntity child = bucket[i];
+            if ( child == ENTITYTAINER_InvalidEntity ) {
+                continue;
+            }
+
+            if ( entitytainer_get_parent( entitytainer, child ) == parent ) {
+                last_child_index = i;
+            }
+            else {
+                bucket[i] = ENTITYTAINER_InvalidEntity;
+            }
+        }
+
+        entitytainer__sync_occupancy( entitytainer, bucket_list_index, bucket_index );
+    }
+    else {
+        int i_dst = 1;
+        for ( int i_src = 1; i_src <= count; ++i_src ) {
+            TheEntitytainerEntity child = bucket[i_src];
+            if ( entitytainer_get_parent( entitytainer, child ) == parent ) {
+                entitytainer__set_child_index( entitytainer, child, i_dst - 1 );
+                entitytainer__move_payloads( entitytainer, &bucket[i_dst], &bucket[i_src], 1 );
+                bucket[i_dst++] = child;
+            }
+        }
+
+        ENTITYTAINER_memset( bucket + i_dst, 0, ( count + 1 - i_dst ) * sizeof( TheEntitytainerEntity ) );
+        last_child_index = i_dst - 1;
+    }
+
+    ENTITYTAINER_assert( count - num_removed == last_child_index || entitytainer->remove_with_holes );
+    bucket[0] = (TheEntitytainerEntity)( count - num_removed );
+    entitytainer__set_num_children( entitytainer, parent, count - num_removed );
+
+    // Shrink directly to the smallest bucket list that fits and has room.
+    int shrink_margin = entitytainer->remove_with_holes ? ENTITYTAINER_ShrinkMargin : 0;
+    entitytainer__demote( entitytainer, parent, bucket_list_index, last_child_index + shrink_margin );
+}
+
+ENTITYTAINER_API void
+entitytainer_reparent( TheEntitytainer* entitytainer, TheEntitytainerEntity child, TheEntitytainerEntity new_parent ) {
+    int                   index      = entitytainer__index( entitytainer, child );
+    TheEntitytainerEntity old_parent = index != 0 ? entitytainer->entry_parent_lookup[index] : 0;
+    ENTITYTAINER_assert( new_parent != child && !entitytainer_is_ancestor( entitytainer, child, new_parent ) );
+    if ( old_parent == new_parent ) {
+        return;
+    }
+
+    if ( old_parent == ENTITYTAINER_InvalidEntity ) {
+        entitytainer_add_child( entitytainer, new_parent, child );
+        return;
+    }
+
+    // Neither half touches the hash table, so the index stays the same. Linking goes first so that the payloads
+    // are still in the old slot to be copied over.
+    int position = entitytainer__link_child( entitytainer, new_parent, child );
+    if ( entitytainer->config.num_payload_columns > 0 ) {
+        int                    old_position = entitytainer_get_child_index( entitytainer, old_parent, child );
+        TheEntitytainerEntity* slot_old     = entitytainer__child_slot( entitytainer, old_parent, old_position );
+        TheEntitytainerEntity* slot_new     = entitytainer__child_slot( entitytainer, new_parent, position );
+        entitytainer__move_payloads( entitytainer, slot_new, slot_old, 1 );
+    }
+
+    if ( entitytainer->remove_with_holes ) {
+        entitytainer__unlink_with_holes( entitytainer, old_parent, child );
+    }
+    else {
+        entitytainer__unlink_no_holes( entitytainer, old_parent, child );
+    }
+
+    entitytainer->entry_parent_lookup[index] = new_parent;
+    entitytainer__mark_entry( entitytainer, index );
+    entitytainer__set_child_index( entitytainer, child, position );
+    entitytainer__update_depth( entitytainer, child );
+    entitytainer__order_attach( entitytainer, child );
+}
+
+ENTITYTAINER_API void
+entitytainer_move_children( TheEntitytainer* entitytainer, TheEntitytainerEntity from, TheEntitytainerEntity to ) {
+    ENTITYTAINER_assert( from != to && !entitytainer_is_ancestor( entitytainer, from, to ) );
+    int num_children = entitytainer_num_children( entitytainer, from );
+    if ( num_children == 0 ) {
+        return;
+    }
+
+    bool swap = entitytainer_num_children( entitytainer, to ) == 0;
+    if ( swap ) {
+        // from ends up with to's empty bucket, which might be a big one.
+        int                  from_index  = entitytainer__index( entitytainer, from );
+        int                  to_index    = entitytainer__index( entitytainer, to );
+        TheEntitytainerEntry from_lookup = entitytainer->entry_lookup[from_index];
+        TheEntitytainerEntry to_lookup   = entitytainer->entry_lookup[to_index];
+        entitytainer->entry_lookup[from_index] = to_lookup;
+        entitytainer->entry_lookup[to_index]   = from_lookup;
+        entitytainer__mark_entry( entitytainer, from_index );
+        entitytainer__mark_entry( entitytainer, to_index );
+        entitytainer__set_num_children( entitytainer, from, 0 );
+        entitytainer__set_num_children( entitytainer, to, num_children );
+
+        int                        bucket_list_index = to_lookup >> entitytainer->entry_list_shift;
+        TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+        int                        bucket_index      = to_lookup & entitytainer->entry_bucket_mask;
+        TheEntitytainerEntity*     bucket = entitytainer__bucket( bucket_list, bucket_index );
+        if ( entitytainer__is_chained( entitytainer, bucket_list_index ) && !entitytainer->keep_capacity_on_remove ) {
+            entitytainer__chain_trim( entitytainer, bucket, 0 );
+        }
+
+        entitytainer__demote( entitytainer, from, bucket_list_index, 0 );
+    }
+    else {
+        // The children are packed then, so each span is a run that can be copied as it is.
+        if ( entitytainer->remove_with_holes ) {
+            entitytainer_remove_holes( entitytainer, from );
+        }
+
+        TheEntitytainerChildSpan span;
+        int                      num_left = num_children;
+        entitytainer_get_child_span( entitytainer, from, &span );
+        do {
+            int num_in_span = num_left < span.capacity ? num_left : span.capacity;
+            entitytainer__link_children( entitytainer, to, span.children, num_in_span, true );
+            num_left -= num_in_span;
+        } while ( num_left > 0 && entitytainer_next_child_span( entitytainer, &span ) );
+    }
+
+    TheEntitytainerChildIter iter;
+    TheEntitytainerEntity    child;
+    entitytainer_children_iter( entitytainer, swap ? to : from, &iter );
+    while ( entitytainer_children_next( entitytainer, &iter, &child, NULL ) ) {
+        int index                                = entitytainer__index( entitytainer, child );
+        entitytainer->entry_parent_lookup[index] = to;
+        entitytainer__mark_entry( entitytainer, index );
+        entitytainer__update_depth( entitytainer, child );
+        entitytainer__order_attach( entitytainer, child );
+    }
+
+    // Nothing in from's bucket is its child anymore.
+    if ( !swap ) {
+        entitytainer__unlink_children( entitytainer, from, num_children );
+    }
+}
+
+ENTITYTAINER_API void
+entitytainer_get_children( TheEntitytainer*        entitytainer,
+                           TheEntitytainerEntity   parent,
+                           TheEntitytainerEntity** children,
+                           int*                    num_children,
+                           int*                    capacity ) {
+
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    *num_children                                = (int)bucket[0];
+    *children                                    = bucket + 1;
+    *capacity                                    = bucket_list->bucket_size - 1;
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        // Only the first page
+        *capacity = bucket_list->bucket_size - 2;
+    }
+
+    // Also keeps a concurrent reader that hits a freed bucket (where the count is the free list link) in bounds.
+    if ( *num_children > *capacity ) {
+        *num_children = *capacity;
+    }
+}
+
+ENTITYTAINER_API int
+entitytainer_num_children( TheEntitytainer* entitytainer, TheEntitytainerEntity parent ) {
+    int                  index  = entitytainer__index( entitytainer, parent );
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[index];
+    ENTITYTAINER_assert( lookup != 0 );
+    if ( entitytainer->entry_num_children != NULL ) {
+        return (int)entitytainer->entry_num_children[index];
+    }
+
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    return (int)bucket[0];
+}
+
+ENTITYTAINER_API void
+entitytainer_get_child_span( TheEntitytainer*          entitytainer,
+                             TheEntitytainerEntity     parent,
+                             TheEntitytainerChildSpan* span ) {
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    entitytainer__fill_span( entitytainer, lookup, span );
+}
+
+ENTITYTAINER_API bool
+entitytainer_next_child_span( TheEntitytainer* entitytainer, TheEntitytainerChildSpan* span ) {
+    TheEntitytainerEntity* page = span->next_page;
+    if ( page == NULL || ( span->num_children_left <= 0 && !entitytainer->remove_with_holes ) ) {
+        return false;
+    }
+
+    span->children     = page + 1;
+    span->next_page    = entitytainer__next_page( entitytainer, page, false );
+    span->num_children = span->num_children_left;
+    if ( entitytainer->remove_with_holes || span->num_children > span->capacity ) {
+        span->num_children = span->capacity;
+    }
+
+    span->num_children_left -= span->num_children;
+    entitytainer__span_payloads( entitytainer, span );
+    return true;
+}
+
+ENTITYTAINER_API void
+entitytainer_children_iter( TheEntitytainer*          entitytainer,
+                            TheEntitytainerEntity     parent,
+                            TheEntitytainerChildIter* iter ) {
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    entitytainer__fill_span( entitytainer, lookup, &iter->span );
+    int bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    int bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    iter->occupancy       = entitytainer__occupancy_bits( entitytainer, bucket_list_index, bucket_index );
+    iter->slot            = 0;
+    iter->first_index     = 0;
+    iter->num_left        = (int)iter->span.children[-1]; // The count is right before the first child
+}
+
+ENTITYTAINER_API bool
+entitytainer_children_next( TheEntitytainer*          entitytainer,
+                            TheEntitytainerChildIter* iter,
+                            TheEntitytainerEntity*    child,
+                            int*                      index ) {
+    TheEntitytainerChildSpan* span = &iter->span;
+    while ( iter->num_left > 0 ) {
+        int slot = iter->slot;
+        if ( iter->occupancy != NULL ) {
+            slot = entitytainer__next_set_bit( iter->occupancy, slot, span->num_children );
+        }
+        else {
+            while ( slot < span->num_children && span->children[slot] == ENTITYTAINER_InvalidEntity ) {
+                ++slot;
+            }
+        }
+
+        if ( slot < span->num_children ) {
+            iter->slot = slot + 1;
+            --iter->num_left;
+            *child = span->children[slot];
+            if ( index != NULL ) {
+                *index = iter->first_index + slot;
+            }
+
+            return true;
+        }
+
+        // On to the next page
+        iter->first_index += span->capacity;
+        iter->slot = 0;
+        if ( !entitytainer_next_child_span( entitytainer, span ) ) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+ENTITYTAINER_API void*
+entitytainer_get_payload( TheEntitytainer* entitytainer, TheEntitytainerEntity child, int column ) {
+    ENTITYTAINER_assert( column >= 0 && column < entitytainer->config.num_payload_columns );
+    TheEntitytainerEntity parent = entitytainer_get_parent( entitytainer, child );
+    ENTITYTAINER_assert( parent != ENTITYTAINER_InvalidEntity );
+    int                    position = entitytainer_get_child_index( entitytainer, parent, child );
+    TheEntitytainerEntity* slot     = entitytainer__child_slot( entitytainer, parent, position );
+    return entitytainer__payload( entitytainer, slot, column );
+}
+
+ENTITYTAINER_API void*
+entitytainer_children_payload( TheEntitytainer* entitytainer, const TheEntitytainerChildIter* iter, int column ) {
+    // children_next has already moved past the child it returned.
+    ENTITYTAINER_assert( column >= 0 && column < entitytainer->config.num_payload_columns && iter->slot > 0 );
+    unsigned char* payloads = (unsigned char*)iter->span.payloads[column];
+    return payloads + ( iter->slot - 1 ) * entitytainer->config.payload_sizes[column];
+}
+
+ENTITYTAINER_API void
+entitytainer_get_children_batch( TheEntitytainer*             entitytainer,
+                                 const TheEntitytainerEntity* parents,
+                                 int                          num_parents,
+                                 TheEntitytainerChildSpan*    spans ) {
+    TheEntitytainerEntry lookups[ENTITYTAINER_BatchSize];
+    for ( int i_batch = 0; i_batch < num_parents; i_batch += ENTITYTAINER_BatchSize ) {
+        int batch_size = num_parents - i_batch;
+        if ( batch_size > ENTITYTAINER_BatchSize ) {
+            batch_size = ENTITYTAINER_BatchSize;
+        }
+
+        entitytainer__prefetch_entries( entitytainer, parents + i_batch, batch_size );
+        entitytainer__prefetch_buckets( entitytainer, parents + i_batch, batch_size, lookups );
+        for ( int i = 0; i < batch_size; ++i ) {
+            entitytainer__fill_span( entitytainer, lookups[i], spans + i_batch + i );
+        }
+    }
+}
+
+ENTITYTAINER_API void
+entitytainer_num_children_batch( TheEntitytainer*             entitytainer,
+                                 const TheEntitytainerEntity* parents,
+                                 int                          num_parents,
+                                 int*                         num_children ) {
+    TheEntitytainerEntry lookups[ENTITYTAINER_BatchSize];
+    for ( int i_batch = 0; i_batch < num_parents; i_batch += ENTITYTAINER_BatchSize ) {
+        int batch_size = num_parents - i_batch;
+        if ( batch_size > ENTITYTAINER_BatchSize ) {
+            batch_size = ENTITYTAINER_BatchSize;
+        }
+
+        entitytainer__prefetch_entries( entitytainer, parents + i_batch, batch_size );
+        if ( entitytainer->entry_num_children != NULL ) {
+            // The buckets aren't needed at all then.
+            for ( int i = 0; i < batch_size; ++i ) {
+                int index                 = entitytainer__index( entitytainer, parents[i_batch + i] );
+                num_children[i_batch + i] = (int)entitytainer->entry_num_children[index];
+            }
+
+            continue;
+        }
+
+        entitytainer__prefetch_buckets( entitytainer, parents + i_batch, batch_size, lookups );
+        for ( int i = 0; i < batch_size; ++i ) {
+            int                        bucket_list_index = lookups[i] >> entitytainer->entry_list_shift;
+            TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+            int                        bucket_index      = lookups[i] & entitytainer->entry_bucket_mask;
+            num_children[i_batch + i] = (int)*entitytainer__bucket( bucket_list, bucket_index );
+        }
+    }
+}
+
+ENTITYTAINER_API int
+entitytainer_get_child_index( TheEntitytainer*      entitytainer,
+                              TheEntitytainerEntity parent,
+                              TheEntitytainerEntity child ) {
+    if ( entitytainer->track_child_index ) {
+        return entitytainer_get_parent( entitytainer, child ) == parent
+                 ? entitytainer__child_position( entitytainer, child )
+                 : -1;
+    }
+
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        return entitytainer__chain_find_child( entitytainer, bucket, child );
+    }
+
+    int num_slots = entitytainer->remove_with_holes ? bucket_list->bucket_size - 1 : (int)bucket[0];
+    return entitytainer__find_entity( bucket + 1, num_slots, child );
+}
+
+ENTITYTAINER_API TheEntitytainerEntity
+entitytainer_get_parent( TheEntitytainer* entitytainer, TheEntitytainerEntity child ) {
+    TheEntitytainerEntity parent = entitytainer->entry_parent_lookup[entitytainer__index( entitytainer, child )];
+    return parent;
+}
+
+ENTITYTAINER_API TheEntitytainerEntity
+entitytainer_to_channel( TheEntitytainer* entitytainer, TheEntitytainerEntity entity, int channel ) {
+    ENTITYTAINER_assert( channel >= 0 && channel < entitytainer->num_channels );
+    return (TheEntitytainerEntity)( entity * entitytainer->num_channels + channel );
+}
+
+ENTITYTAINER_API TheEntitytainerEntity
+entitytainer_from_channel( TheEntitytainer* entitytainer, TheEntitytainerEntity channel_entity ) {
+    return (TheEntitytainerEntity)( channel_entity / entitytainer->num_channels );
+}
+
+ENTITYTAINER_API int
+entitytainer_get_channel( TheEntitytainer* entitytainer, TheEntitytainerEntity channel_entity ) {
+    return (int)( channel_entity % entitytainer->num_channels );
+}
+
+ENTITYTAINER_API void
+entitytainer_get_relations( TheEntitytainer*          entitytainer,
+                            TheEntitytainerEntity     entity,
+                            TheEntitytainerChildSpan* spans,
+                            TheEntitytainerEntity*    parents ) {
+    for ( int channel = 0; channel < entitytainer->num_channels; ++channel ) {
+        int index = entitytainer__index( entitytainer, entitytainer_to_channel( entitytainer, entity, channel ) );
+        if ( spans != NULL ) {
+            TheEntitytainerEntry lookup = entitytainer->entry_lookup[index];
+            if ( lookup != 0 ) {
+                entitytainer__fill_span( entitytainer, lookup, spans + channel );
+            }
+            else {
+                ENTITYTAINER_memset( spans + channel, 0, sizeof( *spans ) );
+            }
+        }
+
+        if ( parents != NULL ) {
+            parents[channel] = entitytainer_from_channel( entitytainer, entitytainer->entry_parent_lookup[index] );
+        }
+    }
+}
+
+ENTITYTAINER_API int
+entitytainer_get_depth( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    if ( entitytainer->entry_depth != NULL ) {
+        return (int)entitytainer->entry_depth[entitytainer__index( entitytainer, entity )];
+    }
+
+    int depth = 0;
+    for ( entity = entitytainer_get_parent( entitytainer, entity ); entity != ENTITYTAINER_InvalidEntity;
+          entity = entitytainer_get_parent( entitytainer, entity ) ) {
+        ++depth;
+    }
+
+    return depth;
+}
+
+ENTITYTAINER_API TheEntitytainerEntity
+entitytainer_get_root( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    if ( entitytainer->entry_root != NULL ) {
+        TheEntitytainerEntity root = entitytainer->entry_root[entitytainer__index( entitytainer, entity )];
+        return root != ENTITYTAINER_InvalidEntity ? root : entity;
+    }
+
+    TheEntitytainerEntity parent = entitytainer_get_parent( entitytainer, entity );
+    while ( parent != ENTITYTAINER_InvalidEntity ) {
+        entity = parent;
+        parent = entitytainer_get_parent( entitytainer, entity );
+    }
+
+    return entity;
+}
+
+ENTITYTAINER_API bool
+entitytainer_is_ancestor( TheEntitytainer*      entitytainer,
+                          TheEntitytainerEntity ancestor,
+                          TheEntitytainerEntity entity ) {
+    int steps = -1; // Walk all the way up
+    if ( entitytainer->entry_depth != NULL ) {
+        steps = entitytainer_get_depth( entitytainer, entity ) - entitytainer_get_depth( entitytainer, ancestor );
+        TheEntitytainerEntity root = entitytainer_get_root( entitytainer, entity );
+        if ( steps <= 0 || root != entitytainer_get_root( entitytainer, ancestor ) ) {
+            return false;
+        }
+    }
+
+    // Only ancestor's depth can be at steps up, so there's no need to compare until then.
+    for ( ; steps > 1; --steps ) {
+        entity = entitytainer_get_parent( entitytainer, entity );
+    }
+
+    for ( entity = entitytainer_get_parent( entitytainer, entity ); entity != ENTITYTAINER_InvalidEntity;
+          entity = entitytainer_get_parent( entitytainer, entity ) ) {
+        if ( entity == ancestor ) {
+            return true;
+        }
+
+        if ( steps == 1 ) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+ENTITYTAINER_API bool
+entitytainer_is_added( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, entity )];
+    return lookup != 0;
+}
+
+ENTITYTAINER_API TheEntitytainerEntity*
+entitytainer_get_topological_order( TheEntitytainer* entitytainer, int* num_entities, int* first_dirty ) {
+    ENTITYTAINER_assert( entitytainer->order != NULL );
+    if ( entitytainer->order_holes > 0 ) {
+        entitytainer__order_compact( entitytainer );
+    }
+
+    *num_entities             = entitytainer->order_count;
+    *first_dirty              = entitytainer->order_dirty;
+    entitytainer->order_dirty = entitytainer->order_count;
+    return entitytainer->order;
+}
+
+ENTITYTAINER_API int
+entitytainer_get_subtree( TheEntitytainer*       entitytainer,
+                          TheEntitytainerEntity  root,
+                          TheEntitytainerEntity* entities,
+                          int                    max_entities,
+                          bool                   depth_first ) {
+    if ( !depth_first ) {
+        // The output doubles as the queue.
+        int num_entities = entitytainer__gather_children( entitytainer, root, entities, max_entities );
+        for ( int i_entity = 0; i_entity < num_entities; ++i_entity ) {
+            int num_children = entitytainer__gather_children(
+              entitytainer, entities[i_entity], entities + num_entities, max_entities - num_entities );
+            if ( num_children == -1 ) {
+                return -1;
+            }
+
+            num_entities += num_children;
+        }
+
+        return num_entities;
+    }
+
+    // The stack lives at the end of the same buffer and grows down towards the output. Every entity is either in the
+    // output or on the stack, so they never overlap. Children are gathered right after the output and then moved onto
+    // the stack as they are, so the first child ends up on top.
+    int num_entities = 0;
+    int stack_top    = max_entities;
+    int num_children = entitytainer__gather_children( entitytainer, root, entities, max_entities );
+    while ( num_children != 0 ) {
+        if ( num_children == -1 ) {
+            return -1;
+        }
+
+        stack_top -= num_children;
+        ENTITYTAINER_memmove(
+          entities + stack_top, entities + num_entities, num_children * sizeof( TheEntitytainerEntity ) );
+
+        while ( stack_top < max_entities ) {
+            TheEntitytainerEntity entity = entities[stack_top++];
+            entities[num_entities++]     = entity;
+            num_children =
+              entitytainer__gather_children( entitytainer, entity, entities + num_entities, stack_top - num_entities );
+            if ( num_children != 0 ) {
+                break;
+            }
+        }
+    }
+
+    return num_entities;
+}
+
+ENTITYTAINER_API void
+entitytainer_remove_holes( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, entity )];
+    ENTITYTAINER_assert( lookup != 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        entitytainer__chain_filter( entitytainer, bucket, ENTITYTAINER_InvalidEntity, true );
+        return;
+    }
+
+    // Single pass stream compaction, only between the first hole and the last child.
+    TheEntitytainerEntity* children = bucket + 1;
+    int                    end      = 1 + entitytainer__find_last_used( children, bucket_list->bucket_size - 1 );
+    int                    i_dst    = entitytainer__find_entity( children, end, ENTITYTAINER_InvalidEntity );
+    if ( i_dst == -1 ) {
+        return;
+    }
+
+    for ( int i_src = i_dst + 1; i_src < end; ++i_src ) {
+        TheEntitytainerEntity child = children[i_src];
+        if ( child != ENTITYTAINER_InvalidEntity ) {
+            children[i_dst] = child;
+            entitytainer__move_payloads( entitytainer, &children[i_dst], &children[i_src], 1 );
+            entitytainer__set_child_index( entitytainer, child, i_dst );
+            ++i_dst;
+        }
+    }
+
+    ENTITYTAINER_memset( children + i_dst, 0, ( end - i_dst ) * sizeof( TheEntitytainerEntity ) );
+    entitytainer__sync_occupancy( entitytainer, bucket_list_index, bucket_index );
+}
+
+ENTITYTAINER_API void
+entitytainer_command_buffer_init( TheEntitytainerCommandBuffer* buffer,
+                                  TheEntitytainerCommand*       commands,
+                                  int                           capacity ) {
+    buffer->commands     = commands;
+    buffer->num_commands = 0;
+    buffer->capacity     = capacity;
+}
+
+ENTITYTAINER_API bool
+entitytainer_record_add_entity( TheEntitytainerCommandBuffer* buffer, TheEntitytainerEntity entity ) {
+    return entitytainer__record( buffer, ENTITYTAINER_CommandAddEntity, ENTITYTAINER_InvalidEntity, entity );
+}
+
+ENTITYTAINER_API bool
+entitytainer_record_remove_entity( TheEntitytainerCommandBuffer* buffer, TheEntitytainerEntity entity ) {
+    return entitytainer__record( buffer, ENTITYTAINER_CommandRemoveEntity, ENTITYTAINER_InvalidEntity, entity );
+}
+
+ENTITYTAINER_API bool
+entitytainer_record_add_child( TheEntitytainerCommandBuffer* buffer,
+                               TheEntitytainerEntity         parent,
+                               TheEntitytainerEntity         child ) {
+    return entitytainer__record( buffer, ENTITYTAINER_CommandAddChild, parent, child );
+}
+
+ENTITYTAINER_API bool
+entitytainer_record_remove_child( TheEntitytainerCommandBuffer* buffer,
+                                  TheEntitytainerEntity         parent,
+                                  TheEntitytainerEntity         child ) {
+    return entitytainer__record( buffer, ENTITYTAINER_CommandRemoveChild, parent, child );
+}
+
+ENTITYTAINER_API int
+entitytainer_apply_commands_needed_size( TheEntitytainerCommandBuffer* buffers, int num_buffers ) {
+    int num_commands = 0;
+    for ( int i_buffer = 0; i_buffer < num_buffers; ++i_buffer ) {
+        num_commands += buffers[i_buffer].num_commands;
+    }
+
+    // The queue, and the children of one parent at a time.
+    return num_commands * (int)( sizeof( TheEntitytainerQueuedCommand ) + sizeof( TheEntitytainerEntity ) );
+}
+
+ENTITYTAINER_API int
+entitytainer_apply_commands( TheEntitytainer*              entitytainer,
+                             TheEntitytainerCommandBuffer* buffers,
+                             int                           num_buffers,
+                             void*                         scratch,
+                             int                           scratch_size,
+                             TheEntitytainerCommand*       conflicts,
+                             int                           max_conflicts ) {
+    ENTITYTAINER_assert( scratch_size >= entitytainer_apply_commands_needed_size( buffers, num_buffers ) );
+    (void)scratch_size;
+
+    // Sort the commands into one range per step, keeping the recorded order within each.
+    int num_commands                                  = 0;
+    int type_starts[ENTITYTAINER_NumCommandTypes + 1] = { 0 };
+    for ( int i_buffer = 0; i_buffer < num_buffers; ++i_buffer ) {
+        for ( int i_command = 0; i_command < buffers[i_buffer].num_commands; ++i_command ) {
+            ++type_starts[buffers[i_buffer].commands[i_command].type + 1];
+            ++num_commands;
+        }
+    }
+
+    for ( int i_type = 0; i_type < ENTITYTAINER_NumCommandTypes; ++i_type ) {
+        type_starts[i_type + 1] += type_starts[i_type];
+    }
+
+    TheEntitytainerQueuedCommand* queue    = (TheEntitytainerQueuedCommand*)scratch;
+    TheEntitytainerEntity*        children = (TheEntitytainerEntity*)( queue + num_commands );
+    int                           type_ends[ENTITYTAINER_NumCommandTypes];
+    ENTITYTAINER_memcpy( type_ends, type_starts, sizeof( type_ends ) );
+    int order = 0;
+    for ( int i_buffer = 0; i_buffer < num_buffers; ++i_buffer ) {
+        for ( int i_command = 0; i_command < buffers[i_buffer].num_commands; ++i_command ) {
+            TheEntitytainerCommand*       command = buffers[i_buffer].commands + i_command;
+            TheEntitytainerQueuedCommand* queued  = queue + type_ends[command->type]++;
+            queued->command                       = *command;
+            queued->bucket_list_index             = 0;
+            queued->order                         = order++;
+        }
+
+        buffers[i_buffer].num_commands = 0;
+    }
+
+    int num_conflicts = 0;
+
+    // 1. Add entities
+    for ( int i = type_starts[ENTITYTAINER_CommandAddEntity]; i < type_starts[ENTITYTAINER_CommandAddEntity + 1];
+          ++i ) {
+        if ( entitytainer_is_added( entitytainer, queue[i].command.entity ) ) {
+            num_conflicts = entitytainer__conflict( conflicts, max_conflicts, num_conflicts, queue + i );
+            continue;
+        }
+
+        entitytainer_add_entity( entitytainer, queue[i].command.entity );
+    }
+
+    // 2. Remove children and 3. add children, one parent at a time.
+    for ( int i_step = ENTITYTAINER_CommandRemoveChild; i_step <= ENTITYTAINER_CommandAddChild; ++i_step ) {
+        TheEntitytainerQueuedCommand* step_queue  = queue + type_starts[i_step];
+        int                           num_in_step = type_starts[i_step + 1] - type_starts[i_step];
+        bool                          is_removing = i_step == ENTITYTAINER_CommandRemoveChild;
+        if ( !is_removing ) {
+            // Only the first add of each child is kept, the others are conflicts no matter which parent they're for.
+            entitytainer__sort_commands( step_queue, num_in_step, ENTITYTAINER_SortByChild );
+            int num_kept = 0;
+            for ( int i = 0; i < num_in_step; ++i ) {
+                if ( i > 0 && step_queue[i].command.entity == step_queue[i - 1].command.entity ) {
+                    num_conflicts = entitytainer__conflict( conflicts, max_conflicts, num_conflicts, step_queue + i );
+                    continue;
+                }
+
+                step_queue[num_kept++] = step_queue[i];
+            }
+
+            num_in_step = num_kept;
+        }
+
+        for ( int i = 0; i < num_in_step; ++i ) {
+            TheEntitytainerEntity parent = step_queue[i].command.parent;
+            TheEntitytainerEntry  lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+            step_queue[i].bucket_list_index = lookup >> entitytainer->entry_list_shift;
+        }
+
+        // Removes are also sorted by child, which puts removing the same child twice next to each other.
+        entitytainer__sort_commands( step_queue, num_in_step, ENTITYTAINER_SortByParent );
+        for ( int i_group = 0; i_group < num_in_step; ) {
+            TheEntitytainerEntity parent      = step_queue[i_group].command.parent;
+            bool                  is_added    = entitytainer_is_added( entitytainer, parent );
+            int                   num_to_move = 0;
+            int                   i           = i_group;
+            for ( ; i < num_in_step && step_queue[i].command.parent == parent; ++i ) {
+                TheEntitytainerEntity child = step_queue[i].command.entity;
+                bool                  valid = is_added;
+                if ( is_removing ) {
+                    valid = valid && entitytainer_get_parent( entitytainer, child ) == parent &&
+                            ( num_to_move == 0 || children[num_to_move - 1] != child );
+                }
+                else {
+                    // Checked before any of the group is added, but siblings can't make a cycle among themselves.
+                    valid = valid && entitytainer_get_parent( entitytainer, child ) == ENTITYTAINER_InvalidEntity &&
+                            child != parent && !entitytainer_is_ancestor( entitytainer, child, parent );
+                }
+
+                if ( !valid ) {
+                    num_conflicts = entitytainer__conflict( conflicts, max_conflicts, num_conflicts, step_queue + i );
+                    continue;
+                }
+
+                children[num_to_move++] = child;
+            }
+
+            if ( num_to_move > 0 && is_removing ) {
+                entitytainer_remove_children( entitytainer, parent, children, num_to_move );
+            }
+            else if ( num_to_move > 0 ) {
+                entitytainer_add_children( entitytainer, parent, children, num_to_move );
+            }
+
+            i_group = i;
+        }
+    }
+
+    // 4. Remove entities
+    for ( int i = type_starts[ENTITYTAINER_CommandRemoveEntity]; i < num_commands; ++i ) {
+        TheEntitytainerEntity entity = queue[i].command.entity;
+        if ( entitytainer_is_added( entitytainer, entity ) && entitytainer_num_children( entitytainer, entity ) > 0 ) {
+            num_conflicts = entitytainer__conflict( conflicts, max_conflicts, num_conflicts, queue + i );
+            continue;
+        }
+
+        entitytainer_remove_entity( entitytainer, entity );
+    }
+
+    return num_conflicts;
+}
+
+ENTITYTAINER_API void
+entitytainer_write_begin( TheEntitytainer* entitytainer ) {
+    ENTITYTAINER_assert( ( entitytainer->sequence & 1 ) == 0 ); // Already writing
+    entitytainer__store_release( &entitytainer->sequence, entitytainer->sequence + 1 );
+    entitytainer__fence_release(); // Only a store-store barrier is needed, so the changes can't come before this.
+}
+
+ENTITYTAINER_API void
+entitytainer_write_end( TheEntitytainer* entitytainer ) {
+    ENTITYTAINER_assert( ( entitytainer->sequence & 1 ) == 1 ); // Not writing
+    entitytainer__store_release( &entitytainer->sequence, entitytainer->sequence + 1 );
+}
+
+ENTITYTAINER_API int
+entitytainer_read_begin( TheEntitytainer* entitytainer ) {
+    int sequence = entitytainer__load_acquire( &entitytainer->sequence );
+    while ( sequence & 1 ) {
+        sequence = entitytainer__load_acquire( &entitytainer->sequence );
+    }
+
+    return sequence;
+}
+
+ENTITYTAINER_API bool
+entitytainer_read_retry( TheEntitytainer* entitytainer, int sequence ) {
+    entitytainer__fence_acquire();
+    return entitytainer__load_acquire( &entitytainer->sequence ) != sequence;
+}
+
+ENTITYTAINER_API void
+entitytainer_reclaim_buckets( TheEntitytainer* entitytainer ) {
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list  = entitytainer->bucket_lists + i_bl;
+        int                        bucket_index = bucket_list->first_retired_bucket;
+        while ( bucket_index != (int)ENTITYTAINER_NoFreeBucket ) {
+            TheEntitytainerEntity* bucket = entitytainer__bucket( bucket_list, bucket_index );
+            int                    next   = bucket[0];
+            bucket[0]                     = (TheEntitytainerEntity)bucket_list->first_free_bucket;
+            bucket_list->first_free_bucket = bucket_index;
+            --bucket_list->used_buckets;
+            entitytainer__mark_bucket( entitytainer, i_bl, bucket_index );
+            bucket_index = next;
+        }
+
+        bucket_list->first_retired_bucket = ENTITYTAINER_NoFreeBucket;
+    }
+}
+
+ENTITYTAINER_API int
+entitytainer_save( TheEntitytainer* entitytainer, unsigned char* buffer, int buffer_size ) {
+    ENTITYTAINER_assert( entitytainer->config.bucket_page_size == 0 ); // The pages aren't in the memory block
+
+    TheEntitytainerBucketList* last        = &entitytainer->bucket_lists[entitytainer->num_bucket_lists - 1];
+    TheEntitytainerEntity*     entity_end  = last->bucket_data + last->bucket_size * last->total_buckets;
+    unsigned char*             begin       = (unsigned char*)entitytainer;
+    unsigned char*             end         = (unsigned char*)entity_end;
+    int                        last_column = entitytainer->config.num_payload_columns - 1;
+    if ( last_column >= 0 ) {
+        // The payloads come last
+        int slots = last->bucket_size * last->total_buckets;
+        end       = last->payloads[last_column] + slots * entitytainer->config.payload_sizes[last_column];
+    }
+
+    int size = (int)( end - begin );
+    if ( size > buffer_size || buffer == NULL ) {
+        return size;
+    }
+
+    ENTITYTAINER_memcpy( buffer, entitytainer, size );
+    return size;
+}
+
+ENTITYTAINER_API int
+entitytainer_save_compact( TheEntitytainer* entitytainer, unsigned char* buffer, int buffer_size ) {
+    TheEntitytainerCompactHeader header = { 0 };
+    header.magic                        = ENTITYTAINER_CompactMagic;
+    header.version                      = ENTITYTAINER_CompactVersion;
+    header.endianness                   = ENTITYTAINER_CompactEndianness;
+    header.entity_size                  = (int)sizeof( TheEntitytainerEntity );
+    header.entry_size                   = (int)sizeof( TheEntitytainerEntry );
+    header.flags                        = entitytainer__config_flags( &entitytainer->config );
+    header.num_entries                  = entitytainer->config.num_entries;
+    header.num_bucket_lists             = entitytainer->num_bucket_lists;
+    header.order_count                  = entitytainer->order != NULL ? entitytainer->order_count : 0;
+    header.order_holes                  = entitytainer->order != NULL ? entitytainer->order_holes : 0;
+    header.num_payload_columns          = entitytainer->config.num_payload_columns;
+    header.num_channels                 = entitytainer->num_channels;
+    for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+        header.payload_sizes[i_column] = entitytainer->config.payload_sizes[i_column];
+    }
+
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    header.num_columns = entitytainer__entry_columns( entitytainer, columns );
+    for ( int i_entry = 1; i_entry < entitytainer->entry_lookup_size; ++i_entry ) {
+        if ( entitytainer->entry_lookup[i_entry] != 0 || entitytainer->entry_parent_lookup[i_entry] != 0 ) {
+            ++header.num_saved_entries;
+        }
+    }
+
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        // Freed buckets are below the first never used one, so that's used + free.
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        int                        num_saved   = bucket_list->used_buckets + entitytainer__count_free( bucket_list );
+
+        header.bucket_sizes[i_bl]          = bucket_list->bucket_size;
+        header.bucket_list_sizes[i_bl]     = bucket_list->total_buckets;
+        header.num_saved_buckets[i_bl]     = num_saved;
+        header.first_free_buckets[i_bl]    = bucket_list->first_free_bucket;
+        header.first_retired_buckets[i_bl] = bucket_list->first_retired_bucket;
+        header.used_buckets[i_bl]          = bucket_list->used_buckets;
+    }
+
+    int size = entitytainer__compact_size( &header );
+    if ( size > buffer_size ) {
+        return size;
+    }
+
+    ENTITYTAINER_memcpy( buffer, &header, sizeof( header ) );
+    buffer += sizeof( header );
+    for ( int i_entry = 1; i_entry < entitytainer->entry_lookup_size; ++i_entry ) {
+        TheEntitytainerEntry lookup = entitytainer->entry_lookup[i_entry];
+        if ( lookup == 0 && entitytainer->entry_parent_lookup[i_entry] == 0 ) {
+            continue;
+        }
+
+        TheEntitytainerEntity entity   = entitytainer->hashed_lookup ? entitytainer->entry_keys[i_entry]
+                                                                     : (TheEntitytainerEntity)i_entry;
+        unsigned int          location = 0;
+        if ( lookup != 0 ) {
+            location = (unsigned int)( lookup >> entitytainer->entry_list_shift ) << ENTITYTAINER_CompactListShift;
+            location |= (unsigned int)( lookup & entitytainer->entry_bucket_mask );
+        }
+
+        ENTITYTAINER_memcpy( buffer, &entity, sizeof( entity ) );
+        buffer += sizeof( entity );
+        ENTITYTAINER_memcpy( buffer, &location, sizeof( location ) );
+        buffer += sizeof( location );
+        for ( int i_column = 0; i_column < header.num_columns; ++i_column ) {
+            ENTITYTAINER_memcpy( buffer, columns[i_column] + i_entry, sizeof( TheEntitytainerEntity ) );
+            buffer += sizeof( TheEntitytainerEntity );
+        }
+    }
+
+    if ( header.order_count > 0 ) {
+        ENTITYTAINER_memcpy( buffer, entitytainer->order, header.order_count * sizeof( TheEntitytainerEntity ) );
+        buffer += header.order_count * sizeof( TheEntitytainerEntity );
+    }
+
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        int bucket_size = header.bucket_sizes[i_bl] * (int)sizeof( TheEntitytainerEntity );
+        int list_size   = header.num_saved_buckets[i_bl] * bucket_size;
+        if ( bucket_list->pages == NULL ) {
+            ENTITYTAINER_memcpy( buffer, bucket_list->bucket_data, list_size );
+        }
+        else {
+            for ( int i_bucket = 0; i_bucket < header.num_saved_buckets[i_bl]; ++i_bucket ) {
+                ENTITYTAINER_memcpy(
+                  buffer + i_bucket * bucket_size, entitytainer__bucket( bucket_list, i_bucket ), bucket_size );
+            }
+        }
+
+        buffer += list_size;
+        for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+            int num_slots     = header.num_saved_buckets[i_bl] * header.bucket_sizes[i_bl];
+            int payloads_size = num_slots * header.payload_sizes[i_column];
+            ENTITYTAINER_memcpy( buffer, entitytainer->bucket_lists[i_bl].payloads[i_column], payloads_size );
+            buffer += payloads_size;
+        }
+    }
+
+    return size;
+}
+
+ENTITYTAINER_API bool
+entitytainer_load_compact_config( const unsigned char*          buffer,
+                                  int                           buffer_size,
+                                  struct TheEntitytainerConfig* config ) {
+    TheEntitytainerCompactHeader header;
+    if ( buffer_size < (int)sizeof( header ) ) {
+        return false;
+    }
+
+    ENTITYTAINER_memcpy( &header, buffer, sizeof( header ) );
+    if ( header.magic != ENTITYTAINER_CompactMagic || header.version != ENTITYTAINER_CompactVersion ||
+         header.endianness != ENTITYTAINER_CompactEndianness ||
+         header.entity_size != (int)sizeof( TheEntitytainerEntity ) ||
+         header.entry_size != (int)sizeof( TheEntitytainerEntry ) ||
+         header.num_bucket_lists > ENTITYTAINER_MAX_BUCKET_LISTS ||
+         header.num_columns > ENTITYTAINER_MAX_ENTRY_COLUMNS ||
+         header.num_payload_columns > ENTITYTAINER_MAX_PAYLOAD_COLUMNS ) {
+        return false;
+    }
+
+    if ( buffer_size < entitytainer__compact_size( &header ) ) {
+        return false;
+    }
+
+    ENTITYTAINER_memset( config, 0, sizeof( *config ) );
+    config->num_entries      = header.num_entries;
+    config->num_bucket_lists = header.num_bucket_lists;
+    for ( int i_bl = 0; i_bl < header.num_bucket_lists; ++i_bl ) {
+        config->bucket_sizes[i_bl]      = header.bucket_sizes[i_bl];
+        config->bucket_list_sizes[i_bl] = header.bucket_list_sizes[i_bl];
+    }
+
+    config->num_channels        = header.num_channels;
+    config->num_payload_columns = header.num_payload_columns;
+    for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+        config->payload_sizes[i_column] = header.payload_sizes[i_column];
+    }
+
+    config->remove_with_holes       = ( header.flags & ( 1 << 0 ) ) != 0;
+    config->keep_capacity_on_remove = ( header.flags & ( 1 << 1 ) ) != 0;
+    config->hashed_lookup           = ( header.flags & ( 1 << 2 ) ) != 0;
+    config->chain_last_bucket_list  = ( header.flags & ( 1 << 3 ) ) != 0;
+    config->track_child_index       = ( header.flags & ( 1 << 4 ) ) != 0;
+    config->remove_unordered        = ( header.flags & ( 1 << 5 ) ) != 0;
+    config->track_depth             = ( header.flags & ( 1 << 6 ) ) != 0;
+    config->track_order             = ( header.flags & ( 1 << 7 ) ) != 0;
+    config->defer_bucket_frees      = ( header.flags & ( 1 << 8 ) ) != 0;
+    config->track_dirty             = ( header.flags & ( 1 << 9 ) ) != 0;
+    config->lazy_demotion           = ( header.flags & ( 1 << 10 ) ) != 0;
+    config->track_occupancy         = ( header.flags & ( 1 << 11 ) ) != 0;
+    config->align_buckets           = ( header.flags & ( 1 << 12 ) ) != 0;
+    config->track_num_children      = ( header.flags & ( 1 << 13 ) ) != 0;
+    return true;
+}
+
+ENTITYTAINER_API TheEntitytainer*
+entitytainer_load_compact( const unsigned char* buffer, int buffer_size, struct TheEntitytainerConfig* config ) {
+    struct TheEntitytainerConfig saved_config;
+    if ( !entitytainer_load_compact_config( buffer, buffer_size, &saved_config ) ) {
+        return NULL;
+    }
+
+    TheEntitytainerCompactHeader header;
+    ENTITYTAINER_memcpy( &header, buffer, sizeof( header ) );
+    buffer += sizeof( header );
+
+    // Only the sizes can change, and they have to fit what's there.
+    ENTITYTAINER_assert( entitytainer__config_flags( config ) == header.flags );
+    ENTITYTAINER_assert( config->num_bucket_lists == header.num_bucket_lists );
+    ENTITYTAINER_assert( config->num_entries >= header.num_saved_entries );
+    ENTITYTAINER_assert( config->num_payload_columns == header.num_payload_columns );
+    ENTITYTAINER_assert( ( config->num_channels > 1 ? config->num_channels : 1 ) == header.num_channels );
+    for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+        ENTITYTAINER_assert( config->payload_sizes[i_column] == header.payload_sizes[i_column] );
+    }
+
+    TheEntitytainer* entitytainer = entitytainer_create( config );
+    for ( int i_bl = 0; i_bl < header.num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        ENTITYTAINER_assert( bucket_list->bucket_size >= header.bucket_sizes[i_bl] );
+        while ( bucket_list->pages != NULL && bucket_list->total_buckets < header.num_saved_buckets[i_bl] ) {
+            entitytainer__add_page( entitytainer, bucket_list );
+        }
+
+        ENTITYTAINER_assert( bucket_list->total_buckets >= header.num_saved_buckets[i_bl] );
+        // The page links are stored in the last slot
+        ENTITYTAINER_assert( !entitytainer__is_chained( entitytainer, i_bl ) ||
+                             bucket_list->bucket_size == header.bucket_sizes[i_bl] );
+        (void)bucket_list;
+    }
+
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int num_columns = entitytainer__entry_columns( entitytainer, columns );
+    ENTITYTAINER_assert( num_columns == header.num_columns );
+    for ( int i_saved = 0; i_saved < header.num_saved_entries; ++i_saved ) {
+        TheEntitytainerEntity entity;
+        unsigned int          location;
+        ENTITYTAINER_memcpy( &entity, buffer, sizeof( entity ) );
+        buffer += sizeof( entity );
+        ENTITYTAINER_memcpy( &location, buffer, sizeof( location ) );
+        buffer += sizeof( location );
+
+        ENTITYTAINER_assert( entitytainer->hashed_lookup || (int)entity < entitytainer->entry_lookup_size );
+        int index = entitytainer__insert_index( entitytainer, entity );
+        if ( location != 0 ) {
+            unsigned int bucket_list_index = location >> ENTITYTAINER_CompactListShift;
+            unsigned int bucket_index      = location & ( ( 1u << ENTITYTAINER_CompactListShift ) - 1 );
+            entitytainer->entry_lookup[index] =
+              (TheEntitytainerEntry)( ( bucket_list_index << entitytainer->entry_list_shift ) | bucket_index );
+        }
+
+        for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+            ENTITYTAINER_memcpy( columns[i_column] + index, buffer, sizeof( TheEntitytainerEntity ) );
+            buffer += sizeof( TheEntitytainerEntity );
+        }
+    }
+
+    if ( entitytainer->order != NULL ) {
+        ENTITYTAINER_memcpy( entitytainer->order, buffer, header.order_count * sizeof( TheEntitytainerEntity ) );
+        buffer += header.order_count * sizeof( TheEntitytainerEntity );
+        entitytainer->order_count = header.order_count;
+        entitytainer->order_holes = header.order_holes;
+        entitytainer->order_dirty = 0;
+    }
+
+    for ( int i_bl = 0; i_bl < header.num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        int                        size_saved  = header.bucket_sizes[i_bl] * (int)sizeof( TheEntitytainerEntity );
+        if ( bucket_list->bucket_size == header.bucket_sizes[i_bl] && bucket_list->pages == NULL ) {
+            ENTITYTAINER_memcpy( bucket_list->bucket_data, buffer, header.num_saved_buckets[i_bl] * size_saved );
+        }
+        else {
+            // Bigger buckets (the rest of each one is zeroed, it might not be with lazy_zeroing) or pages.
+            int size_bucket = bucket_list->bucket_size * (int)sizeof( TheEntitytainerEntity );
+            for ( int i_bucket = 0; i_bucket < header.num_saved_buckets[i_bl]; ++i_bucket ) {
+                TheEntitytainerEntity* bucket = entitytainer__bucket( bucket_list, i_bucket );
+                ENTITYTAINER_memcpy( bucket, buffer + i_bucket * size_saved, size_saved );
+                ENTITYTAINER_memset( (unsigned char*)bucket + size_saved, 0, size_bucket - size_saved );
+            }
+        }
+
+        buffer += header.num_saved_buckets[i_bl] * size_saved;
+        for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+            // Same as the buckets
+            int            payload_saved = header.bucket_sizes[i_bl] * header.payload_sizes[i_column];
+            int            payload_size  = bucket_list->bucket_size * header.payload_sizes[i_column];
+            unsigned char* payloads      = bucket_list->payloads[i_column];
+            for ( int i_bucket = 0; i_bucket < header.num_saved_buckets[i_bl]; ++i_bucket ) {
+                ENTITYTAINER_memcpy(
+                  payloads + i_bucket * payload_size, buffer + i_bucket * payload_saved, payload_saved );
+            }
+
+            buffer += header.num_saved_buckets[i_bl] * payload_saved;
+        }
+
+        bucket_list->first_free_bucket    = header.first_free_buckets[i_bl];
+        bucket_list->first_retired_bucket = header.first_retired_buckets[i_bl];
+        bucket_list->used_buckets         = header.used_buckets[i_bl];
+    }
+
+    entitytainer__mark_all( entitytainer );
+    return entitytainer;
+}
+
+ENTITYTAINER_API TheEntitytainer*
+                 entitytainer_load( unsigned char* buffer, int buffer_size ) {
+    ENTITYTAINER_assert( entitytainer__ptr_to_aligned_ptr( buffer, (int)ENTITYTAINER_alignof( TheEntitytainer ) ) ==
+                         buffer );
+
+    // Fix pointers
+    TheEntitytainer* entitytainer = (TheEntitytainer*)buffer;
+    buffer += sizeof( TheEntitytainer );
+    buffer = entitytainer__place_lookups( entitytainer, buffer );
+
+    buffer                     = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer,
+                                                               (int)ENTITYTAINER_alignof( TheEntitytainerBucketList ) );
+    entitytainer->bucket_lists = (TheEntitytainerBucketList*)buffer;
+
+    unsigned char* bucket_list_end = buffer + sizeof( TheEntitytainerBucketList ) * entitytainer->num_bucket_lists;
+    unsigned char* bucket_data_end = entitytainer__place_bucket_data(
+      &entitytainer->config, entitytainer->bucket_lists, (unsigned char*)entitytainer, bucket_list_end );
+
+    (void)buffer_size;
+    (void)bucket_data_end;
+    ENTITYTAINER_assert( bucket_data_end <= (unsigned char*)entitytainer + buffer_size );
+    return entitytainer;
+}
+
+ENTITYTAINER_API TheEntitytainer*
+entitytainer_view( const unsigned char* buffer, int buffer_size, TheEntitytainerView* view ) {
+    void* aligned = entitytainer__ptr_to_aligned_ptr( (void*)buffer, (int)ENTITYTAINER_alignof( TheEntitytainer ) );
+    ENTITYTAINER_assert( aligned == buffer );
+    (void)aligned;
+
+    // The same offsets as load, but the pointers go into the view.
+    TheEntitytainer* entitytainer = &view->entitytainer;
+    ENTITYTAINER_memcpy( entitytainer, buffer, sizeof( TheEntitytainer ) );
+    ENTITYTAINER_assert( entitytainer->num_bucket_lists <= ENTITYTAINER_MAX_BUCKET_LISTS );
+    unsigned char* lookups = (unsigned char*)buffer + sizeof( TheEntitytainer );
+    unsigned char* lists   = entitytainer__place_lookups( entitytainer, lookups );
+    lists = (unsigned char*)entitytainer__ptr_to_aligned_ptr( lists,
+                                                              (int)ENTITYTAINER_alignof( TheEntitytainerBucketList ) );
+
+    int lists_size = (int)sizeof( TheEntitytainerBucketList ) * entitytainer->num_bucket_lists;
+    ENTITYTAINER_memcpy( view->bucket_lists, lists, lists_size );
+    entitytainer->bucket_lists     = view->bucket_lists;
+    unsigned char* bucket_data_end =
+      entitytainer__place_bucket_data( &entitytainer->config, view->bucket_lists, buffer, lists + lists_size );
+
+    (void)buffer_size;
+    (void)bucket_data_end;
+    ENTITYTAINER_assert( bucket_data_end <= buffer + buffer_size );
+    return entitytainer;
+}
+
+ENTITYTAINER_API void
+entitytainer_load_into( TheEntitytainer* entitytainer_dst, const TheEntitytainer* entitytainer_src ) {
+    // if ( ENTITYTAINER_memcmp( &entitytainer_dst->config, &entitytainer_src->config, sizeof( TheEntitytainerConfig ) )
+    // ==
+    //      0 ) {
+    //     ENTITYTAINER_memcpy( entitytainer_dst, entitytainer_src, sizeof( TheEntitytainerConfig ) );
+    //     return;
+    // }
+
+    // Only allow grow for now
+    ENTITYTAINER_assert( entitytainer_src->config.num_bucket_lists == entitytainer_dst->config.num_bucket_lists );
+    ENTITYTAINER_assert( entitytainer_src->config.bucket_page_size == 0 &&
+                         entitytainer_dst->config.bucket_page_size == 0 );
+    ENTITYTAINER_assert( entitytainer_src->chain_last_bucket_list == entitytainer_dst->chain_last_bucket_list );
+    // The page links are stored in the last slot
+    ENTITYTAINER_assert( !entitytainer_src->chain_last_bucket_list ||
+                         entitytainer_src->config.bucket_sizes[entitytainer_src->num_bucket_lists - 1] ==
+                           entitytainer_dst->config.bucket_sizes[entitytainer_dst->num_bucket_lists - 1] );
+    ENTITYTAINER_assert( entitytainer_src->config.num_payload_columns == entitytainer_dst->config.num_payload_columns );
+    ENTITYTAINER_assert( entitytainer_src->num_channels == entitytainer_dst->num_channels );
+    for ( int i_column = 0; i_column < entitytainer_src->config.num_payload_columns; ++i_column ) {
+        ENTITYTAINER_assert( entitytainer_src->config.payload_sizes[i_column] ==
+                             entitytainer_dst->config.payload_sizes[i_column] );
+    }
+
+    for ( int i_bl = 0; i_bl < entitytainer_src->config.num_bucket_lists; ++i_bl ) {
+        ENTITYTAINER_assert( entitytainer_src->config.bucket_sizes[i_bl] <=
+                             entitytainer_dst->config.bucket_sizes[i_bl] );
+        ENTITYTAINER_assert( entitytainer_src->config.bucket_list_sizes[i_bl] <=
+                             entitytainer_dst->config.bucket_list_sizes[i_bl] );
+
+        if ( entitytainer_src->config.bucket_sizes[i_bl] == entitytainer_dst->config.bucket_sizes[i_bl] ) {
+            int bucket_list_size = sizeof( TheEntitytainerEntity ) * entitytainer_src->config.bucket_list_sizes[i_bl] *
+                                   entitytainer_src->config.bucket_sizes[i_bl];
+            ENTITYTAINER_memcpy( entitytainer_dst->bucket_lists[i_bl].bucket_data,
+                                 entitytainer_src->bucket_lists[i_bl].bucket_data,
+                                 bucket_list_size );
+        }
+        else {
+            TheEntitytainerBucketList* bucket_list_src = &entitytainer_src->bucket_lists[i_bl];
+            int                        bucket_size_src = entitytainer_src->config.bucket_sizes[i_bl];
+            TheEntitytainerBucketList* bucket_list_dst = &entitytainer_dst->bucket_lists[i_bl];
+            int                        bucket_size_dst = entitytainer_dst->config.bucket_sizes[i_bl];
+            for ( int i_bucket = 0; i_bucket < entitytainer_src->config.bucket_list_sizes[i_bl]; ++i_bucket ) {
+                int                    bucket_offset_src = i_bucket * bucket_size_src;
+                TheEntitytainerEntity* bucket_src        = bucket_list_src->bucket_data + bucket_offset_src;
+                int                    bucket_offset_dst = i_bucket * bucket_size_dst;
+                TheEntitytainerEntity* bucket_dst        = bucket_list_dst->bucket_data + bucket_offset_dst;
+                ENTITYTAINER_memcpy( bucket_dst, bucket_src, bucket_size_src * sizeof( TheEntitytainerEntity ) );
+                ENTITYTAINER_memset( bucket_dst + bucket_size_src,
+                                     0,
+                                     ( bucket_size_dst - bucket_size_src ) * sizeof( TheEntitytainerEntity ) );
+            }
+        }
+
+        for ( int i_column = 0; i_column < entitytainer_src->config.num_payload_columns; ++i_column ) {
+            int            payload_size = entitytainer_src->config.payload_sizes[i_column];
+            int            size_src     = entitytainer_src->config.bucket_sizes[i_bl] * payload_size;
+            int            size_dst     = entitytainer_dst->config.bucket_sizes[i_bl] * payload_size;
+            unsigned char* payloads_src = entitytainer_src->bucket_lists[i_bl].payloads[i_column];
+            unsigned char* payloads_dst = entitytainer_dst->bucket_lists[i_bl].payloads[i_column];
+            for ( int i_bucket = 0; i_bucket < entitytainer_src->config.bucket_list_sizes[i_bl]; ++i_bucket ) {
+                ENTITYTAINER_memcpy( payloads_dst + i_bucket * size_dst, payloads_src + i_bucket * size_src, size_src );
+            }
+        }
+
+        entitytainer_dst->bucket_lists[i_bl].first_free_bucket = entitytainer_src->bucket_lists[i_bl].first_free_bucket;
+        entitytainer_dst->bucket_lists[i_bl].first_retired_bucket =
+          entitytainer_src->bucket_lists[i_bl].first_retired_bucket;
+        entitytainer_dst->bucket_lists[i_bl].used_buckets      = entitytainer_src->bucket_lists[i_bl].used_buckets;
+    }
+
+    ENTITYTAINER_assert( ( entitytainer_src->order != NULL ) == ( entitytainer_dst->order != NULL ) );
+    if ( entitytainer_src->order != NULL ) {
+        ENTITYTAINER_memcpy( entitytainer_dst->order,
+                             entitytainer_src->order,
+                             sizeof( TheEntitytainerEntity ) * entitytainer_src->order_count );
+        entitytainer_dst->order_count = entitytainer_src->order_count;
+        entitytainer_dst->order_holes = entitytainer_src->order_holes;
+        entitytainer_dst->order_dirty = 0;
+    }
+
+    ENTITYTAINER_assert( entitytainer_src->hashed_lookup == entitytainer_dst->hashed_lookup );
+    if ( entitytainer_src->hashed_lookup &&
+         entitytainer_src->entry_lookup_size != entitytainer_dst->entry_lookup_size ) {
+        // Different table sizes, so rehash into the destination.
+        for ( int i = 1; i < entitytainer_src->entry_lookup_size; ++i ) {
+            if ( entitytainer_src->entry_keys[i] != ENTITYTAINER_InvalidEntity ) {
+                int index = entitytainer__insert_index( entitytainer_dst, entitytainer_src->entry_keys[i] );
+                entitytainer__copy_entry( entitytainer_dst, index, (TheEntitytainer*)entitytainer_src, i );
+            }
+        }
+    }
+    else {
+        if ( entitytainer_src->hashed_lookup ) {
+            ENTITYTAINER_memcpy( entitytainer_dst->entry_keys,
+                                 entitytainer_src->entry_keys,
+                                 sizeof( TheEntitytainerEntity ) * entitytainer_src->entry_lookup_size );
+            entitytainer_dst->entry_hash_count = entitytainer_src->entry_hash_count;
+        }
+
+        ENTITYTAINER_memcpy( entitytainer_dst->entry_lookup,
+                             entitytainer_src->entry_lookup,
+                             sizeof( TheEntitytainerEntry ) * entitytainer_src->entry_lookup_size );
+
+        TheEntitytainer*       src = (TheEntitytainer*)entitytainer_src;
+        TheEntitytainerEntity* columns_src[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+        TheEntitytainerEntity* columns_dst[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+        int                    num_columns = entitytainer__entry_columns( src, columns_src );
+        int                    num_dst     = entitytainer__entry_columns( entitytainer_dst, columns_dst );
+        ENTITYTAINER_assert( num_columns == num_dst );
+        (void)num_dst;
+        for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+            ENTITYTAINER_memcpy( columns_dst[i_column],
+                                 columns_src[i_column],
+                                 sizeof( TheEntitytainerEntity ) * entitytainer_src->entry_lookup_size );
+        }
+    }
+
+    entitytainer__mark_all( entitytainer_dst );
+}
+
+ENTITYTAINER_API int
+entitytainer_save_delta( TheEntitytainer* entitytainer, unsigned char* buffer, int buffer_size ) {
+    ENTITYTAINER_assert( entitytainer->track_dirty );
+    TheEntitytainerDeltaHeader header = { 0 };
+    header.magic                      = ENTITYTAINER_DeltaMagic;
+    header.entity_size                = (int)sizeof( TheEntitytainerEntity );
+    header.entry_size                 = (int)sizeof( TheEntitytainerEntry );
+    header.flags                      = entitytainer__config_flags( &entitytainer->config ) & ~( 7 << 9 );
+    header.generation                 = entitytainer->generation;
+    header.entry_lookup_size          = entitytainer->entry_lookup_size;
+    header.num_bucket_lists           = entitytainer->num_bucket_lists;
+    header.num_dirty_entries = entitytainer__count_bits( entitytainer->dirty_entries, entitytainer->entry_lookup_size );
+    header.entry_hash_count  = entitytainer->entry_hash_count;
+    header.order_count       = entitytainer->order != NULL ? entitytainer->order_count : 0;
+    header.order_holes       = entitytainer->order != NULL ? entitytainer->order_holes : 0;
+    header.order_start       = entitytainer->dirty_order;
+    if ( header.order_start > header.order_count ) {
+        header.order_start = header.order_count;
+    }
+
+    header.num_payload_columns = entitytainer->config.num_payload_columns;
+    header.num_channels        = entitytainer->num_channels;
+    for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+        header.payload_sizes[i_column] = entitytainer->config.payload_sizes[i_column];
+    }
+
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    header.num_columns = entitytainer__entry_columns( entitytainer, columns );
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        header.bucket_sizes[i_bl]              = bucket_list->bucket_size;
+        header.bucket_list_sizes[i_bl]         = bucket_list->total_buckets;
+        header.num_dirty_buckets[i_bl] =
+          entitytainer__count_bits( entitytainer->dirty_buckets[i_bl], bucket_list->total_buckets );
+        header.first_free_buckets[i_bl]    = bucket_list->first_free_bucket;
+        header.first_retired_buckets[i_bl] = bucket_list->first_retired_bucket;
+        header.used_buckets[i_bl]          = bucket_list->used_buckets;
+    }
+
+    int size = entitytainer__delta_size( &header, entitytainer->hashed_lookup );
+    if ( size > buffer_size ) {
+        return size;
+    }
+
+    ENTITYTAINER_memcpy( buffer, &header, sizeof( header ) );
+    buffer += sizeof( header );
+    for ( int i_word = 0; i_word < ENTITYTAINER_DirtyWords( entitytainer->entry_lookup_size ); ++i_word ) {
+        unsigned int bits = entitytainer->dirty_entries[i_word];
+        for ( int i_entry = i_word * 32; bits != 0; ++i_entry, bits >>= 1 ) {
+            if ( ( bits & 1 ) == 0 ) {
+                continue;
+            }
+
+            ENTITYTAINER_memcpy( buffer, &i_entry, sizeof( i_entry ) );
+            buffer += sizeof( i_entry );
+            if ( entitytainer->hashed_lookup ) {
+                ENTITYTAINER_memcpy( buffer, entitytainer->entry_keys + i_entry, sizeof( TheEntitytainerEntity ) );
+                buffer += sizeof( TheEntitytainerEntity );
+            }
+
+            ENTITYTAINER_memcpy( buffer, entitytainer->entry_lookup + i_entry, sizeof( TheEntitytainerEntry ) );
+            buffer += sizeof( TheEntitytainerEntry );
+            for ( int i_column = 0; i_column < header.num_columns; ++i_column ) {
+                ENTITYTAINER_memcpy( buffer, columns[i_column] + i_entry, sizeof( TheEntitytainerEntity ) );
+                buffer += sizeof( TheEntitytainerEntity );
+            }
+        }
+    }
+
+    int order_size = ( header.order_count - header.order_start ) * (int)sizeof( TheEntitytainerEntity );
+    if ( order_size > 0 ) {
+        ENTITYTAINER_memcpy( buffer, entitytainer->order + header.order_start, order_size );
+        buffer += order_size;
+    }
+
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        int                        size_saved  = bucket_list->bucket_size * (int)sizeof( TheEntitytainerEntity );
+        for ( int i_word = 0; i_word < ENTITYTAINER_DirtyWords( bucket_list->total_buckets ); ++i_word ) {
+            unsigned int bits = entitytainer->dirty_buckets[i_bl][i_word];
+            for ( int i_bucket = i_word * 32; bits != 0; ++i_bucket, bits >>= 1 ) {
+                if ( ( bits & 1 ) == 0 ) {
+                    continue;
+                }
+
+                ENTITYTAINER_memcpy( buffer, &i_bucket, sizeof( i_bucket ) );
+                buffer += sizeof( i_bucket );
+                TheEntitytainerEntity* bucket = entitytainer__bucket( bucket_list, i_bucket );
+                ENTITYTAINER_memcpy( buffer, bucket, size_saved );
+                buffer += size_saved;
+                for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+                    int            payload_saved = bucket_list->bucket_size * header.payload_sizes[i_column];
+                    unsigned char* payloads      = bucket_list->payloads[i_column] + i_bucket * payload_saved;
+                    ENTITYTAINER_memcpy( buffer, payloads, payload_saved );
+                    buffer += payload_saved;
+                }
+            }
+        }
+    }
+
+    return size;
+}
+
+ENTITYTAINER_API void
+entitytainer_clear_dirty( TheEntitytainer* entitytainer ) {
+    ENTITYTAINER_assert( entitytainer->track_dirty );
+    ENTITYTAINER_memset( entitytainer->dirty_entries,
+                         0,
+                         ENTITYTAINER_DirtyWords( entitytainer->entry_lookup_size ) * sizeof( unsigned int ) );
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        int num_words = ENTITYTAINER_DirtyWords( entitytainer->bucket_lists[i_bl].total_buckets );
+        ENTITYTAINER_memset( entitytainer->dirty_buckets[i_bl], 0, num_words * sizeof( unsigned int ) );
+    }
+
+    entitytainer->dirty_order = entitytainer->order_count;
+    ++entitytainer->generation;
+}
+
+ENTITYTAINER_API int
+entitytainer_get_generation( TheEntitytainer* entitytainer ) {
+    return entitytainer->generation;
+}
+
+ENTITYTAINER_API bool
+entitytainer_apply_delta( TheEntitytainer* entitytainer, const unsigned char* buffer, int buffer_size ) {
+    TheEntitytainerDeltaHeader header;
+    if ( buffer_size < (int)sizeof( header ) ) {
+        return false;
+    }
+
+    // Everything has to be laid out the same, so the indices can be used as they are.
+    ENTITYTAINER_memcpy( &header, buffer, sizeof( header ) );
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( entitytainer, columns );
+    if ( header.magic != ENTITYTAINER_DeltaMagic || header.entity_size != (int)sizeof( TheEntitytainerEntity ) ||
+         header.entry_size != (int)sizeof( TheEntitytainerEntry ) ||
+         header.flags != ( entitytainer__config_flags( &entitytainer->config ) & ~( 7 << 9 ) ) ||
+         header.generation != entitytainer->generation ||
+         header.entry_lookup_size != entitytainer->entry_lookup_size ||
+         header.num_bucket_lists != entitytainer->num_bucket_lists || header.num_columns != num_columns ||
+         header.num_payload_columns != entitytainer->config.num_payload_columns ||
+         header.num_channels != entitytainer->num_channels ) {
+        return false;
+    }
+
+    for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+        if ( header.payload_sizes[i_column] != entitytainer->config.payload_sizes[i_column] ) {
+            return false;
+        }
+    }
+
+    for ( int i_bl = 0; i_bl < header.num_bucket_lists; ++i_bl ) {
+        if ( header.bucket_sizes[i_bl] != entitytainer->bucket_lists[i_bl].bucket_size ||
+             header.bucket_list_sizes[i_bl] != entitytainer->bucket_lists[i_bl].total_buckets ) {
+            return false;
+        }
+    }
+
+    if ( buffer_size < entitytainer__delta_size( &header, entitytainer->hashed_lookup ) ) {
+        return false;
+    }
+
+    buffer += sizeof( header );
+    for ( int i = 0; i < header.num_dirty_entries; ++i ) {
+        int i_entry;
+        ENTITYTAINER_memcpy( &i_entry, buffer, sizeof( i_entry ) );
+        buffer += sizeof( i_entry );
+        ENTITYTAINER_assert( i_entry > 0 && i_entry < entitytainer->entry_lookup_size );
+        if ( entitytainer->hashed_lookup ) {
+            ENTITYTAINER_memcpy( entitytainer->entry_keys + i_entry, buffer, sizeof( TheEntitytainerEntity ) );
+            buffer += sizeof( TheEntitytainerEntity );
+        }
+
+        ENTITYTAINER_memcpy( entitytainer->entry_lookup + i_entry, buffer, sizeof( TheEntitytainerEntry ) );
+        buffer += sizeof( TheEntitytainerEntry );
+        for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+            ENTITYTAINER_memcpy( columns[i_column] + i_entry, buffer, sizeof( TheEntitytainerEntity ) );
+            buffer += sizeof( TheEntitytainerEntity );
+        }
+
+        entitytainer__mark_entry( entitytainer, i_entry );
+    }
+
+    int order_size = ( header.order_count - header.order_start ) * (int)sizeof( TheEntitytainerEntity );
+    if ( entitytainer->order != NULL ) {
+        ENTITYTAINER_memcpy( entitytainer->order + header.order_start, buffer, order_size > 0 ? order_size : 0 );
+        buffer += order_size > 0 ? order_size : 0;
+        entitytainer->order_count = header.order_count;
+        entitytainer->order_holes = header.order_holes;
+        entitytainer__mark_order( entitytainer, header.order_start );
+        if ( header.order_start < entitytainer->order_dirty ) {
+            entitytainer->order_dirty = header.order_start;
+        }
+    }
+
+    for ( int i_bl = 0; i_bl < header.num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        int                        size_saved  = bucket_list->bucket_size * (int)sizeof( TheEntitytainerEntity );
+        for ( int i = 0; i < header.num_dirty_buckets[i_bl]; ++i ) {
+            int i_bucket;
+            ENTITYTAINER_memcpy( &i_bucket, buffer, sizeof( i_bucket ) );
+            buffer += sizeof( i_bucket );
+            ENTITYTAINER_assert( i_bucket >= 0 && i_bucket < bucket_list->total_buckets );
+            ENTITYTAINER_memcpy( entitytainer__bucket( bucket_list, i_bucket ), buffer, size_saved );
+            buffer += size_saved;
+            for ( int i_column = 0; i_column < header.num_payload_columns; ++i_column ) {
+                int            payload_saved = bucket_list->bucket_size * header.payload_sizes[i_column];
+                unsigned char* payloads      = bucket_list->payloads[i_column] + i_bucket * payload_saved;
+                ENTITYTAINER_memcpy( payloads, buffer, payload_saved );
+                buffer += payload_saved;
+            }
+
+            entitytainer__mark_bucket( entitytainer, i_bl, i_bucket );
+            entitytainer__sync_occupancy( entitytainer, i_bl, i_bucket );
+        }
+
+        bucket_list->first_free_bucket    = header.first_free_buckets[i_bl];
+        bucket_list->first_retired_bucket = header.first_retired_buckets[i_bl];
+        bucket_list->used_buckets         = header.used_buckets[i_bl];
+    }
+
+    entitytainer->entry_hash_count = header.entry_hash_count;
+    entitytainer->generation       = header.generation + 1;
+    return true;
+}
+
+static void*
+entitytainer__ptr_to_aligned_ptr( void* ptr, int align ) {
+    if ( align == 0 ) {
+        return ptr;
+    }
+
+    long long int ptr_address = (long long int)ptr;
+    int           offset      = ( ~(int)ptr_address + 1 ) & ( align - 1 );
+    void*         aligned_ptr = (char*)ptr + offset;
+    return aligned_ptr;
+}
+
+static TheEntitytainer*
+entitytainer__layout( struct TheEntitytainerConfig* config, TheEntitytainer* header, TheEntitytainerBucketList* lists ) {
+    // Figures out where everything goes in config->memory, without writing to it.
+    unsigned char* buffer_start = (unsigned char*)config->memory;
+    unsigned char* buffer       = buffer_start;
+    buffer = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer, (int)ENTITYTAINER_alignof( TheEntitytainer ) );
+
+    TheEntitytainer* entitytainer   = (TheEntitytainer*)buffer;
+    header->num_bucket_lists        = config->num_bucket_lists;
+    header->num_channels            = config->num_channels > 1 ? config->num_channels : 1;
+    header->remove_with_holes       = config->remove_with_holes;
+    header->keep_capacity_on_remove = config->keep_capacity_on_remove;
+    header->hashed_lookup           = config->hashed_lookup;
+    header->chain_last_bucket_list  = config->chain_last_bucket_list;
+    header->track_child_index       = config->track_child_index;
+    header->remove_unordered        = config->remove_unordered;
+    header->track_depth             = config->track_depth;
+    header->track_order             = config->track_order;
+    header->defer_bucket_frees      = config->defer_bucket_frees;
+    header->track_dirty             = config->track_dirty;
+    header->lazy_demotion           = config->lazy_demotion;
+    header->track_occupancy         = config->track_occupancy;
+    header->track_num_children      = config->track_num_children;
+    header->entry_lookup_size       = entitytainer__lookup_size( config );
+    header->entry_hash_count        = 0;
+    header->order_count             = 0;
+    header->order_holes             = 0;
+    header->order_dirty             = 0;
+    header->sequence                = 0;
+    header->dirty_order             = 0;
+    header->generation              = 0;
+    header->entry_high_water        = 0;
+    header->entry_hash_shift        = 32;
+    for ( int size = header->entry_lookup_size - 1; size > 1; size >>= 1 ) {
+        --header->entry_hash_shift;
+    }
+
+    // Everything from here on goes by the padded bucket sizes.
+    ENTITYTAINER_memcpy( &header->config, config, sizeof( *config ) );
+    entitytainer__align_config( &header->config );
+    config = &header->config;
+
+    // Without holes the children are always packed, so there's nothing to track.
+    ENTITYTAINER_assert( !config->track_occupancy || config->remove_with_holes );
+
+#ifdef ENTITYTAINER_BucketListBitCount
+    int list_bit_count = ENTITYTAINER_BucketListBitCount;
+#else
+    int list_bit_count = 1;
+    while ( ( 1 << list_bit_count ) < config->num_bucket_lists ) {
+        ++list_bit_count;
+    }
+#endif
+
+    ENTITYTAINER_assert( config->num_bucket_lists <= ENTITYTAINER_MAX_BUCKET_LISTS );
+    ENTITYTAINER_assert( config->num_bucket_lists <= ( 1 << list_bit_count ) );
+    header->entry_list_shift  = (int)sizeof( TheEntitytainerEntry ) * 8 - list_bit_count;
+    header->entry_bucket_mask = (int)( ( 1u << header->entry_list_shift ) - 1 );
+
+    buffer += sizeof( TheEntitytainer );
+    buffer = entitytainer__place_lookups( header, buffer );
+
+    buffer               = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer,
+                                                               (int)ENTITYTAINER_alignof( TheEntitytainerBucketList ) );
+    header->bucket_lists = (TheEntitytainerBucketList*)buffer;
+
+    unsigned char* bucket_list_end = buffer + sizeof( TheEntitytainerBucketList ) * config->num_bucket_lists;
+    ENTITYTAINER_assert( config->num_payload_columns >= 0 &&
+                         config->num_payload_columns <= ENTITYTAINER_MAX_PAYLOAD_COLUMNS );
+
+    // The page table is the only thing that grows with the pages, the rest would have to be paged too.
+    int page_size = config->bucket_page_size;
+    ENTITYTAINER_assert( page_size == 0 || ( ( page_size & ( page_size - 1 ) ) == 0 && config->alloc_page != NULL &&
+                                             config->free_page != NULL && !config->track_dirty &&
+                                             !config->track_occupancy && config->num_payload_columns == 0 ) );
+    (void)page_size;
+    for ( int i = 0; i < config->num_bucket_lists; ++i ) {
+        // Just making sure that we don't go into the bucket data area
+        ENTITYTAINER_assert( buffer + sizeof( TheEntitytainerBucketList ) <= bucket_list_end );
+
+        // We need to do this because first_free_bucket is stored as an int.
+        ENTITYTAINER_assert( config->bucket_sizes[i] * sizeof( TheEntitytainerEntity ) >= sizeof( int ) );
+
+        // The bucket index needs to fit in the entry, and in an entity since that's how free buckets are linked.
+        ENTITYTAINER_assert( config->bucket_list_sizes[i] <= entitytainer__max_buckets( header ) );
+
+        // A chained bucket uses its last slot to link to the next page, but still needs to fit a full bucket from the
+        // previous bucket list.
+        ENTITYTAINER_assert( !config->chain_last_bucket_list || i != config->num_bucket_lists - 1 ||
+                             ( config->bucket_sizes[i] >= 3 &&
+                               ( i == 0 || config->bucket_sizes[i] > config->bucket_sizes[i - 1] ) ) );
+
+        // All the pages need to be addressable too.
+        ENTITYTAINER_assert( page_size == 0 ||
+                             ( config->bucket_list_sizes[i] % page_size == 0 &&
+                               config->bucket_list_sizes[i] / page_size <= config->max_bucket_pages &&
+                               config->max_bucket_pages * page_size <= entitytainer__max_buckets( header ) ) );
+
+        TheEntitytainerBucketList* list = &lists[i];
+        list->bucket_size               = config->bucket_sizes[i];
+        list->total_buckets             = config->bucket_list_sizes[i];
+        list->first_free_bucket         = ENTITYTAINER_NoFreeBucket;
+        list->first_retired_bucket      = ENTITYTAINER_NoFreeBucket;
+        list->used_buckets              = 0;
+#if defined( ENTITYTAINER_STATS )
+        list->promotions      = 0;
+        list->demotions       = 0;
+        list->promotion_bytes = 0;
+#endif
+
+        if ( i == 0 ) {
+            // We need this in order to ensure that we can use 0 as the default "invalid" entry.
+            list->used_buckets = 1;
+        }
+
+        buffer += sizeof( TheEntitytainerBucketList );
+    }
+
+    unsigned char* end =
+      entitytainer__place_bucket_data( config, lists, (unsigned char*)entitytainer, bucket_list_end );
+    ENTITYTAINER_assert( end <= buffer_start + config->memory_size );
+    (void)end;
+    return entitytainer;
+}
+
+static void
+entitytainer__grow_config( TheEntitytainer*              entitytainer,
+                           int                           bucket_list_index,
+                           float                         growth,
+                           struct TheEntitytainerConfig* config ) {
+    // A bucket_list_index of -1 means grow the entries and all the bucket lists.
+    ENTITYTAINER_assert( growth >= 1.0f );
+    ENTITYTAINER_memcpy( config, &entitytainer->config, sizeof( *config ) );
+    if ( bucket_list_index == -1 ) {
+        config->num_entries = (int)( entitytainer->config.num_entries * growth );
+    }
+
+    for ( int i = 0; i < entitytainer->num_bucket_lists; ++i ) {
+        TheEntitytainerBucketList* list = &entitytainer->bucket_lists[i];
+        config->bucket_list_sizes[i]    = list->total_buckets;
+        if ( bucket_list_index == -1 || bucket_list_index == i ) {
+            int total_buckets = (int)( list->total_buckets * growth );
+            if ( total_buckets > entitytainer__max_buckets( entitytainer ) ) {
+                total_buckets = entitytainer__max_buckets( entitytainer );
+            }
+
+            config->bucket_list_sizes[i] = total_buckets;
+        }
+    }
+}
+
+static TheEntitytainer*
+entitytainer__realloc( TheEntitytainer* entitytainer_old, struct TheEntitytainerConfig* config ) {
+    // The new memory may be the old memory, grown in place. So grab the old header before it gets overwritten and
+    // then move the regions back to front. Nothing shrinks, so every region ends up at the same or a higher address
+    // and there's no risk of stomping on a region that hasn't been moved yet.
+    TheEntitytainer           old = *entitytainer_old;
+    TheEntitytainerBucketList old_lists[ENTITYTAINER_MAX_BUCKET_LISTS];
+    ENTITYTAINER_assert( old.config.bucket_page_size == 0 ); // Paged bucket lists grow by themselves
+    for ( int i = 0; i < old.num_bucket_lists; ++i ) {
+        old_lists[i] = old.bucket_lists[i];
+    }
+
+    TheEntitytainer           layout;
+    TheEntitytainerBucketList layout_lists[ENTITYTAINER_MAX_BUCKET_LISTS];
+    TheEntitytainer*          entitytainer = entitytainer__layout( config, &layout, layout_lists );
+    ENTITYTAINER_assert( layout.entry_lookup_size >= old.entry_lookup_size );
+
+    // The payloads are after all the bucket data, so they go first.
+    for ( int i = old.num_bucket_lists - 1; i >= 0; --i ) {
+        for ( int i_column = old.config.num_payload_columns - 1; i_column >= 0; --i_column ) {
+            int            payload_size = old.config.payload_sizes[i_column];
+            int            old_size     = old_lists[i].total_buckets * old_lists[i].bucket_size * payload_size;
+            int            new_size     = layout_lists[i].total_buckets * layout_lists[i].bucket_size * payload_size;
+            unsigned char* payloads     = layout_lists[i].payloads[i_column];
+            ENTITYTAINER_memmove( payloads, old_lists[i].payloads[i_column], old_size );
+            ENTITYTAINER_memset( payloads + old_size, 0, new_size - old_size );
+        }
+    }
+
+    for ( int i = old.num_bucket_lists - 1; i >= 0; --i ) {
+        TheEntitytainerBucketList* list     = &layout_lists[i];
+        TheEntitytainerBucketList* list_old = &old_lists[i];
+        ENTITYTAINER_assert( list->total_buckets >= list_old->total_buckets );
+        int old_size = list_old->total_buckets * list_old->bucket_size;
+        int new_size = list->total_buckets * list->bucket_size;
+        ENTITYTAINER_memmove( list->bucket_data, list_old->bucket_data, old_size * sizeof( TheEntitytainerEntity ) );
+        ENTITYTAINER_memset(
+          list->bucket_data + old_size, 0, ( new_size - old_size ) * sizeof( TheEntitytainerEntity ) );
+
+        list->first_free_bucket    = list_old->first_free_bucket;
+        list->first_retired_bucket = list_old->first_retired_bucket;
+        list->used_buckets      = list_old->used_buckets;
+#if defined( ENTITYTAINER_STATS )
+        list->promotions      = list_old->promotions;
+        list->demotions       = list_old->demotions;
+        list->promotion_bytes = list_old->promotion_bytes;
+#endif
+    }
+
+    // The entries keep their indices for now, same as without hashing.
+    int old_entries = old.entry_lookup_size;
+    int new_entries = layout.entry_lookup_size;
+    if ( layout.hashed_lookup ) {
+        ENTITYTAINER_memmove( layout.entry_keys, old.entry_keys, old_entries * sizeof( TheEntitytainerEntity ) );
+        ENTITYTAINER_memset(
+          layout.entry_keys + old_entries, 0, ( new_entries - old_entries ) * sizeof( TheEntitytainerEntity ) );
+        layout.entry_hash_count = old.entry_hash_count;
+    }
+
+    if ( layout.order != NULL ) {
+        ENTITYTAINER_memmove( layout.order, old.order, old.order_count * sizeof( TheEntitytainerEntity ) );
+    }
+
+    TheEntitytainerEntity* columns_old[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    TheEntitytainerEntity* columns_new[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( &old, columns_old );
+    entitytainer__entry_columns( &layout, columns_new );
+    for ( int i_column = num_columns - 1; i_column >= 0; --i_column ) {
+        ENTITYTAINER_memmove(
+          columns_new[i_column], columns_old[i_column], old_entries * sizeof( TheEntitytainerEntity ) );
+        ENTITYTAINER_memset(
+          columns_new[i_column] + old_entries, 0, ( new_entries - old_entries ) * sizeof( TheEntitytainerEntity ) );
+    }
+
+    ENTITYTAINER_memmove( layout.entry_lookup, old.entry_lookup, old_entries * sizeof( TheEntitytainerEntry ) );
+    ENTITYTAINER_memset(
+      layout.entry_lookup + old_entries, 0, ( new_entries - old_entries ) * sizeof( TheEntitytainerEntry ) );
+
+    if ( layout.hashed_lookup && new_entries != old_entries ) {
+        entitytainer__rehash( &layout, old_entries );
+    }
+
+    layout.order_count = old.order_count;
+    layout.order_holes = old.order_holes;
+    layout.order_dirty = old.order_dirty;
+    layout.generation  = old.generation;
+    *entitytainer      = layout;
+    for ( int i = 0; i < layout.num_bucket_lists; ++i ) {
+        entitytainer->bucket_lists[i] = layout_lists[i];
+    }
+
+    // The sizes changed, so a delta wouldn't apply to a replica anyway.
+    entitytainer__mark_all( entitytainer );
+    return entitytainer;
+}
+
+static int
+entitytainer__lookup_size( struct TheEntitytainerConfig* config ) {
+    // Each entity has a row of entries, one per channel.
+    int num_entries = config->num_entries * ( config->num_channels > 1 ? config->num_channels : 1 );
+    if ( !config->hashed_lookup ) {
+        return num_entries;
+    }
+
+    // Power of two table that's at most half full, plus slot 0 which is always empty. That's where lookups of
+    // entities that aren't in the table end up, so they read 0 just like in the direct lookup.
+    int table_size = 2;
+    while ( table_size < num_entries * 2 ) {
+        table_size *= 2;
+    }
+
+    return table_size + 1;
+}
+
+static void
+entitytainer__align_config( struct TheEntitytainerConfig* config ) {
+    // The bucket sizes for align_buckets. A power of two up to a cache line divides it, so no bucket straddles two.
+    if ( !config->align_buckets ) {
+        return;
+    }
+
+    int line_size     = ENTITYTAINER_CacheLineSize / (int)sizeof( TheEntitytainerEntity );
+    int previous      = 0;
+    int previous_size = 0;
+    for ( int i = 0; i < config->num_bucket_lists; ++i ) {
+        // Sizes that were apart stay apart, 17 and 32 would both be padded to 32 otherwise, and a chained last list
+        // needs to be bigger than the one before it.
+        int size = config->bucket_sizes[i];
+        if ( size > previous_size && size <= previous ) {
+            size = previous + 1;
+        }
+
+        previous_size = config->bucket_sizes[i];
+        if ( size <= line_size ) {
+            int padded = 1;
+            while ( padded < size ) {
+                padded *= 2;
+            }
+
+            config->bucket_sizes[i] = padded;
+        }
+        else {
+            config->bucket_sizes[i] = ( size + line_size - 1 ) / line_size * line_size;
+        }
+
+        previous = config->bucket_sizes[i];
+    }
+}
+
+static unsigned char*
+entitytainer__place_lookups( TheEntitytainer* header, unsigned char* buffer ) {
+    // Sets up the pointers to the per entry arrays. They're all entry_lookup_size long and come in this order.
+    header->entry_lookup = (TheEntitytainerEntry*)buffer;
+    buffer += sizeof( TheEntitytainerEntry ) * header->entry_lookup_size;
+    header->entry_parent_lookup = (TheEntitytainerEntity*)buffer;
+    buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+    header->entry_num_children = NULL;
+    if ( header->track_num_children ) {
+        header->entry_num_children = (TheEntitytainerEntity*)buffer;
+        buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+    }
+
+    header->entry_child_index = NULL;
+    if ( header->track_child_index ) {
+        header->entry_child_index = (TheEntitytainerEntity*)buffer;
+        buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+    }
+
+    header->entry_depth = NULL;
+    header->entry_root  = NULL;
+    if ( header->track_depth ) {
+        header->entry_depth = (TheEntitytainerEntity*)buffer;
+        buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+        header->entry_root = (TheEntitytainerEntity*)buffer;
+        buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+    }
+
+    // The order itself isn't per entry, but it's never longer than the lookup.
+    header->entry_order = NULL;
+    header->order       = NULL;
+    if ( header->track_order ) {
+        header->entry_order = (TheEntitytainerEntity*)buffer;
+        buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+        header->order = (TheEntitytainerEntity*)buffer;
+        buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+    }
+
+    header->entry_keys = NULL;
+    if ( header->hashed_lookup ) {
+        header->entry_keys = (TheEntitytainerEntity*)buffer;
+        buffer += sizeof( TheEntitytainerEntity ) * header->entry_lookup_size;
+    }
+
+    header->dirty_entries = NULL;
+    for ( int i = 0; i < ENTITYTAINER_MAX_BUCKET_LISTS; ++i ) {
+        header->dirty_buckets[i] = NULL;
+    }
+
+    if ( header->track_dirty ) {
+        buffer = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer, (int)ENTITYTAINER_alignof( unsigned int ) );
+        header->dirty_entries = (unsigned int*)buffer;
+        buffer += sizeof( unsigned int ) * ENTITYTAINER_DirtyWords( header->entry_lookup_size );
+        for ( int i = 0; i < header->num_bucket_lists; ++i ) {
+            header->dirty_buckets[i] = (unsigned int*)buffer;
+            buffer += sizeof( unsigned int ) * ENTITYTAINER_DirtyWords( header->config.bucket_list_sizes[i] );
+        }
+    }
+
+    header->demote_candidates = NULL;
+    if ( header->lazy_demotion ) {
+        buffer = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer, (int)ENTITYTAINER_alignof( unsigned int ) );
+        header->demote_candidates = (unsigned int*)buffer;
+        buffer += sizeof( unsigned int ) * ENTITYTAINER_DirtyWords( header->entry_lookup_size );
+    }
+
+    for ( int i = 0; i < ENTITYTAINER_MAX_BUCKET_LISTS; ++i ) {
+        header->occupancy[i] = NULL;
+    }
+
+    if ( header->track_occupancy ) {
+        buffer = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer, (int)ENTITYTAINER_alignof( unsigned int ) );
+        for ( int i = 0; i < header->num_bucket_lists; ++i ) {
+            if ( entitytainer__has_occupancy( &header->config, i ) ) {
+                int words             = ENTITYTAINER_OccupancyWords( header->config.bucket_sizes[i] );
+                header->occupancy[i]  = (unsigned int*)buffer;
+                buffer               += sizeof( unsigned int ) * header->config.bucket_list_sizes[i] * words;
+            }
+        }
+    }
+
+    return buffer;
+}
+
+static unsigned char*
+entitytainer__place_bucket_data( const struct TheEntitytainerConfig* config,
+                                 TheEntitytainerBucketList*          lists,
+                                 const unsigned char*                base,
+                                 unsigned char*                      buffer ) {
+    // The bucket data comes right after the bucket lists (and their page tables when paged), in the same order. Then
+    // the payload columns, the same way. With align_buckets each list starts on a cache line from base, which is
+    // where the entitytainer is.
+    for ( int i = 0; i < config->num_bucket_lists; ++i ) {
+        lists[i].pages      = NULL;
+        lists[i].page_shift = 0;
+        lists[i].num_pages  = 0;
+        lists[i].max_pages  = 0;
+        if ( config->bucket_page_size > 0 ) {
+            buffer = (unsigned char*)entitytainer__ptr_to_aligned_ptr(
+              buffer, (int)ENTITYTAINER_alignof( TheEntitytainerEntity* ) );
+            lists[i].pages = (TheEntitytainerEntity**)buffer;
+            buffer += config->max_bucket_pages * sizeof( TheEntitytainerEntity* );
+            while ( ( 1 << lists[i].page_shift ) < config->bucket_page_size ) {
+                ++lists[i].page_shift;
+            }
+
+            lists[i].num_pages = lists[i].total_buckets >> lists[i].page_shift;
+            lists[i].max_pages = config->max_bucket_pages;
+        }
+    }
+
+    for ( int i = 0; i < config->num_bucket_lists; ++i ) {
+        if ( config->align_buckets ) {
+            int offset = (int)( buffer - base );
+            buffer += ( ENTITYTAINER_CacheLineSize - offset % ENTITYTAINER_CacheLineSize ) % ENTITYTAINER_CacheLineSize;
+        }
+
+        lists[i].bucket_data = (TheEntitytainerEntity*)buffer;
+        buffer += lists[i].bucket_size * lists[i].total_buckets * sizeof( TheEntitytainerEntity );
+    }
+
+    for ( int i = 0; i < config->num_bucket_lists; ++i ) {
+        for ( int i_column = 0; i_column < ENTITYTAINER_MAX_PAYLOAD_COLUMNS; ++i_column ) {
+            lists[i].payloads[i_column] = NULL;
+            if ( i_column < config->num_payload_columns ) {
+                buffer = (unsigned char*)entitytainer__ptr_to_aligned_ptr( buffer, ENTITYTAINER_PayloadAlign );
+                lists[i].payloads[i_column] = buffer;
+                buffer += lists[i].bucket_size * lists[i].total_buckets * config->payload_sizes[i_column];
+            }
+        }
+    }
+
+    return buffer;
+}
+
+static int
+entitytainer__entry_columns( TheEntitytainer* entitytainer, TheEntitytainerEntity** columns ) {
+    // The per entry arrays of entities, in memory order. Doesn't include the order and the hash keys, which come last.
+    int num_columns        = 0;
+    columns[num_columns++] = entitytainer->entry_parent_lookup;
+    if ( entitytainer->entry_num_children != NULL ) {
+        columns[num_columns++] = entitytainer->entry_num_children;
+    }
+
+    if ( entitytainer->entry_child_index != NULL ) {
+        columns[num_columns++] = entitytainer->entry_child_index;
+    }
+
+    if ( entitytainer->entry_depth != NULL ) {
+        columns[num_columns++] = entitytainer->entry_depth;
+        columns[num_columns++] = entitytainer->entry_root;
+    }
+
+    if ( entitytainer->entry_order != NULL ) {
+        columns[num_columns++] = entitytainer->entry_order;
+    }
+
+    return num_columns;
+}
+
+static void
+entitytainer__copy_entry( TheEntitytainer* entitytainer_dst,
+                          int              index_dst,
+                          TheEntitytainer* entitytainer_src,
+                          int              index_src ) {
+    // Everything but the hash key
+    TheEntitytainerEntity* columns_src[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    TheEntitytainerEntity* columns_dst[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( entitytainer_src, columns_src );
+    entitytainer__entry_columns( entitytainer_dst, columns_dst );
+    entitytainer_dst->entry_lookup[index_dst] = entitytainer_src->entry_lookup[index_src];
+    for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+        columns_dst[i_column][index_dst] = columns_src[i_column][index_src];
+    }
+
+    // Within the same entitytainer, when the hash table shifts entries. Otherwise everything gets marked anyway.
+    if ( entitytainer_dst == entitytainer_src && entitytainer_dst->lazy_demotion ) {
+        unsigned int* candidates = entitytainer_dst->demote_candidates;
+        if ( ( candidates[index_src >> 5] >> ( index_src & 31 ) ) & 1 ) {
+            candidates[index_dst >> 5] |= 1u << ( index_dst & 31 );
+        }
+        else {
+            candidates[index_dst >> 5] &= ~( 1u << ( index_dst & 31 ) );
+        }
+    }
+
+    entitytainer__mark_entry( entitytainer_dst, index_dst );
+}
+
+static int
+entitytainer__child_position( TheEntitytainer* entitytainer, TheEntitytainerEntity child ) {
+    // The child's tracked index in its parent, or -1 if it isn't tracked.
+    if ( entitytainer->entry_child_index == NULL ) {
+        return -1;
+    }
+
+    return (int)entitytainer->entry_child_index[entitytainer__index( entitytainer, child )];
+}
+
+static void
+entitytainer__set_child_index( TheEntitytainer* entitytainer, TheEntitytainerEntity child, int child_index ) {
+    if ( entitytainer->entry_child_index != NULL ) {
+        int index                              = entitytainer__index( entitytainer, child );
+        entitytainer->entry_child_index[index] = (TheEntitytainerEntity)child_index;
+        entitytainer__mark_entry( entitytainer, index );
+    }
+}
+
+static void
+entitytainer__set_num_children( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int num_children ) {
+    // Mirrors bucket[0] after it changes, with track_num_children.
+    if ( entitytainer->entry_num_children != NULL ) {
+        int index                               = entitytainer__index( entitytainer, parent );
+        entitytainer->entry_num_children[index] = (TheEntitytainerEntity)num_children;
+        entitytainer__mark_entry( entitytainer, index );
+    }
+}
+
+static int
+entitytainer__hash_slot( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    // Fibonacci hashing, returns the probe position (the index into the table minus one).
+    unsigned int hash = (unsigned int)entity * 2654435769u;
+    return (int)( hash >> entitytainer->entry_hash_shift );
+}
+
+static int
+entitytainer__index( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    // Returns the index into entry_lookup/entry_parent_lookup, or 0 if the entity isn't there.
+    if ( !entitytainer->hashed_lookup ) {
+        return (int)entity;
+    }
+
+    int mask = entitytainer->entry_lookup_size - 2;
+    int slot = entitytainer__hash_slot( entitytainer, entity );
+    while ( true ) {
+        TheEntitytainerEntity key = entitytainer->entry_keys[slot + 1];
+        if ( key == entity ) {
+            return slot + 1;
+        }
+
+        if ( key == ENTITYTAINER_InvalidEntity ) {
+            return 0;
+        }
+
+        slot = ( slot + 1 ) & mask;
+    }
+}
+
+static int
+entitytainer__insert_index( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    // Same as above, but adds the entity to the table if it isn't there. It's about to be written to, so it's marked.
+    if ( !entitytainer->hashed_lookup ) {
+        entitytainer__mark_entry( entitytainer, (int)entity );
+        return (int)entity;
+    }
+
+    ENTITYTAINER_assert( entity != ENTITYTAINER_InvalidEntity );
+    int mask = entitytainer->entry_lookup_size - 2;
+    int slot = entitytainer__hash_slot( entitytainer, entity );
+    while ( true ) {
+        TheEntitytainerEntity key = entitytainer->entry_keys[slot + 1];
+        if ( key == entity ) {
+            entitytainer__mark_entry( entitytainer, slot + 1 );
+            return slot + 1;
+        }
+
+        if ( key == ENTITYTAINER_InvalidEntity ) {
+            // Too many live entities
+            ENTITYTAINER_assert( entitytainer->entry_hash_count <
+                                 entitytainer->config.num_entries * entitytainer->num_channels );
+            ++entitytainer->entry_hash_count;
+            entitytainer->entry_keys[slot + 1] = entity;
+            entitytainer__mark_entry( entitytainer, slot + 1 );
+            return slot + 1;
+        }
+
+        slot = ( slot + 1 ) & mask;
+    }
+}
+
+static void
+entitytainer__release_index( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    // Removes the entity from the table (and the order) once it has neither children nor a parent.
+    int index = entitytainer__index( entitytainer, entity );
+    if ( index != 0 ) {
+        entitytainer__mark_entry( entitytainer, index ); // The caller has just changed it
+    }
+
+    if ( index == 0 || entitytainer->entry_lookup[index] != 0 || entitytainer->entry_parent_lookup[index] != 0 ) {
+        return;
+    }
+
+    if ( entitytainer->order != NULL ) {
+        entitytainer__order_remove( entitytainer, entity );
+    }
+
+    if ( !entitytainer->hashed_lookup ) {
+        return;
+    }
+
+    // Backward shift deletion, so there's no need for tombstones.
+    int mask = entitytainer->entry_lookup_size - 2;
+    int hole = index - 1;
+    int slot = hole;
+    while ( true ) {
+        slot                      = ( slot + 1 ) & mask;
+        TheEntitytainerEntity key = entitytainer->entry_keys[slot + 1];
+        if ( key == ENTITYTAINER_InvalidEntity ) {
+            break;
+        }
+
+        int home = entitytainer__hash_slot( entitytainer, key );
+        if ( ( ( slot - home ) & mask ) >= ( ( slot - hole ) & mask ) ) {
+            entitytainer->entry_keys[hole + 1] = key;
+            entitytainer__copy_entry( entitytainer, hole + 1, entitytainer, slot + 1 );
+            hole = slot;
+        }
+    }
+
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( entitytainer, columns );
+    for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+        columns[i_column][hole + 1] = 0;
+    }
+
+    entitytainer->entry_keys[hole + 1]   = ENTITYTAINER_InvalidEntity;
+    entitytainer->entry_lookup[hole + 1] = 0;
+    entitytainer__mark_entry( entitytainer, hole + 1 );
+    --entitytainer->entry_hash_count;
+}
+
+static void
+entitytainer__rehash( TheEntitytainer* entitytainer, int old_entries ) {
+    // After realloc grew the hash table, the entries are still at their indices in the old one. The memory may have
+    // grown in place, so there's no room for a copy of them, and a plain reinsert could overwrite an entry that hasn't
+    // been moved yet. Instead:
+    //  1. Pack them at the top of the table. It's at most half full and at least twice as big as before, so that's
+    //     above the old indices.
+    //  2. Sort them by home slot.
+    //  3. Put each at its home slot, or right after the previous one if that's further along. That's a valid linear
+    //     probing table, and the ones that run past the end wrap around to the bottom. Those go first, then the rest
+    //     is packed at the very top again. Every entry then lands at or below where it's packed, so nothing that's
+    //     still to be moved gets overwritten.
+    TheEntitytainerEntity* keys       = entitytainer->entry_keys;
+    int                    table_size = entitytainer->entry_lookup_size - 1;
+    int                    first      = entitytainer->entry_lookup_size;
+    for ( int i = old_entries - 1; i >= 1; --i ) {
+        if ( keys[i] != ENTITYTAINER_InvalidEntity ) {
+            entitytainer__move_row( entitytainer, --first, i );
+        }
+    }
+
+    int num_keys = entitytainer->entry_lookup_size - first;
+    ENTITYTAINER_assert( first > old_entries || num_keys == 0 );
+    for ( int root = num_keys / 2 - 1; root >= 0; --root ) {
+        entitytainer__sift_rows( entitytainer, first, root, num_keys );
+    }
+
+    for ( int count = num_keys - 1; count > 0; --count ) {
+        entitytainer__swap_rows( entitytainer, first, first + count );
+        entitytainer__sift_rows( entitytainer, first, 0, count );
+    }
+
+    // Wrapping around pushes the entries at the bottom up, which can make more of them wrap around.
+    int num_wrapped = 0;
+    while ( true ) {
+        int slot = num_wrapped - 1;
+        for ( int i_key = 0; i_key < num_keys; ++i_key ) {
+            int home = entitytainer__hash_slot( entitytainer, keys[first + i_key] );
+            slot     = home > slot + 1 ? home : slot + 1;
+        }
+
+        int past_end = slot + 1 > table_size ? slot + 1 - table_size : 0;
+        if ( past_end == num_wrapped ) {
+            break;
+        }
+
+        num_wrapped = past_end;
+    }
+
+    int num_unwrapped = num_keys - num_wrapped;
+    for ( int i_key = num_unwrapped; i_key < num_keys; ++i_key ) {
+        entitytainer__move_row( entitytainer, 1 + i_key - num_unwrapped, first + i_key );
+    }
+
+    for ( int i_key = num_unwrapped - 1; i_key >= 0; --i_key ) {
+        entitytainer__move_row( entitytainer, first + num_wrapped + i_key, first + i_key );
+    }
+
+    first += num_wrapped;
+    int slot = num_wrapped - 1;
+    for ( int i_key = 0; i_key < num_unwrapped; ++i_key ) {
+        int home = entitytainer__hash_slot( entitytainer, keys[first + i_key] );
+        slot     = home > slot + 1 ? home : slot + 1;
+        entitytainer__move_row( entitytainer, slot + 1, first + i_key );
+    }
+}
+
+static void
+entitytainer__move_row( TheEntitytainer* entitytainer, int index_dst, int index_src ) {
+    // Moves everything at index_src, including the hash key, and leaves it empty.
+    if ( index_dst == index_src ) {
+        return;
+    }
+
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( entitytainer, columns );
+    for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+        columns[i_column][index_dst] = columns[i_column][index_src];
+        columns[i_column][index_src] = 0;
+    }
+
+    entitytainer->entry_lookup[index_dst] = entitytainer->entry_lookup[index_src];
+    entitytainer->entry_lookup[index_src] = 0;
+    entitytainer->entry_keys[index_dst]   = entitytainer->entry_keys[index_src];
+    entitytainer->entry_keys[index_src]   = ENTITYTAINER_InvalidEntity;
+}
+
+static void
+entitytainer__swap_rows( TheEntitytainer* entitytainer, int index_a, int index_b ) {
+    TheEntitytainerEntity* columns[ENTITYTAINER_MAX_ENTRY_COLUMNS];
+    int                    num_columns = entitytainer__entry_columns( entitytainer, columns );
+    for ( int i_column = 0; i_column < num_columns; ++i_column ) {
+        TheEntitytainerEntity entity = columns[i_column][index_a];
+        columns[i_column][index_a]   = columns[i_column][index_b];
+        columns[i_column][index_b]   = entity;
+    }
+
+    TheEntitytainerEntry lookup         = entitytainer->entry_lookup[index_a];
+    entitytainer->entry_lookup[index_a] = entitytainer->entry_lookup[index_b];
+    entitytainer->entry_lookup[index_b] = lookup;
+    TheEntitytainerEntity key           = entitytainer->entry_keys[index_a];
+    entitytainer->entry_keys[index_a]   = entitytainer->entry_keys[index_b];
+    entitytainer->entry_keys[index_b]   = key;
+}
+
+static void
+entitytainer__sift_rows( TheEntitytainer* entitytainer, int first, int root, int count ) {
+    // Heap sort step for rehash, the rows from first on form a max heap by home slot.
+    TheEntitytainerEntity* keys = entitytainer->entry_keys;
+    while ( 2 * root + 1 < count ) {
+        int child = 2 * root + 1;
+        if ( child + 1 < count && entitytainer__hash_slot( entitytainer, keys[first + child + 1] ) >
+                                    entitytainer__hash_slot( entitytainer, keys[first + child] ) ) {
+            ++child;
+        }
+
+        if ( entitytainer__hash_slot( entitytainer, keys[first + root] ) >=
+             entitytainer__hash_slot( entitytainer, keys[first + child] ) ) {
+            return;
+        }
+
+        entitytainer__swap_rows( entitytainer, first + root, first + child );
+        root = child;
+    }
+}
+
+static int
+entitytainer__max_buckets( TheEntitytainer* entitytainer ) {
+    // Max number of buckets in a bucket list.
+    unsigned int max_buckets = (unsigned int)entitytainer->entry_bucket_mask + 1;
+    unsigned int max_entity  = (unsigned int)(TheEntitytainerEntity)ENTITYTAINER_NoFreeBucket;
+    if ( max_entity < max_buckets ) {
+        max_buckets = max_entity;
+    }
+
+    return max_buckets > 0x7fffffff ? 0x7fffffff : (int)max_buckets;
+}
+
+#if defined( ENTITYTAINER_SIMD_BYTES )
+static unsigned long long
+entitytainer__simd_match( const TheEntitytainerEntity* entities, TheEntitytainerEntity entity ) {
+    // Compares a block of ENTITYTAINER_SIMD_BYTES bytes against entity. Returns a mask with
+    // ENTITYTAINER_SIMD_MASK_BITS bits set per matching byte.
+#if defined( ENTITYTAINER_SIMD_AVX2 )
+    __m256i block = _mm256_loadu_si256( (const __m256i*)entities );
+    __m256i eq    = sizeof( TheEntitytainerEntity ) == 2
+                   ? _mm256_cmpeq_epi16( block, _mm256_set1_epi16( (short)entity ) )
+                   : _mm256_cmpeq_epi32( block, _mm256_set1_epi32( (int)entity ) );
+    return (unsigned int)_mm256_movemask_epi8( eq );
+#elif defined( ENTITYTAINER_SIMD_SSE2 )
+    __m128i block = _mm_loadu_si128( (const __m128i*)entities );
+    __m128i eq    = sizeof( TheEntitytainerEntity ) == 2 ? _mm_cmpeq_epi16( block, _mm_set1_epi16( (short)entity ) )
+                                                       : _mm_cmpeq_epi32( block, _mm_set1_epi32( (int)entity ) );
+    return (unsigned int)_mm_movemask_epi8( eq );
+#elif defined( ENTITYTAINER_SIMD_NEON )
+    // No movemask on NEON, narrowing each 16 bit lane to 8 bits gives 4 bits per byte instead.
+    uint8x16_t eq;
+    if ( sizeof( TheEntitytainerEntity ) == 2 ) {
+        uint16x8_t block = vld1q_u16( (const uint16_t*)entities );
+        eq               = vreinterpretq_u8_u16( vceqq_u16( block, vdupq_n_u16( (uint16_t)entity ) ) );
+    }
+    else {
+        uint32x4_t block = vld1q_u32( (const uint32_t*)entities );
+        eq               = vreinterpretq_u8_u32( vceqq_u32( block, vdupq_n_u32( (uint32_t)entity ) ) );
+    }
+
+    uint8x8_t nibbles = vshrn_n_u16( vreinterpretq_u16_u8( eq ), 4 );
+    return vget_lane_u64( vreinterpret_u64_u8( nibbles ), 0 );
+#endif
+}
+#endif
+
+static int
+entitytainer__lowest_bit( unsigned long long mask ) {
+#if defined( _MSC_VER )
+    unsigned long index;
+    if ( _BitScanForward( &index, (unsigned long)mask ) ) {
+        return (int)index;
+    }
+
+    _BitScanForward( &index, (unsigned long)( mask >> 32 ) );
+    return (int)index + 32;
+#else
+    return __builtin_ctzll( mask );
+#endif
+}
+
+static int
+entitytainer__highest_bit( unsigned long long mask ) {
+#if defined( _MSC_VER )
+    unsigned long index;
+    if ( _BitScanReverse( &index, (unsigned long)( mask >> 32 ) ) ) {
+        return (int)index + 32;
+    }
+
+    _BitScanReverse( &index, (unsigned long)mask );
+    return (int)index;
+#else
+    return 63 - __builtin_clzll( mask );
+#endif
+}
+
+static int
+entitytainer__find_entity( const TheEntitytainerEntity* entities, int count, TheEntitytainerEntity entity ) {
+    // Index of the first entity in entities that matches, or -1. Pass ENTITYTAINER_InvalidEntity to find a hole.
+    int i = 0;
+#if defined( ENTITYTAINER_SIMD_BYTES )
+    if ( sizeof( TheEntitytainerEntity ) == 2 || sizeof( TheEntitytainerEntity ) == 4 ) {
+        int lanes         = ENTITYTAINER_SIMD_BYTES / (int)sizeof( TheEntitytainerEntity );
+        int bits_per_lane = ENTITYTAINER_SIMD_MASK_BITS * (int)sizeof( TheEntitytainerEntity );
+        for ( ; i + lanes <= count; i += lanes ) {
+            unsigned long long mask = entitytainer__simd_match( entities + i, entity );
+            if ( mask != 0 ) {
+                return i + entitytainer__lowest_bit( mask ) / bits_per_lane;
+            }
+        }
+    }
+#endif
+
+    for ( ; i < count; ++i ) {
+        if ( entities[i] == entity ) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int
+entitytainer__find_last_used( const TheEntitytainerEntity* entities, int count ) {
+    // Index of the last entity that isn't a hole, or -1.
+    int i = count;
+#if defined( ENTITYTAINER_SIMD_BYTES )
+    if ( sizeof( TheEntitytainerEntity ) == 2 || sizeof( TheEntitytainerEntity ) == 4 ) {
+        int lanes         = ENTITYTAINER_SIMD_BYTES / (int)sizeof( TheEntitytainerEntity );
+        int bits_per_lane = ENTITYTAINER_SIMD_MASK_BITS * (int)sizeof( TheEntitytainerEntity );
+        for ( ; i >= lanes; i -= lanes ) {
+            unsigned long long holes = entitytainer__simd_match( entities + i - lanes, ENTITYTAINER_InvalidEntity );
+            unsigned long long used  = ~holes & ENTITYTAINER_SIMD_FULL_MASK;
+            if ( used != 0 ) {
+                return i - lanes + entitytainer__highest_bit( used ) / bits_per_lane;
+            }
+        }
+    }
+#endif
+
+    while ( i > 0 ) {
+        --i;
+        if ( entities[i] != ENTITYTAINER_InvalidEntity ) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static TheEntitytainerEntity
+entitytainer__child_after( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int position ) {
+    // The first child of parent after position (-1 for the first one), skipping holes. InvalidEntity if there's none.
+    if ( entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )] == 0 ) {
+        return ENTITYTAINER_InvalidEntity;
+    }
+
+    int                      span_start = 0;
+    TheEntitytainerChildSpan span;
+    entitytainer_get_child_span( entitytainer, parent, &span );
+    do {
+        for ( int i = position + 1 > span_start ? position + 1 - span_start : 0; i < span.num_children; ++i ) {
+            if ( span.children[i] != ENTITYTAINER_InvalidEntity ) {
+                return span.children[i];
+            }
+        }
+
+        span_start += span.capacity;
+    } while ( entitytainer_next_child_span( entitytainer, &span ) );
+
+    return ENTITYTAINER_InvalidEntity;
+}
+
+static TheEntitytainerEntity
+entitytainer__next_in_subtree( TheEntitytainer* entitytainer, TheEntitytainerEntity top, TheEntitytainerEntity entity ) {
+    // The entity after this one in a depth first walk of top's subtree, or InvalidEntity when done. Goes up through
+    // the parent lookup instead of keeping a stack.
+    TheEntitytainerEntity child = entitytainer__child_after( entitytainer, entity, -1 );
+    if ( child != ENTITYTAINER_InvalidEntity ) {
+        return child;
+    }
+
+    while ( entity != top ) {
+        TheEntitytainerEntity parent   = entitytainer_get_parent( entitytainer, entity );
+        int                   position = entitytainer_get_child_index( entitytainer, parent, entity );
+        TheEntitytainerEntity sibling  = entitytainer__child_after( entitytainer, parent, position );
+        if ( sibling != ENTITYTAINER_InvalidEntity ) {
+            return sibling;
+        }
+
+        entity = parent;
+    }
+
+    return ENTITYTAINER_InvalidEntity;
+}
+
+static void
+entitytainer__update_depth( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    // Call when entity's parent has changed. Its whole subtree gets new depths, and maybe a new root.
+    if ( entitytainer->entry_depth == NULL ) {
+        return;
+    }
+
+    for ( TheEntitytainerEntity descendant = entity; descendant != ENTITYTAINER_InvalidEntity;
+          descendant = entitytainer__next_in_subtree( entitytainer, entity, descendant ) ) {
+        int                   index  = entitytainer__index( entitytainer, descendant );
+        TheEntitytainerEntity parent = entitytainer->entry_parent_lookup[index];
+        TheEntitytainerEntity depth  = 0;
+        TheEntitytainerEntity root   = ENTITYTAINER_InvalidEntity;
+        if ( parent != ENTITYTAINER_InvalidEntity ) {
+            int parent_index = entitytainer__index( entitytainer, parent );
+            depth            = (TheEntitytainerEntity)( entitytainer->entry_depth[parent_index] + 1 );
+            root             = entitytainer->entry_root[parent_index];
+            root             = root != ENTITYTAINER_InvalidEntity ? root : parent;
+        }
+
+        entitytainer->entry_depth[index] = depth;
+        entitytainer->entry_root[index]  = root;
+        entitytainer__mark_entry( entitytainer, index );
+    }
+}
+
+static void
+entitytainer__order_append( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    if ( entitytainer->order_count == entitytainer->entry_lookup_size ) {
+        entitytainer__order_compact( entitytainer );
+    }
+
+    ENTITYTAINER_assert( entitytainer->order_count < entitytainer->entry_lookup_size );
+    int position                     = entitytainer->order_count++;
+    int index                        = entitytainer__index( entitytainer, entity );
+    entitytainer->order[position]    = entity;
+    entitytainer->entry_order[index] = (TheEntitytainerEntity)( position + 1 );
+    entitytainer__mark_entry( entitytainer, index );
+    entitytainer__mark_order( entitytainer, position );
+}
+
+static void
+entitytainer__order_remove( TheEntitytainer* entitytainer, TheEntitytainerEntity entity ) {
+    // Leaves a hole, they're compacted away in get_topological_order.
+    int index    = entitytainer__index( entitytainer, entity );
+    int position = (int)entitytainer->entry_order[index] - 1;
+    if ( position == -1 ) {
+        return;
+    }
+
+    entitytainer->order[position]    = ENTITYTAINER_InvalidEntity;
+    entitytainer->entry_order[index] = 0;
+    entitytainer__mark_entry( entitytainer, index );
+    entitytainer__mark_order( entitytainer, position );
+    ++entitytainer->order_holes;
+    if ( position < entitytainer->order_dirty ) {
+        entitytainer->order_dirty = position;
+    }
+}
+
+static void
+entitytainer__order_attach( TheEntitytainer* entitytainer, TheEntitytainerEntity child ) {
+    // Call when child has got a parent. If the child (and so its subtree) is before the parent, the subtree is moved to
+    // the end, otherwise the order is still fine.
+    if ( entitytainer->order == NULL ) {
+        return;
+    }
+
+    TheEntitytainerEntity parent          = entitytainer_get_parent( entitytainer, child );
+    int                   parent_position = entitytainer->entry_order[entitytainer__index( entitytainer, parent )];
+    int                   child_position  = entitytainer->entry_order[entitytainer__index( entitytainer, child )];
+    ENTITYTAINER_assert( parent_position != 0 );
+    if ( child_position > parent_position ) {
+        return;
+    }
+
+    // Depth first, so the parents still come first.
+    for ( TheEntitytainerEntity descendant = child; descendant != ENTITYTAINER_InvalidEntity;
+          descendant = entitytainer__next_in_subtree( entitytainer, child, descendant ) ) {
+        entitytainer__order_remove( entitytainer, descendant );
+        entitytainer__order_append( entitytainer, descendant );
+    }
+}
+
+static void
+entitytainer__order_compact( TheEntitytainer* entitytainer ) {
+    int                    num_entities = entitytainer->order_count;
+    TheEntitytainerEntity* order        = entitytainer->order;
+    int                    i_dst        = entitytainer__find_entity( order, num_entities, ENTITYTAINER_InvalidEntity );
+    if ( i_dst == -1 ) {
+        return;
+    }
+
+    if ( i_dst < entitytainer->order_dirty ) {
+        entitytainer->order_dirty = i_dst;
+    }
+
+    entitytainer__mark_order( entitytainer, i_dst );
+    for ( int i_src = i_dst + 1; i_src < num_entities; ++i_src ) {
+        TheEntitytainerEntity entity = order[i_src];
+        if ( entity != ENTITYTAINER_InvalidEntity ) {
+            int index                        = entitytainer__index( entitytainer, entity );
+            order[i_dst]                     = entity;
+            entitytainer->entry_order[index] = (TheEntitytainerEntity)( ++i_dst );
+            entitytainer__mark_entry( entitytainer, index );
+        }
+    }
+
+    entitytainer->order_count = i_dst;
+    entitytainer->order_holes = 0;
+}
+
+static int
+entitytainer__gather_children( TheEntitytainer*       entitytainer,
+                               TheEntitytainerEntity  parent,
+                               TheEntitytainerEntity* children,
+                               int                    max_children ) {
+    // Copies parent's children (from all pages, skipping holes) to children. Returns how many, or -1 if they don't fit.
+    if ( entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )] == 0 ) {
+        return 0;
+    }
+
+    int                      num_children = 0;
+    TheEntitytainerChildSpan span;
+    entitytainer_get_child_span( entitytainer, parent, &span );
+    do {
+        if ( !entitytainer->remove_with_holes && num_children + span.num_children <= max_children ) {
+            ENTITYTAINER_memcpy(
+              children + num_children, span.children, span.num_children * sizeof( TheEntitytainerEntity ) );
+            num_children += span.num_children;
+            continue;
+        }
+
+        for ( int i_child = 0; i_child < span.num_children; ++i_child ) {
+            if ( span.children[i_child] == ENTITYTAINER_InvalidEntity ) {
+                continue;
+            }
+
+            if ( num_children == max_children ) {
+                return -1;
+            }
+
+            children[num_children++] = span.children[i_child];
+        }
+    } while ( entitytainer_next_child_span( entitytainer, &span ) );
+
+    return num_children;
+}
+
+static int
+entitytainer__alloc_bucket( TheEntitytainer* entitytainer, TheEntitytainerBucketList* bucket_list ) {
+    int bucket_index = bucket_list->used_buckets;
+    if ( bucket_list->first_free_bucket != (int)ENTITYTAINER_NoFreeBucket ) {
+        // There's a freed bucket available
+        bucket_index                   = bucket_list->first_free_bucket;
+        bucket_list->first_free_bucket = *entitytainer__bucket( bucket_list, bucket_index );
+    }
+    else if ( bucket_index == bucket_list->total_buckets && bucket_list->pages != NULL ) {
+        entitytainer__add_page( entitytainer, bucket_list );
+    }
+
+    ENTITYTAINER_assert( bucket_index < bucket_list->total_buckets ); // No free buckets at all
+    ++bucket_list->used_buckets;
+    int           bucket_list_index = (int)( bucket_list - entitytainer->bucket_lists );
+    unsigned int* occupancy         = entitytainer__occupancy_bits( entitytainer, bucket_list_index, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+    if ( occupancy != NULL ) {
+        ENTITYTAINER_memset(
+          occupancy, 0, ENTITYTAINER_OccupancyWords( bucket_list->bucket_size ) * sizeof( unsigned int ) );
+    }
+
+    return bucket_index;
+}
+
+static void
+entitytainer__free_bucket( TheEntitytainer* entitytainer, TheEntitytainerBucketList* bucket_list, int bucket_index ) {
+    TheEntitytainerEntity* bucket        = entitytainer__bucket( bucket_list, bucket_index );
+    entitytainer__mark_bucket( entitytainer, (int)( bucket_list - entitytainer->bucket_lists ), bucket_index );
+    if ( entitytainer->defer_bucket_frees ) {
+        // Same kind of list, but still counted as used. Only the count is overwritten, so the children stay readable.
+        *bucket                           = (TheEntitytainerEntity)bucket_list->first_retired_bucket;
+        bucket_list->first_retired_bucket = bucket_index;
+        return;
+    }
+
+    *bucket                        = (TheEntitytainerEntity)bucket_list->first_free_bucket;
+    bucket_list->first_free_bucket = bucket_index;
+    --bucket_list->used_buckets;
+}
+
+static int
+entitytainer__load_acquire( int* value ) {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    int result = *(volatile int*)value;
+    entitytainer__fence_acquire();
+    return result;
+#else
+    return __atomic_load_n( value, __ATOMIC_ACQUIRE );
+#endif
+}
+
+static void
+entitytainer__store_release( int* value, int new_value ) {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    entitytainer__fence_release();
+    *(volatile int*)value = new_value;
+#else
+    __atomic_store_n( value, new_value, __ATOMIC_RELEASE );
+#endif
+}
+
+static void
+entitytainer__fence_acquire( void ) {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#if defined( _M_ARM64 ) || defined( _M_ARM )
+    __dmb( _ARM64_BARRIER_ISH );
+#else
+    _ReadWriteBarrier(); // x86 doesn't reorder loads with other loads
+#endif
+#else
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+#endif
+}
+
+static void
+entitytainer__fence_release( void ) {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#if defined( _M_ARM64 ) || defined( _M_ARM )
+    __dmb( _ARM64_BARRIER_ISH );
+#else
+    _ReadWriteBarrier(); // ...or stores with other stores
+#endif
+#else
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+#endif
+}
+
+static bool
+entitytainer__has_free_bucket( TheEntitytainerBucketList* bucket_list ) {
+    return bucket_list->first_free_bucket != (int)ENTITYTAINER_NoFreeBucket ||
+           bucket_list->used_buckets < bucket_list->total_buckets || bucket_list->num_pages < bucket_list->max_pages;
+}
+
+static int
+entitytainer__count_free( const TheEntitytainerBucketList* bucket_list ) {
+    int num_free = 0;
+    for ( int i_free = bucket_list->first_free_bucket; i_free != (int)ENTITYTAINER_NoFreeBucket;
+          i_free     = *entitytainer__bucket( bucket_list, i_free ) ) {
+        ++num_free;
+    }
+
+    return num_free;
+}
+
+static void
+entitytainer__add_page( TheEntitytainer* entitytainer, TheEntitytainerBucketList* bucket_list ) {
+    // A paged list grows here instead of in realloc. The page is only used once it's in the table, so a reader that
+    // got to a bucket through an entry always sees it.
+    struct TheEntitytainerConfig* config       = &entitytainer->config;
+    int                           page_buckets = 1 << bucket_list->page_shift;
+    int page_size = page_buckets * bucket_list->bucket_size * (int)sizeof( TheEntitytainerEntity );
+    ENTITYTAINER_assert( bucket_list->num_pages < bucket_list->max_pages ); // Page table is full
+    TheEntitytainerEntity* page = (TheEntitytainerEntity*)config->alloc_page( config->page_user_data, page_size );
+    ENTITYTAINER_assert( page != NULL );
+    if ( !config->lazy_zeroing ) {
+        ENTITYTAINER_memset( page, 0, page_size );
+    }
+
+    bucket_list->pages[bucket_list->num_pages++] = page;
+    bucket_list->total_buckets += page_buckets;
+}
+
+static TheEntitytainerEntity*
+entitytainer__bucket( const TheEntitytainerBucketList* bucket_list, int bucket_index ) {
+    if ( bucket_list->pages == NULL ) {
+        return bucket_list->bucket_data + bucket_index * bucket_list->bucket_size;
+    }
+
+    int page_mask = ( 1 << bucket_list->page_shift ) - 1;
+    return bucket_list->pages[bucket_index >> bucket_list->page_shift] +
+           ( bucket_index & page_mask ) * bucket_list->bucket_size;
+}
+
+static int
+entitytainer__bucket_index( const TheEntitytainerBucketList* bucket_list, const TheEntitytainerEntity* bucket ) {
+    if ( bucket_list->pages == NULL ) {
+        return (int)( bucket - bucket_list->bucket_data ) / bucket_list->bucket_size;
+    }
+
+    // Only after moving a bucket, and there aren't many pages.
+    int page_size = bucket_list->bucket_size << bucket_list->page_shift;
+    for ( int i_page = 0; i_page < bucket_list->num_pages; ++i_page ) {
+        const TheEntitytainerEntity* page = bucket_list->pages[i_page];
+        if ( bucket >= page && bucket < page + page_size ) {
+            return ( i_page << bucket_list->page_shift ) + (int)( bucket - page ) / bucket_list->bucket_size;
+        }
+    }
+
+    ENTITYTAINER_assert( false );
+    return -1;
+}
+
+static int
+entitytainer__find_bucket_list( TheEntitytainer* entitytainer, int first_bucket_list, int capacity ) {
+    // Returns the first bucket list that can hold <capacity> children, or -1.
+    for ( int i_bl = first_bucket_list; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        if ( entitytainer->bucket_lists[i_bl].bucket_size > capacity ) {
+            return i_bl;
+        }
+    }
+
+    // A chained bucket can hold any number of children.
+    if ( entitytainer->chain_last_bucket_list && first_bucket_list < entitytainer->num_bucket_lists ) {
+        return entitytainer->num_bucket_lists - 1;
+    }
+
+    return -1;
+}
+
+static TheEntitytainerEntity*
+entitytainer__move_bucket( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int bucket_list_index_new ) {
+    int                        lookup_index      = entitytainer__index( entitytainer, parent );
+    TheEntitytainerEntry       lookup            = entitytainer->entry_lookup[lookup_index];
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+
+    TheEntitytainerBucketList* bucket_list_new   = entitytainer->bucket_lists + bucket_list_index_new;
+    int                        bucket_index_new  = entitytainer__alloc_bucket( entitytainer, bucket_list_new );
+    TheEntitytainerEntity*     bucket_new        = entitytainer__bucket( bucket_list_new, bucket_index_new );
+
+    // When shrinking, the caller has made sure that the children fit in the smaller bucket.
+    int size_to_copy = bucket_list->bucket_size;
+    if ( bucket_list_new->bucket_size < size_to_copy ) {
+        size_to_copy = bucket_list_new->bucket_size;
+    }
+
+    ENTITYTAINER_memcpy( bucket_new, bucket, size_to_copy * sizeof( TheEntitytainerEntity ) );
+    entitytainer__move_payloads( entitytainer, bucket_new, bucket, size_to_copy );
+#if defined( ENTITYTAINER_STATS )
+    if ( bucket_list_index_new > bucket_list_index ) {
+        int slot_size = (int)sizeof( TheEntitytainerEntity ) + entitytainer__payload_size( &entitytainer->config );
+        ++bucket_list_new->promotions;
+        bucket_list_new->promotion_bytes += size_to_copy * (long long)slot_size;
+    }
+    else {
+        ++bucket_list_new->demotions;
+    }
+#endif
+
+    ENTITYTAINER_memset( bucket_new + size_to_copy,
+                         0,
+                         ( bucket_list_new->bucket_size - size_to_copy ) * sizeof( TheEntitytainerEntity ) );
+    entitytainer__sync_occupancy( entitytainer, bucket_list_index_new, bucket_index_new );
+    entitytainer__free_bucket( entitytainer, bucket_list, bucket_index );
+
+    // Update lookup
+    unsigned int bucket_list_index_shifted = (unsigned int)bucket_list_index_new << entitytainer->entry_list_shift;
+    TheEntitytainerEntry lookup_new        = (TheEntitytainerEntry)bucket_list_index_shifted;
+    lookup_new                                     = lookup_new | (TheEntitytainerEntry)bucket_index_new;
+    entitytainer->entry_lookup[lookup_index]       = lookup_new;
+    entitytainer__mark_entry( entitytainer, lookup_index );
+    return bucket_new;
+}
+
+static int
+entitytainer__demote_target( TheEntitytainer* entitytainer, int bucket_list_index, int num_positions, bool need_free ) {
+    // The smallest bucket list below bucket_list_index that fits num_positions slots and keeps its margin free, or
+    // bucket_list_index if there's none.
+    for ( int i_bl = 0; i_bl < bucket_list_index; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        if ( num_positions + entitytainer->config.demote_margins[i_bl] < bucket_list->bucket_size &&
+             ( !need_free || entitytainer__has_free_bucket( bucket_list ) ) ) {
+            return i_bl;
+        }
+    }
+
+    return bucket_list_index;
+}
+
+static void
+entitytainer__demote( TheEntitytainer*      entitytainer,
+                      TheEntitytainerEntity parent,
+                      int                   bucket_list_index,
+                      int                   num_positions ) {
+    // After removing children. With lazy_demotion the parent is only marked, maintain checks it again later.
+    if ( entitytainer->keep_capacity_on_remove ) {
+        return;
+    }
+
+    if ( entitytainer->lazy_demotion ) {
+        int smaller_index = entitytainer__demote_target( entitytainer, bucket_list_index, num_positions, false );
+        if ( smaller_index < bucket_list_index ) {
+            int index = entitytainer__index( entitytainer, parent );
+            entitytainer->demote_candidates[index >> 5] |= 1u << ( index & 31 );
+        }
+
+        return;
+    }
+
+    int bucket_list_index_new = entitytainer__demote_target( entitytainer, bucket_list_index, num_positions, true );
+    if ( bucket_list_index_new < bucket_list_index ) {
+        entitytainer__move_bucket( entitytainer, parent, bucket_list_index_new );
+    }
+}
+
+static int
+entitytainer__num_positions( TheEntitytainer* entitytainer, int bucket_list_index, TheEntitytainerEntity* bucket ) {
+    // Slots up to the last child, which is the child count unless there are holes. Plus the shrink margin then.
+    if ( !entitytainer->remove_with_holes ) {
+        return (int)bucket[0];
+    }
+
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        return entitytainer__chain_filter( entitytainer, bucket, ENTITYTAINER_InvalidEntity, false ) +
+               ENTITYTAINER_ShrinkMargin;
+    }
+
+    int capacity = entitytainer->bucket_lists[bucket_list_index].bucket_size - 1;
+    return 1 + entitytainer__find_last_used( bucket + 1, capacity ) + ENTITYTAINER_ShrinkMargin;
+}
+
+static bool
+entitytainer__is_chained( TheEntitytainer* entitytainer, int bucket_list_index ) {
+    return entitytainer->chain_last_bucket_list && bucket_list_index == entitytainer->num_bucket_lists - 1;
+}
+
+static TheEntitytainerEntity*
+entitytainer__next_page( TheEntitytainer* entitytainer, TheEntitytainerEntity* page, bool allocate ) {
+    // Pages are buckets in the last bucket list. The last slot of each page is the index of the next one, plus one.
+    // The first slot is the child count in the first page (the head) and unused in the others.
+    TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + entitytainer->num_bucket_lists - 1;
+    TheEntitytainerEntity*     link        = &page[bucket_list->bucket_size - 1];
+    if ( *link == 0 ) {
+        if ( !allocate ) {
+            return NULL;
+        }
+
+        int                    bucket_index = entitytainer__alloc_bucket( entitytainer, bucket_list );
+        TheEntitytainerEntity* page_new     = entitytainer__bucket( bucket_list, bucket_index );
+        ENTITYTAINER_memset( page_new, 0, bucket_list->bucket_size * sizeof( TheEntitytainerEntity ) );
+        *link = (TheEntitytainerEntity)( bucket_index + 1 );
+        entitytainer__mark_page( entitytainer, page );
+        return page_new;
+    }
+
+    return entitytainer__bucket( bucket_list, *link - 1 );
+}
+
+static TheEntitytainerEntity*
+entitytainer__chain_slot( TheEntitytainer* entitytainer, TheEntitytainerEntity* head, int position ) {
+    // Returns the slot for the child at position, adding pages if needed.
+    int                    page_capacity = entitytainer->bucket_lists[entitytainer->num_bucket_lists - 1].bucket_size - 2;
+    TheEntitytainerEntity* page          = head;
+    for ( int i_page = position / page_capacity; i_page > 0; --i_page ) {
+        page = entitytainer__next_page( entitytainer, page, true );
+    }
+
+    entitytainer__mark_page( entitytainer, page ); // The caller writes to the slot
+    return page + 1 + position % page_capacity;
+}
+
+static void
+entitytainer__chain_trim( TheEntitytainer* entitytainer, TheEntitytainerEntity* head, int num_positions ) {
+    // Frees the pages that aren't needed to hold num_positions children. The head is always kept.
+    TheEntitytainerBucketList* bucket_list   = entitytainer->bucket_lists + entitytainer->num_bucket_lists - 1;
+    int                        page_capacity = bucket_list->bucket_size - 2;
+    TheEntitytainerEntity*     page          = head;
+    for ( int i_page = 1; i_page * page_capacity < num_positions; ++i_page ) {
+        page = entitytainer__next_page( entitytainer, page, false );
+    }
+
+    TheEntitytainerEntity* link = &page[bucket_list->bucket_size - 1];
+    int                    next = *link;
+    *link                       = 0;
+    entitytainer__mark_page( entitytainer, page );
+    while ( next != 0 ) {
+        TheEntitytainerEntity* page_to_free = entitytainer__bucket( bucket_list, next - 1 );
+        int                    bucket_index = next - 1;
+        next                                = page_to_free[bucket_list->bucket_size - 1];
+        page_to_free[bucket_list->bucket_size - 1] = 0;
+        entitytainer__free_bucket( entitytainer, bucket_list, bucket_index );
+    }
+}
+
+static int
+entitytainer__chain_add_child( TheEntitytainer* entitytainer, TheEntitytainerEntity* head, TheEntitytainerEntity child ) {
+    // Same as the regular add_child, the child goes to the end or into the first hole.
+    int page_capacity = entitytainer->bucket_lists[entitytainer->num_bucket_lists - 1].bucket_size - 2;
+    int count         = head[0];
+    int position      = count;
+    if ( entitytainer->remove_with_holes ) {
+        TheEntitytainerEntity* page = head;
+        for ( int i_page = 0; i_page * page_capacity < count; ++i_page ) {
+            int num_slots = count - i_page * page_capacity;
+            int hole      = entitytainer__find_entity(
+              page + 1, num_slots < page_capacity ? num_slots : page_capacity, ENTITYTAINER_InvalidEntity );
+            if ( hole != -1 ) {
+                position = i_page * page_capacity + hole;
+                break;
+            }
+
+            page = entitytainer__next_page( entitytainer, page, false );
+        }
+    }
+
+    TheEntitytainerEntity* slot = entitytainer__chain_slot( entitytainer, head, position );
+    ENTITYTAINER_assert( *slot == ENTITYTAINER_InvalidEntity );
+    *slot   = child;
+    head[0] = (TheEntitytainerEntity)( count + 1 );
+    entitytainer__clear_payloads( entitytainer, slot, 1 );
+    return position;
+}
+
+static int
+entitytainer__chain_find_child( TheEntitytainer* entitytainer, TheEntitytainerEntity* head, TheEntitytainerEntity child ) {
+    int                    page_capacity = entitytainer->bucket_lists[entitytainer->num_bucket_lists - 1].bucket_size - 2;
+    TheEntitytainerEntity* page          = head;
+    for ( int i_page = 0; page != NULL; ++i_page ) {
+        int i = entitytainer__find_entity( page + 1, page_capacity, child );
+        if ( i != -1 ) {
+            return i_page * page_capacity + i;
+        }
+
+        page = entitytainer__next_page( entitytainer, page, false );
+    }
+
+    return -1;
+}
+
+static int
+entitytainer__chain_remove_child( TheEntitytainer* entitytainer, TheEntitytainerEntity* head, TheEntitytainerEntity child ) {
+    int position = entitytainer__child_position( entitytainer, child );
+    if ( position == -1 ) {
+        position = entitytainer__chain_find_child( entitytainer, head, child );
+    }
+
+    ENTITYTAINER_assert( position != -1 );
+    TheEntitytainerEntity* slot = entitytainer__chain_slot( entitytainer, head, position );
+    ENTITYTAINER_assert( *slot == child );
+    *slot = ENTITYTAINER_InvalidEntity;
+    if ( entitytainer->remove_unordered && !entitytainer->remove_with_holes ) {
+        // Move the last child into the gap, only the last page can end up empty.
+        int                    last      = (int)head[0] - 1;
+        TheEntitytainerEntity* slot_last = entitytainer__chain_slot( entitytainer, head, last );
+        if ( slot_last != slot ) {
+            *slot      = *slot_last;
+            *slot_last = ENTITYTAINER_InvalidEntity;
+            entitytainer__move_payloads( entitytainer, slot, slot_last, 1 );
+            entitytainer__set_child_index( entitytainer, *slot, position );
+        }
+
+        if ( !entitytainer->keep_capacity_on_remove ) {
+            entitytainer__chain_trim( entitytainer, head, last );
+        }
+
+        return last;
+    }
+
+    return entitytainer__chain_filter(
+      entitytainer, head, ENTITYTAINER_InvalidEntity, !entitytainer->remove_with_holes );
+}
+
+static int
+entitytainer__chain_filter( TheEntitytainer*       entitytainer,
+                            TheEntitytainerEntity* head,
+                            TheEntitytainerEntity  parent,
+                            bool                   compact ) {
+    // Goes through all pages and clears children that aren't children of parent anymore (keeps all of them if parent
+    // is invalid). If compact, the children are also moved forward to fill the holes. Frees the pages at the end that
+    // end up empty and returns the number of slots that are still in use. Doesn't touch the child count.
+    int                    page_capacity = entitytainer->bucket_lists[entitytainer->num_bucket_lists - 1].bucket_size - 2;
+    TheEntitytainerEntity* page_src      = head;
+    TheEntitytainerEntity* page_dst      = head;
+    int                    i_dst         = 0;
+    int                    num_positions = 0;
+    for ( int i_src = 0; page_src != NULL; ++i_src ) {
+        if ( i_src > 0 && i_src % page_capacity == 0 ) {
+            page_src = entitytainer__next_page( entitytainer, page_src, false );
+            if ( page_src == NULL ) {
+                break;
+            }
+        }
+
+        TheEntitytainerEntity* slot_src = &page_src[1 + i_src % page_capacity];
+        TheEntitytainerEntity  child    = *slot_src;
+        if ( child == ENTITYTAINER_InvalidEntity ) {
+            continue;
+        }
+
+        if ( parent != ENTITYTAINER_InvalidEntity && entitytainer_get_parent( entitytainer, child ) != parent ) {
+            *slot_src = ENTITYTAINER_InvalidEntity;
+            entitytainer__mark_page( entitytainer, page_src );
+            continue;
+        }
+
+        if ( !compact ) {
+            num_positions = i_src + 1;
+            continue;
+        }
+
+        if ( i_dst > 0 && i_dst % page_capacity == 0 ) {
+            page_dst = entitytainer__next_page( entitytainer, page_dst, false );
+        }
+
+        *slot_src                           = ENTITYTAINER_InvalidEntity;
+        page_dst[1 + i_dst % page_capacity] = child;
+        entitytainer__move_payloads( entitytainer, &page_dst[1 + i_dst % page_capacity], slot_src, 1 );
+        entitytainer__mark_page( entitytainer, page_src );
+        entitytainer__mark_page( entitytainer, page_dst );
+        entitytainer__set_child_index( entitytainer, child, i_dst );
+        num_positions = ++i_dst;
+    }
+
+    if ( !entitytainer->keep_capacity_on_remove ) {
+        entitytainer__chain_trim( entitytainer, head, num_positions );
+    }
+
+    return num_positions;
+}
+
+static bool
+entitytainer__command_less( const TheEntitytainerQueuedCommand* a,
+                            const TheEntitytainerQueuedCommand* b,
+                            int                                 sort_by ) {
+    if ( sort_by == ENTITYTAINER_SortByChild ) {
+        if ( a->command.entity != b->command.entity ) {
+            return a->command.entity < b->command.entity;
+        }
+
+        return a->order < b->order;
+    }
+
+    if ( a->bucket_list_index != b->bucket_list_index ) {
+        return a->bucket_list_index < b->bucket_list_index;
+    }
+
+    if ( a->command.parent != b->command.parent ) {
+        return a->command.parent < b->command.parent;
+    }
+
+    if ( a->command.type == ENTITYTAINER_CommandRemoveChild && a->command.entity != b->command.entity ) {
+        return a->command.entity < b->command.entity;
+    }
+
+    return a->order < b->order;
+}
+
+static void
+entitytainer__sift_down( TheEntitytainerQueuedCommand* commands, int i_root, int i_end, int sort_by ) {
+    for ( int i_child = i_root * 2 + 1; i_child < i_end; i_child = i_root * 2 + 1 ) {
+        if ( i_child + 1 < i_end && entitytainer__command_less( commands + i_child, commands + i_child + 1, sort_by ) ) {
+            ++i_child;
+        }
+
+        if ( !entitytainer__command_less( commands + i_root, commands + i_child, sort_by ) ) {
+            return;
+        }
+
+        TheEntitytainerQueuedCommand temp = commands[i_root];
+        commands[i_root]                  = commands[i_child];
+        commands[i_child]                 = temp;
+        i_root                            = i_child;
+    }
+}
+
+static void
+entitytainer__sort_commands( TheEntitytainerQueuedCommand* commands, int num_commands, int sort_by ) {
+    // Heap sort, so no extra memory. The order makes every key unique, so it doesn't need to be stable either.
+    for ( int i_root = num_commands / 2 - 1; i_root >= 0; --i_root ) {
+        entitytainer__sift_down( commands, i_root, num_commands, sort_by );
+    }
+
+    for ( int i_end = num_commands - 1; i_end > 0; --i_end ) {
+        TheEntitytainerQueuedCommand largest = commands[0];
+        commands[0]                          = commands[i_end];
+        commands[i_end]                      = largest;
+        entitytainer__sift_down( commands, 0, i_end, sort_by );
+    }
+}
+
+static bool
+entitytainer__record( TheEntitytainerCommandBuffer* buffer,
+                      int                           type,
+                      TheEntitytainerEntity         parent,
+                      TheEntitytainerEntity         entity ) {
+    if ( buffer->num_commands == buffer->capacity ) {
+        return false;
+    }
+
+    TheEntitytainerCommand* command = buffer->commands + buffer->num_commands++;
+    command->type                   = type;
+    command->parent                 = parent;
+    command->entity                 = entity;
+    return true;
+}
+
+static int
+entitytainer__conflict( TheEntitytainerCommand*             conflicts,
+                        int                                 max_conflicts,
+                        int                                 num_conflicts,
+                        const TheEntitytainerQueuedCommand* queued ) {
+    if ( num_conflicts < max_conflicts ) {
+        conflicts[num_conflicts] = queued->command;
+    }
+
+    return num_conflicts + 1;
+}
+
+static int
+entitytainer__config_flags( const struct TheEntitytainerConfig* config ) {
+    // All the bools, for the compact save
+    int flags = 0;
+    flags |= config->remove_with_holes ? 1 << 0 : 0;
+    flags |= config->keep_capacity_on_remove ? 1 << 1 : 0;
+    flags |= config->hashed_lookup ? 1 << 2 : 0;
+    flags |= config->chain_last_bucket_list ? 1 << 3 : 0;
+    flags |= config->track_child_index ? 1 << 4 : 0;
+    flags |= config->remove_unordered ? 1 << 5 : 0;
+    flags |= config->track_depth ? 1 << 6 : 0;
+    flags |= config->track_order ? 1 << 7 : 0;
+    flags |= config->defer_bucket_frees ? 1 << 8 : 0;
+    flags |= config->track_dirty ? 1 << 9 : 0;
+    flags |= config->lazy_demotion ? 1 << 10 : 0;
+    flags |= config->track_occupancy ? 1 << 11 : 0;
+    flags |= config->align_buckets ? 1 << 12 : 0;
+    flags |= config->track_num_children ? 1 << 13 : 0;
+    return flags;
+}
+
+static int
+entitytainer__compact_size( const TheEntitytainerCompactHeader* header ) {
+    int entry_size = (int)sizeof( TheEntitytainerEntity ) * ( 1 + header->num_columns ) + (int)sizeof( unsigned int );
+    int size       = (int)sizeof( TheEntitytainerCompactHeader ) + header->num_saved_entries * entry_size;
+    size += header->order_count * (int)sizeof( TheEntitytainerEntity );
+    int payload_size = 0;
+    for ( int i_column = 0; i_column < header->num_payload_columns; ++i_column ) {
+        payload_size += header->payload_sizes[i_column];
+    }
+
+    for ( int i_bl = 0; i_bl < header->num_bucket_lists; ++i_bl ) {
+        int slot_size = (int)sizeof( TheEntitytainerEntity ) + payload_size;
+        size += header->num_saved_buckets[i_bl] * header->bucket_sizes[i_bl] * slot_size;
+    }
+
+    return size;
+}
+
+static void
+entitytainer__mark_entry( TheEntitytainer* entitytainer, int index ) {
+    // Every entry that's written to is marked, so this is also where clear finds out how far it needs to go.
+    if ( index >= entitytainer->entry_high_water ) {
+        entitytainer->entry_high_water = index + 1;
+    }
+
+    if ( entitytainer->track_dirty ) {
+        entitytainer->dirty_entries[index >> 5] |= 1u << ( index & 31 );
+    }
+}
+
+static void
+entitytainer__mark_bucket( TheEntitytainer* entitytainer, int bucket_list_index, int bucket_index ) {
+    if ( entitytainer->track_dirty ) {
+        entitytainer->dirty_buckets[bucket_list_index][bucket_index >> 5] |= 1u << ( bucket_index & 31 );
+    }
+}
+
+static void
+entitytainer__mark_page( TheEntitytainer* entitytainer, TheEntitytainerEntity* page ) {
+    // Pages are always in the last bucket list.
+    if ( entitytainer->track_dirty ) {
+        int                        bucket_list_index = entitytainer->num_bucket_lists - 1;
+        TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+        int bucket_index = entitytainer__bucket_index( bucket_list, page );
+        entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+    }
+}
+
+static void
+entitytainer__mark_order( TheEntitytainer* entitytainer, int position ) {
+    if ( position < entitytainer->dirty_order ) {
+        entitytainer->dirty_order = position;
+    }
+}
+
+static void
+entitytainer__mark_all( TheEntitytainer* entitytainer ) {
+    // For when everything has been replaced. Any parent can be a demotion candidate then as well, maintain checks
+    // them all. The free buckets get bits too, but they're cleared when the bucket is handed out again. Entry 0 is
+    // never used, and apply_delta doesn't take it.
+    entitytainer->dirty_order      = 0;
+    entitytainer->entry_high_water = entitytainer->entry_lookup_size;
+    if ( entitytainer->lazy_demotion ) {
+        entitytainer__set_bits( entitytainer->demote_candidates, entitytainer->entry_lookup_size );
+    }
+
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        if ( entitytainer->occupancy[i_bl] != NULL ) {
+            for ( int i_bucket = 0; i_bucket < entitytainer->bucket_lists[i_bl].total_buckets; ++i_bucket ) {
+                entitytainer__sync_occupancy( entitytainer, i_bl, i_bucket );
+            }
+        }
+    }
+
+    if ( !entitytainer->track_dirty ) {
+        return;
+    }
+
+    entitytainer__set_bits( entitytainer->dirty_entries, entitytainer->entry_lookup_size );
+    entitytainer->dirty_entries[0] &= ~1u;
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        entitytainer__set_bits( entitytainer->dirty_buckets[i_bl], entitytainer->bucket_lists[i_bl].total_buckets );
+    }
+}
+
+static void
+entitytainer__set_bits( unsigned int* bits, int count ) {
+    // The first count bits, the rest of the last word stays clear.
+    ENTITYTAINER_memset( bits, 0xff, ENTITYTAINER_DirtyWords( count ) * sizeof( unsigned int ) );
+    if ( count % 32 != 0 ) {
+        bits[count / 32] = ( 1u << ( count % 32 ) ) - 1;
+    }
+}
+
+static void
+entitytainer__add_bits( unsigned int* bits, int count ) {
+    // Same, but the rest of the last word is left as it is.
+    ENTITYTAINER_memset( bits, 0xff, ( count / 32 ) * sizeof( unsigned int ) );
+    if ( count % 32 != 0 ) {
+        bits[count / 32] |= ( 1u << ( count % 32 ) ) - 1;
+    }
+}
+
+static int
+entitytainer__count_bits( const unsigned int* bits, int count ) {
+    int num_set = 0;
+    for ( int i_word = 0; i_word < ENTITYTAINER_DirtyWords( count ); ++i_word ) {
+        for ( unsigned int word = bits[i_word]; word != 0; word &= word - 1 ) {
+            ++num_set;
+        }
+    }
+
+    return num_set;
+}
+
+static int
+entitytainer__first_clear_bit( const unsigned int* bits, int count ) {
+    // Or count if they're all set.
+    for ( int i_word = 0; i_word < ENTITYTAINER_DirtyWords( count ); ++i_word ) {
+        if ( bits[i_word] != ~0u ) {
+            int index = i_word * 32 + entitytainer__lowest_bit( ~bits[i_word] );
+            return index < count ? index : count;
+        }
+    }
+
+    return count;
+}
+
+static int
+entitytainer__next_set_bit( const unsigned int* bits, int first, int count ) {
+    // The first set bit from first on, or count if there's none.
+    for ( int i_word = first >> 5; i_word < ENTITYTAINER_DirtyWords( count ); ++i_word ) {
+        unsigned int word = bits[i_word];
+        if ( i_word == first >> 5 ) {
+            word &= ~0u << ( first & 31 );
+        }
+
+        if ( word != 0 ) {
+            return i_word * 32 + entitytainer__lowest_bit( word );
+        }
+    }
+
+    return count;
+}
+
+static int
+entitytainer__last_set_bit( const unsigned int* bits, int count ) {
+    // Or -1 if there's none.
+    for ( int i_word = ENTITYTAINER_DirtyWords( count ) - 1; i_word >= 0; --i_word ) {
+        if ( bits[i_word] != 0 ) {
+            return i_word * 32 + entitytainer__highest_bit( bits[i_word] );
+        }
+    }
+
+    return -1;
+}
+
+static bool
+entitytainer__has_occupancy( const struct TheEntitytainerConfig* config, int bucket_list_index ) {
+    // The chained bucket list's pages are searched like before.
+    return config->track_occupancy &&
+           !( config->chain_last_bucket_list && bucket_list_index == config->num_bucket_lists - 1 );
+}
+
+static unsigned int*
+entitytainer__occupancy_bits( TheEntitytainer* entitytainer, int bucket_list_index, int bucket_index ) {
+    // NULL when the bucket list doesn't have any.
+    unsigned int* bits = entitytainer->occupancy[bucket_list_index];
+    if ( bits == NULL ) {
+        return NULL;
+    }
+
+    int bucket_size = entitytainer->bucket_lists[bucket_list_index].bucket_size;
+    return bits + bucket_index * ENTITYTAINER_OccupancyWords( bucket_size );
+}
+
+static void
+entitytainer__sync_occupancy( TheEntitytainer* entitytainer, int bucket_list_index, int bucket_index ) {
+    // Rebuilds the bits from the bucket, for when the children have been moved around in bulk.
+    unsigned int* bits = entitytainer__occupancy_bits( entitytainer, bucket_list_index, bucket_index );
+    if ( bits == NULL ) {
+        return;
+    }
+
+    TheEntitytainerBucketList*   bucket_list = entitytainer->bucket_lists + bucket_list_index;
+    const TheEntitytainerEntity* children    = entitytainer__bucket( bucket_list, bucket_index ) + 1;
+    ENTITYTAINER_memset( bits, 0, ENTITYTAINER_OccupancyWords( bucket_list->bucket_size ) * sizeof( unsigned int ) );
+    for ( int i = 0; i < bucket_list->bucket_size - 1; ++i ) {
+        if ( children[i] != ENTITYTAINER_InvalidEntity ) {
+            bits[i >> 5] |= 1u << ( i & 31 );
+        }
+    }
+}
+
+static int
+entitytainer__payload_size( const struct TheEntitytainerConfig* config ) {
+    // All the columns' bytes for one slot
+    int size = 0;
+    for ( int i_column = 0; i_column < config->num_payload_columns; ++i_column ) {
+        size += config->payload_sizes[i_column];
+    }
+
+    return size;
+}
+
+static unsigned char*
+entitytainer__payload( TheEntitytainer* entitytainer, const TheEntitytainerEntity* slot, int column ) {
+    // slot is somewhere in the bucket data, so find its bucket list and then it's the same offset in the column.
+    for ( int i_bl = 0; i_bl < entitytainer->num_bucket_lists; ++i_bl ) {
+        TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + i_bl;
+        int                        offset      = (int)( slot - bucket_list->bucket_data );
+        if ( offset >= 0 && offset < bucket_list->bucket_size * bucket_list->total_buckets ) {
+            return bucket_list->payloads[column] + offset * entitytainer->config.payload_sizes[column];
+        }
+    }
+
+    ENTITYTAINER_assert( false );
+    return NULL;
+}
+
+static void
+entitytainer__move_payloads( TheEntitytainer*             entitytainer,
+                             TheEntitytainerEntity*       slot_dst,
+                             const TheEntitytainerEntity* slot_src,
+                             int                          count ) {
+    // Goes with moving count children from slot_src to slot_dst, they can overlap.
+    if ( count <= 0 || slot_dst == slot_src ) {
+        return;
+    }
+
+    for ( int i_column = 0; i_column < entitytainer->config.num_payload_columns; ++i_column ) {
+        ENTITYTAINER_memmove( entitytainer__payload( entitytainer, slot_dst, i_column ),
+                              entitytainer__payload( entitytainer, slot_src, i_column ),
+                              count * entitytainer->config.payload_sizes[i_column] );
+    }
+}
+
+static void
+entitytainer__clear_payloads( TheEntitytainer* entitytainer, TheEntitytainerEntity* slot, int count ) {
+    // For new children
+    if ( count <= 0 ) {
+        return;
+    }
+
+    for ( int i_column = 0; i_column < entitytainer->config.num_payload_columns; ++i_column ) {
+        ENTITYTAINER_memset( entitytainer__payload( entitytainer, slot, i_column ),
+                             0,
+                             count * entitytainer->config.payload_sizes[i_column] );
+    }
+}
+
+static void
+entitytainer__swap_payloads( TheEntitytainer*       entitytainer,
+                             TheEntitytainerEntity* slot_a,
+                             TheEntitytainerEntity* slot_b,
+                             int                    count ) {
+    for ( int i_column = 0; i_column < entitytainer->config.num_payload_columns; ++i_column ) {
+        unsigned char* payload_a = entitytainer__payload( entitytainer, slot_a, i_column );
+        unsigned char* payload_b = entitytainer__payload( entitytainer, slot_b, i_column );
+        for ( int i = 0; i < count * entitytainer->config.payload_sizes[i_column]; ++i ) {
+            unsigned char temp = payload_a[i];
+            payload_a[i]       = payload_b[i];
+            payload_b[i]       = temp;
+        }
+    }
+}
+
+static void
+entitytainer__span_payloads( TheEntitytainer* entitytainer, TheEntitytainerChildSpan* span ) {
+    for ( int i_column = 0; i_column < entitytainer->config.num_payload_columns; ++i_column ) {
+        span->payloads[i_column] = entitytainer__payload( entitytainer, span->children, i_column );
+    }
+}
+
+static TheEntitytainerEntity*
+entitytainer__child_slot( TheEntitytainer* entitytainer, TheEntitytainerEntity parent, int position ) {
+    // Where parent's child at position is. Marks its bucket or page, since the caller is going to write to it.
+    TheEntitytainerEntry lookup = entitytainer->entry_lookup[entitytainer__index( entitytainer, parent )];
+    ENTITYTAINER_assert( lookup != 0 && position >= 0 );
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        return entitytainer__chain_slot( entitytainer, bucket, position );
+    }
+
+    ENTITYTAINER_assert( position + 1 < bucket_list->bucket_size );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+    return bucket + 1 + position;
+}
+
+static int
+entitytainer__delta_size( const TheEntitytainerDeltaHeader* header, bool hashed_lookup ) {
+    int entry_size = (int)sizeof( int ) + (int)sizeof( TheEntitytainerEntry ) +
+                     (int)sizeof( TheEntitytainerEntity ) * ( header->num_columns + ( hashed_lookup ? 1 : 0 ) );
+    int size = (int)sizeof( TheEntitytainerDeltaHeader ) + header->num_dirty_entries * entry_size;
+    if ( header->order_count > header->order_start ) {
+        size += ( header->order_count - header->order_start ) * (int)sizeof( TheEntitytainerEntity );
+    }
+
+    int payload_size = 0;
+    for ( int i_column = 0; i_column < header->num_payload_columns; ++i_column ) {
+        payload_size += header->payload_sizes[i_column];
+    }
+
+    for ( int i_bl = 0; i_bl < header->num_bucket_lists; ++i_bl ) {
+        int slot_size   = (int)sizeof( TheEntitytainerEntity ) + payload_size;
+        int bucket_size = (int)sizeof( int ) + header->bucket_sizes[i_bl] * slot_size;
+        size += header->num_dirty_buckets[i_bl] * bucket_size;
+    }
+
+    return size;
+}
+
+static void
+entitytainer__defrag_swap( TheEntitytainer* entitytainer,
+                           int              bucket_list_index,
+                           int*             owners,
+                           int              bucket_index,
+                           int              bucket_index_new ) {
+    // Swaps the bucket at bucket_index with whatever's at bucket_index_new, and fixes up the entries and page links
+    // pointing to both of them.
+    TheEntitytainerBucketList* bucket_list = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_size = bucket_list->bucket_size;
+    int                        indices[2]  = { bucket_index_new, bucket_index };
+    int                        old_owners[2];
+    TheEntitytainerEntity*     bucket      = entitytainer__bucket( bucket_list, bucket_index );
+    TheEntitytainerEntity*     bucket_new  = entitytainer__bucket( bucket_list, bucket_index_new );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index );
+    entitytainer__mark_bucket( entitytainer, bucket_list_index, bucket_index_new );
+    for ( int i = 0; i < bucket_size; ++i ) {
+        TheEntitytainerEntity temp = bucket[i];
+        bucket[i]                  = bucket_new[i];
+        bucket_new[i]              = temp;
+    }
+
+    entitytainer__swap_payloads( entitytainer, bucket, bucket_new, bucket_size );
+
+    entitytainer__sync_occupancy( entitytainer, bucket_list_index, bucket_index );
+    entitytainer__sync_occupancy( entitytainer, bucket_list_index, bucket_index_new );
+    old_owners[0]            = owners[bucket_index];
+    old_owners[1]            = owners[bucket_index_new];
+    owners[bucket_index_new] = old_owners[0];
+    owners[bucket_index]     = old_owners[1];
+
+    // Whatever points to them. If that's the other one of the two, it's fixed below instead.
+    for ( int i = 0; i < 2; ++i ) {
+        int owner = old_owners[i];
+        if ( owner >= 0 ) {
+            unsigned int bucket_list_index_shifted = (unsigned int)bucket_list_index << entitytainer->entry_list_shift;
+            entitytainer->entry_lookup[owner]      = (TheEntitytainerEntry)( bucket_list_index_shifted | indices[i] );
+            entitytainer__mark_entry( entitytainer, owner );
+        }
+        else if ( owner <= -3 && -3 - owner != bucket_index && -3 - owner != bucket_index_new ) {
+            TheEntitytainerEntity* link = entitytainer__bucket( bucket_list, -3 - owner ) + bucket_size - 1;
+            *link                       = (TheEntitytainerEntity)( indices[i] + 1 );
+            entitytainer__mark_bucket( entitytainer, bucket_list_index, -3 - owner );
+        }
+    }
+
+    // What they point to
+    if ( !entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        return;
+    }
+
+    for ( int i = 0; i < 2; ++i ) {
+        if ( old_owners[i] == ENTITYTAINER_DefragFree ) {
+            continue;
+        }
+
+        TheEntitytainerEntity* link = entitytainer__bucket( bucket_list, indices[i] ) + bucket_size - 1;
+        if ( *link == 0 ) {
+            continue;
+        }
+
+        int next = *link - 1;
+        if ( next == bucket_index || next == bucket_index_new ) {
+            next  = next == bucket_index ? bucket_index_new : bucket_index;
+            *link = (TheEntitytainerEntity)( next + 1 );
+        }
+
+        owners[next] = -3 - indices[i];
+    }
+}
+
+static void
+entitytainer__fill_span( TheEntitytainer* entitytainer, TheEntitytainerEntry lookup, TheEntitytainerChildSpan* span ) {
+    int                        bucket_list_index = lookup >> entitytainer->entry_list_shift;
+    TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+    int                        bucket_index      = lookup & entitytainer->entry_bucket_mask;
+    TheEntitytainerEntity*     bucket            = entitytainer__bucket( bucket_list, bucket_index );
+    span->children                               = bucket + 1;
+    span->capacity                               = bucket_list->bucket_size - 1;
+    span->num_children_left                      = (int)bucket[0];
+    span->next_page                              = NULL;
+    if ( entitytainer__is_chained( entitytainer, bucket_list_index ) ) {
+        span->capacity  = bucket_list->bucket_size - 2;
+        span->next_page = entitytainer__next_page( entitytainer, bucket, false );
+    }
+
+    span->num_children = span->num_children_left;
+    if ( entitytainer->remove_with_holes || span->num_children > span->capacity ) {
+        span->num_children = span->capacity;
+    }
+
+    span->num_children_left -= span->num_children;
+    entitytainer__span_payloads( entitytainer, span );
+}
+
+static void
+entitytainer__prefetch_entries( TheEntitytainer*             entitytainer,
+                                const TheEntitytainerEntity* parents,
+                                int                          num_parents ) {
+    // Where the lookups are, or where probing starts for hashed lookup.
+    for ( int i = 0; i < num_parents; ++i ) {
+        if ( entitytainer->hashed_lookup ) {
+            ENTITYTAINER_prefetch( entitytainer->entry_keys + entitytainer__hash_slot( entitytainer, parents[i] ) + 1 );
+        }
+        else {
+            ENTITYTAINER_prefetch( entitytainer->entry_lookup + parents[i] );
+        }
+    }
+}
+
+static void
+entitytainer__prefetch_buckets( TheEntitytainer*             entitytainer,
+                                const TheEntitytainerEntity* parents,
+                                int                          num_parents,
+                                TheEntitytainerEntry*        lookups ) {
+    for ( int i = 0; i < num_parents; ++i ) {
+        lookups[i] = entitytainer->entry_lookup[entitytainer__index( entitytainer, parents[i] )];
+        ENTITYTAINER_assert( lookups[i] != 0 );
+        int                        bucket_list_index = lookups[i] >> entitytainer->entry_list_shift;
+        TheEntitytainerBucketList* bucket_list       = entitytainer->bucket_lists + bucket_list_index;
+        int                        bucket_index      = lookups[i] & entitytainer->entry_bucket_mask;
+        ENTITYTAINER_prefetch( entitytainer__bucket( bucket_list, bucket_index ) );
+    }
 }
 
 #endif // ENTITYTAINER_IMPLEMENTATION
@@ -0,0 +1,316 @@
+/*
+the_entitytainer.hpp - C++17 front-end for the_entitytainer.h
+
+    entitytainer::Container<TheEntitytainerEntity, TheEntitytainerEntry, 4, 16, 256>
+
+The bucket sizes are template arguments, so the read path (num_children, children_span) decodes the entry with
+constant shifts and masks, picks the bucket list with an unrolled chain of compares and finds the bucket with a shift
+when the bucket size is a power of two. Everything else goes through the C functions.
+
+It's the same TheEntitytainer in the same memory block, so save blobs load with entitytainer_load and the other way
+around, and the C functions can be used on handle() too. Like the C API, it doesn't own the memory.
+
+The entity and entry types have to be the ones the_entitytainer.h was included with (see ENTITYTAINER_Entity), they're
+template arguments so that a mismatch is a compile error. The fast read path needs direct lookup and flat bucket lists,
+so hashed_lookup and bucket_page_size aren't supported.
+
+Include the_entitytainer.h first, with ENTITYTAINER_IMPLEMENTATION in one source file as usual.
+*/
+
+#ifndef INCLUDE_THE_ENTITYTAINER_HPP
+#define INCLUDE_THE_ENTITYTAINER_HPP
+
+#include "the_entitytainer.h"
+
+#include <array>
+#include <type_traits>
+
+#if defined( __has_include )
+#if __has_include( <span> ) && __cplusplus >= 202002L
+#include <span>
+#endif
+#endif
+
+namespace entitytainer {
+
+#if defined( __cpp_lib_span )
+template <typename T>
+using Span = std::span<T>;
+#else
+// Just enough of std::span for pre C++20 compilers.
+template <typename T>
+class Span {
+  public:
+    constexpr Span() = default;
+    constexpr Span( T* data, size_t size )
+    : m_data( data )
+    , m_size( size ) {}
+
+    constexpr T*     data() const { return m_data; }
+    constexpr size_t size() const { return m_size; }
+    constexpr bool   empty() const { return m_size == 0; }
+    constexpr T*     begin() const { return m_data; }
+    constexpr T*     end() const { return m_data + m_size; }
+    constexpr T&     operator[]( size_t index ) const { return m_data[index]; }
+
+  private:
+    T*     m_data = nullptr;
+    size_t m_size = 0;
+};
+#endif
+
+template <typename EntityT, typename EntryT, int... BucketSizes>
+class Container {
+    static_assert( std::is_same<EntityT, TheEntitytainerEntity>::value,
+                   "EntityT has to be the TheEntitytainerEntity that the_entitytainer.h was included with" );
+    static_assert( std::is_same<EntryT, TheEntitytainerEntry>::value,
+                   "EntryT has to be the TheEntitytainerEntry that the_entitytainer.h was included with" );
+    static_assert( sizeof...( BucketSizes ) >= 1 && sizeof...( BucketSizes ) <= ENTITYTAINER_MAX_BUCKET_LISTS,
+                   "1 to ENTITYTAINER_MAX_BUCKET_LISTS bucket lists" );
+
+  public:
+    static constexpr int                                 num_bucket_lists = (int)sizeof...( BucketSizes );
+    static constexpr std::array<int, sizeof...( BucketSizes )> bucket_sizes     = { { BucketSizes... } };
+
+    // The same as entitytainer__layout works it out.
+    static constexpr int
+    list_bit_count() {
+#ifdef ENTITYTAINER_BucketListBitCount
+        return ENTITYTAINER_BucketListBitCount;
+#else
+        int bits = 1;
+        while ( ( 1 << bits ) < num_bucket_lists ) {
+            ++bits;
+        }
+
+        return bits;
+#endif
+    }
+
+    static constexpr int      entry_list_shift  = (int)sizeof( EntryT ) * 8 - list_bit_count();
+    static constexpr unsigned entry_bucket_mask = ( 1u << entry_list_shift ) - 1;
+
+    // entitytainer_needed_size for a config with just these bucket lists, direct lookup and none of the optional
+    // tracking. Use the config overload for the rest.
+    static constexpr int
+    needed_size( int num_entries, const std::array<int, sizeof...( BucketSizes )>& bucket_list_sizes ) {
+        int size = (int)sizeof( TheEntitytainer );
+        size += num_entries * (int)( sizeof( EntryT ) + sizeof( EntityT ) );
+        size += num_bucket_lists * (int)sizeof( TheEntitytainerBucketList );
+        for ( int i = 0; i < num_bucket_lists; ++i ) {
+            size += bucket_list_sizes[i] * bucket_sizes[i] * (int)sizeof( EntityT );
+        }
+
+        size += ( 3 + num_bucket_lists ) * (int)sizeof( void* ) * 16;
+        return size;
+    }
+
+    static int
+    needed_size( TheEntitytainerConfig config ) {
+        set_bucket_sizes( config );
+        return entitytainer_needed_size( &config );
+    }
+
+    // Fills in the bucket sizes. The rest of options is kept, memory and memory_size are set by create.
+    static TheEntitytainerConfig
+    make_config( int                                                 num_entries,
+                 const std::array<int, sizeof...( BucketSizes )>& bucket_list_sizes,
+                 TheEntitytainerConfig                               options = TheEntitytainerConfig() ) {
+        options.num_entries = num_entries;
+        for ( int i = 0; i < num_bucket_lists; ++i ) {
+            options.bucket_list_sizes[i] = bucket_list_sizes[i];
+        }
+
+        set_bucket_sizes( options );
+        return options;
+    }
+
+    static Container
+    create( TheEntitytainerConfig config, void* memory, int memory_size ) {
+        set_bucket_sizes( config );
+        config.memory      = memory;
+        config.memory_size = memory_size;
+        ENTITYTAINER_assert( !config.hashed_lookup && config.bucket_page_size == 0 );
+        TheEntitytainer* entitytainer = entitytainer_create( &config );
+        ENTITYTAINER_assert( matches( entitytainer ) ); // align_buckets didn't pad the sizes
+        return Container( entitytainer );
+    }
+
+    // Like entitytainer_load. Returns an empty container (see valid) if the blob has other bucket lists.
+    static Container
+    load( unsigned char* buffer, int buffer_size ) {
+        return attach( entitytainer_load( buffer, buffer_size ) );
+    }
+
+    // Wraps an entitytainer that was set up in C, if it matches.
+    static Container
+    attach( TheEntitytainer* entitytainer ) {
+        return Container( matches( entitytainer ) ? entitytainer : nullptr );
+    }
+
+    static bool
+    matches( const TheEntitytainer* entitytainer ) {
+        if ( entitytainer == nullptr || entitytainer->num_bucket_lists != num_bucket_lists ||
+             entitytainer->entry_list_shift != entry_list_shift || entitytainer->hashed_lookup ||
+             entitytainer->config.bucket_page_size != 0 ) {
+            return false;
+        }
+
+        for ( int i = 0; i < num_bucket_lists; ++i ) {
+            if ( entitytainer->bucket_lists[i].bucket_size != bucket_sizes[i] ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Container() = default;
+
+    bool             valid() const { return m_entitytainer != nullptr; }
+    TheEntitytainer* handle() const { return m_entitytainer; }
+
+    int
+    save( unsigned char* buffer, int buffer_size ) const {
+        return entitytainer_save( m_entitytainer, buffer, buffer_size );
+    }
+
+    void clear() { entitytainer_clear( m_entitytainer ); }
+    void add_entity( EntityT entity ) { entitytainer_add_entity( m_entitytainer, entity ); }
+    void remove_entity( EntityT entity ) { entitytainer_remove_entity( m_entitytainer, entity ); }
+    void add_child( EntityT parent, EntityT child ) { entitytainer_add_child( m_entitytainer, parent, child ); }
+    bool is_added( EntityT entity ) const { return entitytainer_is_added( m_entitytainer, entity ); }
+    EntityT get_parent( EntityT child ) const { return m_entitytainer->entry_parent_lookup[child]; }
+
+    void
+    remove_child( EntityT parent, EntityT child ) {
+        if ( m_entitytainer->remove_with_holes ) {
+            entitytainer_remove_child_with_holes( m_entitytainer, parent, child );
+        }
+        else {
+            entitytainer_remove_child_no_holes( m_entitytainer, parent, child );
+        }
+    }
+
+    int
+    num_children( EntityT parent ) const {
+        if ( m_entitytainer->entry_num_children != nullptr ) {
+            return (int)m_entitytainer->entry_num_children[parent];
+        }
+
+        return (int)*bucket( parent, nullptr );
+    }
+
+    // The same as entitytainer_get_children: with holes it includes them, and a chained parent's first page only.
+    Span<const EntityT>
+    children_span( EntityT parent ) const {
+        int            list_index;
+        const EntityT* found    = bucket( parent, &list_index );
+        int            capacity = bucket_sizes[list_index] - 1;
+        if ( list_index == num_bucket_lists - 1 && m_entitytainer->chain_last_bucket_list ) {
+            capacity -= 1;
+        }
+
+        int count = (int)found[0];
+        return Span<const EntityT>( found + 1, (size_t)( count < capacity ? count : capacity ) );
+    }
+
+    // All of a parent's children, without holes and across chained pages, for range-for. Uses
+    // entitytainer_children_iter, so it's slower than children_span.
+    class ChildIterator {
+      public:
+        ChildIterator() = default;
+        ChildIterator( TheEntitytainer* entitytainer, EntityT parent )
+        : m_entitytainer( entitytainer ) {
+            entitytainer_children_iter( m_entitytainer, parent, &m_iter );
+            ++*this;
+        }
+
+        EntityT operator*() const { return m_child; }
+        bool    operator!=( const ChildIterator& other ) const { return m_entitytainer != other.m_entitytainer; }
+
+        ChildIterator&
+        operator++() {
+            if ( !entitytainer_children_next( m_entitytainer, &m_iter, &m_child, nullptr ) ) {
+                m_entitytainer = nullptr;
+            }
+
+            return *this;
+        }
+
+      private:
+        TheEntitytainer*         m_entitytainer = nullptr;
+        TheEntitytainerChildIter m_iter         = {};
+        EntityT                  m_child        = ENTITYTAINER_InvalidEntity;
+    };
+
+    struct ChildRange {
+        TheEntitytainer* entitytainer;
+        EntityT          parent;
+        ChildIterator    begin() const { return ChildIterator( entitytainer, parent ); }
+        ChildIterator    end() const { return ChildIterator(); }
+    };
+
+    ChildRange children( EntityT parent ) const { return ChildRange{ m_entitytainer, parent }; }
+
+  private:
+    explicit Container( TheEntitytainer* entitytainer )
+    : m_entitytainer( entitytainer ) {}
+
+    static void
+    set_bucket_sizes( TheEntitytainerConfig& config ) {
+        config.num_bucket_lists = num_bucket_lists;
+        for ( int i = 0; i < num_bucket_lists; ++i ) {
+            config.bucket_sizes[i] = bucket_sizes[i];
+        }
+    }
+
+    static constexpr int
+    shift_of( int size ) {
+        // -1 if it isn't a power of two
+        int shift = 0;
+        while ( ( 1 << shift ) < size ) {
+            ++shift;
+        }
+
+        return ( 1 << shift ) == size ? shift : -1;
+    }
+
+    template <int List>
+    static const EntityT*
+    bucket_in_list( const TheEntitytainerBucketList* lists, int list_index, int bucket_index, int* found_list ) {
+        constexpr int size  = bucket_sizes[List];
+        constexpr int shift = shift_of( size );
+        if constexpr ( List + 1 < num_bucket_lists ) {
+            if ( list_index != List ) {
+                return bucket_in_list<List + 1>( lists, list_index, bucket_index, found_list );
+            }
+        }
+
+        if ( found_list != nullptr ) {
+            *found_list = List;
+        }
+
+        if constexpr ( shift >= 0 ) {
+            return lists[List].bucket_data + ( bucket_index << shift );
+        }
+        else {
+            return lists[List].bucket_data + bucket_index * size;
+        }
+    }
+
+    const EntityT*
+    bucket( EntityT parent, int* found_list ) const {
+        EntryT lookup = m_entitytainer->entry_lookup[parent];
+        ENTITYTAINER_assert( lookup != 0 );
+        int list_index   = (int)( lookup >> entry_list_shift );
+        int bucket_index = (int)( lookup & entry_bucket_mask );
+        return bucket_in_list<0>( m_entitytainer->bucket_lists, list_index, bucket_index, found_list );
+    }
+
+    TheEntitytainer* m_entitytainer = nullptr;
+};
+
+} // namespace entitytainer
+
+#endif // INCLUDE_THE_ENTITYTAINER_HPP